@@ -38,12 +38,18 @@ int main(int argc,char*argv[])
   TRY(qbox=make_qbox(tb,&opts.x,&opts.lx));
 
   { tile_t *ts=0;
-    int i;  
+    unsigned char *hits=0;
+    aabb3_t q;
+    size_t i,n=TileBaseCount(tb);
     TRY(ts=TileBaseArray(tb));
-    for(i=0;i<TileBaseCount(tb);++i)
-    { if(AABBHit(qbox,TileAABB(ts[i])))
+    TRY(AABB3FromAABB(&q,qbox));
+    TRY(hits=(unsigned char*)malloc(n+1));
+    TileBaseHitMany(tb,hits,&q);
+    for(i=0;i<n;++i)
+    { if(hits[i])
         printf("%s\n",TilePath(ts[i]));
     }
+    free(hits);
   }
 
 Finalize:
@@ -46,14 +46,25 @@ int pop()   { return (stack.n>0)?(stack.data[--stack.n]):(-1); }
 int count() { return stack.n; }
 
 
+/** The tile whose neighbors are wanted. */
+struct query_t
+{ tile_t tile;
+  aabb_t box;
+};
+
+/** Tests the footprints of the two tiles after a bounding box prefilter. */
 unsigned hit(tile_t *a, void *ctx)
-{ aabb_t box=(aabb_t)ctx;
-  return AABBHit(TileAABB(*a),box);
+{ struct query_t *q=(struct query_t*)ctx;
+  const footprint_t *fa,*fb;
+  if(!AABBHit(TileAABB(*a),q->box)) return 0;
+  if((fa=TileFootprint(*a)) && (fb=TileFootprint(q->tile)))
+    return FootprintsHit(fa,fb);
+  return 1;
 }
 
 unsigned hit_nocorners(tile_t *a, void *ctx)
 { if(hit(a,ctx))
-  { aabb_t ref=(aabb_t)ctx,
+  { aabb_t ref=((struct query_t*)ctx)->box,
          other=TileAABB(*a);
     size_t i,n,c=0;
     int64_t *a,*b;
@@ -87,6 +98,7 @@ int main(int argc,char*argv[])
   tiles_t tb=0;
   regex_t reg={0};
   aabb_t qbox=0;
+  struct query_t query={0};
   unsigned (*predicate)(tile_t *a,void *ctx)=hit;
   regaparams_t params={0};
   regamatch_t  match={0};
@@ -131,6 +143,8 @@ int main(int argc,char*argv[])
     }
     if((i=pop())>=0)
     { TRY(qbox=TileAABB(ts[i]));
+      query.tile=ts[i];
+      query.box=qbox;
       fprintf(stderr,"Looking for neighbors of:\n\t%s\n",TilePath(ts[i]));
     } else
     { fprintf(stderr,"No matching tiles found.\n");
@@ -143,7 +157,7 @@ int main(int argc,char*argv[])
     char *root=0;
     tilebase_cache_t out=0;
     size_t nout=0;
-    TRY(ts=TilesFilter(TileBaseArray(tb),TileBaseCount(tb),&nout,predicate,qbox));
+    TRY(ts=TilesFilter(TileBaseArray(tb),TileBaseCount(tb),&nout,predicate,&query));
     TileBaseCacheClose(
       TileBaseCacheWriteMany(
         out=TileBaseCacheOpenWithRoot(opts.output,"w",root=TilesCommonRoot(ts,nout)),
@@ -158,7 +172,7 @@ int main(int argc,char*argv[])
   } else
   { tile_t *ts=0;
     size_t i,n=0;  
-    TRY(ts=TilesFilter(TileBaseArray(tb),TileBaseCount(tb),&n,predicate,qbox));
+    TRY(ts=TilesFilter(TileBaseArray(tb),TileBaseCount(tb),&n,predicate,&query));
     for(i=0;i<n;++i)
       printf("%s %s\n",signstr(qbox,TileAABB(ts[i])),TilePath(ts[i]));
     if(ts) free(ts);
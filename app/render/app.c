@@ -4,12 +4,19 @@
  */
 #include <stdio.h>
 #include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
 #include "tilebase.h"
+#include "src/util/dirlist.h"
 #include "src/opts.h"
 #include "src/address.h"
 #include "src/render.h"
 #include "src/mkpath.h"
 #include "src/fixup.h"
+#include "src/manifest.h"
+#include "src/changes.h"
+#include "src/chunked.h"
+#include "src/shards.h"
 #include <app/render/config.h>
 
 #ifdef _MSC_VER
@@ -25,8 +32,13 @@
 
 #ifdef _MSC_VER
 #pragma warning (disable:4996) // deprecation warning for sprintf
+#include <direct.h>
+#define rmdir      _rmdir
+#define stat       _stat
+#define S_ISREG(e) (((e)&_S_IFREG)!=0)
 #define PATHSEP  '\\'
 #else
+#include <unistd.h>
 #define PATHSEP  '/'
 #endif
 #define ENDL     "\n"
@@ -45,6 +57,8 @@
 
 int g_flag_loaded_from_tree=0;
 opts_t OPTS={0};
+manifest_t g_manifest=0; // nodes finished so far.  See --resume.
+shards_t   g_shards=0;   // if not NULL, nodes are stored here instead of in directories.  See --shards.
 
 /** Adjusts OPTS so the bounding box matches the address.
  *
@@ -85,6 +99,65 @@ static unsigned print_addr(nd_t v, address_t address, aabb_t bbox, void* args)
   return 0;
 }
 
+/// Manifest keys name the node's directory relative to OPTS.dst.
+static const char* manifest_key(const char *path)
+{ return *path?path:".";
+}
+
+/// The origin and voxel size (nm) of the node \a vol that fills \a bbox.  Same as in transform.txt.
+static unsigned placement(nd_t vol, aabb_t bbox, int64_t origin[3], double scale[3])
+{ int64_t *o,*s;
+  int i;
+  for(i=0;i<3;++i)
+  { origin[i]=0;
+    scale[i]=1.0;
+  }
+  if(bbox)
+  { TRY(AABBGet(bbox,0,&o,&s));
+    for(i=0;i<3;++i)
+    { origin[i]=o[i];
+      scale[i]=(double)s[i]/(double)ndshape(vol)[i];
+    }
+  }
+  return 1;
+Error:
+  return 0;
+}
+
+/**
+ * Saves \a vol to the node directory in \a full as a compressed volume (see --chunked).
+ * \param[in] n  Length of the node directory path in \a full.
+ */
+static unsigned save_chunked(char *full, size_t n, size_t cap, nd_t vol, aabb_t bbox)
+{ int64_t origin[3];
+  double scale[3];
+  TRY(placement(vol,bbox,origin,scale));
+  TRY((snprintf(full+n,cap-n,"%c%s",PATHSEP,CHUNKED_NAME))>0);
+  TRY(chunked_write(full,vol,origin,scale,0));
+  return 1;
+Error:
+  return 0;
+}
+
+/// Stores \a vol in its shard under \a key (see --shards).
+static unsigned save_shard(const char *key, nd_t vol, aabb_t bbox)
+{ int64_t origin[3];
+  double scale[3];
+  void *buf=0;
+  size_t nbytes;
+  printf("SAVING %s"ENDL,key);
+  TRY(placement(vol,bbox,origin,scale));
+  TRY(buf=chunked_encode(vol,origin,scale,0,&nbytes));
+  TRY(shards_put(g_shards,key,buf,nbytes));
+  if(g_manifest)
+    TRY(manifest_add(g_manifest,key,nbytes,manifest_checksum(buf,nbytes)));
+  free(buf);
+  return 1;
+Error:
+  free(buf);
+  return 0;
+}
+
 static unsigned save(nd_t vol, address_t address, aabb_t bbox, void* args)
 { char full[1024]={0},
        path[1024]={0};
@@ -96,14 +169,22 @@ static unsigned save(nd_t vol, address_t address, aabb_t bbox, void* args)
   //TRY(ndconvert_ip(tmp,nd_u16));
 
   TRY(address_to_path(path,countof(path),address));
+  if(g_shards) // no directories; the node goes in a container
+  { TRY(save_shard(manifest_key(path),vol,bbox));
+    goto Finalize;
+  }
   TRY((n=snprintf(full,countof(full),"%s%c%s",OPTS.dst,PATHSEP,path))>0);
   printf("SAVING %s"ENDL,full);
   TRY(mkpath(full));
-  TRY((snprintf(full+n,countof(full)-n,"%c%s",PATHSEP,OPTS.dst_pattern))>0);
-  ndioClose(ndioWrite(ndioOpen(full,ndioFormat("series"),"w"),vol));
+  if(OPTS.flag_chunked) // the origin and scale are saved with the volume
+    TRY(save_chunked(full,n,countof(full),vol,bbox));
+  else
+  { TRY((snprintf(full+n,countof(full)-n,"%c%s",PATHSEP,OPTS.dst_pattern))>0);
+    ndioClose(ndioWrite(ndioOpen(full,ndioFormat("series"),"w"),vol));
+  }
 
   // output text document with origin and scale
-  if(bbox)
+  if(bbox && !OPTS.flag_chunked)
   { int64_t *o,*s;
     int i;
     char *lbls[] = {"ox","oy","oz","sx","sy","sz"};
@@ -153,6 +234,14 @@ static unsigned save(nd_t vol, address_t address, aabb_t bbox, void* args)
     ndioClose(ndioWrite(ndioOpen(full,ndioFormat("series"),"w"),zx));
     ndfree(zx);
   }
+
+  // record the finished node, after everything for it has been written
+  if(g_manifest)
+  { uint64_t nbytes,checksum;
+    full[n]='\0';
+    TRY(manifest_digest(full,&nbytes,&checksum));
+    TRY(manifest_add(g_manifest,manifest_key(path),nbytes,checksum));
+  }
 Finalize:
   //ndfree(tmp);
   if(fp) fclose(fp);
@@ -203,7 +292,24 @@ static nd_t load(address_t address)
   ndio_t f=0;
   g_flag_loaded_from_tree=1;
   TRY(address_to_path(path,countof(path),address));
+  if(g_shards)
+  { void *buf;
+    size_t nbytes;
+    printf("LOADING %s"ENDL,manifest_key(path));
+    if(!(buf=shards_get(g_shards,manifest_key(path),&nbytes)))
+    { LOG("Node %s is not in %s"ENDL,manifest_key(path),OPTS.dst);
+      return 0;
+    }
+    out=chunked_decode(buf,nbytes,0,0);
+    free(buf);
+    return out;
+  }
   TRY((n=snprintf(full,countof(full),"%s%c%s",OPTS.dst,PATHSEP,path))>0);
+  if(OPTS.flag_chunked)
+  { TRY((snprintf(full+n,countof(full)-n,"%c%s",PATHSEP,CHUNKED_NAME))>0);
+    printf("LOADING %s"ENDL,full);
+    return chunked_read(full,0,0);
+  }
   TRY((snprintf(full+n,countof(full)-n,"%c%s",PATHSEP,OPTS.dst_pattern))>0);
   printf("LOADING %s"ENDL,full);
 #if 1
@@ -220,6 +326,107 @@ Error:
   goto Finalize;
 }
 
+/**
+ * \returns 1 if the node at \a address is in the manifest and its files
+ *          haven't changed since they were recorded, otherwise 0.
+ */
+static unsigned done(address_t address)
+{ char full[1024]={0},
+       path[1024]={0};
+  uint64_t nbytes,checksum,n,c;
+  TRY(address_to_path(path,countof(path),address));
+  if(!manifest_find(g_manifest,manifest_key(path),&nbytes,&checksum))
+    return 0;
+  if(g_shards)
+  { void *buf;
+    unsigned ok;
+    if(!(buf=shards_get(g_shards,manifest_key(path),&n)))
+      return 0;
+    ok=(n==nbytes && manifest_checksum(buf,(size_t)n)==checksum);
+    free(buf);
+    if(!ok)
+      LOG("%s changed since it was rendered.  Rendering it again."ENDL,manifest_key(path));
+    return ok;
+  }
+  TRY(snprintf(full,countof(full),"%s%c%s",OPTS.dst,PATHSEP,path)>0);
+  if(!manifest_digest(full,&n,&c) || n!=nbytes || c!=checksum)
+  { LOG("%s changed since it was rendered.  Rendering it again."ENDL,full);
+    return 0;
+  }
+  return 1;
+Error:
+  return 0;
+}
+
+/**
+ * Removes what an earlier render saved for the node at \a address, which no
+ * longer holds any tile (see struct render).  Its children were removed
+ * first, so the node's directory is removed too unless it's the output root.
+ * The node is also dropped from the manifest, so a later --resume doesn't
+ * count it as finished.
+ */
+static unsigned discard(address_t address)
+{ char full[1024]={0},
+       path[1024]={0};
+  dirlist_t list=0;
+  size_t i,n;
+  TRY(address_to_path(path,countof(path),address));
+  printf("REMOVING %s"ENDL,manifest_key(path));
+  if(g_manifest)
+    TRY(manifest_remove(g_manifest,manifest_key(path)));
+  if(g_shards)
+    return shards_remove(g_shards,manifest_key(path));
+  TRY((n=snprintf(full,countof(full),"%s%c%s",OPTS.dst,PATHSEP,path))>0);
+  if(!(list=DirListRead(full))) // nothing was saved for it
+    return 1;
+  for(i=0;i<DirListCount(list);++i)
+  { const char *name=DirListName(list,i);
+    struct stat s;
+    if(0==strcmp(name,MANIFEST_NAME))
+      continue;
+    TRY(snprintf(full+n,countof(full)-n,"%c%s",PATHSEP,name)>0);
+    if(0==stat(full,&s) && S_ISREG(s.st_mode))
+      TRY(0==remove(full));
+  }
+  full[n]='\0';
+  if(address_length(address))
+    rmdir(full); // leaves it alone if something else was put there
+  DirListFree(list);
+  return 1;
+Error:
+  DirListFree(list);
+  return 0;
+}
+
+/**
+ * Collects the footprints of the tiles that changed since the last render
+ * (see --changed and --previous).
+ * \returns 0 on failure, otherwise an array the caller must free().
+ */
+static aabb3_t* find_changes(tiles_t tiles, size_t *n)
+{ aabb3_t *a=0,*b=0,*out=0;
+  size_t na=0,nb=0;
+  tiles_t previous=0;
+  if(OPTS.changed)
+    TRY(a=changes_from_list(tiles,OPTS.changed,&na));
+  if(OPTS.previous)
+  { TRY(previous=TileBaseOpen(OPTS.previous,OPTS.src_format));
+    TRY(fix_fov(previous,OPTS.fov_x_um*1000.0,OPTS.fov_y_um*1000.0));
+    TRY(b=changes_from_diff(previous,tiles,&nb));
+  }
+  TRY(out=(aabb3_t*)malloc(sizeof(*out)*(na+nb+1)));
+  if(na) memcpy(out,a,sizeof(*a)*na);
+  if(nb) memcpy(out+na,b,sizeof(*b)*nb);
+  *n=na+nb;
+Finalize:
+  free(a);
+  free(b);
+  TileBaseClose(previous);
+  return out;
+Error:
+  *n=0;
+  goto Finalize;
+}
 
 static uint64_t nextpow2(uint64_t v)
 { v--;
@@ -251,12 +458,19 @@ static void set_render_opts(struct render* opts)
   opts->output_filter_size_nm[1]=OPTS.output_filter_size_nm[1];
   opts->output_filter_size_nm[2]=OPTS.output_filter_size_nm[2];
 
+  opts->backend=OPTS.backend;
+  opts->nthreads=OPTS.nthreads;
+  opts->nwriters=OPTS.nwriters;
+  opts->memory_budget=OPTS.memory_budget;
+  opts->tile_major=OPTS.flag_tile_major;
+
 }
 
 
 int main(int argc, char* argv[])
 { unsigned ecode=0;
   tiles_t tiles=0;
+  aabb3_t *changed=0;
   handler_t on_ready=save;
   struct render render_opts={0};
   ndioAddPluginPath("plugins");             // search this path for plugins (relative to executable)
@@ -265,8 +479,12 @@ int main(int argc, char* argv[])
     OPTS=parseargs(&argc,&argv,&isok);
     TRY(isok);
   }
-  fprintf(stderr,"GPU: %d\n",(int)(OPTS.gpu_id));
-  cudaSetDevice(OPTS.gpu_id);
+  OPTS.backend=backend_resolve(OPTS.backend);
+  fprintf(stderr,"Backend: %s\n",backend_name(OPTS.backend));
+  if(OPTS.backend==RENDER_BACKEND_GPU)
+  { fprintf(stderr,"GPU: %d\n",(int)(OPTS.gpu_id));
+    cudaSetDevice(OPTS.gpu_id);
+  }
   //printf("OPTS: %s %s\n",OPTS.src,OPTS.dst);
   TRY(tiles=TileBaseOpen(OPTS.src,OPTS.src_format));
   TRY(fix_fov(tiles,OPTS.fov_x_um*1000.0,OPTS.fov_y_um*1000.0));
@@ -312,6 +530,15 @@ int main(int argc, char* argv[])
     goto Finalize;
   }
 
+  if(OPTS.flag_sharded)
+  { // a fresh render starts the shards over.  Otherwise the nodes already in them are needed.
+    const int fresh=!(OPTS.target || OPTS.flag_resume || OPTS.changed || OPTS.previous);
+    char full[1024]={0};
+    TRY(snprintf(full,countof(full),"%s",OPTS.dst)>0);
+    TRY(mkpath(full));
+    TRY(g_shards=shards_open(OPTS.dst,OPTS.shard_depth,fresh));
+  }
+
   if(OPTS.target)
   { printf("RENDERING TARGET: ");
     print_addr(0,OPTS.target,0,stdout);
@@ -321,9 +548,34 @@ int main(int argc, char* argv[])
   }
 
   set_render_opts(&render_opts);
+  if(OPTS.changed || OPTS.previous)
+  { TRY(changed=find_changes(tiles,&render_opts.nchanged));
+    if(!render_opts.nchanged)
+    { LOG("No tiles changed.  Nothing to render."ENDL);
+      goto Finalize;
+    }
+    LOG("Rendering the nodes that overlap %llu changed tile footprints."ENDL,(unsigned long long)render_opts.nchanged);
+    render_opts.changed=changed;
+    render_opts.loader=load;
+    render_opts.discard=discard; // nodes that lost all their tiles
+  }
+  { char full[1024]={0};
+    TRY(snprintf(full,countof(full),"%s",OPTS.dst)>0);
+    TRY(mkpath(full));
+    TRY(snprintf(full,countof(full),"%s%c%s",OPTS.dst,PATHSEP,MANIFEST_NAME)>0);
+    // an incremental render only redoes some nodes, so the entries for the others are kept
+    TRY(g_manifest=manifest_open(full,OPTS.flag_resume || OPTS.changed || OPTS.previous));
+  }
+  if(OPTS.flag_resume)
+  { render_opts.done=done;
+    render_opts.loader=load;
+  }
   TRY(render(&render_opts,tiles,on_ready,NULL));
 
 Finalize:
+  manifest_close(g_manifest);
+  shards_close(g_shards);
+  free(changed);
   TileBaseClose(tiles);
 #ifdef _MSC_VER //helps with msvc debugging
   LOG("Press <ENTER>"ENDL); getchar();
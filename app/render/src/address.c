@@ -48,6 +48,11 @@ unsigned  address_eq(address_t a, address_t b)
   return 1;
 }
 
+/** \returns the number of nodes on the path (not counting the root). */
+unsigned address_length(address_t self)
+{ return self?self->sz:0;
+}
+
 /** Move the iterator down the tree one step. */
 address_t address_next(address_t self)
 { if(!self) return 0;
@@ -18,6 +18,7 @@ address_t copy_address(address_t self); // returns a newly constructed address
 
 // query
 unsigned  address_eq(address_t a, address_t b);
+unsigned  address_length(address_t self);
 
 // iteratable
 unsigned  address_id(address_t self);
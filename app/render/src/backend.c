@@ -0,0 +1,328 @@
+/**
+ * \file
+ * Where the render pipeline runs: on a CUDA device or on the host.
+ *
+ * The CPU backend keeps every buffer in host memory.  The separable
+ * convolutions used by the antialiasing filters and the affine resampling
+ * call the same nd kernels as the GPU backend, but on host arrays, and split
+ * the volume into slabs that are processed on separate threads.
+ *
+ * Tolerance: both backends work in single precision with the same filters
+ * and transforms, but the order of floating point operations differs.  Output
+ * voxels are expected to agree with the GPU backend to within one count for
+ * integer types, and to within a relative error of 1e-5 for floating point
+ * types.
+ */
+#include <app/render/config.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "nd.h"
+#include "src/util/thread.h"
+#include "backend.h"
+#if HAVE_CUDA
+#include "cuda_runtime.h" // for cudaMemGetInfo
+#endif
+#ifdef _MSC_VER
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+#define ENDL          "\n"
+#define LOG(...)      fprintf(stderr,__VA_ARGS__)
+#define TRY(e)        do{if(!(e)) { LOG("%s(%d): %s()"ENDL "\tExpression evaluated as false."ENDL "\t%s"ENDL,__FILE__,__LINE__,__FUNCTION__,#e); goto Error;}} while(0)
+#define NEW(T,e,N)    TRY((e)=(T*)malloc(sizeof(T)*(N)))
+
+#define SLABS_PER_THREAD 4 ///< Number of slabs per thread.  More than one evens out the load.
+
+static TB_THREAD_LOCAL unsigned g_threads=0; ///< threads a kernel called from this thread may use.  0 means ThreadCount().
+
+//
+// === SELECTION ===
+//
+
+static const char *g_names[]={"auto","gpu","cpu"};
+
+/** \returns 1 if \a backend can be used in this build, otherwise 0. */
+unsigned backend_available(render_backend_t backend)
+{ switch(backend)
+  { case RENDER_BACKEND_AUTO:
+    case RENDER_BACKEND_CPU: return 1;
+    case RENDER_BACKEND_GPU: return HAVE_CUDA;
+    default: return 0;
+  }
+}
+
+/** \returns the backend to use for \a requested.  Resolves RENDER_BACKEND_AUTO. */
+render_backend_t backend_resolve(render_backend_t requested)
+{ if(requested!=RENDER_BACKEND_AUTO)
+    return requested;
+#if HAVE_CUDA
+  { int n=0;
+    if(cudaSuccess==cudaGetDeviceCount(&n) && n>0)
+      return RENDER_BACKEND_GPU;
+  }
+#endif
+  return RENDER_BACKEND_CPU;
+}
+
+const char* backend_name(render_backend_t backend)
+{ return ((unsigned)backend<sizeof(g_names)/sizeof(*g_names))?g_names[backend]:"unknown";
+}
+
+/** \returns 1 and sets \a *backend if \a name is a backend's name, otherwise 0. */
+int backend_from_name(const char *name, render_backend_t *backend)
+{ unsigned i;
+  for(i=0;i<sizeof(g_names)/sizeof(*g_names);++i)
+    if(0==strcmp(name,g_names[i]))
+    { if(backend) *backend=(render_backend_t)i;
+      return 1;
+    }
+  return 0;
+}
+
+#ifdef __linux
+/** \returns the kernel's estimate of memory available without swapping, or 0. */
+static size_t mem_available(void)
+{ FILE *fp;
+  char line[256];
+  unsigned long long kb=0;
+  if(!(fp=fopen("/proc/meminfo","r")))
+    return 0;
+  while(fgets(line,sizeof(line),fp))
+    if(1==sscanf(line,"MemAvailable: %llu kB",&kb))
+      break;
+  fclose(fp);
+  return (size_t)kb*1024;
+}
+#endif
+
+/**
+ * Queries the memory available to buffers of \a backend.
+ * For the CPU backend this is host RAM.
+ * \returns 1 on success, otherwise 0.
+ */
+unsigned backend_mem_info(render_backend_t backend, size_t *free, size_t *total)
+{ *free=*total=0;
+  if(backend==RENDER_BACKEND_GPU)
+  {
+#if HAVE_CUDA
+    return cudaSuccess==cudaMemGetInfo(free,total);
+#else
+    return 0;
+#endif
+  }
+#ifdef _MSC_VER
+  { MEMORYSTATUSEX s;
+    s.dwLength=sizeof(s);
+    TRY(GlobalMemoryStatusEx(&s));
+    *free =(size_t)s.ullAvailPhys;
+    *total=(size_t)s.ullTotalPhys;
+  }
+#else
+  { long page=sysconf(_SC_PAGESIZE),
+         pages=sysconf(_SC_PHYS_PAGES);
+    TRY(page>0 && pages>0);
+    *total=(size_t)page*(size_t)pages;
+#ifdef __linux
+    *free=mem_available();
+#endif
+#ifdef _SC_AVPHYS_PAGES
+    if(!*free)
+      *free=(size_t)page*(size_t)sysconf(_SC_AVPHYS_PAGES);
+#endif
+    if(!*free)
+      *free=*total/2; // no estimate, assume half
+  }
+#endif
+  return 1;
+Error:
+  return 0;
+}
+
+//
+// === HOST KERNELS ===
+//
+
+/// @cond PRIVATE
+typedef enum _slab_op_t {SLAB_CONV,SLAB_AFFINE} slab_op_t;
+
+/** Shared by the threads working on the slabs of one call. */
+typedef struct _slab_work_t
+{ slab_op_t  op;
+  nd_t       dst,src;
+  unsigned   axis;     ///< slabs are taken along this axis
+  size_t     step,     ///< planes per slab
+             nslabs,
+             next;     ///< next slab to process
+  unsigned   ok;
+  tbmutex_t  lock;
+  // SLAB_CONV
+  nd_t                      filter;
+  unsigned                  idim;
+  const nd_conv_params_t   *conv;
+  // SLAB_AFFINE
+  const float              *transform;
+  const nd_affine_params_t *affine;
+} slab_work_t;
+/// @endcond
+
+/**
+ * Makes \a view refer to \a count planes of \a a along \a axis starting at
+ * plane \a offset.  Strides are kept, so the view addresses \a a's data in
+ * place (see make_subdiv()).
+ */
+static nd_t slab(nd_t view, nd_t a, unsigned axis, size_t offset, size_t count)
+{ const unsigned n=ndndim(a);
+  TRY(ndreshape(ndcast(ndref(view,nddata(a),ndkind(a)),ndtype(a)),n,ndshape(a)));
+  memcpy(ndstrides(view),ndstrides(a),(n+1)*sizeof(size_t));
+  ndshape(view)[axis]=count;
+  ndstrides(view)[n]=ndstrides(a)[n]/ndshape(a)[axis]*count;
+  TRY(ndoffset(view,axis,(int64_t)offset));
+  return view;
+Error:
+  return 0;
+}
+
+/** Processes slab \a i of \a w.  \a d, \a s and \a t are the calling thread's workspace. */
+static unsigned do_slab(slab_work_t *w, size_t i, nd_t d, nd_t s, float *t)
+{ const size_t offset=i*w->step,
+               extent=ndshape(w->dst)[w->axis],
+               count =(offset+w->step<extent)?w->step:(extent-offset);
+  TRY(slab(d,w->dst,w->axis,offset,count));
+  switch(w->op)
+  { case SLAB_CONV:
+      TRY(slab(s,w->src,w->axis,offset,count));
+      TRY(ndconv1(d,s,w->filter,w->idim,w->conv));
+      break;
+    case SLAB_AFFINE:
+    { // dst plane z samples the source at transform*(x,y,z+offset)
+      const size_t n=ndndim(w->dst)+1;
+      size_t r;
+      memcpy(t,w->transform,n*n*sizeof(float));
+      for(r=0;r<n;++r)
+        t[r*n+n-1]+=(float)offset*w->transform[r*n+w->axis];
+      TRY(ndaffine(d,w->src,t,w->affine));
+      break;
+    }
+  }
+  return 1;
+Error:
+  if(nderror(d)) LOG("\t[nd Error]:"ENDL "\t%s"ENDL,nderror(d));
+  return 0;
+}
+
+static void* slab_worker(void *arg)
+{ slab_work_t *w=(slab_work_t*)arg;
+  nd_t d=ndinit(),s=ndinit();
+  float *t=0;
+  unsigned ok=(d && s);
+  size_t i,n=ndndim(w->dst)+1;
+  if(ok && w->op==SLAB_AFFINE)
+    ok=(NULL!=(t=(float*)malloc(n*n*sizeof(float))));
+  while(ok)
+  { MutexLock(&w->lock);
+    i=w->next++;
+    MutexUnlock(&w->lock);
+    if(i>=w->nslabs) break;
+    ok=do_slab(w,i,d,s,t);
+  }
+  if(!ok)
+  { MutexLock(&w->lock);
+    w->ok=0;
+    w->next=w->nslabs; // stop the others early
+    MutexUnlock(&w->lock);
+  }
+  if(d) ndfree(ndref(d,0,nd_unknown_kind)); // views don't own their data
+  if(s) ndfree(ndref(s,0,nd_unknown_kind));
+  free(t);
+  return 0;
+}
+
+/**
+ * Limits the number of threads used by host kernels called from the calling
+ * thread.  Used when several threads run kernels at once.
+ * \param[in] n  Thread count.  0 restores the default, ThreadCount().
+ */
+void cpu_set_threads(unsigned n)
+{ g_threads=n;
+}
+
+/** \returns the number of threads host kernels called from the calling thread may use.  See cpu_set_threads(). */
+unsigned cpu_threads(void)
+{ return g_threads?g_threads:ThreadCount();
+}
+
+/** Runs \a w on up to cpu_threads() threads.  The caller works too if no thread starts. */
+static unsigned run(slab_work_t *w)
+{ tbthread_t *threads=0;
+  unsigned i,nthreads=cpu_threads(),nstarted=0;
+  const size_t extent=ndshape(w->dst)[w->axis];
+  size_t nslabs=(size_t)nthreads*SLABS_PER_THREAD;
+  if(nslabs>extent) nslabs=extent;
+  if(!nslabs) nslabs=1;
+  w->step=(extent+nslabs-1)/nslabs;
+  w->nslabs=(extent+w->step-1)/w->step;
+  w->next=0;
+  w->ok=1;
+  MutexInit(&w->lock);
+  if(w->nslabs>1 && nthreads>1 && (threads=(tbthread_t*)malloc(sizeof(*threads)*nthreads)))
+    for(i=0;i<nthreads;++i)
+      nstarted+=ThreadCreate(threads+nstarted,slab_worker,w);
+  if(!nstarted)
+    slab_worker(w);
+  for(i=0;i<nstarted;++i)
+    ThreadJoin(threads+i);
+  free(threads);
+  MutexFree(&w->lock);
+  return w->ok;
+}
+
+/**
+ * Separable convolution of host arrays along dimension \a idim.
+ * Like ndconv1(), but slabs of the volume are filtered in parallel.  Slabs
+ * are taken along the outermost spatial dimension other than \a idim.
+ * \returns \a dst on success, otherwise 0.
+ */
+nd_t cpu_conv1(nd_t dst, nd_t src, nd_t filter, unsigned idim, const nd_conv_params_t *params)
+{ slab_work_t w;
+  memset(&w,0,sizeof(w));
+  TRY(ndkind(dst)!=nd_gpu_cuda && ndkind(src)!=nd_gpu_cuda);
+  TRY(ndndim(dst)>=3);
+  w.op=SLAB_CONV;
+  w.dst=dst;
+  w.src=src;
+  w.axis=(idim==2)?1:2;
+  w.filter=filter;
+  w.idim=idim;
+  w.conv=params;
+  TRY(run(&w));
+  return dst;
+Error:
+  return 0;
+}
+
+/**
+ * Resamples the host array \a src into \a dst.
+ * Like ndaffine(), but z-slabs of \a dst are resampled in parallel.
+ * \param[in] transform  Row-major <tt>(ndim+1)x(ndim+1)</tt> matrix mapping
+ *                       \a dst voxels to \a src voxels.  Host memory.
+ * \returns \a dst on success, otherwise 0.
+ */
+nd_t cpu_affine(nd_t dst, nd_t src, const float *transform, const nd_affine_params_t *params)
+{ slab_work_t w;
+  memset(&w,0,sizeof(w));
+  TRY(ndkind(dst)!=nd_gpu_cuda && ndkind(src)!=nd_gpu_cuda);
+  TRY(ndndim(dst)>=3);
+  w.op=SLAB_AFFINE;
+  w.dst=dst;
+  w.src=src;
+  w.axis=2;
+  w.transform=transform;
+  w.affine=params;
+  TRY(run(&w));
+  return dst;
+Error:
+  return 0;
+}
@@ -0,0 +1,32 @@
+/**
+ * \file
+ * Where the render pipeline runs.
+ */
+#pragma once
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include "nd.h"
+
+typedef enum _render_backend_t
+{ RENDER_BACKEND_AUTO=0, ///< Use the GPU if there is one, otherwise the CPU.
+  RENDER_BACKEND_GPU,    ///< Buffers live on a CUDA device.  Requires HAVE_CUDA.
+  RENDER_BACKEND_CPU     ///< Buffers live in host memory.  Kernels run on host threads.
+} render_backend_t;
+
+render_backend_t backend_resolve  (render_backend_t requested);
+unsigned         backend_available(render_backend_t backend);
+const char*      backend_name     (render_backend_t backend);
+int              backend_from_name(const char *name, render_backend_t *backend);
+unsigned         backend_mem_info (render_backend_t backend, size_t *free, size_t *total);
+
+void     cpu_set_threads(unsigned n);
+unsigned cpu_threads(void);
+nd_t cpu_conv1 (nd_t dst, nd_t src, nd_t filter, unsigned idim, const nd_conv_params_t *params);
+nd_t cpu_affine(nd_t dst, nd_t src, const float *transform, const nd_affine_params_t *params);
+
+#ifdef __cplusplus
+} //extern "C"
+#endif
@@ -0,0 +1,221 @@
+/**
+ * \file
+ * Find the regions of a tile database that changed since the last render.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "changes.h"
+
+#define ENDL        "\n"
+#define LOG(...)    fprintf(stderr,__VA_ARGS__)
+#define TRY(e)      do{if(!(e)) { LOG("%s(%d): %s()"ENDL "\tExpression evaluated as false."ENDL "\t%s"ENDL,__FILE__,__LINE__,__FUNCTION__,#e); goto Error;}} while(0)
+#define NEW(T,e,N)  TRY((e)=(T*)malloc(sizeof(T)*(N)))
+#define REALLOC(T,e,N)  TRY((e)=(T*)realloc((e),sizeof(T)*(N)))
+
+#ifdef _MSC_VER
+#pragma warning (disable:4996) // deprecation warning for fopen
+#endif
+
+/// A tile named by its path relative to the root of its database (see root_length()).
+typedef struct _named_t
+{ const char *name;
+  size_t      i;    ///< index into TileBaseArray()
+} named_t;
+
+static int cmp_named(const void *a, const void *b)
+{ return strcmp(((const named_t*)a)->name,((const named_t*)b)->name);
+}
+
+static int ispathsep(char c) { return c=='/' || c=='\\'; }
+
+/**
+ * \returns the length of the prefix of the tile paths in \a tiles that
+ *          names the root of the database, including the path separator.
+ *
+ * The root is the path the database was opened from (see TileBaseRoot()),
+ * so names don't depend on which tiles happen to be in it.  If a tile isn't
+ * under that path, for example because it came from a cache written
+ * somewhere else, the common root of the tile paths is used instead.
+ */
+static size_t root_length(tiles_t tiles)
+{ const size_t ntiles=TileBaseCount(tiles);
+  const char *root=TileBaseRoot(tiles);
+  tile_t *ts=TileBaseArray(tiles);
+  char *common=0;
+  size_t i,n=strlen(root);
+  while(n>0 && ispathsep(root[n-1]))
+    --n;
+  if(n && ts)
+  { for(i=0;i<ntiles;++i)
+    { const char *p=TilePath(ts[i]);
+      if(strncmp(p,root,n) || !ispathsep(p[n]))
+        break;
+    }
+    if(i==ntiles)
+      return n+1;
+  }
+  n=(ts && ntiles && (common=TilesCommonRoot(ts,ntiles)))?strlen(common):0;
+  while(n>0 && !ispathsep(common[n-1])) // with one tile the common root is the whole path
+    --n;
+  free(common);
+  return n;
+}
+
+/**
+ * \returns an array of the tiles in \a tiles sorted by their path relative
+ *          to the root of the database (see root_length()), or 0 on failure.
+ *          The names point into the tiles' paths.
+ */
+static named_t* sort_by_name(tiles_t tiles)
+{ const size_t ntiles=TileBaseCount(tiles);
+  tile_t *ts;
+  named_t *out=0;
+  size_t i,n;
+  TRY(ts=TileBaseArray(tiles));
+  NEW(named_t,out,ntiles+1);
+  n=root_length(tiles);
+  for(i=0;i<ntiles;++i)
+  { out[i].name=TilePath(ts[i])+n;
+    out[i].i=i;
+  }
+  qsort(out,ntiles,sizeof(*out),cmp_named);
+  return out;
+Error:
+  return 0;
+}
+
+static unsigned push(aabb3_t **boxes, size_t *n, size_t *cap, const aabb3_t *b)
+{ if(*n>=*cap)
+    REALLOC(aabb3_t,*boxes,*cap=(*cap?2*(*cap):16));
+  (*boxes)[(*n)++]=*b;
+  return 1;
+Error:
+  return 0;
+}
+
+/**
+ * Reads a list of changed tiles, one path per line.  Paths may be given
+ * relative to the path \a tiles was opened from, or in full.  Blank lines
+ * are skipped.
+ *
+ * Tiles that were removed can't be found this way; use changes_from_diff().
+ *
+ * \param[out] n  The number of returned boxes.
+ * \returns 0 on failure, otherwise an array of boxes the caller must free().
+ */
+aabb3_t* changes_from_list(tiles_t tiles, const char *listfile, size_t *n)
+{ const aabb3_t *fp;
+  const size_t ntiles=TileBaseCount(tiles);
+  tile_t *ts;
+  named_t *names=0;
+  aabb3_t *out=0;
+  size_t cap=0,root=0;
+  char line[2048];
+  FILE *f=0;
+  *n=0;
+  TRY(ts=TileBaseArray(tiles));
+  TRY(fp=TileBaseFootprintBoxes(tiles));
+  TRY(names=sort_by_name(tiles));
+  if(ntiles)
+    root=names[0].name-TilePath(ts[names[0].i]);
+  TRY(f=fopen(listfile,"r"));
+  NEW(aabb3_t,out,1);
+  while(fgets(line,sizeof(line),f))
+  { named_t key,*hit;
+    char *s=line,*e=line+strlen(line);
+    while(e>s && (e[-1]=='\n' || e[-1]=='\r' || e[-1]==' ' || e[-1]=='\t' || ispathsep(e[-1])))
+      *--e='\0';
+    while(*s==' ' || *s=='\t') ++s;
+    if(!*s) continue;
+    if(ntiles && 0==strncmp(s,TilePath(ts[names[0].i]),root)) // full path
+      s+=root;
+    while(s[0]=='.' && ispathsep(s[1])) s+=2;
+    key.name=s;
+    if(!(hit=(named_t*)bsearch(&key,names,ntiles,sizeof(*names),cmp_named)))
+    { LOG("Changed tile %s is not in the tile database."ENDL,s);
+      goto Error;
+    }
+    TRY(push(&out,n,&cap,fp+hit->i));
+  }
+  TRY(!ferror(f));
+  fclose(f);
+  free(names);
+  return out;
+Error:
+  if(f) fclose(f);
+  free(names);
+  free(out);
+  *n=0;
+  return 0;
+}
+
+static unsigned same_box(const aabb3_t *a, const aabb3_t *b)
+{ return 0==memcmp(a,b,sizeof(*a));
+}
+
+/** \returns 1 if \a a and \a b have the same shape, voxel type and transform. */
+static unsigned same_tile(tile_t a, tile_t b)
+{ nd_t sa=TileShape(a),sb=TileShape(b);
+  const float *ta,*tb;
+  unsigned i,d;
+  if(!sa || !sb) return 0;
+  if(ndtype(sa)!=ndtype(sb) || (d=ndndim(sa))!=ndndim(sb)) return 0;
+  for(i=0;i<d;++i)
+    if(ndshape(sa)[i]!=ndshape(sb)[i]) return 0;
+  if(!(ta=TileTransform(a)) || !(tb=TileTransform(b))) return 0;
+  return 0==memcmp(ta,tb,sizeof(float)*(d+1)*(d+1));
+}
+
+/**
+ * Compares two versions of a tile database.  Tiles are matched by their
+ * path relative to the path each database was opened from.
+ *
+ * A tile is changed if it was added, removed, or if its footprint, shape or
+ * transform differ.  Re-imaged tiles with the same metadata aren't detected;
+ * use changes_from_list() for those.
+ *
+ * \param[out] n  The number of returned boxes.
+ * \returns 0 on failure, otherwise an array of boxes the caller must free().
+ */
+aabb3_t* changes_from_diff(tiles_t previous, tiles_t tiles, size_t *n)
+{ const size_t na=TileBaseCount(previous),
+               nb=TileBaseCount(tiles);
+  const aabb3_t *fa,*fb;
+  tile_t *ta,*tb;
+  named_t *a=0,*b=0;
+  aabb3_t *out=0;
+  size_t i=0,j=0,cap=0;
+  *n=0;
+  TRY(ta=TileBaseArray(previous));
+  TRY(tb=TileBaseArray(tiles));
+  TRY(fa=TileBaseFootprintBoxes(previous));
+  TRY(fb=TileBaseFootprintBoxes(tiles));
+  TRY(a=sort_by_name(previous));
+  TRY(b=sort_by_name(tiles));
+  NEW(aabb3_t,out,1);
+  while(i<na || j<nb)
+  { const int c=(i>=na)?1:(j>=nb)?-1:strcmp(a[i].name,b[j].name);
+    if(c<0)      // removed
+      TRY(push(&out,n,&cap,fa+a[i++].i));
+    else if(c>0) // added
+      TRY(push(&out,n,&cap,fb+b[j++].i));
+    else
+    { const size_t ia=a[i++].i,ib=b[j++].i;
+      if(same_box(fa+ia,fb+ib) && same_tile(ta[ia],tb[ib]))
+        continue;
+      TRY(push(&out,n,&cap,fa+ia));
+      if(!same_box(fa+ia,fb+ib))
+        TRY(push(&out,n,&cap,fb+ib));
+    }
+  }
+  free(a);
+  free(b);
+  return out;
+Error:
+  free(a);
+  free(b);
+  free(out);
+  *n=0;
+  return 0;
+}
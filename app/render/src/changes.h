@@ -0,0 +1,20 @@
+/**
+ * \file
+ * Find the regions of a tile database that changed since the last render.
+ *
+ * Changes are reported as the footprint bounds of the tiles involved.  A
+ * tile that moved contributes both its old and new bounds.
+ */
+#pragma once
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "tilebase.h"
+
+aabb3_t* changes_from_list(tiles_t tiles, const char *listfile, size_t *n);
+aabb3_t* changes_from_diff(tiles_t previous, tiles_t tiles, size_t *n);
+
+#ifdef __cplusplus
+} //extern "C"
+#endif
@@ -0,0 +1,535 @@
+/**
+ * \file
+ * Compressed, chunked node volumes.
+ *
+ * File layout (native byte order):
+ * \verbatim
+ *   chunked_header_t  header
+ *   uint64_t          size[header.nchunks]   compressed bytes in each chunk
+ *   uint8_t           chunks[]               one after the other
+ * \endverbatim
+ * A chunk whose size equals its uncompressed size is stored as is.
+ *
+ * Bit-shuffling transposes a chunk so that bit k of every element is stored
+ * together.  For the smooth, mostly small valued data in a volume most of the
+ * resulting bit planes are constant, which the LZ stage then removes.  Whole
+ * groups of 8 elements are shuffled; the bytes left over at the end of a
+ * chunk are appended as they are.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "src/util/thread.h"
+#include "backend.h"
+#include "chunked.h"
+
+#define ENDL          "\n"
+#define LOG(...)      fprintf(stderr,__VA_ARGS__)
+#define TRY(e)        do{if(!(e)) { LOG("%s(%d): %s()"ENDL "\tExpression evaluated as false."ENDL "\t%s"ENDL,__FILE__,__LINE__,__FUNCTION__,#e); goto Error;}} while(0)
+#define NEW(T,e,N)    TRY((e)=(T*)malloc(sizeof(T)*(N)))
+#define ZERO(T,e,N)   memset((e),0,sizeof(T)*(N))
+
+#ifdef _MSC_VER
+#pragma warning (disable:4996) // deprecation warning for fopen
+#endif
+
+#define MAGIC       "TBCV"
+#define VERSION     1
+#define MAXDIM      8
+
+#define LZ_MINMATCH     4         ///< shortest match the format can express
+#define LZ_LASTLITERALS 5         ///< the format requires the last 5 bytes to be literals
+#define LZ_MFLIMIT      12        ///< the last match must start at least this far from the end
+#define LZ_MAXOFFSET    65535
+#define LZ_HASHLOG      16
+
+typedef struct _chunked_header_t
+{ char     magic[4];          ///< MAGIC
+  uint32_t version;
+  uint32_t type;              ///< nd_type_id_t
+  uint32_t ndim;
+  uint64_t shape[MAXDIM];     ///< voxels along each dimension.  Only the first ndim are used.
+  int64_t  origin_nm[3];      ///< position of voxel 0
+  double   scale_nm[3];       ///< voxel size
+  uint64_t chunk_bytes;       ///< uncompressed bytes per chunk
+  uint64_t nchunks;
+} chunked_header_t;
+
+//
+// === BITSHUFFLE ===
+//
+
+/** Transposes the 8x8 bit matrix in \a x: bit j of byte i goes to bit i of byte j. */
+static uint64_t transpose8(uint64_t x)
+{ uint64_t t;
+  t=(x^(x>> 7))&0x00AA00AA00AA00AAULL; x^=t^(t<< 7);
+  t=(x^(x>>14))&0x0000CCCC0000CCCCULL; x^=t^(t<<14);
+  t=(x^(x>>28))&0x00000000F0F0F0F0ULL; x^=t^(t<<28);
+  return x;
+}
+
+/**
+ * Writes the \a n bytes of elements of \a bpp bytes in \a src to \a dst as
+ * bit planes.  Plane b*8+j holds bit j of byte b of each element.
+ */
+static void shuffle(uint8_t *dst, const uint8_t *src, size_t n, size_t bpp)
+{ const size_t ngroups=n/bpp/8,
+               stride=8*bpp;
+  size_t b,g,i;
+  for(b=0;b<bpp;++b)
+    for(g=0;g<ngroups;++g)
+    { const uint8_t *s=src+g*stride+b;
+      uint64_t x=0;
+      for(i=0;i<8;++i)
+        x|=((uint64_t)s[i*bpp])<<(8*i);
+      x=transpose8(x);
+      for(i=0;i<8;++i)
+        dst[(b*8+i)*ngroups+g]=(uint8_t)(x>>(8*i));
+    }
+  memcpy(dst+ngroups*stride,src+ngroups*stride,n-ngroups*stride);
+}
+
+/** Inverse of shuffle(). */
+static void unshuffle(uint8_t *dst, const uint8_t *src, size_t n, size_t bpp)
+{ const size_t ngroups=n/bpp/8,
+               stride=8*bpp;
+  size_t b,g,i;
+  for(b=0;b<bpp;++b)
+    for(g=0;g<ngroups;++g)
+    { uint8_t *d=dst+g*stride+b;
+      uint64_t x=0;
+      for(i=0;i<8;++i)
+        x|=((uint64_t)src[(b*8+i)*ngroups+g])<<(8*i);
+      x=transpose8(x);
+      for(i=0;i<8;++i)
+        d[i*bpp]=(uint8_t)(x>>(8*i));
+    }
+  memcpy(dst+ngroups*stride,src+ngroups*stride,n-ngroups*stride);
+}
+
+//
+// === LZ ===
+// Greedy matching with a single-entry hash table, like the fast mode of
+// LZ4.  The output is an LZ4 block.
+//
+
+static uint32_t read32(const uint8_t *p)
+{ uint32_t v;
+  memcpy(&v,p,sizeof(v));
+  return v;
+}
+
+static uint32_t lz_hash(uint32_t v)
+{ return (v*2654435761u)>>(32-LZ_HASHLOG);
+}
+
+static uint8_t* put_length(uint8_t *op, size_t n)
+{ for(;n>=255;n-=255)
+    *op++=255;
+  *op++=(uint8_t)n;
+  return op;
+}
+
+/** Emits one sequence.  \returns the new output position, or 0 if it doesn't fit before \a oend. */
+static uint8_t* put_sequence(uint8_t *op, uint8_t *oend, const uint8_t *lit, size_t nlit, size_t offset, size_t mlen)
+{ uint8_t *token;
+  if((size_t)(oend-op)<1+nlit/255+1+nlit+2+mlen/255+1)
+    return 0;
+  token=op++;
+  *token=(uint8_t)((nlit<15?nlit:15)<<4);
+  if(nlit>=15)
+    op=put_length(op,nlit-15);
+  memcpy(op,lit,nlit);
+  op+=nlit;
+  if(offset) // the last sequence has only literals
+  { *op++=(uint8_t)(offset&0xff);
+    *op++=(uint8_t)(offset>>8);
+    *token|=(uint8_t)(mlen<15?mlen:15);
+    if(mlen>=15)
+      op=put_length(op,mlen-15);
+  }
+  return op;
+}
+
+/**
+ * Compresses \a n bytes from \a src into \a dst.
+ * \param[in] table  Workspace with room for 1<<LZ_HASHLOG entries.
+ * \returns the compressed size, or 0 if it would exceed \a cap.
+ */
+static size_t lz_compress(uint8_t *dst, size_t cap, const uint8_t *src, size_t n, uint32_t *table)
+{ const uint8_t *ip=src,*anchor=src,*const end=src+n;
+  uint8_t *op=dst,*const oend=dst+cap;
+  if(n>LZ_MFLIMIT)
+  { const uint8_t *const mflimit=end-LZ_MFLIMIT,
+                  *const matchlimit=end-LZ_LASTLITERALS;
+    memset(table,0,sizeof(*table)<<LZ_HASHLOG);
+    while(ip<mflimit)
+    { const uint32_t h=lz_hash(read32(ip));
+      const uint8_t *ref=src+table[h],*m,*r;
+      table[h]=(uint32_t)(ip-src);
+      if(ref>=ip || ip-ref>LZ_MAXOFFSET || read32(ref)!=read32(ip))
+      { ++ip;
+        continue;
+      }
+      while(ip>anchor && ref>src && ip[-1]==ref[-1]) // extend backwards over pending literals
+      { --ip;
+        --ref;
+      }
+      for(m=ip+LZ_MINMATCH,r=ref+LZ_MINMATCH;m<matchlimit && *m==*r;++m,++r) {}
+      if(!(op=put_sequence(op,oend,anchor,ip-anchor,ip-ref,(m-ip)-LZ_MINMATCH)))
+        return 0;
+      anchor=ip=m;
+      if(ip<mflimit)
+        table[lz_hash(read32(ip-2))]=(uint32_t)(ip-2-src);
+    }
+  }
+  if(!(op=put_sequence(op,oend,anchor,end-anchor,0,0)))
+    return 0;
+  return op-dst;
+}
+
+static unsigned get_length(const uint8_t **ip, const uint8_t *iend, size_t *n)
+{ unsigned b;
+  do
+  { if(*ip>=iend) return 0;
+    *n+=(b=*(*ip)++);
+  } while(b==255);
+  return 1;
+}
+
+/** Decompresses \a csize bytes from \a src into exactly \a n bytes at \a dst.  \returns 0 if the input is corrupt. */
+static unsigned lz_decompress(uint8_t *dst, size_t n, const uint8_t *src, size_t csize)
+{ const uint8_t *ip=src,*const iend=src+csize;
+  uint8_t *op=dst,*const oend=dst+n;
+  while(ip<iend)
+  { const unsigned token=*ip++;
+    size_t nlit=token>>4,mlen=token&15,offset;
+    if(nlit==15)
+      TRY(get_length(&ip,iend,&nlit));
+    TRY(nlit<=(size_t)(iend-ip) && nlit<=(size_t)(oend-op));
+    memcpy(op,ip,nlit);
+    op+=nlit;
+    ip+=nlit;
+    if(ip==iend) // last sequence
+      break;
+    TRY(iend-ip>=2);
+    offset=ip[0]|((size_t)ip[1]<<8);
+    ip+=2;
+    TRY(offset && offset<=(size_t)(op-dst));
+    if(mlen==15)
+      TRY(get_length(&ip,iend,&mlen));
+    mlen+=LZ_MINMATCH;
+    TRY(mlen<=(size_t)(oend-op));
+    if(offset>=mlen)
+      memcpy(op,op-offset,mlen);
+    else
+    { const uint8_t *r=op-offset; // overlapping copy repeats the pattern
+      size_t i;
+      for(i=0;i<mlen;++i)
+        op[i]=r[i];
+    }
+    op+=mlen;
+  }
+  TRY(op==oend);
+  return 1;
+Error:
+  return 0;
+}
+
+//
+// === PARALLEL CODING ===
+//
+
+/** Shared by the threads coding the chunks of one volume. */
+typedef struct _codec_work_t
+{ uint8_t   *raw;          ///< the uncompressed volume
+  size_t     nbytes,
+             bpp,
+             chunk_bytes,
+             nchunks;
+  uint8_t  **chunks;       ///< encoding: each compressed chunk
+  const uint8_t *payload;  ///< decoding: the compressed chunks, one after the other
+  uint64_t  *offsets;      ///< decoding: where each chunk starts in payload
+  uint64_t  *sizes;        ///< compressed bytes in each chunk
+  int        decode;
+  size_t     next;         ///< next chunk to code
+  unsigned   ok;
+  tbmutex_t  lock;
+} codec_work_t;
+
+static size_t chunk_size(const codec_work_t *w, size_t i)
+{ const size_t o=i*w->chunk_bytes;
+  return (o+w->chunk_bytes<w->nbytes)?w->chunk_bytes:(w->nbytes-o);
+}
+
+static unsigned encode_chunk(codec_work_t *w, size_t i, uint8_t *tmp, uint32_t *table)
+{ const size_t n=chunk_size(w,i);
+  uint8_t *raw=w->raw+i*w->chunk_bytes;
+  size_t c;
+  NEW(uint8_t,w->chunks[i],n);
+  shuffle(tmp,raw,n,w->bpp);
+  if(n>1 && (c=lz_compress(w->chunks[i],n-1,tmp,n,table))) // must be smaller than n to be told apart from a stored chunk
+    w->sizes[i]=c;
+  else
+  { memcpy(w->chunks[i],raw,n);
+    w->sizes[i]=n;
+  }
+  return 1;
+Error:
+  return 0;
+}
+
+static unsigned decode_chunk(codec_work_t *w, size_t i, uint8_t *tmp)
+{ const size_t n=chunk_size(w,i);
+  uint8_t *raw=w->raw+i*w->chunk_bytes;
+  const uint8_t *in=w->payload+w->offsets[i];
+  if(w->sizes[i]==n)
+  { memcpy(raw,in,n);
+    return 1;
+  }
+  TRY(lz_decompress(tmp,n,in,(size_t)w->sizes[i]));
+  unshuffle(raw,tmp,n,w->bpp);
+  return 1;
+Error:
+  LOG("Chunk %llu is corrupt."ENDL,(unsigned long long)i);
+  return 0;
+}
+
+static void* codec_worker(void *arg)
+{ codec_work_t *w=(codec_work_t*)arg;
+  uint8_t *tmp=(uint8_t*)malloc(w->chunk_bytes);
+  uint32_t *table=w->decode?0:(uint32_t*)malloc(sizeof(uint32_t)<<LZ_HASHLOG);
+  unsigned ok=tmp && (w->decode || table);
+  size_t i;
+  while(ok)
+  { MutexLock(&w->lock);
+    i=w->next++;
+    MutexUnlock(&w->lock);
+    if(i>=w->nchunks) break;
+    ok=w->decode?decode_chunk(w,i,tmp):encode_chunk(w,i,tmp,table);
+  }
+  if(!ok)
+  { MutexLock(&w->lock);
+    w->ok=0;
+    w->next=w->nchunks; // stop the others early
+    MutexUnlock(&w->lock);
+  }
+  free(tmp);
+  free(table);
+  return 0;
+}
+
+/**
+ * Codes the chunks of \a w on up to cpu_threads() threads, so callers that
+ * run side by side, like the writer threads, can split the cores between them.
+ */
+static unsigned run(codec_work_t *w)
+{ tbthread_t *threads=0;
+  unsigned i,nthreads=cpu_threads(),nstarted=0;
+  if(nthreads>w->nchunks) nthreads=(unsigned)w->nchunks;
+  w->next=0;
+  w->ok=1;
+  MutexInit(&w->lock);
+  if(nthreads>1 && (threads=(tbthread_t*)malloc(sizeof(*threads)*nthreads)))
+    for(i=0;i<nthreads;++i)
+      nstarted+=ThreadCreate(threads+nstarted,codec_worker,w);
+  if(!nstarted)
+    codec_worker(w);
+  for(i=0;i<nstarted;++i)
+    ThreadJoin(threads+i);
+  free(threads);
+  MutexFree(&w->lock);
+  return w->ok;
+}
+
+//
+// === INTERFACE ===
+//
+
+/**
+ * Encodes \a vol in memory.
+ * \param[in]  origin_nm    Position of the first voxel.  May be NULL.
+ * \param[in]  scale_nm     Voxel size.  May be NULL.
+ * \param[in]  chunk_bytes  Uncompressed bytes per chunk.  0 uses CHUNKED_CHUNK_BYTES.
+ *                          Rounded down to a whole number of 8 element groups.
+ * \param[out] nbytes       Size of the result.
+ * \returns 0 on failure, otherwise a buffer the caller must free().
+ */
+void* chunked_encode(nd_t vol, const int64_t origin_nm[3], const double scale_nm[3], size_t chunk_bytes, size_t *nbytes)
+{ chunked_header_t h;
+  codec_work_t w;
+  nd_t host=0;
+  uint8_t *out=0,*p;
+  size_t i;
+  memset(&h,0,sizeof(h));
+  memset(&w,0,sizeof(w));
+  TRY(ndndim(vol)<=MAXDIM);
+  TRY(ndnelem(vol)>0);
+  if(ndkind(vol)==nd_gpu_cuda)
+    TRY(host=ndcopy(ndheap(vol),vol,0,0));
+  w.raw=(uint8_t*)nddata(host?host:vol);
+  w.nbytes=ndnbytes(vol);
+  w.bpp=w.nbytes/ndnelem(vol);
+  if(!chunk_bytes) chunk_bytes=CHUNKED_CHUNK_BYTES;
+  w.chunk_bytes=chunk_bytes-chunk_bytes%(8*w.bpp);
+  if(!w.chunk_bytes) w.chunk_bytes=8*w.bpp;
+  w.nchunks=(w.nbytes+w.chunk_bytes-1)/w.chunk_bytes;
+  NEW(uint8_t*,w.chunks,w.nchunks);
+  ZERO(uint8_t*,w.chunks,w.nchunks);
+  NEW(uint64_t,w.sizes,w.nchunks);
+  TRY(run(&w));
+
+  memcpy(h.magic,MAGIC,sizeof(h.magic));
+  h.version=VERSION;
+  h.type=(uint32_t)ndtype(vol);
+  h.ndim=ndndim(vol);
+  for(i=0;i<h.ndim;++i)
+    h.shape[i]=ndshape(vol)[i];
+  for(i=0;i<3;++i)
+  { h.origin_nm[i]=origin_nm?origin_nm[i]:0;
+    h.scale_nm[i] =scale_nm?scale_nm[i]:1.0;
+  }
+  h.chunk_bytes=w.chunk_bytes;
+  h.nchunks=w.nchunks;
+  *nbytes=sizeof(h)+w.nchunks*sizeof(*w.sizes);
+  for(i=0;i<w.nchunks;++i)
+    *nbytes+=(size_t)w.sizes[i];
+  NEW(uint8_t,out,*nbytes);
+  memcpy(p=out,&h,sizeof(h));                         p+=sizeof(h);
+  memcpy(p,w.sizes,w.nchunks*sizeof(*w.sizes));       p+=w.nchunks*sizeof(*w.sizes);
+  for(i=0;i<w.nchunks;++i)
+  { memcpy(p,w.chunks[i],(size_t)w.sizes[i]);
+    p+=w.sizes[i];
+  }
+Finalize:
+  if(w.chunks)
+    for(i=0;i<w.nchunks;++i)
+      free(w.chunks[i]);
+  free(w.chunks);
+  free(w.sizes);
+  if(host) ndfree(host);
+  return out;
+Error:
+  free(out);
+  out=0;
+  goto Finalize;
+}
+
+/**
+ * Decodes a volume encoded by chunked_encode().
+ * \param[out] origin_nm  Position of the first voxel.  May be NULL.
+ * \param[out] scale_nm   Voxel size.  May be NULL.
+ * \returns 0 on failure, otherwise a heap array the caller must ndfree().
+ */
+nd_t chunked_decode(const void *buf, size_t nbytes, int64_t origin_nm[3], double scale_nm[3])
+{ chunked_header_t h;
+  codec_work_t w;
+  const uint8_t *p=(const uint8_t*)buf;
+  size_t shape[MAXDIM],i,nelem,npayload=0;
+  nd_t out=0;
+  memset(&w,0,sizeof(w));
+  TRY(nbytes>=sizeof(h));
+  memcpy(&h,p,sizeof(h));
+  TRY(0==memcmp(h.magic,MAGIC,sizeof(h.magic)));
+  TRY(h.version==VERSION);
+  TRY(h.ndim>0 && h.ndim<=MAXDIM);
+  TRY(h.type<nd_id_count);
+  TRY(h.chunk_bytes>0 && h.chunk_bytes<=SIZE_MAX/2);
+  for(i=0,nelem=1;i<h.ndim;++i)
+  { TRY(h.shape[i]>0 && h.shape[i]<=SIZE_MAX/8/nelem); // so the byte count can't overflow
+    nelem*=(size_t)(shape[i]=(size_t)h.shape[i]);
+  }
+  TRY(out=ndreshape(ndcast(ndinit(),(nd_type_id_t)h.type),h.ndim,shape));
+
+  // check the header against the size table before allocating anything it asks for
+  w.decode=1;
+  w.nbytes=ndnbytes(out);
+  w.bpp=w.nbytes/nelem;
+  w.chunk_bytes=(size_t)h.chunk_bytes;
+  w.nchunks=(size_t)h.nchunks;
+  TRY(w.bpp>0);
+  TRY(w.nchunks==(w.nbytes+w.chunk_bytes-1)/w.chunk_bytes);
+  TRY(w.chunk_bytes%(8*w.bpp)==0);
+  TRY((nbytes-sizeof(h))/sizeof(*w.sizes)>=w.nchunks);
+  NEW(uint64_t,w.sizes,w.nchunks+1);
+  NEW(uint64_t,w.offsets,w.nchunks+1);
+  memcpy(w.sizes,p+sizeof(h),w.nchunks*sizeof(*w.sizes));
+  w.payload=p+sizeof(h)+w.nchunks*sizeof(*w.sizes);
+  for(i=0;i<w.nchunks;++i)
+  { const size_t n=chunk_size(&w,i);
+    TRY(w.sizes[i]<=n);
+    TRY(n/255<=w.sizes[i]); // LZ output is at most 255 times its input
+    w.offsets[i]=npayload;
+    npayload+=(size_t)w.sizes[i];
+  }
+  TRY(npayload==nbytes-(size_t)(w.payload-p));
+  TRY(ndref(out,malloc(w.nbytes),nd_heap));
+  TRY(w.raw=(uint8_t*)nddata(out));
+  TRY(run(&w));
+
+  for(i=0;i<3;++i)
+  { if(origin_nm) origin_nm[i]=h.origin_nm[i];
+    if(scale_nm)  scale_nm[i] =h.scale_nm[i];
+  }
+Finalize:
+  free(w.sizes);
+  free(w.offsets);
+  return out;
+Error:
+  if(out) ndfree(out);
+  out=0;
+  goto Finalize;
+}
+
+/**
+ * Saves \a vol to \a path.  See chunked_encode().
+ * \returns 1 on success, otherwise 0.
+ */
+unsigned chunked_write(const char *path, nd_t vol, const int64_t origin_nm[3], const double scale_nm[3], size_t chunk_bytes)
+{ void *buf=0;
+  size_t nbytes;
+  FILE *fp=0;
+  TRY(buf=chunked_encode(vol,origin_nm,scale_nm,chunk_bytes,&nbytes));
+  TRY(fp=fopen(path,"wb"));
+  TRY(1==fwrite(buf,nbytes,1,fp));
+  { const int r=fclose(fp);
+    fp=0; // closed either way
+    TRY(0==r);
+  }
+  free(buf);
+  return 1;
+Error:
+  if(fp) fclose(fp);
+  free(buf);
+  return 0;
+}
+
+/**
+ * Loads a volume saved by chunked_write().  See chunked_decode().
+ * \returns 0 on failure, otherwise a heap array the caller must ndfree().
+ */
+nd_t chunked_read(const char *path, int64_t origin_nm[3], double scale_nm[3])
+{ uint8_t *buf=0;
+  size_t nbytes=0,cap=0,n;
+  nd_t out=0;
+  FILE *fp=0;
+  TRY(fp=fopen(path,"rb"));
+  do // read the whole file
+  { if(nbytes==cap)
+    { uint8_t *t;
+      TRY(t=(uint8_t*)realloc(buf,cap=cap?2*cap:(1<<20)));
+      buf=t;
+    }
+    nbytes+=(n=fread(buf+nbytes,1,cap-nbytes,fp));
+  } while(n);
+  TRY(!ferror(fp));
+  TRY(out=chunked_decode(buf,nbytes,origin_nm,scale_nm));
+Finalize:
+  if(fp) fclose(fp);
+  free(buf);
+  return out;
+Error:
+  LOG("Could not read %s"ENDL,path);
+  goto Finalize;
+}
@@ -0,0 +1,33 @@
+/**
+ * \file
+ * Compressed, chunked node volumes.
+ *
+ * A node is saved as a single file: a fixed size header recording the voxel
+ * type, shape and placement of the volume, the compressed size of each chunk,
+ * and the chunks themselves.  Chunks hold a fixed number of uncompressed
+ * bytes (the last may be shorter).  Each one is bit-shuffled and then
+ * compressed with an LZ77 codec that emits the LZ4 block format.  A chunk
+ * that doesn't get smaller is stored as is.
+ *
+ * Chunks are encoded and decoded in parallel.  The same encoding can be
+ * kept in memory, for example to store nodes in a container (see shards.h).
+ */
+#pragma once
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include "nd.h"
+
+#define CHUNKED_NAME        "volume.tbv"  ///< file name used for a node's volume in a node directory
+#define CHUNKED_CHUNK_BYTES (1<<20)       ///< default uncompressed bytes per chunk
+
+void*    chunked_encode(nd_t vol, const int64_t origin_nm[3], const double scale_nm[3], size_t chunk_bytes, size_t *nbytes);
+nd_t     chunked_decode(const void *buf, size_t nbytes, int64_t origin_nm[3], double scale_nm[3]);
+unsigned chunked_write(const char *path, nd_t vol, const int64_t origin_nm[3], const double scale_nm[3], size_t chunk_bytes);
+nd_t     chunked_read (const char *path, int64_t origin_nm[3], double scale_nm[3]);
+
+#ifdef __cplusplus
+} //extern "C"
+#endif
@@ -4,8 +4,11 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <math.h>
 #include "nd.h"
+#include "filter.h"
+#include "src/util/thread.h"
 #ifdef _MSC_VER
 #define isfinite _finite
 #endif
@@ -93,4 +96,50 @@ nd_t make_aa_filter(float scale,float size, float size_thresh,nd_t workspace)
   return out;
 Error:
   return 0;
-}
\ No newline at end of file
+}
+
+//
+// SHARED FILTERS
+// Tiles and nodes at one level of the tree mostly share a few scales, so
+// each distinct filter is made once.
+//
+
+typedef struct _aa_filter_entry_t
+{ float sigma;  ///< multiple of AA_FILTER_QUANTUM
+  nd_t  filter;
+} aa_filter_entry_t;
+
+static tbmutex_t          g_filters_lock=TBMUTEX_INIT; ///< guards g_filters
+static aa_filter_entry_t *g_filters;
+static size_t             g_nfilters,g_filters_cap;
+
+nd_t aa_filter(float scale,float size, float size_thresh)
+{ float sigma=scale*fabs(size);
+  nd_t out=0;
+  size_t i;
+  if(sigma<=size_thresh) return 0; // no filter needed.  Decided before rounding so it's the same as make_aa_filter()'s.
+  sigma=AA_FILTER_QUANTUM*floorf(sigma/AA_FILTER_QUANTUM+0.5f);
+  if(sigma<AA_FILTER_QUANTUM) sigma=AA_FILTER_QUANTUM;
+  MutexLock(&g_filters_lock);
+  for(i=0;i<g_nfilters;++i)
+    if(g_filters[i].sigma==sigma)
+    { out=g_filters[i].filter;
+      goto Finalize;
+    }
+  if(g_nfilters==g_filters_cap)
+  { aa_filter_entry_t *e;
+    size_t cap=g_filters_cap?2*g_filters_cap:16;
+    TRY(e=(aa_filter_entry_t*)realloc(g_filters,cap*sizeof(*e)));
+    g_filters=e;
+    g_filters_cap=cap;
+  }
+  TRY(out=make_aa_filter(1.0f,sigma,0.0f,0));
+  g_filters[g_nfilters].sigma=sigma;
+  g_filters[g_nfilters++].filter=out;
+Finalize:
+  MutexUnlock(&g_filters_lock);
+  return out;
+Error:
+  out=0;
+  goto Finalize;
+}
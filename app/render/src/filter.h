@@ -14,6 +14,14 @@ If the size is less than size_thresh, returns zero.
 */
 nd_t make_aa_filter(float scale,float size, float size_thresh,nd_t workspace);
 
+/*
+Like make_aa_filter(), but the filter is shared and immutable.  Don't change
+or free it.  Filters are cached by their sigma, rounded to AA_FILTER_QUANTUM
+voxels, and live as long as the process.  Thread safe.
+*/
+#define AA_FILTER_QUANTUM (1.0f/1024.0f)
+nd_t aa_filter(float scale,float size, float size_thresh);
+
 #ifdef __cplusplus
 } //extern "C"
 #endif
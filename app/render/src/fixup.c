@@ -50,6 +50,7 @@ int fix_fov(tiles_t tiles, int64_t x_nm, int64_t y_nm)
         shape_nm[1]=y_nm;
       }
     }
+    TileBaseInvalidateBoxes(tiles);
   }
   return 1;
 Error:
@@ -0,0 +1,274 @@
+/**
+ * \file
+ * Append-only record of the nodes a render has finished.
+ */
+#include "manifest.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include "src/util/dirlist.h"
+
+#define ENDL        "\n"
+#define LOG(...)    fprintf(stderr,__VA_ARGS__)
+#define TRY(e)      do{if(!(e)) { LOG("%s(%d): %s()"ENDL "\tExpression evaluated as false."ENDL "\t%s"ENDL,__FILE__,__LINE__,__FUNCTION__,#e); goto Error;}} while(0)
+#define NEW(T,e,N)  TRY((e)=(T*)malloc(sizeof(T)*(N)))
+#define REALLOC(T,e,N)  TRY((e)=(T*)realloc((e),sizeof(T)*(N)))
+
+#ifdef _MSC_VER
+#pragma warning (disable:4996) // deprecation warning for fopen
+#define snprintf _snprintf
+#define stat     _stat
+#define S_ISREG(e) (((e)&_S_IFREG)!=0)
+#define PATHSEP  '\\'
+#else
+#define PATHSEP  '/'
+#endif
+
+#define FNV_OFFSET 14695981039346656037ULL
+#define FNV_PRIME  1099511628211ULL
+
+typedef struct _entry_t
+{ char    *key;
+  uint64_t nbytes,
+           checksum;
+  size_t   line;     ///< later lines win when a key repeats
+  int      removed;  ///< the line was written by manifest_remove()
+} entry_t;
+
+struct _manifest_t
+{ FILE    *fp;       ///< open for appending
+  entry_t *entries;  ///< sorted by key after manifest_open()
+  size_t   n,cap;
+};
+
+static int cmp_entry(const void *a, const void *b)
+{ const entry_t *ea=(const entry_t*)a,
+                *eb=(const entry_t*)b;
+  int c=strcmp(ea->key,eb->key);
+  if(c) return c;
+  return (ea->line>eb->line)-(ea->line<eb->line);
+}
+
+static unsigned push(manifest_t self, const char *key, uint64_t nbytes, uint64_t checksum, int removed)
+{ entry_t *e;
+  if(self->n>=self->cap)
+    REALLOC(entry_t,self->entries,self->cap=(self->cap?2*self->cap:64));
+  e=self->entries+self->n;
+  NEW(char,e->key,strlen(key)+1);
+  strcpy(e->key,key);
+  e->nbytes=nbytes;
+  e->checksum=checksum;
+  e->removed=removed;
+  e->line=self->n++;
+  return 1;
+Error:
+  return 0;
+}
+
+/**
+ * Reads the entries in \a fp.  Malformed lines, like one cut short by a
+ * crash, are skipped.  A key whose last line marks it removed is dropped.
+ */
+static unsigned load(manifest_t self, FILE *fp)
+{ char line[2048],key[1024],mark[2];
+  unsigned long long nbytes,checksum;
+  size_t i,j;
+  while(fgets(line,sizeof(line),fp))
+  { if(!strchr(line,'\n'))
+      continue;
+    if(3==sscanf(line,"%1023s %llu %llx",key,&nbytes,&checksum))
+      TRY(push(self,key,nbytes,checksum,0));
+    else if(2==sscanf(line,"%1023s %1s",key,mark) && mark[0]=='-')
+      TRY(push(self,key,0,0,1));
+  }
+  // sort, then keep the last entry for each key
+  qsort(self->entries,self->n,sizeof(*self->entries),cmp_entry);
+  for(i=0,j=0;i<self->n;++i)
+  { if(self->entries[i].removed || (i+1<self->n && 0==strcmp(self->entries[i].key,self->entries[i+1].key)))
+    { free(self->entries[i].key);
+      continue;
+    }
+    self->entries[j++]=self->entries[i];
+  }
+  self->n=j;
+  return 1;
+Error:
+  return 0;
+}
+
+/**
+ * Opens the manifest at \a path.
+ * \param[in] resume  If 1, the entries already in the file are kept.
+ *                    Otherwise the manifest starts out empty.
+ * \returns 0 on failure.
+ */
+manifest_t manifest_open(const char *path, int resume)
+{ manifest_t self=0;
+  FILE *fp=0;
+  NEW(struct _manifest_t,self,1);
+  memset(self,0,sizeof(*self));
+  if(resume && (fp=fopen(path,"r")))
+  { int last=EOF;
+    TRY(load(self,fp));
+    if(0==fseek(fp,-1,SEEK_END))
+      last=fgetc(fp);
+    fclose(fp);
+    fp=0;
+    TRY(self->fp=fopen(path,"a"));
+    if(last!=EOF && last!='\n') // end a line cut short by a crash so the next entry starts clean
+      fputc('\n',self->fp);
+  } else
+    TRY(self->fp=fopen(path,"w"));
+  LOG("Manifest %s: %llu finished nodes"ENDL,path,(unsigned long long)self->n);
+  return self;
+Error:
+  if(fp) fclose(fp);
+  manifest_close(self);
+  return 0;
+}
+
+void manifest_close(manifest_t self)
+{ size_t i;
+  if(!self) return;
+  if(self->fp) fclose(self->fp);
+  for(i=0;i<self->n;++i)
+    free(self->entries[i].key);
+  free(self->entries);
+  free(self);
+}
+
+/** \returns the number of entries read when the manifest was opened. */
+size_t manifest_count(manifest_t self)
+{ return self?self->n:0;
+}
+
+/**
+ * Appends an entry and flushes it to disk.
+ * Entries added this way are not visible to manifest_find().
+ */
+unsigned manifest_add(manifest_t self, const char *key, uint64_t nbytes, uint64_t checksum)
+{ TRY(self && self->fp);
+  TRY(fprintf(self->fp,"%s\t%llu\t%016llx"ENDL,key,(unsigned long long)nbytes,(unsigned long long)checksum)>0);
+  TRY(0==fflush(self->fp));
+  return 1;
+Error:
+  return 0;
+}
+
+/** \returns the entry read for \a key when the manifest was opened, or NULL. */
+static entry_t* find(manifest_t self, const char *key)
+{ size_t lo=0,hi;
+  if(!self) return 0;
+  hi=self->n;
+  while(lo<hi)
+  { const size_t mid=lo+(hi-lo)/2;
+    const int c=strcmp(key,self->entries[mid].key);
+    if(c==0)
+      return self->entries+mid;
+    if(c<0) hi=mid;
+    else    lo=mid+1;
+  }
+  return 0;
+}
+
+/**
+ * Records that the node \a key is no longer finished, for example because
+ * its files were removed.  It stops counting as finished right away, and
+ * the next time the manifest is opened.
+ */
+unsigned manifest_remove(manifest_t self, const char *key)
+{ entry_t *e;
+  TRY(self && self->fp);
+  if((e=find(self,key)))
+  { free(e->key);
+    memmove(e,e+1,sizeof(*e)*(self->entries+self->n-e-1));
+    --self->n;
+  }
+  TRY(fprintf(self->fp,"%s\t-"ENDL,key)>0);
+  TRY(0==fflush(self->fp));
+  return 1;
+Error:
+  return 0;
+}
+
+/** \returns 1 and fills in the size and checksum recorded for \a key if it was found, otherwise 0. */
+unsigned manifest_find(manifest_t self, const char *key, uint64_t *nbytes, uint64_t *checksum)
+{ const entry_t *e=find(self,key);
+  if(!e) return 0;
+  if(nbytes)   *nbytes  =e->nbytes;
+  if(checksum) *checksum=e->checksum;
+  return 1;
+}
+
+static int cmp_name(const void *a, const void *b)
+{ return strcmp(*(const char**)a,*(const char**)b);
+}
+
+static uint64_t hash(uint64_t h, const unsigned char *data, size_t n)
+{ size_t i;
+  for(i=0;i<n;++i)
+    h=(h^data[i])*FNV_PRIME;
+  return h;
+}
+
+/** Adds the contents of the file at \a path to a running FNV-1a hash. */
+static unsigned hash_file(const char *path, uint64_t *nbytes, uint64_t *h)
+{ unsigned char buf[1<<16];
+  size_t n;
+  FILE *fp=0;
+  TRY(fp=fopen(path,"rb"));
+  while((n=fread(buf,1,sizeof(buf),fp))>0)
+  { *h=hash(*h,buf,n);
+    *nbytes+=n;
+  }
+  TRY(!ferror(fp));
+  fclose(fp);
+  return 1;
+Error:
+  if(fp) fclose(fp);
+  return 0;
+}
+
+/**
+ * Computes the total size and a checksum of the files directly inside
+ * \a dir.  Subdirectories, which hold child nodes, and the manifest are
+ * skipped.  Files are
+ * visited in name order, so the result doesn't depend on the listing order.
+ */
+unsigned manifest_digest(const char *dir, uint64_t *nbytes, uint64_t *checksum)
+{ dirlist_t list=0;
+  const char **names=0;
+  char path[2048];
+  size_t i,n;
+  *nbytes=0;
+  *checksum=FNV_OFFSET;
+  TRY(list=DirListRead(dir));
+  n=DirListCount(list);
+  NEW(const char*,names,n+1);
+  for(i=0;i<n;++i)
+    names[i]=DirListName(list,i);
+  qsort(names,n,sizeof(*names),cmp_name);
+  for(i=0;i<n;++i)
+  { struct stat s;
+    TRY(snprintf(path,sizeof(path),"%s%c%s",dir,PATHSEP,names[i])<(int)sizeof(path));
+    if(0==strcmp(names[i],MANIFEST_NAME)) // the manifest itself may live in the root node's directory
+      continue;
+    if(stat(path,&s)<0 || !S_ISREG(s.st_mode))
+      continue;
+    TRY(hash_file(path,nbytes,checksum));
+  }
+  free((void*)names);
+  DirListFree(list);
+  return 1;
+Error:
+  free((void*)names);
+  DirListFree(list);
+  return 0;
+}
+
+/** \returns the checksum manifest_digest() would compute for a single file holding \a data. */
+uint64_t manifest_checksum(const void *data, size_t nbytes)
+{ return hash(FNV_OFFSET,(const unsigned char*)data,nbytes);
+}
@@ -0,0 +1,34 @@
+/**
+ * \file
+ * Append-only record of the nodes a render has finished.
+ *
+ * Each line names a node by its output directory relative to the output
+ * root ("." for the root), followed by the total size in bytes and a
+ * checksum of the files written for it, or by "-" once the node has been
+ * removed.  Lines are flushed as they are added, so the record survives the
+ * renderer dying part way through.
+ */
+#pragma once
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define MANIFEST_NAME "render.manifest"
+
+typedef struct _manifest_t* manifest_t;
+
+manifest_t manifest_open  (const char *path, int resume);
+void       manifest_close (manifest_t self);
+size_t     manifest_count (manifest_t self);
+unsigned   manifest_add   (manifest_t self, const char *key, uint64_t nbytes, uint64_t checksum);
+unsigned   manifest_remove(manifest_t self, const char *key);
+unsigned   manifest_find  (manifest_t self, const char *key, uint64_t *nbytes, uint64_t *checksum);
+unsigned   manifest_digest(const char *dir, uint64_t *nbytes, uint64_t *checksum);
+uint64_t   manifest_checksum(const void *data, size_t nbytes);
+
+#ifdef __cplusplus
+} //extern "C"
+#endif
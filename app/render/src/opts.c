@@ -18,6 +18,8 @@
 #include <sys/stat.h>
 #include <math.h> // for pow
 #include "opts.h"
+#include "manifest.h"
+#include "chunked.h"
 #include "tilebase.h"
 #include "src/metadata/metadata.h"
 
@@ -85,13 +87,24 @@ static int  is_four_or_eight(const char* s);
 static int  is_address(const char* s);
 static int  is_metadata_fmt(const char* s);
 static int  is_positive_int(const char* s);
+static int  is_backend(const char* s);
 
 static void set_print_addresses(opts_t *ctx);
 static void set_raveler_output(opts_t *ctx);
 static void set_output_ortho(opts_t *ctx);
+static void set_tile_major(opts_t *ctx);
+static void set_resume(opts_t *ctx);
+static void set_chunked(opts_t *ctx);
 
 static int  set_address(opts_t *ctx,const char *s);
 static int  set_gpu(opts_t *ctx,const char *s);
+static int  set_backend(opts_t *ctx,const char *s);
+static int  set_nthreads(opts_t *ctx,const char *s);
+static int  set_nwriters(opts_t *ctx,const char *s);
+static int  set_memory_budget(opts_t *ctx,const char *s);
+static int  set_changed(opts_t *ctx,const char *s);
+static int  set_previous(opts_t *ctx,const char *s);
+static int  set_shards(opts_t *ctx,const char *s);
 static int  set_source_path(opts_t *ctx,const char *s);
 static int  set_output_path(opts_t *ctx,const char *s);
 static int  set_dest_file(opts_t *ctx,const char *s);
@@ -123,8 +136,41 @@ static opt_t SPEC[]=
   {NULL,            NULL,            set_print_addresses, 1, "--print-addresses", NULL, NULL,   "Print the addresses of each node in the tree in order of dependency.",{0}},
   {is_address,      set_address,     NULL,                0, "-t",  "--target-address", NULL,   "Render target address in the tree from it's children.",{0}},
   {is_positive_int, set_gpu,         NULL,                0, "-gpu",NULL,               "0",    "Use this GPU for acceleration.",{0}},
+  {is_backend,      set_backend,     NULL,                0, "--backend",NULL,          "auto",
+        "Where to render: auto, cpu or gpu.  "
+        "auto uses the GPU if there is one, otherwise the CPU.",{0}},
+  {is_positive_int, set_nthreads,    NULL,                0, "-j",  "--threads",        "0",    "Number of leaves to render at once with the CPU backend.  0 uses one per core.",{0}},
+  {is_human_readible_size,set_memory_budget,NULL,         0, "--memory-budget", NULL,   NULL,
+        "Memory to use for tree nodes in flight and for each worker's tile and filter buffers when rendering leaves in parallel.  "
+        "Fewer workers are used if they don't fit.  "
+        "Accepts the same suffixes as --count-of-leaf.  "
+        "Defaults to half the available memory.",{0}},
+  {is_positive_int, set_nwriters,    NULL,                0, "--writers", NULL,         "0",
+        "Number of threads that save nodes while rendering continues.  "
+        "Each one holds up to two nodes waiting to be saved.  0 saves each node before moving on.",{0}},
   {NULL,            NULL,            set_raveler_output,  1, "--raveler-output", NULL , NULL,   "Save using raveler format.  WORK IN PROGRESS.  Currently just enforces some constraints.",{0}},
   {NULL,            NULL,            set_output_ortho,    1, "--ortho", NULL,           NULL,   "Output orthogonal views alongside each node (YZ and ZX).",{0}},
+  {NULL,            NULL,            set_chunked,         1, "--chunked", NULL,         NULL,
+        "Save each node as a single compressed file, " CHUNKED_NAME ", instead of using --dest-file.  "
+        "The file also records the node's origin and voxel size, so no transform.txt is written.",{0}},
+  {is_positive_int, set_shards,      NULL,                0, "--shards", NULL,          NULL,
+        "Pack nodes into a few container files in the output path instead of writing a directory per node.  "
+        "Each subtree below this many address steps goes in one file.  0 puts the whole tree in one file.  "
+        "Nodes are compressed as with --chunked.  Can't be used with --ortho.",{0}},
+  {NULL,            NULL,            set_tile_major,      1, "--tile-major", NULL,      NULL,
+        "Read each tile once and resample it into every leaf it overlaps, instead of reading tiles once per leaf.  "
+        "Falls back to the usual order if the leaves that are open at once don't fit in --memory-budget.",{0}},
+  {NULL,            NULL,            set_resume,          1, "--resume", NULL,          NULL,
+        "Continue an interrupted render.  Nodes listed in " MANIFEST_NAME " in the output directory are skipped "
+        "if their files are unchanged, and are reloaded when a parent still has to be rendered.",{0}},
+  {validate_path,   set_changed,     NULL,                0, "--changed", NULL,         NULL,
+        "Update an earlier render after some tiles changed.  "
+        "The file lists the changed tiles, one path per line, either in full or relative to the source path.  "
+        "Only nodes that overlap a changed tile are rendered.  The others are loaded from the output path.  "
+        "Nodes left without any tile are removed from the output path.",{0}},
+  {validate_path,   set_previous,    NULL,                0, "--previous", NULL,        NULL,
+        "Like --changed, but finds the changed tiles by comparing the source with the tile database (or cache) "
+        "that the earlier render was made from.  Detects tiles that were added, removed, moved or reshaped.",{0}},
   {NULL,            set_dest_file,   NULL,                0, "-f",  "--dest-file",      "default.%.tif",
         "The file name pattern used to save downsampled volumes.  "
         "Different color channels are saved to different volumes.  "
@@ -203,14 +249,17 @@ static int  is_human_readible_size(const char* s)
     any |= (*end==suffixes[i]);
   return (r>0) && any;
 }
-static void set_human_readible_size(const char *s, unsigned *dst) // assumes validated s
+static double human_readible_size(const char *s) // assumes validated s
 { const char *suffixes="kMGPTE"; // 10^[3,6,9,12,15,18]
   char *end=0;
   long i,r=strtol(s,&end,10);
   for(i=0;i<countof(suffixes);++i)
     if(*end==suffixes[i])
       break;
-  *dst=(unsigned) (r*pow(10,3*(i+1)));
+  return r*pow(10,3*(i+1));
+}
+static void set_human_readible_size(const char *s, unsigned *dst) // assumes validated s
+{ *dst=(unsigned)human_readible_size(s);
 }
 
 static int  is_double(const char *s)        { char *end=0; strtod(s,&end); return (end!=s); }
@@ -238,6 +287,11 @@ static int  is_metadata_fmt(const char* s)
   return 0;
 }
 
+static int  is_backend(const char* s)
+{ render_backend_t b;
+  return backend_from_name(s,&b) && backend_available(b);
+}
+
 static int  set_address(opts_t *ctx,const char *s) // assumes validated
 { if(s)
   { char *end=0;
@@ -253,7 +307,17 @@ static int  set_address(opts_t *ctx,const char *s) // assumes validated
 static void set_print_addresses(opts_t *ctx) {ctx->flag_print_addresses=1;}
 static void set_raveler_output(opts_t *ctx)  {ctx->flag_raveler_output=1;}
 static void set_output_ortho(opts_t *ctx)    {ctx->flag_output_ortho=1;}
+static void set_tile_major(opts_t *ctx)      {ctx->flag_tile_major=1;}
+static void set_resume(opts_t *ctx)          {ctx->flag_resume=1;}
+static void set_chunked(opts_t *ctx)         {ctx->flag_chunked=1;}
 static int  set_gpu(opts_t *ctx,const char *s)          {ctx->gpu_id=strtol(s,0,10);                         return 1;}
+static int  set_backend(opts_t *ctx,const char *s)      {return backend_from_name(s,&ctx->backend);}
+static int  set_nthreads(opts_t *ctx,const char *s)     {ctx->nthreads=strtol(s,0,10);                       return 1;}
+static int  set_nwriters(opts_t *ctx,const char *s)     {ctx->nwriters=strtol(s,0,10);                       return 1;}
+static int  set_memory_budget(opts_t *ctx,const char *s){ctx->memory_budget=(size_t)human_readible_size(s);   return 1;}
+static int  set_changed(opts_t *ctx,const char *s)      {ctx->changed=s;                                     return 1;}
+static int  set_previous(opts_t *ctx,const char *s)     {ctx->previous=s;                                    return 1;}
+static int  set_shards(opts_t *ctx,const char *s)       {ctx->flag_sharded=1; ctx->shard_depth=strtol(s,0,10); return 1;}
 static int  set_source_path(opts_t *ctx,const char *s)  {ctx->src=s;                                         return 1;}
 static int  set_output_path(opts_t *ctx,const char *s)  {ctx->dst=s;                                         return 1;}
 static int  set_dest_file(opts_t *ctx,const char *s)    {ctx->dst_pattern=s;                                 return 1;}
@@ -499,6 +563,11 @@ opts_t parseargs(int *argc, char** argv[], int *isok)
       goto Error;
     }
   }
+  // options that don't go together
+  if(opts.flag_sharded && opts.flag_output_ortho)
+  { LOG("\t--ortho can't be used with --shards.\n\tOrthogonal views are saved in node directories, which --shards doesn't make.\n");
+    goto Error;
+  }
 
   *isok=1;
   return opts;
@@ -10,6 +10,7 @@
 #endif
 
 #include "address.h"
+#include "backend.h"
 
 typedef struct _opts_t
 { const char *src;
@@ -34,6 +35,13 @@ typedef struct _opts_t
   double    fov_y_um;
 
   unsigned  flag_output_ortho;
+  unsigned  flag_tile_major;
+  unsigned  flag_resume;
+  unsigned  flag_chunked;
+  unsigned  flag_sharded;
+  unsigned  shard_depth; // address steps that pick a node's shard.  See --shards.
+  const char *changed;  // if not NULL, a file listing tiles that changed since the last render.
+  const char *previous; // if not NULL, the tile database the last render was made from.
 
   // input/output filtering
   float input_filter_scale_thresh; ///< scale threshold for applying input prefiltering.  Scale is (input pixel size)/(output pixel size).
@@ -48,6 +56,10 @@ typedef struct _opts_t
 
   address_t target; // if not NULL, will try to render target from it's children.
   int gpu_id;
+  render_backend_t backend;
+  unsigned nthreads;
+  unsigned nwriters;
+  size_t   memory_budget;
 } opts_t;
 
 opts_t parseargs(int *argc, char** argv[], int *isok);
@@ -0,0 +1,397 @@
+/**
+ * \file
+ * A pool of arrays sorted into size classes.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "src/util/thread.h"
+#include "pool.h"
+
+#ifdef _MSC_VER
+#include <malloc.h>
+#endif
+
+#define ENDL        "\n"
+#define LOG(...)    fprintf(stderr,__VA_ARGS__)
+#define TRY(e)      do{if(!(e)) { LOG("%s(%d): %s()"ENDL "\tExpression evaluated as false."ENDL "\t%s"ENDL,__FILE__,__LINE__,__FUNCTION__,#e); goto Error;}} while(0)
+#define NEW(T,e,N)  TRY((e)=(T*)malloc(sizeof(T)*(N)))
+#define ZERO(T,e,N) memset((e),0,sizeof(T)*(N))
+
+#define NCLASSES  200 ///< 4 per power of two from 4 KiB.  The last one holds 7<<59 bytes.
+#define NPLACES   2   ///< host and device
+
+typedef struct _block_t block_t;
+struct _block_t
+{ nd_t      a;
+  void     *mem;    ///< host memory behind a.  NULL for device buffers, which nd manages.
+  size_t    cap;    ///< bytes
+  unsigned  cls;
+  unsigned  place;  ///< 0 for the host, 1 for the device
+  int       inuse;
+  block_t  *next;   ///< in the free list of its class
+};
+
+struct _pool_t
+{ block_t  *free[NPLACES][NCLASSES];
+  block_t **index;    ///< open addressing hash table from nd_t to block.  Holds every block.
+  size_t    nindex,   ///< number of slots.  Power of two.
+            nblocks;
+  size_t    allocated,inuse,peak; ///< bytes
+  size_t    max_free; ///< bytes kept in free buffers.  0 for no limit.
+  tbmutex_t lock;
+};
+
+static size_t class_bytes(unsigned c)
+{ return (size_t)(4+(c&3))<<((c>>2)+10); // 4,5,6,7 KiB, then 8,10,12,14 KiB, ...
+}
+
+/** \returns the smallest class that holds \a nbytes.  NCLASSES or more if there isn't one. */
+static unsigned class_of(size_t nbytes)
+{ size_t kib=(nbytes>>10)+((nbytes&1023)!=0),j; // rounding up this way can't overflow
+  unsigned e=0;
+  if(kib<=4) return 0;
+  while((kib>>e)>=8) ++e;         // now kib is in [4<<e,8<<e)
+  j=(kib+((size_t)1<<e)-1)>>e;    // in [4,8]
+  if(j==8) { ++e; j=4; }
+  return 4*e+(unsigned)(j-4);
+}
+
+static unsigned place_of(render_backend_t where)
+{ return where==RENDER_BACKEND_GPU;
+}
+
+static size_t hash(nd_t a, size_t n)
+{ return (size_t)((((uint64_t)(uintptr_t)a)>>4)*0x9E3779B97F4A7C15ULL>>17)&(n-1);
+}
+
+/** \returns the slot in \a index that holds \a a, or the empty slot where it would go. */
+static block_t** slot(block_t **index, size_t n, nd_t a)
+{ size_t i=hash(a,n);
+  while(index[i] && index[i]->a!=a)
+    i=(i+1)&(n-1);
+  return index+i;
+}
+
+static unsigned add_to_index(pool_t self, block_t *b)
+{ if(2*(self->nblocks+1)>self->nindex) // keep the table at most half full
+  { size_t i,n=self->nindex?2*self->nindex:64;
+    block_t **index;
+    NEW(block_t*,index,n);
+    ZERO(block_t*,index,n);
+    for(i=0;i<self->nindex;++i)
+      if(self->index[i])
+        *slot(index,n,self->index[i]->a)=self->index[i];
+    free(self->index);
+    self->index=index;
+    self->nindex=n;
+  }
+  *slot(self->index,self->nindex,b->a)=b;
+  ++self->nblocks;
+  return 1;
+Error:
+  return 0;
+}
+
+/** Takes \a b out of the index.  Later blocks in its run move up so lookups still find them. */
+static void remove_from_index(pool_t self, block_t *b)
+{ const size_t n=self->nindex;
+  size_t i=slot(self->index,n,b->a)-self->index,j=i;
+  self->index[i]=0;
+  --self->nblocks;
+  while(self->index[j=(j+1)&(n-1)])
+  { const size_t k=hash(self->index[j]->a,n); // where it wants to be
+    if((i<j)?(i<k && k<=j):(i<k || k<=j))     // already as close as it can get
+      continue;
+    self->index[i]=self->index[j];
+    self->index[j]=0;
+    i=j;
+  }
+}
+
+static block_t* find(pool_t self, nd_t a)
+{ return self->nindex?*slot(self->index,self->nindex,a):0;
+}
+
+static void* aligned_malloc(size_t nbytes)
+{
+#ifdef _MSC_VER
+  return _aligned_malloc(nbytes,POOL_ALIGNMENT);
+#else
+  void *p=0;
+  return posix_memalign(&p,POOL_ALIGNMENT,nbytes)?0:p;
+#endif
+}
+
+static void aligned_free(void *p)
+{
+#ifdef _MSC_VER
+  _aligned_free(p);
+#else
+  free(p);
+#endif
+}
+
+static void free_block(block_t *b)
+{ if(!b) return;
+  if(b->mem)
+  { ndref(b->a,0,nd_unknown_kind); // the pool owns the memory
+    aligned_free(b->mem);
+  }
+  ndfree(b->a);
+  free(b);
+}
+
+/** Allocates a block of class \a c.  Called without the lock held. */
+static block_t* make_block(unsigned c, unsigned place)
+{ block_t *b=0;
+  nd_t shape=0;
+  NEW(block_t,b,1);
+  ZERO(block_t,b,1);
+  b->cap=class_bytes(c);
+  b->cls=c;
+  b->place=place;
+  if(place)
+  { size_t n=b->cap;
+    TRY(shape=ndreshape(ndcast(ndinit(),nd_u8),1,&n));
+    TRY(b->a=ndcuda(shape,0));
+  } else
+  { TRY(b->mem=aligned_malloc(b->cap));
+    TRY(b->a=ndref(ndinit(),b->mem,nd_heap));
+  }
+  ndfree(shape);
+  return b;
+Error:
+  ndfree(shape);
+  free_block(b);
+  return 0;
+}
+
+static unsigned same_shape(nd_t a, nd_type_id_t type, unsigned ndim, const size_t *shape)
+{ return ndtype(a)==type && ndndim(a)==ndim && 0==memcmp(ndshape(a),shape,ndim*sizeof(*shape));
+}
+
+/** Gives the array in \a b its new shape. */
+static nd_t shape_block(block_t *b, nd_type_id_t type, unsigned ndim, const size_t *shape)
+{ if(same_shape(b->a,type,ndim,shape))
+    return b->a;
+  TRY(ndreshape(ndcast(b->a,type),ndim,shape));
+  if(b->place)
+    TRY(ndCudaSyncShape(b->a)); // the device keeps a copy of the shape
+  return b->a;
+Error:
+  return 0;
+}
+
+static size_t type_bytes(nd_type_id_t type)
+{ switch(type)
+  { case nd_u8:  case nd_i8:                return 1;
+    case nd_u16: case nd_i16:               return 2;
+    case nd_u32: case nd_i32: case nd_f32:  return 4;
+    case nd_u64: case nd_i64: case nd_f64:  return 8;
+    default: return 0;
+  }
+}
+
+/** \returns SIZE_MAX if the count overflows, which no class holds. */
+static size_t count_bytes(nd_type_id_t type, unsigned ndim, const size_t *shape)
+{ size_t n=type_bytes(type);
+  unsigned i;
+  for(i=0;i<ndim;++i)
+  { if(shape[i] && n>SIZE_MAX/shape[i])
+      return SIZE_MAX;
+    n*=shape[i];
+  }
+  return n;
+}
+
+/**
+ * \returns a free block of class \a c, or 0.  Bigger classes aren't tried,
+ * so a buffer is never more than 25% larger than asked for.  Call with the
+ * lock held.
+ */
+static block_t* pop_free(pool_t self, unsigned c, unsigned place)
+{ block_t *b=self->free[place][c];
+  if(b)
+  { self->free[place][c]=b->next;
+    b->next=0;
+  }
+  return b;
+}
+
+static void mark_used(pool_t self, block_t *b)
+{ b->inuse=1;
+  self->inuse+=b->cap;
+  if(self->inuse>self->peak)
+    self->peak=self->inuse;
+}
+
+pool_t pool_make(void)
+{ pool_t self=0;
+  NEW(struct _pool_t,self,1);
+  ZERO(struct _pool_t,self,1);
+  MutexInit(&self->lock);
+  return self;
+Error:
+  return 0;
+}
+
+/**
+ * Limits the bytes kept in free buffers to \a max_free.  A buffer put back
+ * beyond that is freed instead of kept for reuse.  0, the default, keeps
+ * every buffer until the pool is freed.
+ */
+void pool_set_limit(pool_t self, size_t max_free)
+{ MutexLock(&self->lock);
+  self->max_free=max_free;
+  MutexUnlock(&self->lock);
+}
+
+/** Frees every buffer, including ones that weren't put back. */
+void pool_free(pool_t self)
+{ size_t i;
+  if(!self) return;
+  if(self->nblocks)
+    LOG("Buffer pool: %u buffers, %g MB allocated, %g MB at peak"ENDL,
+        (unsigned)self->nblocks,self->allocated*1e-6,self->peak*1e-6);
+  for(i=0;i<self->nindex;++i)
+    free_block(self->index[i]);
+  free(self->index);
+  MutexFree(&self->lock);
+  free(self);
+}
+
+/**
+ * Gets an array with the given type and shape from the pool.
+ * \param[in] where  RENDER_BACKEND_GPU for device memory, otherwise host memory.
+ * \returns 0 on failure.  The contents are not initialized.  Return the
+ *          array with pool_put().  Don't free it.
+ */
+nd_t pool_get(pool_t self, render_backend_t where, nd_type_id_t type, unsigned ndim, const size_t *shape)
+{ const unsigned place=place_of(where);
+  unsigned c;
+  block_t *b;
+  nd_t out;
+  TRY(self);
+  c=class_of(count_bytes(type,ndim,shape));
+  TRY(c<NCLASSES);
+  MutexLock(&self->lock);
+  if((b=pop_free(self,c,place)))
+    mark_used(self,b);
+  MutexUnlock(&self->lock);
+  if(!b)
+  { TRY(b=make_block(c,place));
+    MutexLock(&self->lock);
+    if(add_to_index(self,b))
+    { self->allocated+=b->cap;
+      mark_used(self,b);
+    } else
+    { free_block(b);
+      b=0;
+    }
+    MutexUnlock(&self->lock);
+    TRY(b);
+  }
+  if(!(out=shape_block(b,type,ndim,shape)))
+    pool_put(self,b->a);
+  return out;
+Error:
+  return 0;
+}
+
+/**
+ * Gives \a a a new type and shape.  \a a is reshaped in place if it's big
+ * enough.  Otherwise it's put back and a bigger array is taken from the pool.
+ * \param[in] a  An array from pool_get(), or NULL to get a new one.
+ * \returns the array, or 0 on failure.  Either way, don't use \a a again
+ *          unless it was returned.
+ */
+nd_t pool_fit(pool_t self, render_backend_t where, nd_t a, nd_type_id_t type, unsigned ndim, const size_t *shape)
+{ block_t *b;
+  nd_t out;
+  if(!a)
+    return pool_get(self,where,type,ndim,shape);
+  MutexLock(&self->lock);
+  b=find(self,a);
+  MutexUnlock(&self->lock);
+  TRY(b && b->inuse);
+  if(b->place==place_of(where) && count_bytes(type,ndim,shape)<=b->cap)
+  { if(!(out=shape_block(b,type,ndim,shape)))
+      pool_put(self,a);
+    return out;
+  }
+  TRY(pool_put(self,a)>0);
+  return pool_get(self,where,type,ndim,shape);
+Error:
+  return 0;
+}
+
+/**
+ * Returns \a a to the pool.  If that takes the free buffers over the limit
+ * set with pool_set_limit(), \a a is freed.
+ * \returns 1 on success, 0 if \a a didn't come from the pool (it's left
+ *          alone), and -1 if it was already put back.
+ */
+int pool_put(pool_t self, nd_t a)
+{ block_t *b,*trim=0;
+  int out=1;
+  if(!self || !a) return 0;
+  MutexLock(&self->lock);
+  if(!(b=find(self,a)))
+    out=0;
+  else if(!b->inuse)
+    out=-1;
+  else
+  { b->inuse=0;
+    self->inuse-=b->cap;
+    if(self->max_free && self->allocated-self->inuse>self->max_free)
+    { remove_from_index(self,b);
+      self->allocated-=b->cap;
+      trim=b;
+    } else
+    { b->next=self->free[b->place][b->cls];
+      self->free[b->place][b->cls]=b;
+    }
+  }
+  MutexUnlock(&self->lock);
+  free_block(trim);
+  if(out<0)
+    LOG("%s(%d): %s()"ENDL "\tBuffer was put back twice."ENDL,__FILE__,__LINE__,__FUNCTION__);
+  return out;
+}
+
+/** Sets aside \a n free buffers that can each hold \a nbytes. */
+unsigned pool_reserve(pool_t self, render_backend_t where, size_t nbytes, unsigned n)
+{ const unsigned c=class_of(nbytes),place=place_of(where);
+  unsigned i;
+  TRY(self && c<NCLASSES);
+  for(i=0;i<n;++i)
+  { block_t *b;
+    unsigned ok;
+    TRY(b=make_block(c,place));
+    MutexLock(&self->lock);
+    if((ok=add_to_index(self,b)))
+    { self->allocated+=b->cap;
+      b->next=self->free[place][c];
+      self->free[place][c]=b;
+    }
+    MutexUnlock(&self->lock);
+    if(!ok)
+    { free_block(b);
+      goto Error;
+    }
+  }
+  return 1;
+Error:
+  return 0;
+}
+
+/** Bytes allocated by the pool, the bytes in buffers that are out, and the most that were out at once. */
+void pool_stats(pool_t self, size_t *allocated, size_t *inuse, size_t *peak)
+{ MutexLock(&self->lock);
+  if(allocated) *allocated=self->allocated;
+  if(inuse)     *inuse    =self->inuse;
+  if(peak)      *peak     =self->peak;
+  MutexUnlock(&self->lock);
+}
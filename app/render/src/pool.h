@@ -0,0 +1,39 @@
+/**
+ * \file
+ * A pool of arrays for the render's node buffers, tile staging buffers and
+ * filter workspaces.
+ *
+ * Memory is handed out in size classes.  There are four classes per power
+ * of two, so a buffer is never more than 25% larger than asked for.  Each
+ * class keeps a free list, so getting and putting buffers takes constant
+ * time.  Released buffers are kept for reuse until the pool is freed, up to
+ * a limit on the bytes kept in free buffers (see pool_set_limit()).
+ *
+ * Host buffers are aligned to POOL_ALIGNMENT bytes.  Contents are not
+ * initialized; callers that don't overwrite every voxel fill the array
+ * themselves.  All functions are thread safe.
+ */
+#pragma once
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "nd.h"
+#include "backend.h"
+
+#define POOL_ALIGNMENT 64 ///< bytes.  A cache line, and wide enough for any SIMD load.
+
+typedef struct _pool_t* pool_t;
+
+pool_t   pool_make   (void);
+void     pool_free   (pool_t self);
+void     pool_set_limit(pool_t self, size_t max_free);
+nd_t     pool_get    (pool_t self, render_backend_t where, nd_type_id_t type, unsigned ndim, const size_t *shape);
+nd_t     pool_fit    (pool_t self, render_backend_t where, nd_t a, nd_type_id_t type, unsigned ndim, const size_t *shape);
+int      pool_put    (pool_t self, nd_t a);
+unsigned pool_reserve(pool_t self, render_backend_t where, size_t nbytes, unsigned n);
+void     pool_stats  (pool_t self, size_t *allocated, size_t *inuse, size_t *peak);
+
+#ifdef __cplusplus
+} //extern "C"
+#endif
@@ -17,6 +17,10 @@
 #include "xform.h"
 #include "address.h"
 #include "subdiv.h"
+#include "backend.h"
+#include "writer.h"
+#include "pool.h"
+#include "src/util/thread.h"
 #include <math.h> //for sqrt
 #include "tictoc.h" // for profiling
 #if HAVE_CUDA
@@ -99,18 +103,22 @@ static void dump(const char *filename,nd_t a)
 // === RENDERING ===
 
 typedef struct _filter_workspace
-{ nd_t filters[3];  ///< filter for each axis
-  nd_t gpu[2];      ///< double buffer on gpu for serial seperable convolutions
+{ nd_t filters[3];  ///< filter for each axis.  Shared (see aa_filter()), so don't change or free them.
+  float scales[3];  ///< the transform's scales the filters were picked for (see compute_aa_filters())
+  int has_scales;   ///< 0 until scales is set
+  nd_t gpu[2];      ///< double buffer on the backend's device for serial seperable convolutions.  From pool.
   int enable[3];    ///< enable filtering for the corresponding axis
   float scale_thresh;
-  unsigned capacity;///< capacity of alloc'd gpu buffers
   unsigned i;       ///< current gpu buffer
   nd_conv_params_t params;
+  render_backend_t backend;
+  pool_t pool;      ///< see desc_t
 } filter_workspace;
 
 typedef struct _affine_workspace
-{ nd_t host_xform,gpu_xform;
+{ nd_t host_xform,gpu_xform; ///< gpu_xform is only used by the GPU backend
   nd_affine_params_t params;
+  render_backend_t backend;
 } affine_workspace;
 
 /// Common arguments and memory context used for building the tree
@@ -123,17 +131,26 @@ struct _desc_t
   size_t countof_leaf;
   void *args; // extra arguments to pass to yield()
   handler_t yield;
+  done_t   done;   // may be NULL.  See struct render.
+  loader_t loader;
+  const aabb3_t *changed;
+  size_t   nchanged;
+  discard_t discard; // may be NULL.  See struct render.
+  render_backend_t backend; // resolved; never RENDER_BACKEND_AUTO
 
   /* WORKSPACE */
   nd_t ref;
-  int  nbufs;
-  nd_t *bufs; //Need 1 for each node on path in tree - so pathlength(root,leaf)
-  int  *inuse;
+  pool_t pool;     // node buffers, tile staging buffers and filter buffers.  Shared by the workers in render_parallel().
+  int  nbufs;      // node buffers set aside in the pool when the reference shape is first set.  Need 1 for each node on path in tree - so pathlength(root,leaf)
   filter_workspace input_fws;
   filter_workspace output_fws;
   affine_workspace aws;
   float *transform;
   size_t free,total;
+  unsigned char *hits; ///< hits[i] is 1 if tile i intersects the current leaf (see select_tiles())
+  octree_t tree;       ///< geometry of the subdivision tree
+  aabb_t  *cboxes;     ///< one child box for each level of the tree.  Reused during traversal.
+  int      ncboxes;
 
   /* INTERFACE */
   /* Returns an array that fills the bounding box \a bbox that corresponds to
@@ -208,46 +225,116 @@ static desc_t make_desc(const struct render *opts, tiles_t tiles, handler_t yiel
   out.countof_leaf=opts->countof_leaf;
   out.args=args;
   out.yield=yield;
+  out.done=opts->done;
+  out.loader=opts->loader;
+  out.changed=opts->changed;
+  out.nchanged=opts->nchanged;
+  out.discard=opts->discard;
+  out.backend=backend_resolve(opts->backend);
   filter_workspace__init(&out.input_fws);
   out.input_fws.scale_thresh=opts->input_filter_scale_thresh;
+  out.input_fws.backend=out.backend;
 
   filter_workspace__init(&out.output_fws);
   out.output_fws.scale_thresh=opts->output_filter_scale_thresh;
+  out.output_fws.backend=out.backend;
   compute_output_filters(&out.output_fws,
       opts->output_filter_size_nm[0]/(float)out.x_nm,
       opts->output_filter_size_nm[1]/(float)out.y_nm,
       opts->output_filter_size_nm[2]/(float)out.z_nm);
 
   affine_workspace__init(&out.aws);
+  out.aws.backend=out.backend;
 
   out.make=render_child;
   return out;
 }
 
+/** Makes \a pool the one \a desc and its filter workspaces take buffers from. */
+static void set_pool(desc_t *desc, pool_t pool)
+{ desc->pool=pool;
+  desc->input_fws.pool=pool;
+  desc->output_fws.pool=pool;
+}
+
+/**
+ * \returns opts->memory_budget, or, if that's 0, half the free memory of
+ * \a backend.  0 if that isn't known either.
+ */
+static size_t memory_budget(const struct render *opts, render_backend_t backend)
+{ size_t free,total;
+  if(opts->memory_budget)
+    return opts->memory_budget;
+  if(backend_mem_info(backend,&free,&total))
+    return free/2; // leave room for tiles and workspaces
+  return 0;
+}
+
+/** Makes the buffer pool.  Buffers it keeps for reuse are limited to the memory budget. */
+static unsigned make_pool(desc_t *desc, const struct render *opts)
+{ pool_t pool;
+  TRY(pool=pool_make());
+  pool_set_limit(pool,memory_budget(opts,desc->backend));
+  set_pool(desc,pool);
+  return 1;
+Error:
+  return 0;
+}
+
 static void cleanup_desc(desc_t *desc)
 { size_t i;
   ndfree(desc->ref);
-  for(i=0;i<desc->nbufs;++i)
-    ndfree(desc->bufs[i]);
+  pool_free(desc->pool); // frees the filter buffers too
   if(desc->transform) free(desc->transform);
+  if(desc->hits) free(desc->hits);
+  for(i=0;i<desc->ncboxes;++i)
+    AABBFree(desc->cboxes[i]);
+  if(desc->cboxes) free(desc->cboxes);
 }
 
-static unsigned isleaf(const desc_t*const desc, aabb_t bbox)
-{ int64_t c=(int64_t)(AABBVolume(bbox)/(double)desc->voxvol_nm3);
+static unsigned isleaf_by_volume(const desc_t*const desc, double volume_nm3)
+{ int64_t c=(int64_t)(volume_nm3/(double)desc->voxvol_nm3);
   return c<(int64_t)desc->countof_leaf;
 }
 
-/// Count path length from the current node to a leaf
+static unsigned isleaf(const desc_t*const desc, aabb_t bbox)
+{ return isleaf_by_volume(desc,AABBVolume(bbox));
+}
+
+/** 
+ * Count path length from the current node to a leaf.
+ * Follows the last child, which gets the remainder when a box is split, so
+ * this is the longest path.
+ */
 static int pathlength(desc_t *desc, aabb_t bbox)
-{ int i,n=0;
-  aabb_t *cboxes=0;
-  ALLOCA(aabb_t,cboxes,desc->nchildren);
-  ZERO(  aabb_t,cboxes,desc->nchildren);
-  if(isleaf(desc,bbox)) return 1;
-  AABBBinarySubdivision(cboxes,(unsigned)desc->nchildren,bbox);
-  n=pathlength(desc,cboxes[0]);
-  for(i=0;i<desc->nchildren;++i) AABBFree(cboxes[i]);
-  return n+1;
+{ int n=1;
+  aabb3_t b;
+  TRY(AABB3FromAABB(&b,bbox));
+  while(!isleaf_by_volume(desc,AABB3Volume(&b)))
+  { b=OctreeChild(&desc->tree,&b,(unsigned)desc->nchildren-1);
+    ++n;
+  }
+  return n;
+Error:
+  return 0;
+}
+
+/** 
+ * Sets up the tree geometry rooted at \a bbox and allocates a child box for
+ * each level of the tree for use by render_node().
+ */
+static int prepare_tree(desc_t *desc, aabb_t bbox)
+{ aabb3_t root;
+  int i,n;
+  TRY(AABB3FromAABB(&root,bbox));
+  TRY(OctreeInit(&desc->tree,&root,(unsigned)desc->nchildren));
+  TRY(n=pathlength(desc,bbox));
+  NEW(aabb_t,desc->cboxes,n);
+  ZERO(aabb_t,desc->cboxes,n);
+  desc->ncboxes=n;
+  for(i=0;i<n;++i)
+    TRY(desc->cboxes[i]=AABBMake(3));
+  return 1;
 Error:
   return 0;
 }
@@ -256,10 +343,6 @@ Error:
 static int preallocate(desc_t *desc, aabb_t bbox)
 { size_t n;
   TRY(n=pathlength(desc,bbox));
-  NEW(nd_t,desc->bufs,n);
-  ZERO(nd_t,desc->bufs,n);
-  NEW(int,desc->inuse,n);
-  ZERO(int,desc->inuse,n);
   desc->nbufs=(int)n;
   return 1;
 Error:
@@ -269,92 +352,61 @@ Error:
 static int preallocate_for_render_one_target(desc_t *desc, aabb_t bbox)
 { size_t n=2;
   //TRY(n=pathlength(desc,bbox));
-  NEW(nd_t,desc->bufs,n);
-  ZERO(nd_t,desc->bufs,n);
-  NEW(int,desc->inuse,n);
-  ZERO(int,desc->inuse,n);
   desc->nbufs=(int)n;
   return 1;
-Error:
-  return 0;
 }
 
+/**
+ * Sets the reference shape and, the first time, sets aside desc->nbufs node
+ * buffers of desc->countof_leaf voxels in the pool.
+ * Pools whose size isn't known yet can be left empty by setting desc->ref
+ * directly; alloc_vol() gets buffers from the pool as they are needed.
+ */
 static desc_t* set_ref_shape(desc_t *desc, nd_t v)
-{ nd_t t;
-  if(desc->ref) // init first time only
+{ if(desc->ref) // init first time only
   { TRY(ndreshape(ndcast(desc->ref,ndtype(v)),ndndim(v),ndshape(v))); // update reference shape
     return desc;
   }
   TRY(ndreshape(ndcast(desc->ref=ndinit(),ndtype(v)),ndndim(v),ndshape(v)));
-  { int i;    // preallocate gpu bufs with pixel type corresponding to input
-    TRY(ndShapeSet(ndcast(t=ndinit(),ndtype(desc->ref)),0,desc->countof_leaf));
-    for(i=0;i<desc->nbufs;++i)
-      TRY(desc->bufs[i]=NDCUDA(t,0));
-  }
+  if(desc->nbufs && ndnelem(v)) // with the pixel type corresponding to input
+    TRY(pool_reserve(desc->pool,desc->backend,desc->countof_leaf*(ndnbytes(v)/ndnelem(v)),(unsigned)desc->nbufs));
   return desc;
 Error:
-  LOG("\t[nd Error]:"ENDL "\t%s"ENDL,nderror(t));
   return 0;
 }
 
-static int sum(int n, const int*const v)
-{ int i,o=0;
-  for(i=0;i<n;++i) o+=v[i];
-  return o;
-}
-
-static unsigned same_shape_by_res(nd_t v, int64_t*restrict shape_nm, int64_t*restrict res, size_t ndim)
-{ size_t i,*vs;
-  vs=ndshape(v);
-  for(i=0;i<ndim;++i)
-    if(vs[i]!=(shape_nm[i]/res[i]))
-      return 0;
-  return 1;
-}
-
+/**
+ * Gets a buffer for the node that fills \a bbox at the given resolution.
+ * Nodes are composed from tiles or children that need not cover every voxel,
+ * so the buffer starts out filled with the boundary value.
+ */
 static nd_t alloc_vol(desc_t *desc, aabb_t bbox, int64_t x_nm, int64_t y_nm, int64_t z_nm)
-{ nd_t v;
+{ nd_t v=0;
   int64_t *shape_nm;
   int64_t  res[]={x_nm,y_nm,z_nm};
-  size_t ndim,i,j;
-  int resize=1;
+  size_t ndim,i,*shape;
+  TRY(desc->ref);                               // see set_ref_shape()
   AABBGet(bbox,&ndim,0,&shape_nm);
-  for(i=0;i<desc->nbufs && desc->inuse[i];++i); // search for first unused - preferably with correct shape
-  for(j=i;j<desc->nbufs;++j)
-  { if(!desc->inuse[j] && same_shape_by_res(desc->bufs[j],shape_nm,res,ndim))
-    { i=j;
-      resize=0;
-      break;
-    }
-  }
-  TRY(i<desc->nbufs);                           // check that one was available
-  TRY(v=desc->bufs[i]);                         // ensure bufs was init'd - see set_ref_shape()
-  desc->inuse[i]=1;
-  DBG("    alloc_vol(): [%3u] buf=%u"ENDL,(unsigned)sum(desc->nbufs,desc->inuse),(unsigned)i);
-  if(resize)
-  { for(i=0;i<ndim && i<countof(res);++i) // set spatial dimensions
-      TRY(ndShapeSet(v,(unsigned)i,shape_nm[i]/res[i]));
-    for(;i<ndndim(desc->ref);++i) // other dimensions are same as input
-      TRY(ndShapeSet(v,(unsigned)i,ndshape(desc->ref)[i]));
-    TRY(ndCudaSyncShape(v)); // expensive...worth avoiding
-  }
+  ALLOCA(size_t,shape,ndndim(desc->ref));
+  for(i=0;i<ndim && i<countof(res);++i)         // set spatial dimensions
+    shape[i]=shape_nm[i]/res[i];
+  for(;i<ndndim(desc->ref);++i)                 // other dimensions are same as input
+    shape[i]=ndshape(desc->ref)[i];
+  TRY(v=pool_get(desc->pool,desc->backend,ndtype(desc->ref),ndndim(desc->ref),shape));
+  DBG("    alloc_vol(): %g MB"ENDL,ndnbytes(v)*1e-6);
   TRY(ndfill(v,(uint64_t)(desc->aws.params.boundary_value)));
   return v;
 Error:
+  if(v) pool_put(desc->pool,v);
   return 0;
 }
 
 static unsigned release_vol(desc_t *desc,nd_t a)
-{ size_t i;
+{ int r;
   if(!a) return 0;
-  for(i=0;i<desc->nbufs && desc->bufs[i]!=a;++i) {} // search for buffer corresponding to a
-  DBG("    release_vol(): buf=%u"ENDL,(unsigned)i);
-  if(i>=desc->nbufs)                                // if a is not from the managed pool, just free it
-  { ndfree(a);
-    return 1;
-  }
-  TRY(desc->inuse[i]);                              // ensure it was marked inuse. (sanity check)
-  desc->inuse[i]=0;
+  TRY((r=pool_put(desc->pool,a))>=0);           // fails if it was released already (sanity check)
+  if(r==0)                                      // if a is not from the pool (e.g. from desc->loader), just free it
+    ndfree(a);
   return 1;
 Error:
   return 0;
@@ -372,28 +424,15 @@ static unsigned same_shape(nd_t a, nd_t b)
 }
 
 static unsigned filter_workspace__gpu_resize(filter_workspace *ws, nd_t vol)
-{
-#if HAVE_CUDA
+{ unsigned i;
+  if(ws->backend==RENDER_BACKEND_GPU)
   { size_t free,total;
-    cudaMemGetInfo(&free,&total);
+    backend_mem_info(ws->backend,&free,&total);
     LOG("GPU Mem:\t%6.2f free\t%6.2f total\n",free/1e6,total/1e6);
   }
-
-  if(!ws->gpu[0])
-  { TRY(ws->gpu[0]=NDCUDA(vol,0));
-    TRY(ws->gpu[1]=NDCUDA(vol,0));
-    ws->capacity=(unsigned)ndnbytes(ws->gpu[0]);
-  }
-
-  if(!same_shape(ws->gpu[0],vol))
-  { ndreshape(ws->gpu[0],ndndim(vol),ndshape(vol));
-    ndreshape(ws->gpu[1],ndndim(vol),ndshape(vol));
-    ndCudaSyncShape(ws->gpu[0]); // the cuda transfer can get expensive so it's worth avoiding these calls
-    ndCudaSyncShape(ws->gpu[1]);
-    ws->capacity=(unsigned)ndnbytes(ws->gpu[0]);
-  }
+  for(i=0;i<countof(ws->gpu);++i) // reshaped in place unless they're too small.  The cuda transfer can get expensive so it's worth avoiding.
+    TRY(ws->gpu[i]=pool_fit(ws->pool,ws->backend,ws->gpu[i],ndtype(vol),ndndim(vol),ndshape(vol)));
   return 1;
-#endif
 Error:
   return 0;
 }
@@ -409,38 +448,45 @@ Error:
   return 0;
 }
 
+/**
+ * Picks the input filters for \a transform.
+ * Tiles that share a scale share their filters, so nothing is done when the
+ * scales haven't changed since the last call.
+ */
 static int compute_aa_filters(filter_workspace *ws, float *transform, size_t ndim) 
-{
-  unsigned i=0;
-  for(i=0;i<3;++i) {
-    nd_t f=0;
-    // ndim+1 for width of transform matrix, ndim+2 to address diagonals
-    TIME(f=make_aa_filter(0.5f,transform[i*(ndim+2)],ws->scale_thresh,ws->filters[i]));
+{ float s[3];
+  unsigned i;
+  for(i=0;i<3;++i) // ndim+1 for width of transform matrix, ndim+2 to address diagonals
+    s[i]=transform[i*(ndim+2)];
+  if(ws->has_scales && s[0]==ws->scales[0] && s[1]==ws->scales[1] && s[2]==ws->scales[2])
+    return 1;
+  for(i=0;i<3;++i)
+  { nd_t f=aa_filter(0.5f,s[i],ws->scale_thresh);
     ws->enable[i] = (f!=NULL);
     if(f)
       ws->filters[i]=f;
   }
+  memcpy(ws->scales,s,sizeof(s));
+  ws->has_scales=1;
   return 1;
-Error:
-  return 0;
 }
 
 static int compute_output_filters(filter_workspace *ws, float sx, float sy, float sz)
-{ nd_t f=0;
-  f=make_aa_filter(1.0f,sx,ws->scale_thresh,ws->filters[0]);
-  ws->enable[0]=(f!=NULL);
-  if(f) ws->filters[0]=f;
-  
-  f=make_aa_filter(1.0f,sy,ws->scale_thresh,ws->filters[1]);
-  ws->enable[1]=(f!=NULL);
-  if(f) ws->filters[1]=f;
-
-  f=make_aa_filter(1.0f,sz,ws->scale_thresh,ws->filters[2]);
-  ws->enable[2]=(f!=NULL);
-  if(f) ws->filters[2]=f;
+{ const float s[3]={sx,sy,sz};
+  unsigned i;
+  for(i=0;i<3;++i)
+  { nd_t f=aa_filter(1.0f,s[i],ws->scale_thresh);
+    ws->enable[i]=(f!=NULL);
+    if(f) ws->filters[i]=f;
+  }
+  ws->has_scales=0;
   return 1;
-Error:
-  return 0;
+}
+
+static nd_t conv1(filter_workspace *ws, nd_t dst, nd_t src, unsigned idim)
+{ if(ws->backend==RENDER_BACKEND_CPU)
+    return cpu_conv1(dst,src,ws->filters[idim],idim,&ws->params);
+  return ndconv1(dst,src,ws->filters[idim],idim,&ws->params);
 }
 
 /**
@@ -460,7 +506,7 @@ static nd_t aafilt(nd_t vol, filter_workspace *ws)
   DUMP("aafilt-src.%.tif",ws->gpu[0]);
   for(i=0,j=0;i<3;++i)
     if(ws->enable[i]) 
-    { TIME(TRY(ndconv1(ws->gpu[~j&1],ws->gpu[j&1],ws->filters[j],j,&ws->params)));
+    { TIME(TRY(conv1(ws,ws->gpu[~j&1],ws->gpu[j&1],j)));
       ++j;
     }
   ws->i=j&1; // this will be the index of the last destination buffer
@@ -484,7 +530,13 @@ Error:
 #endif
 
 static nd_t xform(nd_t dst, nd_t src, float *transform, affine_workspace *ws)
-{ TRY(affine_workspace__gpu_resize(ws,dst));
+{ if(ws->backend==RENDER_BACKEND_CPU)
+  { DUMP("xform-src.%.tif",src);
+    TRY(cpu_affine(dst,src,transform,&ws->params)); // the transform stays in host memory
+    DUMP("xform-dst.%.tif",dst);
+    return dst;
+  }
+  TRY(affine_workspace__gpu_resize(ws,dst));
   TRY(ndref(ws->host_xform,transform,nd_heap));
   TRY(ndcopy(ws->gpu_xform,ws->host_xform,0,0));
   DUMP("xform-src.%.tif",src);
@@ -496,11 +548,25 @@ Error:
   return 0;
 }
 
-static int any_tiles_in_box(tile_t *tiles, size_t ntiles, aabb_t bbox)
-{ size_t i;
-  for(i=0;i<ntiles;++i)
-    if(AABBHit(bbox,TileAABB(tiles[i])))
-      return 1;
+static int any_tiles_in_box(tiles_t tiles, aabb_t bbox)
+{ aabb3_t q;
+  TRY(AABB3FromAABB(&q,bbox));
+  return TileBaseHitMany(tiles,0,&q)>0;
+Error:
+  return 0;
+}
+
+/**
+ * Marks the tiles whose footprints intersect \a bbox in \a desc->hits.
+ * \returns the number of hit tiles.
+ */
+static size_t select_tiles(desc_t *desc, aabb_t bbox)
+{ aabb3_t q;
+  if(!desc->hits)
+    NEW(unsigned char,desc->hits,TileBaseCount(desc->tiles)+1);
+  TRY(AABB3FromAABB(&q,bbox));
+  return TileBaseHitMany(desc->tiles,desc->hits,&q);
+Error:
   return 0;
 }
 
@@ -511,75 +577,267 @@ static unsigned crop(nd_t vol,nd_t crop) {
   return 1;
 }
 
+/** Sets up the parts of \a desc that depend on the input.  \a shape is the shape of the first tile. */
+static unsigned setup_input(desc_t *desc, nd_t shape)
+{ unsigned n=ndndim(shape);
+  if(!desc->transform)
+    NEW(float,desc->transform,(n+1)*(n+1));   // FIXME: pretty sure this is a memory leak.  transform get's init'd for each leaf without being freed
+  TRY(set_ref_shape(desc,shape));
+  affine_workspace__set_boundary_value(&desc->aws,shape);
+  return 1;
+Error:
+  return 0;
+}
+
+static tbmutex_t g_open_lock=TBMUTEX_INIT; ///< serializes TileOpenFile(), which may open a tile's metadata, and reads that aren't thread safe
+
+/**
+ * Formats whose volumes are HDF5 files.  HDF5 isn't built thread safe by
+ * default, and the container format's own calls into it are made while
+ * opening tiles, so these volumes are read under \a g_open_lock.
+ */
+static const char *g_serial_formats[]={"tilebase.container"};
+
+/** \returns 1 if \a tile has to be read while holding \a g_open_lock, otherwise 0. */
+static int reads_serially(tile_t tile)
+{ const char *format=TileFormat(tile);
+  size_t i;
+  for(i=0;i<countof(g_serial_formats);++i)
+    if(0==strcmp(format,g_serial_formats[i]))
+      return 1;
+  return 0;
+}
+
+/**
+ * Reads \a tile into \a *in and crops it.
+ * \a *in is taken from \a pool if it's NULL and resized as needed.  The read
+ * fills it, so it isn't initialized.  Only touches the pool, which is thread
+ * safe, so it can run on a reader thread (see prefetch_t).
+ * The tile is read through a handle of its own, so several workers can load
+ * the same tile at once (see describe_tiles()), except for formats that must
+ * be read one at a time (see reads_serially()).
+ * Call ndPopShape() on \a *in to undo the crop.
+ */
+static unsigned load_tile(pool_t pool, tile_t tile, nd_t *in)
+{ nd_t s;
+  ndio_t file;
+  unsigned ok=0;
+  int serial=0;
+  TRY(s=TileShape(tile));
+  TRY(*in=pool_fit(pool,RENDER_BACKEND_CPU,*in,ndtype(s),ndndim(s),ndshape(s))); // tiles are read into host memory
+  MutexLock(&g_open_lock);
+  if((file=TileOpenFile(tile)) && (serial=reads_serially(tile)))
+  { TIME(ok=(NULL!=ndioRead(file,*in)));
+    ndioClose(file); // closing calls into HDF5 too
+  }
+  MutexUnlock(&g_open_lock);
+  TRY(file);
+  if(!serial)
+  { TIME(ok=(NULL!=ndioRead(file,*in)));
+    ndioClose(file);
+  }
+  TRY(ok);
+  DUMP("tile.%.tif",*in);
+  TRY(crop(ndPushShape(*in),TileCrop(tile)));
+  DUMP("crop.%.tif",*in);
+  return 1;
+Error:
+  return 0;
+}
+
+//
+// PIPELINED READS
+// A reader thread loads the next tile into one staging buffer while the
+// caller filters and resamples the current tile from the other.
+//
+
+#define NSTAGES 2 ///< number of staging buffers.  2 is double buffering.
+
+typedef enum _stage_state_t
+{ STAGE_EMPTY=0, ///< free for the reader
+  STAGE_FULL,    ///< holds a cropped tile for the caller
+  STAGE_FAILED   ///< the read failed
+} stage_state_t;
+
+typedef struct _prefetch_t
+{ pool_t         pool;      ///< staging buffers come from here
+  tile_t        *tiles;
+  const size_t  *order;     ///< indices into tiles in the order they're used
+  size_t         n,
+                 next;      ///< next tile handed to the caller
+  nd_t           in[NSTAGES];
+  stage_state_t  state[NSTAGES];
+  unsigned       stop,
+                 threaded;  ///< 0 if tiles are read on the caller's thread
+  tbmutex_t      lock;      ///< guards state and stop
+  tbcond_t       changed;
+  tbthread_t     reader;
+} prefetch_t;
+
+static void* prefetch_reader(void *arg)
+{ prefetch_t *p=(prefetch_t*)arg;
+  size_t k;
+  for(k=0;k<p->n;++k)
+  { const unsigned i=k%NSTAGES;
+    unsigned ok;
+    MutexLock(&p->lock);
+    while(!p->stop && p->state[i]!=STAGE_EMPTY)
+      CondWait(&p->changed,&p->lock);
+    ok=!p->stop;
+    MutexUnlock(&p->lock);
+    if(!ok) break;
+    ok=load_tile(p->pool,p->tiles[p->order[k]],p->in+i);
+    MutexLock(&p->lock);
+    p->state[i]=ok?STAGE_FULL:STAGE_FAILED;
+    CondBroadcast(&p->changed);
+    MutexUnlock(&p->lock);
+    if(!ok) break;
+  }
+  return 0;
+}
+
+/** Starts reading the \a n tiles listed in \a order. */
+static void prefetch_start(prefetch_t *p, pool_t pool, tile_t *tiles, const size_t *order, size_t n)
+{ memset(p,0,sizeof(*p));
+  p->pool=pool;
+  p->tiles=tiles;
+  p->order=order;
+  p->n=n;
+  MutexInit(&p->lock);
+  CondInit(&p->changed);
+  p->threaded=(n>1) && ThreadCreate(&p->reader,prefetch_reader,p); // otherwise read inline
+}
+
+/**
+ * Waits for the next tile.
+ * \returns the cropped volume, or 0 if the read failed.  The volume belongs
+ *          to \a p.  Call prefetch_done() when finished with it.
+ */
+static nd_t prefetch_next(prefetch_t *p)
+{ const unsigned i=p->next%NSTAGES;
+  stage_state_t state;
+  if(!p->threaded)
+    return load_tile(p->pool,p->tiles[p->order[p->next]],p->in+i)?p->in[i]:0;
+  MutexLock(&p->lock);
+  while((state=p->state[i])==STAGE_EMPTY)
+    CondWait(&p->changed,&p->lock);
+  MutexUnlock(&p->lock);
+  return (state==STAGE_FULL)?p->in[i]:0;
+}
+
+/** Hands the current staging buffer back to the reader. */
+static unsigned prefetch_done(prefetch_t *p)
+{ const unsigned i=(p->next++)%NSTAGES;
+  TRY(ndPopShape(p->in[i]));
+  MutexLock(&p->lock);
+  p->state[i]=STAGE_EMPTY;
+  CondBroadcast(&p->changed);
+  MutexUnlock(&p->lock);
+  return 1;
+Error:
+  return 0;
+}
+
+/** Stops the reader, even if tiles are left, and returns the staging buffers to the pool. */
+static void prefetch_stop(prefetch_t *p)
+{ unsigned i;
+  if(p->threaded)
+  { MutexLock(&p->lock);
+    p->stop=1;
+    CondBroadcast(&p->changed);
+    MutexUnlock(&p->lock);
+    ThreadJoin(&p->reader);
+  }
+  for(i=0;i<NSTAGES;++i)
+    if(p->in[i]) pool_put(p->pool,p->in[i]);
+  CondFree(&p->changed);
+  MutexFree(&p->lock);
+}
+
+/**
+ * Resamples the cropped volume \a in of \a tile into each of the \a n
+ * volumes in \a outs.  \a outs[i] fills \a bboxes[i].
+ * The boxes only change the translation of the transform, not its scale, so
+ * each part of the tile is filtered once and then resampled into every output.
+ */
+static unsigned splat(desc_t *desc, tile_t tile, nd_t in, size_t n, aabb_t *bboxes, nd_t *outs)
+{ subdiv_t subdiv=0;
+  nd_t t;
+  size_t i;
+  if(desc->total==0)
+    TRY(backend_mem_info(desc->backend,&desc->free,&desc->total));
+  TRY(subdiv=make_subdiv(in,TileTransform(tile),ndndim(in),desc->free,desc->total));
+  do
+  { TIME(compose(desc->transform,bboxes[0],desc->x_nm,desc->y_nm,desc->z_nm,subdiv_xform(subdiv),ndndim(in)));
+    TRY(compute_aa_filters(&desc->input_fws,desc->transform,ndndim(in)));
+    TIME(TRY(t=aafilt(subdiv_vol(subdiv),&desc->input_fws))); // t is on the backend's device
+    for(i=0;i<n;++i)
+    { if(i)
+        TIME(compose(desc->transform,bboxes[i],desc->x_nm,desc->y_nm,desc->z_nm,subdiv_xform(subdiv),ndndim(in)));
+      TIME(TRY(xform(outs[i],t,desc->transform,&desc->aws)));
+    }
+  } while(next_subdivision(subdiv));
+  free_subdiv(subdiv);
+  return 1;
+Error:
+  free_subdiv(subdiv);
+  return 0;
+}
+
+/**
+ * Antialiasing on the output.
+ * The result is copied back so it stays in the buffer pool; the filter's
+ * buffers belong to the workspace.
+ */
+static nd_t filter_output(desc_t *desc, nd_t out)
+{ nd_t f;
+  TRY(f=aafilt(out,&desc->output_fws));
+  TRY(ndcopy(out,f,0,0));
+  return out;
+Error:
+  return 0;
+}
+
 /**
  * Does not assume all tiles have the same size. (fixed: ngc)
+ * Reading the next tile overlaps with filtering and resampling the current
+ * one (see prefetch_t).
  */
 static nd_t render_leaf(desc_t *desc, aabb_t bbox, address_t path)
-{ nd_t out=0,in=0,t=0;
-  size_t i;
+{ nd_t out=0,in=0;
+  size_t i,n=0,*order=0;
   tile_t *tiles;
-  subdiv_t subdiv=0;
+  prefetch_t p;
+  unsigned started=0;
   TRY(tiles=TileBaseArray(desc->tiles));
-  for(i=0;i<TileBaseCount(desc->tiles);++i)
-  { // Maybe initialize
-    if(!AABBHit(bbox,TileAABB(tiles[i]))) continue;                             // Select hit tiles
-    PROGRESS(".");
-    // Wait to init until a hit is confirmed.
-    if(!in)                                                                     // Alloc on first iteration: in, transform
-    { unsigned n;
-      in=ndheap(TileShape(tiles[i]));
-
-      n=ndndim(in);
-      if(!desc->transform)
-        NEW(float,desc->transform,(n+1)*(n+1));   // FIXME: pretty sure this is a memory leak.  transform get's init'd for each leaf without being freed
-      TRY(set_ref_shape(desc,in));
-      affine_workspace__set_boundary_value(&desc->aws,in);
-    }
-    if(!same_shape(in,TileShape(tiles[i]))) // maybe resize "in"
-    { nd_t s=TileShape(tiles[i]);
-      if(ndnbytes(in)<ndnbytes(s))
-        TRY(ndref(in,realloc(nddata(in),ndnbytes(s)),nd_heap));
-      TRY(ndcast(ndreshape(in,ndndim(s),ndshape(s)),ndtype(s)));
-    }
-    if(!out) {
-      TRY(out=alloc_vol(desc,bbox,desc->x_nm,desc->y_nm,desc->z_nm));    // Alloc on first iteration: out, must come after set_ref_shape
-      TIME(TRY(filter_workspace__gpu_resize(&desc->output_fws,out)));
-    }
+  if(!select_tiles(desc,bbox))
+    goto Finalize;
+  NEW(size_t,order,TileBaseCount(desc->tiles));
+  for(i=0;i<TileBaseCount(desc->tiles);++i)                                     // Select hit tiles
+    if(desc->hits[i])
+      order[n++]=i;
+  TRY(setup_input(desc,TileShape(tiles[order[0]])));
+  TRY(out=alloc_vol(desc,bbox,desc->x_nm,desc->y_nm,desc->z_nm));               // must come after set_ref_shape
+  TIME(TRY(filter_workspace__gpu_resize(&desc->output_fws,out)));
+  prefetch_start(&p,desc->pool,tiles,order,n);
+  started=1;
+  for(i=0;i<n;++i)
+  { PROGRESS(".");
+    TIME(TRY(in=prefetch_next(&p))); // time spent waiting on the reader
     // The main idea
-    TIME(TRY(ndioRead(TileFile(tiles[i]),in)));
-    DUMP("tile.%.tif",in);
-    TRY(crop(ndPushShape(in),TileCrop(tiles[i])));
-    DUMP("crop.%.tif",in);    
-#if HAVE_CUDA
-    if(desc->total==0)
-      TRY(cudaSuccess==cudaMemGetInfo(&desc->free,&desc->total));
-#endif
-    TRY(subdiv=make_subdiv(in,TileTransform(tiles[i]),ndndim(in),desc->free,desc->total));
-    do
-    { TIME(compose(desc->transform,bbox,desc->x_nm,desc->y_nm,desc->z_nm,subdiv_xform(subdiv),ndndim(in)));
-      TRY(compute_aa_filters(&desc->input_fws,desc->transform,ndndim(in)));
-      TIME(TRY(t=aafilt(subdiv_vol(subdiv),&desc->input_fws))); // t is on the gpu
-      TIME(TRY(xform(out,t,desc->transform,&desc->aws)));
-    } while(next_subdivision(subdiv));
-    free_subdiv(subdiv);
-    TRY(in=ndPopShape(in));
-    subdiv=0;
+    TRY(splat(desc,tiles[order[i]],in,1,&bbox,&out));
+    TRY(prefetch_done(&p));
   } // end loop over tiles
 
-  
-  /* 
-  Antialiasing on the output.
-  */
-  if(out)
-    TRY(out=aafilt(out,&desc->output_fws));
+  TRY(filter_output(desc,out));
 
 Finalize:
   PROGRESS(ENDL);
-  ndfree(in);
+  if(started)
+    prefetch_stop(&p);
+  free(order);
   return out;
 Error:
-  free_subdiv(subdiv);
-  subdiv=0;
   release_vol(desc,out);
   out=0;
   goto Finalize;
@@ -617,21 +875,23 @@ Error:
  */
 static nd_t render_node(desc_t *desc, aabb_t bbox, address_t path)
 {
-  unsigned i;
+  unsigned i,depth;
   nd_t out=0;
-  aabb_t *cboxes=0;
-  ALLOCA(aabb_t,cboxes,desc->nchildren);
-  ZERO(  aabb_t,cboxes,desc->nchildren);
-  TRY(AABBBinarySubdivision(cboxes,(unsigned)desc->nchildren,bbox));
+  aabb_t cbox;
+  aabb3_t parent;
+  TRY((depth=address_length(path))<(unsigned)desc->ncboxes);
+  cbox=desc->cboxes[depth];
+  TRY(AABB3FromAABB(&parent,bbox));
   for(i=0;i<desc->nchildren;++i)
   { nd_t c=0;
+    const aabb3_t child=OctreeChild(&desc->tree,&parent,i);
+    TRY(AABB3ToAABB(cbox,&child));
     TRY(address_push(path,i));
-    c=desc->make(desc,cboxes[i],path);
+    c=desc->make(desc,cbox,path);
     TRY(address_pop(path));
     if(!c) continue;
-    out=render_child_to_parent(desc,bbox,path,c,cboxes[i],out);
+    out=render_child_to_parent(desc,bbox,path,c,cbox,out);
     release_vol(desc,c);
-    AABBFree(cboxes[i]);
   }
   return out;
 Error:
@@ -640,10 +900,59 @@ Error:
   return 0;
 }
 
+/// \returns 1 if the node at \a path, which fills \a box, was finished by an earlier render.
+static unsigned is_done(desc_t *desc, address_t path, const aabb3_t *box)
+{ if(!desc->loader)
+    return 0;
+  if(desc->nchanged && !AABBHitMany(0,desc->changed,desc->nchanged,box)) // no changed tile touches it
+    return 1;
+  return desc->done && desc->done(path);
+}
+
+/**
+ * Calls desc->discard() for the nodes of the subtree at \a box that overlap a
+ * changed box, children first.  The subtree doesn't hold any tile now, but
+ * it may have before the tiles changed, so an earlier render may have saved
+ * some of those nodes.
+ */
+static unsigned discard(desc_t *desc, const aabb3_t *box, address_t path)
+{ unsigned i;
+  if(!desc->discard || !desc->nchanged || !AABBHitMany(0,desc->changed,desc->nchanged,box))
+    return 1;
+  if(!isleaf_by_volume(desc,AABB3Volume(box)))
+    for(i=0;i<desc->nchildren;++i)
+    { const aabb3_t child=OctreeChild(&desc->tree,box,i);
+      unsigned ok;
+      TRY(address_push(path,i));
+      ok=discard(desc,&child,path);
+      TRY(address_pop(path));
+      TRY(ok);
+    }
+  return desc->discard(path);
+Error:
+  return 0;
+}
+
 /// Renders a volume that fills \a bbox fro \a tiles
 static nd_t render_child(desc_t *desc, aabb_t bbox, address_t path)
 { nd_t out=0;
+  aabb3_t q;
   DBG("--- Address: %-20u ---"ENDL, (unsigned)address_to_int(path,10));
+  TRY(AABB3FromAABB(&q,bbox));
+  if(!TileBaseHitMany(desc->tiles,0,&q)) // nothing to render, but an earlier render may have left something here
+  { TRY(discard(desc,&q,path));
+    return 0;
+  }
+  if(is_done(desc,path,&q)) // skip the subtree.  It only needs to be reloaded if the parent has to be composed.
+  { if(address_length(path))
+    { TRY(out=desc->loader(path));
+      if(!setup_input(desc,out)) // the parent may be composed before any leaf has set up the workspace
+      { release_vol(desc,out);
+        goto Error;
+      }
+    }
+    return out;
+  }
   if(isleaf(desc,bbox))
     out=render_leaf(desc,bbox,path);
   else
@@ -663,7 +972,7 @@ static nd_t addr_seq__child(desc_t *desc, aabb_t bbox, address_t path)
 {
   if(!isleaf(desc,bbox))
     render_node(desc,bbox,path);
-  if(any_tiles_in_box(TileBaseArray(desc->tiles),TileBaseCount(desc->tiles),bbox)) // cull empty nodes
+  if(any_tiles_in_box(desc->tiles,bbox)) // cull empty nodes
     desc->yield(0,path,bbox,desc->args);
   return 0;
 }
@@ -693,32 +1002,683 @@ Error:
 }
 static nd_t target__get_child(desc_t *desc, aabb_t bbox, address_t path)
 { nd_t out=0;
-  if(address_eq(path,target__addr))
-  { if(isleaf(desc,bbox))
-      out=render_leaf(desc,bbox,path);
-    else
-    { desc->make=target__load;
-      out=render_node(desc,bbox,path);
-      desc->make=target__get_child;
-    }
-
-    if(out)
-      TRY(desc->yield(out,path,bbox,desc->args));
-  } else
-  { if(!isleaf(desc,bbox))
-      render_node(desc,bbox,path);
+  if(isleaf(desc,bbox))
+    out=render_leaf(desc,bbox,path);
+  else
+  { desc->make=target__load;
+    out=render_node(desc,bbox,path);
+    desc->make=target__get_child;
   }
-
+  if(out)
+    TRY(desc->yield(out,path,bbox,desc->args));
   return out;
 Error:
   return 0;
 }
+/** Computes the bounding box of the \a target node directly from the tree geometry. */
+static aabb_t target__bbox(desc_t *desc, aabb_t dst, address_t target)
+{ uint64_t index=0;
+  unsigned level=0;
+  address_t it;
+  aabb3_t b;
+  for(it=address_begin(target);it;it=address_next(it),++level)
+    index=OctreeChildIndex(&desc->tree,index,address_id(it));
+  b=OctreeNode(&desc->tree,level,index);
+  return AABB3ToAABB(dst,&b);
+}
 static void target__setup(desc_t *desc, address_t target, loader_t loader)
 { target__addr=target;
   target__load_func=loader;
   desc->make=target__get_child;
 }
 
+//
+// PARALLEL RENDERING
+// Leaves are rendered concurrently by a pool of workers.  Each worker has its
+// own desc_t workspace; they share the buffer pool.
+//
+// Every node of the tree holds one pool buffer from the time the first leaf
+// below it starts until it has been composed into its parent.  A leaf is only
+// started once a buffer is reserved for it and for each of its ancestors
+// that doesn't have one yet, so the size of the pool is the memory budget.
+//
+// Leaves are started in depth-first order.  Nodes holding a reservation are
+// then either working or ancestors of the next leaf, so a pool of
+// pathlength() buffers is always enough to make progress.
+//
+// A finished node is yielded, composed into its parent and released.  The
+// worker that finishes the last child of a node goes on to finish the node,
+// so children are always yielded before their parent.
+//
+
+typedef struct _task_t task_t;
+struct _task_t
+{ task_t   *parent;
+  aabb_t    bbox;
+  address_t path;
+  unsigned  pending;  ///< children that have not finished
+  unsigned  refs;     ///< tiles that still have to be splatted into a leaf (see render_tiles())
+  int       reserved; ///< 1 if a pool buffer is reserved for this node
+  int       loaded;   ///< 1 if the node was finished by an earlier render.  It is reloaded instead of rendered.
+  nd_t      out;      ///< allocated when the first child is composed
+  tbmutex_t lock;     ///< serializes composition into out
+};
+
+typedef struct _scheduler_t
+{ task_t   **tasks;   ///< every node that intersects a tile
+  size_t     ntasks;
+  task_t   **leaves;  ///< leaves and loaded nodes in depth-first order
+  size_t     nleaves,
+             next;    ///< next leaf to start
+  int        nfree;   ///< pool buffers that aren't reserved
+  unsigned   ok;
+  tbmutex_t  lock;    ///< guards next, nfree, ok, and each task's reserved and pending
+  tbcond_t   changed; ///< signaled when buffers are released or on failure
+  tbmutex_t  yield;   ///< serializes calls to desc->yield
+} scheduler_t;
+
+typedef struct _worker_t
+{ scheduler_t *s;
+  desc_t       desc;
+  unsigned     nthreads; ///< threads available to each host kernel call
+} worker_t;
+
+static unsigned push_task(task_t ***list, size_t *n, task_t *t)
+{ if((*n&(*n-1))==0) // grow at powers of 2
+    REALLOC(task_t*,*list,(*n)?(2*(*n)):1);
+  (*list)[(*n)++]=t;
+  return 1;
+Error:
+  return 0;
+}
+
+static void free_task(task_t *t)
+{ if(!t) return;
+  AABBFree(t->bbox);
+  free_address(t->path);
+  MutexFree(&t->lock);
+  free(t);
+}
+
+/**
+ * Adds the node at \a box and the nodes below it to the schedule.
+ * Subtrees that don't intersect any tile are skipped after discarding what
+ * an earlier render may have saved for them (see discard()).  So are subtrees
+ * finished by an earlier render or untouched by the changed tiles; their
+ * root is scheduled to be reloaded like a leaf.
+ * \returns 1 if a task was added for the node, 0 if it was skipped, -1 on error.
+ */
+static int plan(scheduler_t *s, desc_t *desc, const aabb3_t *box, address_t path, task_t *parent)
+{ task_t *t=0;
+  unsigned i,done;
+  if(!TileBaseHitMany(desc->tiles,0,box)) // also builds the tile index before the workers share it
+    return discard(desc,box,path)?0:-1;
+  if((done=is_done(desc,path,box)) && !parent) // the whole tree is finished
+    return 0;
+  NEW(task_t,t,1);
+  ZERO(task_t,t,1);
+  MutexInit(&t->lock);
+  if(!push_task(&s->tasks,&s->ntasks,t))
+  { free_task(t);
+    return -1;
+  }
+  t->parent=parent;                          // from here on, t is freed with s->tasks
+  TRY(t->bbox=AABBMake(3));
+  TRY(AABB3ToAABB(t->bbox,box));
+  TRY(t->path=copy_address(path));
+  if((t->loaded=done) || isleaf(desc,t->bbox))
+  { TRY(push_task(&s->leaves,&s->nleaves,t));
+    return 1;
+  }
+  for(i=0;i<desc->nchildren;++i)
+  { const aabb3_t child=OctreeChild(&desc->tree,box,i);
+    int r;
+    TRY(address_push(path,i));
+    r=plan(s,desc,&child,path,t);
+    TRY(address_pop(path));
+    TRY(r>=0);
+    t->pending+=r;
+  }
+  if(!t->pending) // nothing below hits a tile.  t was the last task added.
+  { --s->ntasks;
+    free_task(t);
+    return 0;
+  }
+  return 1;
+Error:
+  return -1;
+}
+
+/**
+ * Plans the tree rooted at \a bbox into \a s (see plan()).
+ * Call free_schedule() when done with \a s, also if this fails.
+ */
+static unsigned schedule(scheduler_t *s, desc_t *desc, aabb_t bbox)
+{ address_t path=0;
+  aabb3_t root;
+  memset(s,0,sizeof(*s));
+  MutexInit(&s->lock);
+  MutexInit(&s->yield);
+  CondInit(&s->changed);
+  s->ok=1;
+  TRY(path=make_address());
+  TRY(AABB3FromAABB(&root,bbox));
+  TRY(plan(s,desc,&root,path,0)>=0);
+  free_address(path);
+  return 1;
+Error:
+  free_address(path);
+  return 0;
+}
+
+static void free_schedule(scheduler_t *s)
+{ size_t i;
+  for(i=0;i<s->ntasks;++i)
+    free_task(s->tasks[i]);
+  free(s->tasks);
+  free(s->leaves);
+  CondFree(&s->changed);
+  MutexFree(&s->yield);
+  MutexFree(&s->lock);
+}
+
+/** Number of buffers that must be reserved before leaf \a t can start. */
+static int need(const task_t *t)
+{ int n=0;
+  for(;t && !t->reserved;t=t->parent)
+    ++n;
+  return n;
+}
+
+static void reserve(scheduler_t *s, task_t *t)
+{ for(;t && !t->reserved;t=t->parent)
+  { t->reserved=1;
+    --s->nfree;
+  }
+}
+
+static void fail(scheduler_t *s)
+{ MutexLock(&s->lock);
+  s->ok=0;
+  CondBroadcast(&s->changed);
+  MutexUnlock(&s->lock);
+}
+
+/**
+ * Yields \a out for the finished node \a t, composes it into the parent and
+ * returns the buffer to the pool.  Repeats for each parent that is finished
+ * as a result.
+ * \param[in] out  May be NULL if nothing was rendered for \a t.
+ */
+static unsigned finish(scheduler_t *s, desc_t *desc, task_t *t, nd_t out)
+{ while(t)
+  { task_t *p=t->parent;
+    unsigned ok=1,done;
+    if(out)
+    { if(!t->loaded) // otherwise it was saved by an earlier render
+      { MutexLock(&s->yield);
+        ok=desc->yield(out,t->path,t->bbox,desc->args);
+        MutexUnlock(&s->yield);
+      }
+      if(ok && p)
+      { MutexLock(&p->lock);
+        ok=(NULL!=(p->out=render_child_to_parent(desc,p->bbox,p->path,out,t->bbox,p->out)));
+        MutexUnlock(&p->lock);
+      }
+      release_vol(desc,out);
+    }
+    MutexLock(&s->lock);
+    t->reserved=0;
+    ++s->nfree;
+    done=(p && --p->pending==0);
+    CondBroadcast(&s->changed);
+    MutexUnlock(&s->lock);
+    TRY(ok);
+    t=done?p:0;
+    out=done?p->out:0;
+  }
+  return 1;
+Error:
+  return 0;
+}
+
+static void* worker(void *arg)
+{ worker_t *w=(worker_t*)arg;
+  scheduler_t *s=w->s;
+  cpu_set_threads(w->nthreads);
+  while(1)
+  { task_t *t=0;
+    nd_t out;
+    MutexLock(&s->lock);
+    while(s->ok && s->next<s->nleaves && need(s->leaves[s->next])>s->nfree)
+      CondWait(&s->changed,&s->lock);
+    if(s->ok && s->next<s->nleaves)
+    { t=s->leaves[s->next++];
+      reserve(s,t);
+    }
+    MutexUnlock(&s->lock);
+    if(!t) break;
+    out=t->loaded?w->desc.loader(t->path):render_leaf(&w->desc,t->bbox,t->path);
+    if(!out || !finish(s,&w->desc,t,out)) // planned leaves hit a tile, so they always render something
+      fail(s);
+  }
+  return 0;
+}
+
+/** \returns the number of workers to use for parallel rendering. */
+static unsigned count_workers(const struct render *opts, const desc_t *desc)
+{ if(desc->backend==RENDER_BACKEND_GPU) // the device is selected per thread, so stay on the main thread
+    return 1;
+  return opts->nthreads?opts->nthreads:ThreadCount();
+}
+
+/**
+ * Bytes a worker takes from the pool besides node buffers: the staging
+ * buffers tiles are read into (see prefetch_t) and the double buffers of its
+ * input and output filters.  \a shape is the shape of a tile.
+ * Staging buffers are in host memory, so they only count against the budget
+ * of the CPU backend.
+ */
+static size_t worker_bytes(const desc_t *desc, nd_t shape)
+{ const size_t tile=ndnbytes(shape),
+               leaf=desc->countof_leaf*(ndnbytes(shape)/ndnelem(shape)),
+               input=(tile>leaf)?tile:leaf; // tiles, or children composed into a parent
+  return (desc->backend==RENDER_BACKEND_CPU?NSTAGES*tile:0)+2*input+2*leaf;
+}
+
+/**
+ * Number of node buffers allowed by the memory budget when \a nworkers
+ * workers are rendering.  What the workers hold otherwise (see
+ * worker_bytes()) comes out of the budget first.
+ * Each buffer holds desc->countof_leaf voxels like those of \a shape.
+ */
+static size_t count_bufs(const struct render *opts, const desc_t *desc, nd_t shape, unsigned nworkers)
+{ const size_t budget=memory_budget(opts,desc->backend),
+               bytes=desc->countof_leaf*(ndnbytes(shape)/ndnelem(shape)),
+               other=nworkers*worker_bytes(desc,shape);
+  if(budget<other)
+    return 0;
+  return bytes?(budget-other)/bytes:0;
+}
+
+/**
+ * Fills in the shape, transform and crop of each tile that hits \a bbox.
+ * Tiles look these up lazily, which isn't thread safe, so this is done
+ * before the workers share them.
+ */
+static unsigned describe_tiles(desc_t *desc, aabb_t bbox)
+{ tile_t *tiles;
+  size_t i;
+  TRY(tiles=TileBaseArray(desc->tiles));
+  TRY(select_tiles(desc,bbox));
+  for(i=0;i<TileBaseCount(desc->tiles);++i)
+    if(desc->hits[i])
+      TRY(TileShape(tiles[i]) && TileTransform(tiles[i]) && TileCrop(tiles[i]));
+  return 1;
+Error:
+  return 0;
+}
+
+/**
+ * \returns the shape of the first tile that hits \a bbox.  Pool buffers take
+ *          its voxel type.  0 on failure.
+ */
+static nd_t first_hit_shape(desc_t *desc, aabb_t bbox)
+{ tile_t *tiles;
+  size_t i;
+  TRY(tiles=TileBaseArray(desc->tiles));
+  TRY(select_tiles(desc,bbox));
+  for(i=0;i<TileBaseCount(desc->tiles);++i)
+    if(desc->hits[i])
+      return TileShape(tiles[i]);
+Error:
+  return 0;
+}
+
+/** Copies the parts of the shared workspace in \a src that a worker needs. */
+static unsigned share_desc(desc_t *dst, const desc_t *src, unsigned nworkers)
+{ dst->tree =src->tree;
+  set_pool(dst,src->pool);
+  dst->free =src->free/nworkers; // used to subdivide tiles; the workers split host memory
+  dst->total=src->total;
+  dst->aws.params.boundary_value=src->aws.params.boundary_value;
+  TRY(ndreshape(ndcast(dst->ref=ndinit(),ndtype(src->ref)),ndndim(src->ref),ndshape(src->ref)));
+  { const size_t n=ndndim(src->ref)+1;
+    NEW(float,dst->transform,n*n); // a worker may compose a loaded node before it renders a leaf
+  }
+  return 1;
+Error:
+  return 0;
+}
+
+/** Returns a worker's desc_t to a state that cleanup_desc() can handle without touching shared data. */
+static void unshare_desc(desc_t *desc)
+{ unsigned i;
+  for(i=0;i<countof(desc->input_fws.gpu);++i) // hand the worker's filter buffers to the others
+  { pool_put(desc->pool,desc->input_fws.gpu[i]);
+    pool_put(desc->pool,desc->output_fws.gpu[i]);
+  }
+  set_pool(desc,0);
+}
+
+/**
+ * Renders the tree rooted at \a bbox on several workers.
+ * \a desc must have been set up by prepare_tree(), and \a s by
+ * schedule().  A single worker runs on the calling thread.
+ */
+static unsigned render_parallel(const struct render *opts, desc_t *desc, aabb_t bbox, scheduler_t *s, unsigned nworkers)
+{ worker_t *workers=0;
+  tbthread_t *threads=0;
+  size_t i,n,nbufs;
+  unsigned nstarted=0,ok=0;
+
+  if(!s->nleaves)
+  { ok=1; // nothing to render
+    goto Finalize;
+  }
+
+  TRY(describe_tiles(desc,bbox));
+  if(nworkers>s->nleaves)
+    nworkers=(unsigned)s->nleaves;
+
+  { // the pool, sized by the memory budget
+    nd_t shape;
+    TRY(shape=first_hit_shape(desc,bbox));
+    n=pathlength(desc,bbox);
+    while(nworkers>1 && count_bufs(opts,desc,shape,nworkers)<n) // each worker needs room for its own buffers
+      --nworkers;
+    nbufs=count_bufs(opts,desc,shape,nworkers);
+    if(nbufs>s->ntasks) nbufs=s->ntasks;
+    if(nbufs<n)        nbufs=n;
+    desc->nbufs=(int)nbufs;
+    s->nfree=(int)nbufs;
+    TRY(set_ref_shape(desc,shape));
+    affine_workspace__set_boundary_value(&desc->aws,shape);
+    TRY(backend_mem_info(desc->backend,&desc->free,&desc->total));
+  }
+
+  NEW(worker_t,workers,nworkers);
+  ZERO(worker_t,workers,nworkers);
+  NEW(tbthread_t,threads,nworkers);
+  LOG("Rendering %llu leaves on %u workers with %d buffers"ENDL,
+      (unsigned long long)s->nleaves,nworkers,(int)nbufs);
+  for(i=0;i<nworkers;++i)
+  { worker_t *w=workers+i;
+    w->s=s;
+    w->desc=make_desc(opts,desc->tiles,desc->yield,desc->args);
+    w->nthreads=ThreadCount()/nworkers;
+    if(!w->nthreads) w->nthreads=1;
+    TRY(share_desc(&w->desc,desc,nworkers));
+  }
+  if(nworkers>1)
+    for(i=0;i<nworkers;++i)
+      nstarted+=ThreadCreate(threads+nstarted,worker,workers+i);
+  if(!nstarted)
+    worker(workers);
+  for(i=0;i<nstarted;++i)
+    ThreadJoin(threads+i);
+  TRY(s->ok);
+  ok=1;
+Finalize:
+  if(workers)
+    for(i=0;i<nworkers;++i)
+    { unshare_desc(&workers[i].desc);
+      cleanup_desc(&workers[i].desc);
+    }
+  free(workers);
+  free(threads);
+  return ok;
+Error:
+  goto Finalize;
+}
+
+//
+// TILE-MAJOR RENDERING
+// Walks the tiles in Morton order and reads each one exactly once.  A tile
+// is filtered once and resampled into every leaf it overlaps.  Each leaf
+// counts the tiles that overlap it, and is finished (see finish()) once the
+// last one has been applied.
+//
+// Leaves stay open from their first tile to their last, so the traversal is
+// replayed first to find the number of buffers it needs.  If that doesn't fit
+// the memory budget, leaves are rendered one at a time as usual.
+//
+
+/// Tiles in traversal order, each with the leaves it overlaps.
+typedef struct _splat_plan_t
+{ size_t  *order;   ///< indices of tiles that hit a leaf, in Morton order
+  size_t   norder;
+  size_t  *first;   ///< tile i hits leaves[first[i]] through leaves[first[i+1]-1]
+  task_t **leaves;
+} splat_plan_t;
+
+typedef struct _tile_key_t
+{ uint64_t key;
+  size_t   i;
+} tile_key_t;
+
+static int cmp_tile_key(const void *a, const void *b)
+{ const uint64_t ka=((const tile_key_t*)a)->key,
+                 kb=((const tile_key_t*)b)->key;
+  return (ka>kb)-(ka<kb);
+}
+
+static void free_splat_plan(splat_plan_t *p)
+{ free(p->order);
+  free(p->first);
+  free(p->leaves);
+  memset(p,0,sizeof(*p));
+}
+
+/** Finds the leaves hit by each tile and sets each leaf's reference count. */
+static unsigned make_splat_plan(splat_plan_t *p, scheduler_t *s, desc_t *desc, const aabb3_t *root)
+{ const size_t ntiles=TileBaseCount(desc->tiles);
+  const aabb3_t *boxes;
+  unsigned char *hits=0;
+  size_t i,j,*cursor=0;
+  tile_key_t *keys=0;
+  unsigned pass;
+  memset(p,0,sizeof(*p));
+  TRY(boxes=TileBaseBoxes(desc->tiles));
+  NEW(unsigned char,hits,ntiles+1);
+  NEW(size_t,p->first,ntiles+1);
+  ZERO(size_t,p->first,ntiles+1);
+  NEW(size_t,cursor,ntiles+1);
+  for(pass=0;pass<2;++pass) // count, then fill
+  { for(j=0;j<s->nleaves;++j)
+    { task_t *leaf=s->leaves[j];
+      aabb3_t q;
+      if(leaf->loaded) continue; // reloaded instead (see render_tiles())
+      TRY(AABB3FromAABB(&q,leaf->bbox));
+      TileBaseHitMany(desc->tiles,hits,&q);
+      for(i=0;i<ntiles;++i)
+      { if(!hits[i]) continue;
+        if(pass==0)
+        { ++p->first[i+1];
+          ++leaf->refs;
+        } else
+          p->leaves[cursor[i]++]=leaf;
+      }
+    }
+    if(pass==0)
+    { for(i=0;i<ntiles;++i)
+        p->first[i+1]+=p->first[i];
+      memcpy(cursor,p->first,ntiles*sizeof(size_t));
+      NEW(task_t*,p->leaves,p->first[ntiles]+1);
+    }
+  }
+  NEW(tile_key_t,keys,ntiles+1);
+  for(i=0;i<ntiles;++i)
+    if(p->first[i+1]>p->first[i])
+    { keys[p->norder].key=SFCKey(SFC_ORDER_MORTON,root,boxes+i);
+      keys[p->norder++].i=i;
+    }
+  qsort(keys,p->norder,sizeof(*keys),cmp_tile_key);
+  NEW(size_t,p->order,p->norder+1);
+  for(i=0;i<p->norder;++i)
+    p->order[i]=keys[i].i;
+  free(keys);
+  free(cursor);
+  free(hits);
+  return 1;
+Error:
+  free(keys);
+  free(cursor);
+  free(hits);
+  free_splat_plan(p);
+  return 0;
+}
+
+/** Closes the node \a n, and every parent it finishes, during peak_buffers()'s replay. */
+static void replay_close(task_t *n, size_t *open)
+{ while(n)
+  { n->reserved=0;
+    --*open;
+    if(!n->parent || --n->parent->pending)
+      break;
+    n=n->parent;
+  }
+}
+
+/**
+ * Replays the traversal described by \a p to find the largest number of
+ * node buffers in use at once.  Task state is restored afterwards.
+ * \returns 0 on error.
+ */
+static size_t peak_buffers(scheduler_t *s, const splat_plan_t *p)
+{ unsigned *pending=0,*refs=0;
+  size_t i,k,open=0,peak=0;
+  NEW(unsigned,pending,s->ntasks);
+  NEW(unsigned,refs,s->ntasks);
+  for(i=0;i<s->ntasks;++i)
+  { pending[i]=s->tasks[i]->pending;
+    refs[i]   =s->tasks[i]->refs;
+  }
+  for(i=0;i<s->nleaves;++i) // loaded nodes are composed before the first tile is read
+  { task_t *n=s->leaves[i];
+    if(!n->loaded) continue;
+    open+=need(n);
+    reserve(s,n);
+    if(open>peak) peak=open;
+    replay_close(n,&open);
+  }
+  for(k=0;k<p->norder;++k)
+  { const size_t t=p->order[k];
+    for(i=p->first[t];i<p->first[t+1];++i)
+    { open+=need(p->leaves[i]);
+      reserve(s,p->leaves[i]);
+    }
+    if(open>peak) peak=open;
+    for(i=p->first[t];i<p->first[t+1];++i)
+      if(--p->leaves[i]->refs==0)
+        replay_close(p->leaves[i],&open);
+  }
+  for(i=0;i<s->ntasks;++i)
+  { s->tasks[i]->pending=pending[i];
+    s->tasks[i]->refs   =refs[i];
+    s->tasks[i]->reserved=0;
+  }
+  s->nfree=0;
+  free(pending);
+  free(refs);
+  return peak;
+Error:
+  free(pending);
+  free(refs);
+  return 0;
+}
+
+/**
+ * Renders the tree rooted at \a bbox tile by tile.
+ * \a desc must have been set up by prepare_tree(), and \a s by schedule().
+ * \returns 1 on success, 0 if the traversal needs more buffers than the
+ *          memory budget allows, and -1 on error.  On 0, nothing has been
+ *          rendered and \a s can be handed to render_parallel().
+ */
+static int render_tiles(const struct render *opts, desc_t *desc, aabb_t bbox, scheduler_t *s)
+{ splat_plan_t p;
+  aabb3_t root;
+  tile_t *tiles;
+  prefetch_t prefetch;
+  unsigned started=0;
+  nd_t in,*outs=0;
+  aabb_t *boxes=0;
+  size_t i,j,k,nbufs;
+  int ok=-1;
+  memset(&p,0,sizeof(p));
+
+  TRY(tiles=TileBaseArray(desc->tiles));
+  TRY(AABB3FromAABB(&root,bbox));
+  if(!s->nleaves)
+  { ok=1; // nothing to render
+    goto Finalize;
+  }
+  TRY(make_splat_plan(&p,s,desc,&root));
+  TRY(nbufs=peak_buffers(s,&p));
+  { nd_t shape;
+    size_t allowed;
+    TRY(shape=first_hit_shape(desc,bbox));
+    allowed=count_bufs(opts,desc,shape,1);
+    if(nbufs>allowed)
+    { LOG("Tile-major rendering needs %llu buffers but the memory budget allows %llu.  Rendering leaf by leaf instead."ENDL,
+          (unsigned long long)nbufs,(unsigned long long)allowed);
+      ok=0;
+      goto Finalize;
+    }
+    // Nothing is set aside in the pool; buffers are taken as leaves open (see alloc_vol()), so only the buffers actually used are allocated.
+    TRY(ndreshape(ndcast(desc->ref=ndinit(),ndtype(shape)),ndndim(shape),ndshape(shape)));
+    TRY(setup_input(desc,shape));
+  }
+  LOG("Rendering %llu leaves from %llu tiles with at most %llu buffers"ENDL,
+      (unsigned long long)s->nleaves,(unsigned long long)p.norder,(unsigned long long)nbufs);
+
+  for(i=0;i<s->nleaves;++i) // nodes finished by an earlier render
+    if(s->leaves[i]->loaded)
+    { TRY(in=desc->loader(s->leaves[i]->path));
+      TRY(finish(s,desc,s->leaves[i],in));
+    }
+
+  NEW(aabb_t,boxes,s->nleaves); // the leaves a tile is splatted into
+  NEW(nd_t,outs,s->nleaves);
+  prefetch_start(&prefetch,desc->pool,tiles,p.order,p.norder); // reading tile k+1 overlaps with splatting tile k
+  started=1;
+  for(k=0;k<p.norder;++k)
+  { const size_t t=p.order[k];
+    PROGRESS(".");
+    TIME(TRY(in=prefetch_next(&prefetch)));
+    for(i=p.first[t],j=0;i<p.first[t+1];++i,++j)
+    { task_t *leaf=p.leaves[i];
+      if(!leaf->out)
+      { TRY(leaf->out=alloc_vol(desc,leaf->bbox,desc->x_nm,desc->y_nm,desc->z_nm));
+        TIME(TRY(filter_workspace__gpu_resize(&desc->output_fws,leaf->out)));
+      }
+      boxes[j]=leaf->bbox;
+      outs[j]=leaf->out;
+    }
+    TRY(splat(desc,tiles[t],in,j,boxes,outs));
+    for(i=p.first[t];i<p.first[t+1];++i)
+    { task_t *leaf=p.leaves[i];
+      if(--leaf->refs==0) // last tile for this leaf
+      { TRY(filter_output(desc,leaf->out));
+        TRY(finish(s,desc,leaf,leaf->out));
+      }
+    }
+    TRY(prefetch_done(&prefetch));
+  }
+  PROGRESS(ENDL);
+  ok=1;
+Finalize:
+  if(started)
+    prefetch_stop(&prefetch);
+  free(boxes);
+  free(outs);
+  free_splat_plan(&p);
+  return ok;
+Error:
+  ok=-1;
+  goto Finalize;
+}
+
 // === INTERFACE ===
 
 /** Select a subvolume from the total data set using fractional coordinates.
@@ -736,23 +1696,50 @@ Error:
   return 0;
 }
 
+static unsigned put_node(nd_t vol, address_t address, aabb_t bbox, void *args)
+{ return writer_put((writer_t)args,vol,address,bbox);
+}
+
 /**
  * \param[in]   opts         Point to a `struct render` holding options that control the render.
  * \param[in]   tiles        Source tile database.
  * \param[in]   yield        Callback that handles nodes in the tree when they
- *                           are done being rendered.
+ *                           are done being rendered.  If opts->nwriters>0,
+ *                           it's called from background threads.
  * \param[in]   args         Additional arguments to be passed to yeild.
  */
 unsigned render(const struct render *opts, tiles_t tiles, handler_t yield, void* args)
 { unsigned ok=1;
-  desc_t desc=make_desc(opts,tiles,yield,args);
+  writer_t writer=opts->nwriters?writer_open(yield,args,opts->nwriters,2*opts->nwriters):0;
+  desc_t desc=writer?make_desc(opts,tiles,put_node,writer):make_desc(opts,tiles,yield,args);
   aabb_t bbox=0;
   address_t path=0;
+  scheduler_t s;
+  unsigned nworkers,scheduled=0;
+  TRY(!opts->nwriters || writer);
+  TRY(make_pool(&desc,opts));
   TRY(bbox=AdjustTilesBoundingBox(tiles,opts->ori,opts->size));
+  TRY(prepare_tree(&desc,bbox));
+  nworkers=count_workers(opts,&desc);
+  if(opts->tile_major || nworkers>1)
+  { scheduled=1;
+    TRY(schedule(&s,&desc,bbox)); // planned once, so a fallback doesn't discard nodes again
+  }
+  if(opts->tile_major)
+  { int r;
+    TRY((r=render_tiles(opts,&desc,bbox,&s))>=0);
+    if(r) goto Finalize; // otherwise it didn't fit the memory budget
+  }
+  if(scheduled)
+  { TRY(render_parallel(opts,&desc,bbox,&s,nworkers));
+    goto Finalize;
+  }
   TRY(preallocate(&desc,bbox));
   TRY(path=make_address());
   desc.make(&desc,bbox,path);
 Finalize:
+  if(!writer_close(writer)) ok=0; // waits for the last nodes to be saved
+  if(scheduled) free_schedule(&s);
   cleanup_desc(&desc);
   AABBFree(bbox);
   free_address(path);
@@ -775,6 +1762,7 @@ unsigned addresses(const struct render *opts, tiles_t tiles, handler_t yield, vo
   aabb_t bbox=0;
   address_t path=0;
   TRY(bbox=AdjustTilesBoundingBox(tiles,opts->ori,opts->size));
+  TRY(prepare_tree(&desc,bbox));
 //TRY(preallocate(&desc,bbox));
   TRY(path=make_address());
   setup_print_addresses(&desc);
@@ -803,10 +1791,14 @@ unsigned render_target(const struct render *opts, tiles_t tiles, handler_t yield
   desc_t desc=make_desc(opts,tiles,yield,yield_args);
   aabb_t bbox=0;
   address_t path=0;
+  TRY(make_pool(&desc,opts));
   TRY(bbox=AdjustTilesBoundingBox(tiles,opts->ori,opts->size));
+  TRY(prepare_tree(&desc,bbox));
   TRY(preallocate_for_render_one_target(&desc,bbox));
-  TRY(path=make_address());
+  TRY(address_length(target)<(unsigned)desc.ncboxes);
+  TRY(path=copy_address(target));
   target__setup(&desc,target,loader);
+  TRY(target__bbox(&desc,bbox,target));
   desc.make(&desc,bbox,path);
 Finalize:
   cleanup_desc(&desc);
@@ -11,6 +11,11 @@ extern "C" {
 #include "nd.h"
 #include "tilebase.h"
 #include "address.h"
+#include "backend.h"
+
+typedef nd_t     (*loader_t)(address_t address);
+typedef unsigned (*done_t)(address_t address);
+typedef unsigned (*discard_t)(address_t address);
 
 struct render {
     double voxel_um[3],  ///< Desired voxel size of leaf nodes (x,y, and z).
@@ -23,6 +28,17 @@ struct render {
 
     float output_filter_scale_thresh; ///< scale threshold (px) for applying post-filtering to output leaves.
     float output_filter_size_nm[3];  ///< post-filter size for x,y,z at the leaf level.
+
+    render_backend_t backend;        ///< where buffers live and kernels run.  RENDER_BACKEND_AUTO picks the GPU if there is one.
+    unsigned nthreads;               ///< number of leaves rendered at once on the CPU backend.  0 uses one per core.
+    size_t   memory_budget;          ///< bytes of node buffers in flight, plus each worker's tile and filter buffers, when rendering in parallel or tile by tile.  0 uses half the available memory.
+    unsigned tile_major;             ///< if 1, read each tile once and resample it into every leaf it overlaps.
+    done_t   done;                   ///< if not NULL, returns 1 for nodes finished by an earlier render.  Their subtrees are skipped.
+    loader_t loader;                 ///< reloads a finished node when its parent still has to be composed.  Required if done or changed is set.
+    const aabb3_t *changed;          ///< if nchanged>0, only nodes that intersect one of these boxes are rendered.  The others count as done.
+    size_t   nchanged;
+    discard_t discard;               ///< if not NULL, called for each node that overlaps a changed box but no longer holds a tile, children first.  Removes what an earlier render saved for it.
+    unsigned nwriters;               ///< if >0, nodes are saved by this many background threads while rendering continues.  See writer.h.
 };
 
 
@@ -32,7 +48,6 @@ struct render {
  */
 // Requires: address.h - typedef struct _address_t *address_t;
 typedef unsigned (*handler_t)(nd_t vol, address_t address, aabb_t bbox, void *args);
-typedef nd_t     (*loader_t)(address_t address);
 
 unsigned render       (const struct render *opts, tiles_t tiles, handler_t yield, void *args);
 unsigned addresses    (const struct render *opts, tiles_t tiles, handler_t yield, void *args);
@@ -0,0 +1,365 @@
+/**
+ * \file
+ * Sharded containers for the nodes of a rendered tree.
+ *
+ * A shard is a sequence of records (native byte order):
+ * \verbatim
+ *   uint32_t magic
+ *   uint32_t keylen
+ *   uint64_t nbytes
+ *   char     key[keylen]
+ *   uint8_t  data[nbytes]
+ * \endverbatim
+ * Records are only ever appended.  If a node is written again, the later
+ * record wins.  A record with no data marks a removed node.  The index of a
+ * shard, key -> (offset,length), is rebuilt from the record headers when the
+ * shard is first used.  A record cut short by a crash is dropped from the end
+ * of the file.
+ *
+ * Each shard has its own lock.  Writes to different shards proceed in
+ * parallel; writes to the same shard are serialized.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "src/util/thread.h"
+#include "shards.h"
+
+#define ENDL        "\n"
+#define LOG(...)    fprintf(stderr,__VA_ARGS__)
+#define TRY(e)      do{if(!(e)) { LOG("%s(%d): %s()"ENDL "\tExpression evaluated as false."ENDL "\t%s"ENDL,__FILE__,__LINE__,__FUNCTION__,#e); goto Error;}} while(0)
+#define NEW(T,e,N)  TRY((e)=(T*)malloc(sizeof(T)*(N)))
+#define ZERO(T,e,N) memset((e),0,sizeof(T)*(N))
+
+#ifdef _MSC_VER
+#pragma warning (disable:4996) // deprecation warning for fopen
+#include <io.h>             // _chsize_s
+#define fseeko   _fseeki64
+#define ftello   _ftelli64
+#define snprintf _snprintf
+#define PATHSEP  '\\'
+#else
+#include <unistd.h>         // ftruncate
+#define PATHSEP  '/'
+#endif
+
+#define MAGIC      0x52534254u // "TBSR"
+#define MAXKEY     4096
+
+typedef struct _record_t
+{ uint32_t magic,
+           keylen;
+  uint64_t nbytes;
+} record_t;
+
+typedef struct _entry_t
+{ char    *key;     ///< NULL for an empty slot
+  uint64_t offset,  ///< where the data starts
+           nbytes;
+} entry_t;
+
+typedef struct _shard_t
+{ char      *name;
+  FILE      *fp;       ///< NULL until the shard is first used
+  uint64_t   end;      ///< where the next record goes
+  entry_t   *table;    ///< open addressing.  cap is a power of 2.
+  size_t     n,cap;
+  tbmutex_t  lock;
+} shard_t;
+
+struct _shards_t
+{ char      *root;
+  unsigned   depth;
+  int        truncate; ///< if 1, shards are emptied when they're first used
+  shard_t  **shards;
+  size_t     n,cap;
+  tbmutex_t  lock;     ///< guards the list of shards
+};
+
+//
+// === INDEX ===
+//
+
+static uint64_t hash(const char *s)
+{ uint64_t h=14695981039346656037ULL;
+  for(;*s;++s)
+    h=(h^(unsigned char)*s)*1099511628211ULL;
+  return h;
+}
+
+static entry_t* slot(entry_t *table, size_t cap, const char *key)
+{ size_t i=(size_t)hash(key)&(cap-1);
+  while(table[i].key && strcmp(table[i].key,key))
+    i=(i+1)&(cap-1);
+  return table+i;
+}
+
+static unsigned insert(shard_t *s, const char *key, uint64_t offset, uint64_t nbytes)
+{ entry_t *e;
+  if(2*(s->n+1)>s->cap) // grow and rehash
+  { size_t i,cap=s->cap?2*s->cap:64;
+    entry_t *t;
+    NEW(entry_t,t,cap);
+    ZERO(entry_t,t,cap);
+    for(i=0;i<s->cap;++i)
+      if(s->table[i].key)
+        *slot(t,cap,s->table[i].key)=s->table[i];
+    free(s->table);
+    s->table=t;
+    s->cap=cap;
+  }
+  e=slot(s->table,s->cap,key);
+  if(!e->key)
+  { NEW(char,e->key,strlen(key)+1);
+    strcpy(e->key,key);
+    ++s->n;
+  }
+  e->offset=offset;
+  e->nbytes=nbytes;
+  return 1;
+Error:
+  return 0;
+}
+
+//
+// === SHARDS ===
+//
+
+static unsigned truncate_at(FILE *fp, uint64_t n)
+{ TRY(0==fflush(fp));
+#ifdef _MSC_VER
+  TRY(0==_chsize_s(_fileno(fp),(__int64)n));
+#else
+  TRY(0==ftruncate(fileno(fp),(off_t)n));
+#endif
+  return 1;
+Error:
+  return 0;
+}
+
+/** Builds the index of \a s from the records in its file. */
+static unsigned scan(shard_t *s, const char *path)
+{ record_t r;
+  char key[MAXKEY+1];
+  uint64_t size,o=0;
+  TRY(0==fseeko(s->fp,0,SEEK_END));
+  size=(uint64_t)ftello(s->fp);
+  TRY(0==fseeko(s->fp,0,SEEK_SET));
+  while(o+sizeof(r)<=size)
+  { const uint64_t data=o+sizeof(r);
+    if(1!=fread(&r,sizeof(r),1,s->fp)) break;
+    if(r.magic!=MAGIC || r.keylen==0 || r.keylen>MAXKEY) break;
+    if(r.nbytes>size || data+r.keylen+r.nbytes>size) break;
+    if(1!=fread(key,r.keylen,1,s->fp)) break;
+    key[r.keylen]='\0';
+    TRY(insert(s,key,data+r.keylen,r.nbytes));
+    o=data+r.keylen+r.nbytes;
+    TRY(0==fseeko(s->fp,(int64_t)o,SEEK_SET));
+  }
+  if(o<size)
+  { LOG("%s: dropping %llu bytes after the last complete record."ENDL,path,(unsigned long long)(size-o));
+    TRY(truncate_at(s->fp,o));
+  }
+  s->end=o;
+  return 1;
+Error:
+  return 0;
+}
+
+/**
+ * Opens the file for shard \a s the first time it's used.  Call with s->lock held.
+ * \param[in] create  If 0 and the file doesn't exist, nothing is done.
+ * \returns 1 if the shard is open.
+ */
+static unsigned open_shard(shards_t self, shard_t *s, int create)
+{ char path[2048];
+  if(s->fp)
+    return 1;
+  TRY(snprintf(path,sizeof(path),"%s%c%s.%s",self->root,PATHSEP,s->name,SHARDS_EXT)<(int)sizeof(path));
+  if(self->truncate)
+  { if(!create) return 0;
+    TRY(s->fp=fopen(path,"w+b"));
+    return 1;
+  }
+  if(!(s->fp=fopen(path,"r+b")))
+  { if(!create) return 0;
+    TRY(s->fp=fopen(path,"w+b"));
+    return 1;
+  }
+  TRY(scan(s,path));
+  return 1;
+Error:
+  return 0;
+}
+
+static void free_shard(shard_t *s)
+{ size_t i;
+  if(!s) return;
+  if(s->fp) fclose(s->fp);
+  for(i=0;i<s->cap;++i)
+    free(s->table[i].key);
+  free(s->table);
+  free(s->name);
+  MutexFree(&s->lock);
+  free(s);
+}
+
+/** Writes the name of the shard holding \a key to \a name. */
+static unsigned shard_name(shards_t self, const char *key, char *name, size_t cap)
+{ size_t i,n=0;
+  unsigned d=0;
+  if(self->depth==0 || 0==strcmp(key,"."))
+    key="root";
+  for(i=0;key[i] && n+1<cap;++i)
+  { if(key[i]=='/' && ++d>=self->depth) break;
+    name[n++]=(key[i]=='/')?'-':key[i];
+  }
+  TRY(n+1<cap || !key[i]);
+  name[n]='\0';
+  return 1;
+Error:
+  return 0;
+}
+
+/** \returns the shard holding \a key, adding it to the list if it's new. */
+static shard_t* find_shard(shards_t self, const char *key)
+{ char name[MAXKEY+1];
+  shard_t *s=0;
+  size_t i;
+  TRY(shard_name(self,key,name,sizeof(name)));
+  MutexLock(&self->lock);
+  for(i=0;i<self->n;++i)
+    if(0==strcmp(self->shards[i]->name,name))
+    { s=self->shards[i];
+      break;
+    }
+  if(!s && (s=(shard_t*)malloc(sizeof(*s))))
+  { memset(s,0,sizeof(*s));
+    MutexInit(&s->lock);
+    if(self->n>=self->cap)
+    { shard_t **t=(shard_t**)realloc(self->shards,sizeof(*t)*(self->cap=self->cap?2*self->cap:16));
+      if(t) self->shards=t;
+      else  self->cap=self->n;
+    }
+    if(self->n<self->cap && (s->name=(char*)malloc(strlen(name)+1)))
+    { strcpy(s->name,name);
+      self->shards[self->n++]=s;
+    } else
+    { free_shard(s);
+      s=0;
+    }
+  }
+  MutexUnlock(&self->lock);
+  TRY(s);
+  return s;
+Error:
+  return 0;
+}
+
+//
+// === INTERFACE ===
+//
+
+/**
+ * Opens the container whose shards live in the directory \a root.
+ * Shard files are opened as they're needed.
+ * \param[in] depth     Number of address steps that pick a node's shard.
+ * \param[in] truncate  If 1, existing shards are emptied when they are first
+ *                      written.  Otherwise new records are appended to them.
+ * \returns 0 on failure.
+ */
+shards_t shards_open(const char *root, unsigned depth, int truncate)
+{ shards_t self=0;
+  NEW(struct _shards_t,self,1);
+  memset(self,0,sizeof(*self));
+  MutexInit(&self->lock);
+  NEW(char,self->root,strlen(root)+1);
+  strcpy(self->root,root);
+  self->depth=depth;
+  self->truncate=truncate;
+  return self;
+Error:
+  shards_close(self);
+  return 0;
+}
+
+void shards_close(shards_t self)
+{ size_t i;
+  if(!self) return;
+  for(i=0;i<self->n;++i)
+    free_shard(self->shards[i]);
+  free(self->shards);
+  free(self->root);
+  MutexFree(&self->lock);
+  free(self);
+}
+
+/**
+ * Appends \a nbytes of \a data to the shard for \a key and flushes it.
+ * \returns 1 on success, otherwise 0.
+ */
+unsigned shards_put(shards_t self, const char *key, const void *data, size_t nbytes)
+{ shard_t *s;
+  record_t r;
+  unsigned ok=0;
+  TRY(strlen(key)>0 && strlen(key)<=MAXKEY);
+  TRY(s=find_shard(self,key));
+  r.magic=MAGIC;
+  r.keylen=(uint32_t)strlen(key);
+  r.nbytes=nbytes;
+  MutexLock(&s->lock);
+  if(open_shard(self,s,1)
+     && 0==fseeko(s->fp,(int64_t)s->end,SEEK_SET)
+     && 1==fwrite(&r,sizeof(r),1,s->fp)
+     && 1==fwrite(key,r.keylen,1,s->fp)
+     && (!nbytes || 1==fwrite(data,nbytes,1,s->fp))
+     && 0==fflush(s->fp)
+     && insert(s,key,s->end+sizeof(r)+r.keylen,nbytes))
+  { s->end+=sizeof(r)+r.keylen+nbytes;
+    ok=1;
+  }
+  MutexUnlock(&s->lock);
+  TRY(ok);
+  return 1;
+Error:
+  LOG("Could not store %s in the %s shard."ENDL,key,self->root);
+  return 0;
+}
+
+/**
+ * Removes \a key by appending a record with no data.
+ * \returns 1 on success, otherwise 0.
+ */
+unsigned shards_remove(shards_t self, const char *key)
+{ return shards_put(self,key,0,0);
+}
+
+/**
+ * Reads the latest record for \a key.
+ * \param[out] nbytes  Size of the returned data.
+ * \returns 0 if there's no such record, if it was removed or on failure,
+ *          otherwise a buffer the caller must free().
+ */
+void* shards_get(shards_t self, const char *key, size_t *nbytes)
+{ shard_t *s;
+  entry_t *e;
+  void *out=0;
+  *nbytes=0;
+  TRY(s=find_shard(self,key));
+  MutexLock(&s->lock);
+  if(open_shard(self,s,0) && s->cap && (e=slot(s->table,s->cap,key))->key && e->nbytes)
+  { if((out=malloc((size_t)e->nbytes))
+       && (0!=fseeko(s->fp,(int64_t)e->offset,SEEK_SET)
+           || 1!=fread(out,(size_t)e->nbytes,1,s->fp)))
+    { free(out);
+      out=0;
+    }
+    if(out)
+      *nbytes=(size_t)e->nbytes;
+  }
+  MutexUnlock(&s->lock);
+  return out;
+Error:
+  return 0;
+}
@@ -0,0 +1,33 @@
+/**
+ * \file
+ * Sharded containers for the nodes of a rendered tree.
+ *
+ * Instead of one directory per node, nodes are appended to a few large shard
+ * files.  A node's shard is named after the first \a depth steps of its
+ * address, so each subtree below that depth is packed into one file.  For
+ * example, with a depth of 2, "3-1.tbs" holds node 3/1 and everything below
+ * it.  Nodes above that depth get a shard each, and the root is in
+ * "root.tbs".  A depth of 0 puts the whole tree in "root.tbs".
+ *
+ * Keys are node paths as written by address_to_path(), with "." for the root.
+ */
+#pragma once
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+
+#define SHARDS_EXT "tbs"
+
+typedef struct _shards_t* shards_t;
+
+shards_t shards_open  (const char *root, unsigned depth, int truncate);
+void     shards_close (shards_t self);
+unsigned shards_put   (shards_t self, const char *key, const void *data, size_t nbytes);
+unsigned shards_remove(shards_t self, const char *key);
+void*    shards_get   (shards_t self, const char *key, size_t *nbytes);
+
+#ifdef __cplusplus
+} //extern "C"
+#endif
@@ -19,14 +19,14 @@ int breakme() {}
 #define ZERO(T,e,N)   memset((e),0,(N)*sizeof(T))
 
 /*
-   Tile split for limited memory on the gpu.
+   Tile split for limited memory on the backend's device (gpu or host).
    Division is linearly spaced on z.
 */
 
 subdiv_t  make_subdiv(nd_t in, float *transform, int ndim,size_t free,size_t total)
 { subdiv_t ctx=0;
-#if HAVE_CUDA
   TRY(ndndim(in)>=3); // assume there's a z.
+  TRY(free>0);
   NEW(struct _subdiv_t,ctx,1);
   ZERO(struct _subdiv_t,ctx,1);
 #define CEIL(num,den) (((num)+(den)-1)/(den))
@@ -67,7 +67,6 @@ subdiv_t  make_subdiv(nd_t in, float *transform, int ndim,size_t free,size_t tot
       ctx->dz_nm[r]=ctx->dz_px*transform[(ndim+1)*r+2];
   }
   return ctx;
-#endif
 Error:
   return 0;
 }
@@ -0,0 +1,234 @@
+/**
+ * \file
+ * Saves rendered nodes on background threads.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "src/util/thread.h"
+#include "backend.h"
+#include "writer.h"
+
+#define ENDL        "\n"
+#define LOG(...)    fprintf(stderr,__VA_ARGS__)
+#define TRY(e)      do{if(!(e)) { LOG("%s(%d): %s()"ENDL "\tExpression evaluated as false."ENDL "\t%s"ENDL,__FILE__,__LINE__,__FUNCTION__,#e); goto Error;}} while(0)
+#define NEW(T,e,N)  TRY((e)=(T*)malloc(sizeof(T)*(N)))
+#define ZERO(T,e,N) memset((e),0,sizeof(T)*(N))
+
+typedef enum _slot_state_t
+{ SLOT_FREE=0,
+  SLOT_FILLING,   ///< writer_put() is copying a node in
+  SLOT_QUEUED,
+  SLOT_WRITING
+} slot_state_t;
+
+typedef struct _slot_t
+{ slot_state_t state;
+  uint64_t     seq;       ///< order in which nodes were put
+  nd_t         vol;       ///< host copy of the node.  Refers to data.
+  void        *data;
+  size_t       cap;       ///< bytes allocated for data
+  address_t    address;
+  aabb_t       bbox;      ///< NULL if the node was put without one
+  char         path[1024];///< address_to_path() of address.  Used to find descendants.
+} slot_t;
+
+struct _writer_t
+{ handler_t   handler;
+  void       *args;
+  slot_t     *slots;
+  unsigned    nslots;
+  tbthread_t *threads;
+  unsigned    nthreads,
+              share;      ///< threads each handler call may use for host kernels (see cpu_set_threads())
+  uint64_t    seq;
+  unsigned    ok;         ///< 0 once a write fails
+  int         closing;
+  tbmutex_t   lock;       ///< guards the slot states, seq, ok and closing
+  tbcond_t    changed;
+};
+
+/// \returns 1 if \a path names a node below the node named by \a parent.
+static int is_below(const char *path, const char *parent)
+{ const size_t n=strlen(parent);
+  if(!n) return path[0]!='\0';          // everything is below the root
+  return 0==strncmp(path,parent,n) && (path[n]=='/' || path[n]=='\\'); // address_to_path() uses the native separator
+}
+
+/**
+ * \returns the oldest queued slot with no earlier queued or writing
+ *          descendant, or 0 if there isn't one.  Call with the lock held.
+ */
+static slot_t* next_ready(writer_t self)
+{ slot_t *best=0;
+  unsigned i,j;
+  for(i=0;i<self->nslots;++i)
+  { slot_t *s=self->slots+i;
+    int blocked=0;
+    if(s->state!=SLOT_QUEUED || (best && best->seq<s->seq))
+      continue;
+    for(j=0;j<self->nslots && !blocked;++j)
+    { const slot_t *o=self->slots+j;
+      blocked=(o->state==SLOT_QUEUED || o->state==SLOT_WRITING) && o->seq<s->seq && is_below(o->path,s->path);
+    }
+    if(!blocked)
+      best=s;
+  }
+  return best;
+}
+
+static unsigned any_pending(writer_t self)
+{ unsigned i;
+  for(i=0;i<self->nslots;++i)
+    if(self->slots[i].state!=SLOT_FREE)
+      return 1;
+  return 0;
+}
+
+static void* write_loop(void *arg)
+{ writer_t self=(writer_t)arg;
+  cpu_set_threads(self->share); // the writers split the cores
+  MutexLock(&self->lock);
+  while(1)
+  { slot_t *s;
+    unsigned ok;
+    while(!(s=next_ready(self)) && !(self->closing && !any_pending(self)))
+      CondWait(&self->changed,&self->lock);
+    if(!s) break;
+    s->state=SLOT_WRITING;
+    MutexUnlock(&self->lock);
+    ok=self->handler(s->vol,s->address,s->bbox,self->args);
+    MutexLock(&self->lock);
+    if(!ok) self->ok=0;
+    s->state=SLOT_FREE;
+    CondBroadcast(&self->changed);
+  }
+  MutexUnlock(&self->lock);
+  return 0;
+}
+
+/** Copies \a vol, \a address and \a bbox into \a s.  The node's data is copied to host memory. */
+static unsigned fill(slot_t *s, nd_t vol, address_t address, aabb_t bbox)
+{ const size_t nbytes=ndnbytes(vol);
+  if(nbytes>s->cap)
+  { void *d;
+    TRY(d=realloc(s->data,nbytes));
+    s->data=d;
+    s->cap=nbytes;
+  }
+  TRY(ndreshape(ndcast(ndref(s->vol,s->data,nd_heap),ndtype(vol)),ndndim(vol),ndshape(vol)));
+  TRY(ndcopy(s->vol,vol,0,0));
+  free_address(s->address);
+  TRY(s->address=copy_address(address));
+  s->path[0]='\0'; // left as is for the root
+  TRY(address_to_path(s->path,sizeof(s->path),address));
+  if(bbox)
+    TRY(s->bbox=AABBCopy(s->bbox,bbox));
+  else
+  { AABBFree(s->bbox);
+    s->bbox=0;
+  }
+  return 1;
+Error:
+  return 0;
+}
+
+/**
+ * Starts \a nthreads threads that pass nodes to \a handler.
+ * \param[in] nbufs  Number of staging buffers.  At least one per thread is used.
+ * \returns 0 on failure.
+ */
+writer_t writer_open(handler_t handler, void *args, unsigned nthreads, unsigned nbufs)
+{ writer_t self=0;
+  unsigned i;
+  if(!nthreads) nthreads=1;
+  if(nbufs<nthreads) nbufs=nthreads;
+  NEW(struct _writer_t,self,1);
+  ZERO(struct _writer_t,self,1);
+  self->handler=handler;
+  self->args=args;
+  self->ok=1;
+  MutexInit(&self->lock);
+  CondInit(&self->changed);
+  NEW(slot_t,self->slots,nbufs);
+  ZERO(slot_t,self->slots,nbufs);
+  self->nslots=nbufs;
+  for(i=0;i<nbufs;++i)
+    TRY(self->slots[i].vol=ndinit());
+  NEW(tbthread_t,self->threads,nthreads);
+  if(!(self->share=ThreadCount()/nthreads))
+    self->share=1;
+  for(i=0;i<nthreads;++i)
+    self->nthreads+=ThreadCreate(self->threads+self->nthreads,write_loop,self);
+  TRY(self->nthreads);
+  LOG("Saving nodes on %u threads with %u staging buffers"ENDL,self->nthreads,self->nslots);
+  return self;
+Error:
+  writer_close(self);
+  return 0;
+}
+
+/**
+ * Queues a copy of \a vol to be saved.  Waits while every staging buffer is
+ * busy.  Must be called with the children of a node before the node itself.
+ * \returns 0 if the copy failed or an earlier write failed.
+ */
+unsigned writer_put(writer_t self, nd_t vol, address_t address, aabb_t bbox)
+{ slot_t *s=0;
+  unsigned i,ok;
+  MutexLock(&self->lock);
+  while(self->ok && !s)
+  { for(i=0;i<self->nslots && !s;++i)
+      if(self->slots[i].state==SLOT_FREE)
+        s=self->slots+i;
+    if(!s)
+      CondWait(&self->changed,&self->lock);
+  }
+  if(s)
+    s->state=SLOT_FILLING;
+  MutexUnlock(&self->lock);
+  if(!s) return 0;
+  ok=fill(s,vol,address,bbox);
+  MutexLock(&self->lock);
+  if(ok)
+  { s->seq=self->seq++;
+    s->state=SLOT_QUEUED;
+  } else
+  { s->state=SLOT_FREE;
+    self->ok=0;
+  }
+  CondBroadcast(&self->changed);
+  ok=self->ok;
+  MutexUnlock(&self->lock);
+  return ok;
+}
+
+/**
+ * Waits for the queued nodes to be saved, then stops the writer threads.
+ * \returns 1 if every node was saved, otherwise 0.
+ */
+unsigned writer_close(writer_t self)
+{ unsigned i,ok;
+  if(!self) return 1;
+  MutexLock(&self->lock);
+  self->closing=1;
+  CondBroadcast(&self->changed);
+  MutexUnlock(&self->lock);
+  for(i=0;i<self->nthreads;++i)
+    ThreadJoin(self->threads+i);
+  ok=self->ok;
+  if(self->slots)
+    for(i=0;i<self->nslots;++i)
+    { slot_t *s=self->slots+i;
+      if(s->vol) ndfree(ndref(s->vol,0,nd_unknown_kind)); // data is freed below
+      free(s->data);
+      free_address(s->address);
+      AABBFree(s->bbox);
+    }
+  free(self->slots);
+  free(self->threads);
+  CondFree(&self->changed);
+  MutexFree(&self->lock);
+  free(self);
+  return ok;
+}
@@ -0,0 +1,29 @@
+/**
+ * \file
+ * Saves rendered nodes on background threads.
+ *
+ * writer_put() copies a node into one of a fixed number of staging buffers
+ * and returns.  Writer threads pass the copies to the handler.  When every
+ * buffer is busy, writer_put() waits for one to be written, which bounds the
+ * memory held by nodes waiting to be saved.  Staging buffers are reused from
+ * one node to the next.
+ *
+ * A node is only handed to the handler once every node below it that was
+ * put earlier has been handled, so nodes are still finished children first.
+ */
+#pragma once
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "render.h"
+
+typedef struct _writer_t* writer_t;
+
+writer_t writer_open (handler_t handler, void *args, unsigned nthreads, unsigned nbufs);
+unsigned writer_put  (writer_t self, nd_t vol, address_t address, aabb_t bbox);
+unsigned writer_close(writer_t self);
+
+#ifdef __cplusplus
+} //extern "C"
+#endif
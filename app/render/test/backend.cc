@@ -0,0 +1,123 @@
+/**
+ * \file
+ * Tests: CPU backend kernels against the nd kernels they split up.
+ *
+ * backend.c promises that the slab-parallel host kernels agree with a
+ * single call to the nd kernel to within one count for integer types and a
+ * relative error of 1e-5 for floating point types.
+ * @cond TESTS
+ */
+
+// solves a std::tuple problem in vs2012
+#define GTEST_HAS_TR1_TUPLE     0
+#define GTEST_USE_OWN_TR1_TUPLE 1
+
+#include <gtest/gtest.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "nd.h"
+#include "backend.h"
+
+#define countof(e) (sizeof(e)/sizeof(*(e)))
+
+static const size_t shape[]={37,29,23}; // odd sizes leave a short last slab
+
+static nd_t make(nd_type_id_t type)
+{ return ndheap_ip(ndreshape(ndcast(ndinit(),type),3,shape));
+}
+
+/** Fills \a a with a smooth ramp plus noise, so both the filters and the interpolation have something to do. */
+static void fill(nd_t a)
+{ size_t i,n=ndnelem(a);
+  srand(42);
+  for(i=0;i<n;++i)
+  { double v=0.5+0.25*sin(i*0.01)+0.25*rand()/(double)RAND_MAX;
+    switch(ndtype(a))
+    { case nd_f32: ((float*)nddata(a))[i]=(float)v; break;
+      case nd_u16: ((uint16_t*)nddata(a))[i]=(uint16_t)(v*60000.0); break;
+      default: FAIL()<<"Unexpected type";
+    }
+  }
+}
+
+/** \returns the number of voxels in \a a that differ from \a expect by more than the backend's tolerance. */
+static size_t count_mismatches(nd_t a, nd_t expect)
+{ size_t i,n=ndnelem(a),bad=0;
+  for(i=0;i<n;++i)
+    switch(ndtype(a))
+    { case nd_f32:
+      { const float x=((float*)nddata(a))[i],e=((float*)nddata(expect))[i];
+        bad+=fabs(x-e)>1e-5*fmax(fabs(e),1e-3);
+        break;
+      }
+      case nd_u16:
+        bad+=abs((int)((uint16_t*)nddata(a))[i]-(int)((uint16_t*)nddata(expect))[i])>1;
+        break;
+      default: break;
+    }
+  return bad;
+}
+
+struct CPUBackend:public testing::TestWithParam<nd_type_id_t>
+{ nd_t src,expect,out;
+  void SetUp()
+  { ASSERT_NE((void*)NULL,src   =make(GetParam()));
+    ASSERT_NE((void*)NULL,expect=make(GetParam()));
+    ASSERT_NE((void*)NULL,out   =make(GetParam()));
+    fill(src);
+    ndfill(expect,0);
+    ndfill(out,0);
+  }
+  void TearDown()
+  { cpu_set_threads(0);
+    ndfree(src);
+    ndfree(expect);
+    ndfree(out);
+  }
+};
+
+TEST_P(CPUBackend,Conv1MatchesSingleSlab)
+{ const float taps[]={0.1f,0.2f,0.4f,0.2f,0.1f};
+  const size_t ntaps=countof(taps);
+  const unsigned threads[]={1,4};
+  nd_conv_params_t params={nd_boundary_replicate};
+  nd_t filter;
+  unsigned idim,t;
+  ASSERT_NE((void*)NULL,filter=ndheap_ip(ndreshape(ndcast(ndinit(),nd_f32),1,&ntaps)));
+  memcpy(nddata(filter),taps,sizeof(taps));
+  for(idim=0;idim<3;++idim)
+  { ASSERT_NE((void*)NULL,ndconv1(expect,src,filter,idim,&params))<<nderror(expect);
+    for(t=0;t<countof(threads);++t)
+    { cpu_set_threads(threads[t]);
+      ndfill(out,0);
+      ASSERT_NE((void*)NULL,cpu_conv1(out,src,filter,idim,&params));
+      EXPECT_EQ(0,count_mismatches(out,expect))<<"idim "<<idim<<", "<<threads[t]<<" threads";
+    }
+  }
+  ndfree(filter);
+}
+
+TEST_P(CPUBackend,AffineMatchesSingleSlab)
+{ // maps dst voxels to src voxels: a small rotation about z, a scale and a shift
+  const float c=(float)cos(0.1),s=(float)sin(0.1);
+  const float transform[]={
+    1.1f*c, -s,   0.0f, 1.5f,
+       s,   c,    0.0f,-2.25f,
+    0.0f, 0.0f,  0.9f,  0.75f,
+    0.0f, 0.0f,  0.0f,  1.0f};
+  const unsigned threads[]={1,4};
+  nd_affine_params_t params={0};
+  unsigned t;
+  ASSERT_NE((void*)NULL,ndaffine(expect,src,transform,&params))<<nderror(expect);
+  for(t=0;t<countof(threads);++t)
+  { cpu_set_threads(threads[t]);
+    ndfill(out,0);
+    ASSERT_NE((void*)NULL,cpu_affine(out,src,transform,&params));
+    EXPECT_EQ(0,count_mismatches(out,expect))<<threads[t]<<" threads";
+  }
+}
+
+INSTANTIATE_TEST_CASE_P(Types,CPUBackend,testing::Values(nd_f32,nd_u16));
+///@endcond
@@ -0,0 +1,285 @@
+/**
+ * \file
+ * Tests: Encoding and decoding chunked node volumes.
+ *
+ * Volumes have to come back bit for bit, whatever their type and contents
+ * and however the last chunk falls.  Corrupt buffers have to be rejected
+ * without reading or writing out of bounds.
+ * @cond TESTS
+ */
+
+// solves a std::tuple problem in vs2012
+#define GTEST_HAS_TR1_TUPLE     0
+#define GTEST_USE_OWN_TR1_TUPLE 1
+
+#include <gtest/gtest.h>
+#include <vector>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "nd.h"
+#include "chunked.h"
+
+#define countof(e) (sizeof(e)/sizeof(*(e)))
+
+typedef std::vector<uint8_t> bytes_t;
+
+enum contents_t { RANDOM, CONSTANT, SMOOTH };
+
+static nd_t make(nd_type_id_t type, unsigned ndim, const size_t *shape)
+{ return ndheap_ip(ndreshape(ndcast(ndinit(),type),ndim,shape));
+}
+
+/** RANDOM bytes don't compress.  CONSTANT and SMOOTH leave most bit planes constant. */
+static void fill(nd_t a, contents_t contents)
+{ uint8_t *d=(uint8_t*)nddata(a);
+  const size_t n=ndnbytes(a),bpp=n/ndnelem(a);
+  size_t i;
+  srand(42);
+  for(i=0;i<n;++i)
+    switch(contents)
+    { case RANDOM:   d[i]=(uint8_t)rand(); break;
+      case CONSTANT: d[i]=0x5a; break;
+      case SMOOTH:   d[i]=(i%bpp)?0:(uint8_t)((i/bpp/64)+(rand()&1)); break; // small values in the low byte
+    }
+}
+
+static bytes_t encode(nd_t vol, size_t chunk_bytes)
+{ const int64_t origin[3]={-1,2,-3};
+  const double  scale[3]={0.5,1.5,2.0};
+  size_t nbytes=0;
+  uint8_t *buf=(uint8_t*)chunked_encode(vol,origin,scale,chunk_bytes,&nbytes);
+  bytes_t out;
+  if(buf)
+    out.assign(buf,buf+nbytes);
+  free(buf);
+  return out;
+}
+
+static nd_t decode(const bytes_t &buf)
+{ return chunked_decode(buf.empty()?0:&buf[0],buf.size(),0,0);
+}
+
+static void expect_same(nd_t a, nd_t b)
+{ ASSERT_NE((void*)NULL,a);
+  ASSERT_NE((void*)NULL,b);
+  ASSERT_EQ(ndtype(a),ndtype(b));
+  ASSERT_EQ(ndndim(a),ndndim(b));
+  EXPECT_EQ(0,memcmp(ndshape(a),ndshape(b),ndndim(a)*sizeof(size_t)));
+  ASSERT_EQ(ndnbytes(a),ndnbytes(b));
+  EXPECT_EQ(0,memcmp(nddata(a),nddata(b),ndnbytes(a)));
+}
+
+//
+// === ROUND TRIPS ===
+//
+
+struct ChunkedRoundTrip:public testing::TestWithParam<nd_type_id_t>
+{ void check(unsigned ndim, const size_t *shape, contents_t contents, size_t chunk_bytes)
+  { nd_t vol,out;
+    bytes_t buf;
+    ASSERT_NE((void*)NULL,vol=make(GetParam(),ndim,shape));
+    fill(vol,contents);
+    buf=encode(vol,chunk_bytes);
+    ASSERT_FALSE(buf.empty());
+    out=decode(buf);
+    expect_same(vol,out);
+    ndfree(vol);
+    if(out) ndfree(out);
+  }
+};
+
+TEST_P(ChunkedRoundTrip,Random)
+{ const size_t shape[]={64,32,8};
+  check(countof(shape),shape,RANDOM,4096);
+}
+
+TEST_P(ChunkedRoundTrip,Constant)
+{ const size_t shape[]={64,32,8};
+  check(countof(shape),shape,CONSTANT,4096);
+}
+
+TEST_P(ChunkedRoundTrip,Smooth)
+{ const size_t shape[]={64,32,8};
+  check(countof(shape),shape,SMOOTH,4096);
+}
+
+TEST_P(ChunkedRoundTrip,PartialLastChunk)
+{ const size_t shape[]={37,29,3};       // odd, so the last chunk ends part way through a group of 8 elements
+  const contents_t contents[]={RANDOM,CONSTANT,SMOOTH};
+  unsigned i;
+  for(i=0;i<countof(contents);++i)
+  { check(countof(shape),shape,contents[i],1000);
+    check(countof(shape),shape,contents[i],1);   // rounds up to one group of 8 elements per chunk
+  }
+}
+
+TEST_P(ChunkedRoundTrip,SingleElement)
+{ const size_t shape[]={1};
+  check(countof(shape),shape,RANDOM,0);
+}
+
+INSTANTIATE_TEST_CASE_P(Types,ChunkedRoundTrip,
+  testing::Values(nd_u8,nd_u16,nd_u32,nd_u64,nd_i8,nd_i16,nd_i32,nd_i64,nd_f32,nd_f64));
+
+TEST(Chunked,KeepsPlacement)
+{ const size_t shape[]={16,16};
+  int64_t origin[3];
+  double scale[3];
+  nd_t vol,out;
+  bytes_t buf;
+  ASSERT_NE((void*)NULL,vol=make(nd_u16,countof(shape),shape));
+  fill(vol,SMOOTH);
+  buf=encode(vol,0);
+  ASSERT_NE((void*)NULL,out=chunked_decode(&buf[0],buf.size(),origin,scale));
+  EXPECT_EQ(-1,origin[0]); EXPECT_EQ(2,origin[1]); EXPECT_EQ(-3,origin[2]);
+  EXPECT_EQ(0.5,scale[0]); EXPECT_EQ(1.5,scale[1]); EXPECT_EQ(2.0,scale[2]);
+  ndfree(vol);
+  ndfree(out);
+}
+
+//
+// === CORRUPT INPUT ===
+//
+
+/**
+ * The encoding of a CONSTANT u8 volume in 4 chunks of 64 bytes.  Every chunk
+ * is compressed, so the chunks can be swapped for hand made LZ streams.
+ */
+struct ChunkedCorrupt:public testing::Test
+{ nd_t    vol;
+  bytes_t good;
+  size_t  nheader;  ///< bytes before the chunk sizes
+  enum { NCHUNKS=4, CHUNK=64 };
+
+  void SetUp()
+  { const size_t shape[]={NCHUNKS*CHUNK},one[]={CHUNK};
+    uint64_t size;
+    nd_t r;
+    bytes_t stored;
+    // a single incompressible chunk is stored, which gives away the header size
+    ASSERT_NE((void*)NULL,r=make(nd_u8,1,one));
+    fill(r,RANDOM);
+    stored=encode(r,CHUNK);
+    ndfree(r);
+    ASSERT_GT(stored.size(),sizeof(uint64_t)+CHUNK);
+    nheader=stored.size()-sizeof(uint64_t)-CHUNK;
+    memcpy(&size,&stored[nheader],sizeof(size));
+    ASSERT_EQ((uint64_t)CHUNK,size);
+
+    ASSERT_NE((void*)NULL,vol=make(nd_u8,1,shape));
+    fill(vol,CONSTANT);
+    good=encode(vol,CHUNK);
+    ASSERT_LT(good.size(),nheader+NCHUNKS*(sizeof(uint64_t)+CHUNK)); // compressed
+  }
+  void TearDown()
+  { ndfree(vol);
+  }
+
+  uint64_t size_of(size_t i) const
+  { uint64_t s;
+    memcpy(&s,&good[nheader+i*sizeof(s)],sizeof(s));
+    return s;
+  }
+
+  /** \returns the good encoding with the first chunk replaced by \a stream. */
+  bytes_t with_first_chunk(const bytes_t &stream) const
+  { const size_t payload=nheader+NCHUNKS*sizeof(uint64_t);
+    const uint64_t n=stream.size();
+    bytes_t out(good.begin(),good.begin()+payload);
+    memcpy(&out[nheader],&n,sizeof(n));
+    out.insert(out.end(),stream.begin(),stream.end());
+    out.insert(out.end(),good.begin()+payload+(size_t)size_of(0),good.end());
+    return out;
+  }
+
+  void expect_rejected(const bytes_t &buf, const char *why)
+  { nd_t out=decode(buf);
+    EXPECT_EQ((void*)NULL,out)<<why;
+    if(out) ndfree(out);
+  }
+};
+
+TEST_F(ChunkedCorrupt,GoodDecodes)
+{ nd_t out=decode(good);
+  expect_same(vol,out);
+  if(out) ndfree(out);
+}
+
+TEST_F(ChunkedCorrupt,Truncated)
+{ size_t n;
+  for(n=0;n<good.size();++n)
+    expect_rejected(bytes_t(good.begin(),good.begin()+n),"truncated");
+}
+
+TEST_F(ChunkedCorrupt,TrailingBytes)
+{ bytes_t buf(good);
+  buf.push_back(0);
+  expect_rejected(buf,"trailing byte");
+}
+
+TEST_F(ChunkedCorrupt,BadMagic)
+{ bytes_t buf(good);
+  buf[0]^=0xff;
+  expect_rejected(buf,"magic");
+}
+
+TEST_F(ChunkedCorrupt,BadVersion)
+{ bytes_t buf(good);
+  buf[4]^=0xff;
+  expect_rejected(buf,"version");
+}
+
+TEST_F(ChunkedCorrupt,ChunkSizes)
+{ const uint64_t sizes[]={0,CHUNK+1,~(uint64_t)0};
+  unsigned i;
+  for(i=0;i<countof(sizes);++i)
+  { bytes_t buf(good);
+    memcpy(&buf[nheader],&sizes[i],sizeof(sizes[i]));
+    expect_rejected(buf,"chunk size");
+  }
+  { bytes_t buf(good); // sizes that don't add up to the payload
+    const uint64_t s=size_of(0)+1;
+    memcpy(&buf[nheader],&s,sizeof(s));
+    expect_rejected(buf,"payload size");
+  }
+}
+
+TEST_F(ChunkedCorrupt,LZStreams)
+{ // token: literal count in the high nibble, match length-4 in the low nibble
+  static const uint8_t
+    offset_zero[]      ={0x10,'a',0,0, 0x50,'a','a','a','a','a'},
+    offset_too_far[]   ={0x10,'a',2,0, 0x50,'a','a','a','a','a'},
+    no_offset[]        ={0x10,'a',1},
+    length_past_end[]  ={0xf0,255,255},
+    match_too_long[]   ={0x1f,'a',1,0,255,0, 0x50,'a','a','a','a','a'},
+    short_output[]     ={0x50,'a','a','a','a','a'},
+    long_output[]      ={0x1f,'a',1,0,40, 0x50,'a','a','a','a','a'}; // 1+59 bytes, then 5 literals
+  const struct { const uint8_t *s; size_t n; const char *why; } cases[]={
+    {offset_zero,      sizeof(offset_zero),      "offset 0"},
+    {offset_too_far,   sizeof(offset_too_far),   "offset before the start"},
+    {no_offset,        sizeof(no_offset),        "missing offset"},
+    {length_past_end,  sizeof(length_past_end),  "literal length runs off the end"},
+    {match_too_long,   sizeof(match_too_long),   "match runs past the chunk"},
+    {short_output,     sizeof(short_output),     "too little output"},
+    {long_output,      sizeof(long_output),      "literals run past the chunk"},
+  };
+  unsigned i;
+  for(i=0;i<countof(cases);++i)
+    expect_rejected(with_first_chunk(bytes_t(cases[i].s,cases[i].s+cases[i].n)),cases[i].why);
+}
+
+TEST_F(ChunkedCorrupt,FlippedBytesStayInBounds)
+{ // most of these decode to something else, but none may touch memory outside the buffers
+  size_t i;
+  for(i=0;i<good.size();++i)
+  { bytes_t buf(good);
+    nd_t out;
+    buf[i]^=0xff;
+    if((out=decode(buf)))
+    { EXPECT_EQ(ndnbytes(vol),ndnbytes(out))<<"byte "<<i;
+      ndfree(out);
+    }
+  }
+}
+///@endcond
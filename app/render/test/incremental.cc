@@ -0,0 +1,229 @@
+/**
+ * \file
+ * Tests: Re-rendering only the part of the tree that changed tiles touch.
+ *
+ * When tiles move or go away, only the nodes overlapping their old or new
+ * bounds are rendered again.  Together with the nodes kept from the earlier
+ * render, they have to give the same tree as rendering everything again.
+ * Nodes that no longer hold any tile have to be discarded.
+ * @cond TESTS
+ */
+
+// solves a std::tuple problem in vs2012
+#define GTEST_HAS_TR1_TUPLE     0
+#define GTEST_USE_OWN_TR1_TUPLE 1
+
+#include <gtest/gtest.h>
+#include <map>
+#include <set>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "tilebase.h"
+#include "src/synthetic.h"
+#include "config.h"
+#include "nd.h"
+#include "render.h"
+#include "changes.h"
+
+#define LATTICE_PATH TILEBASE_TEST_OUTPUT_PATH "/render-incremental-lattice"
+#define FIRST_TILE   "00000-00000-00000"
+#define LAST_TILE    LATTICE_PATH "/00000-00001-00001"
+
+typedef std::map<uint64_t,nd_t>    nodes_t; ///< keyed by address_to_int(address,10)
+typedef std::map<uint64_t,aabb3_t> boxes_t;
+typedef std::set<uint64_t>         keys_t;
+
+struct tree_t
+{ nodes_t nodes;
+  boxes_t boxes;
+};
+
+static uint64_t key(address_t a)
+{ return address_to_int(a,10);
+}
+
+static nd_t copy(nd_t a)
+{ nd_t out=ndheap(a);
+  return out?ndcopy(out,a,0,0):0;
+}
+
+static void clear(tree_t *tree)
+{ for(nodes_t::iterator it=tree->nodes.begin();it!=tree->nodes.end();++it)
+    ndfree(it->second);
+  tree->nodes.clear();
+  tree->boxes.clear();
+}
+
+static unsigned keep(nd_t vol, address_t address, aabb_t bbox, void *args)
+{ tree_t *tree=(tree_t*)args;
+  aabb3_t box;
+  nd_t c;
+  if(tree->nodes.count(key(address))) // saved twice
+    return 0;
+  if(!AABB3FromAABB(&box,bbox) || !(c=copy(vol)))
+    return 0;
+  tree->nodes[key(address)]=c;
+  tree->boxes[key(address)]=box;
+  return 1;
+}
+
+static keys_t keys_of(const nodes_t &nodes)
+{ keys_t out;
+  for(nodes_t::const_iterator it=nodes.begin();it!=nodes.end();++it)
+    out.insert(it->first);
+  return out;
+}
+
+static void expect_same(const nodes_t &expect, const nodes_t &actual)
+{ nodes_t::const_iterator e,a;
+  ASSERT_EQ(expect.size(),actual.size());
+  for(e=expect.begin();e!=expect.end();++e)
+  { ASSERT_NE(actual.end(),a=actual.find(e->first))<<"node "<<e->first;
+    ASSERT_EQ(ndnbytes(e->second),ndnbytes(a->second))<<"node "<<e->first;
+    EXPECT_EQ(0,memcmp(nddata(e->second),nddata(a->second),ndnbytes(e->second)))
+      <<"node "<<e->first<<" differs from the one rendered from scratch.";
+  }
+}
+
+// loader_t and discard_t don't take a context
+static tree_t g_saved;      ///< nodes from the first render
+static keys_t g_discarded;
+
+static nd_t load(address_t address)
+{ nodes_t::iterator it=g_saved.nodes.find(key(address));
+  return (it==g_saved.nodes.end())?0:copy(it->second);
+}
+
+static unsigned discard(address_t address)
+{ g_discarded.insert(key(address));
+  return 1;
+}
+
+/** The parameter is the number of leaves rendered at once.  1 renders them in order. */
+struct RenderIncremental:public testing::TestWithParam<unsigned>
+{ synthetic_lattice_t lattice;
+  struct render opts;
+  tiles_t previous,tiles;
+  aabb3_t *changed;
+  size_t nchanged;
+  tree_t yielded,scratch;
+
+  void SetUp()
+  { ndioAddPluginPath(ND_ROOT_DIR"/bin/plugins");
+    previous=tiles=0;
+    changed=0;
+    nchanged=0;
+    g_discarded.clear();
+    memset(&lattice,0,sizeof(lattice));
+    lattice.count[0]=lattice.count[1]=2;
+    lattice.count[2]=1;
+    lattice.overlap=0.25;
+    lattice.tile.dims[0]=lattice.tile.dims[1]=32;
+    lattice.tile.dims[2]=4;
+    lattice.tile.voxel[0]=lattice.tile.voxel[1]=lattice.tile.voxel[2]=1000.0;
+    lattice.tile.type=nd_u16;
+    lattice.ext="tif";
+    remove(LATTICE_PATH "/tilebase.cache.yml"); // an earlier test may have moved or removed a tile
+    ASSERT_EQ(4u,SyntheticLatticeMake(LATTICE_PATH,&lattice,NULL,NULL));
+    ASSERT_NE((void*)NULL,previous=TileBaseOpen(LATTICE_PATH,"tilebase.synthetic"));
+    ASSERT_NE((void*)NULL,TileBaseFootprintBoxes(previous)); // before the files change underneath
+
+    memset(&opts,0,sizeof(opts));
+    opts.voxel_um[0]=opts.voxel_um[1]=opts.voxel_um[2]=2.0;
+    opts.size[0]=opts.size[1]=opts.size[2]=1.0;
+    opts.countof_leaf=150; // the root is 28x28x2 voxels, the leaves are 7x7x2
+    opts.nchildren=4;
+    opts.input_filter_scale_thresh=0.25f;
+    opts.output_filter_scale_thresh=0.25f;
+    opts.backend=RENDER_BACKEND_CPU;
+    opts.nthreads=GetParam();
+    ASSERT_EQ(1,render(&opts,previous,keep,&g_saved));
+    ASSERT_EQ(21u,g_saved.nodes.size()); // the root, its 4 children and their 16 children
+  }
+
+  void TearDown()
+  { clear(&g_saved);
+    clear(&yielded);
+    clear(&scratch);
+    free(changed);
+    if(tiles)    TileBaseClose(tiles);
+    if(previous) TileBaseClose(previous);
+  }
+
+  /** Renders \a tiles again, only where it differs from \a previous. */
+  void rerender()
+  { ASSERT_NE((void*)NULL,changed=changes_from_diff(previous,tiles,&nchanged));
+    ASSERT_LT(0u,nchanged);
+    opts.changed=changed;
+    opts.nchanged=nchanged;
+    opts.loader=load;
+    opts.discard=discard;
+    ASSERT_EQ(1,render(&opts,tiles,keep,&yielded));
+    opts.changed=0;
+    opts.nchanged=0;
+    opts.loader=0;
+    opts.discard=0;
+    ASSERT_EQ(1,render(&opts,tiles,keep,&scratch));
+  }
+
+  /** \returns the nodes of \a tree whose box overlaps a changed box. */
+  keys_t touched(const tree_t &tree)
+  { keys_t out;
+    for(boxes_t::const_iterator it=tree.boxes.begin();it!=tree.boxes.end();++it)
+      if(AABBHitMany(0,changed,nchanged,&it->second))
+        out.insert(it->first);
+    return out;
+  }
+
+  /** \returns the earlier render with the discarded nodes removed and the yielded ones replaced. */
+  nodes_t merged()
+  { nodes_t out;
+    nodes_t::const_iterator it;
+    for(it=g_saved.nodes.begin();it!=g_saved.nodes.end();++it)
+      if(!g_discarded.count(it->first))
+        out[it->first]=it->second;
+    for(it=yielded.nodes.begin();it!=yielded.nodes.end();++it)
+      out[it->first]=it->second;
+    return out;
+  }
+};
+
+TEST_P(RenderIncremental,MovedTileRendersWhatItTouches)
+{ const int64_t origin[]={2000,0,0}; // one output voxel along x.  The overall bounds stay the same.
+  tile_update_t update={FIRST_TILE,3,origin,0};
+  keys_t expect;
+  ASSERT_NE((void*)NULL,tiles=TileBaseOpen(LATTICE_PATH,"tilebase.synthetic"));
+  ASSERT_EQ(1u,TileBaseUpdate(tiles,&update,1));
+  rerender();
+  ASSERT_EQ(2u,nchanged); // old and new bounds
+  expect=touched(scratch);
+  EXPECT_LT(expect.size(),scratch.nodes.size()); // otherwise this tests nothing
+  EXPECT_EQ(expect,keys_of(yielded.nodes));
+  EXPECT_TRUE(g_discarded.empty());
+  expect_same(scratch.nodes,merged());
+}
+
+TEST_P(RenderIncremental,RemovedTileIsDiscarded)
+{ keys_t expect;
+  ASSERT_EQ(0,remove(LAST_TILE "/" SYNTHETIC_DESCRIPTOR));
+  ASSERT_EQ(0,remove(LAST_TILE "/volume.tif"));
+  remove(LATTICE_PATH "/tilebase.cache.yml");
+  ASSERT_NE((void*)NULL,tiles=TileBaseOpen(LATTICE_PATH,"tilebase.synthetic"));
+  ASSERT_EQ(3u,TileBaseCount(tiles));
+  rerender();
+  ASSERT_EQ(1u,nchanged);
+  { const keys_t t=touched(g_saved);
+    for(keys_t::const_iterator it=t.begin();it!=t.end();++it)
+      if(!TileBaseHitMany(tiles,0,&g_saved.boxes[*it])) // only the removed tile was there
+        expect.insert(*it);
+  }
+  EXPECT_FALSE(expect.empty());
+  EXPECT_EQ(expect,g_discarded);
+  for(keys_t::const_iterator it=expect.begin();it!=expect.end();++it)
+    EXPECT_EQ(0u,yielded.nodes.count(*it))<<"node "<<*it<<" was rendered without any tile.";
+  expect_same(scratch.nodes,merged());
+}
+
+INSTANTIATE_TEST_CASE_P(Workers,RenderIncremental,testing::Values(1u,4u));
+///@endcond
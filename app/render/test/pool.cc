@@ -0,0 +1,211 @@
+/**
+ * \file
+ * Tests: The buffer pool.
+ *
+ * Buffers come in size classes from 4 KiB up, four per power of two, so a
+ * buffer is never more than 25% larger than asked for.  Sizes no class can
+ * hold are refused.  Everything here uses host buffers, so it runs without
+ * a GPU.
+ * @cond TESTS
+ */
+
+// solves a std::tuple problem in vs2012
+#define GTEST_HAS_TR1_TUPLE     0
+#define GTEST_USE_OWN_TR1_TUPLE 1
+
+#include <gtest/gtest.h>
+#include <stdint.h>
+#include <string.h>
+#include "nd.h"
+#include "pool.h"
+
+#define countof(e) (sizeof(e)/sizeof(*(e)))
+
+struct Pool:public testing::Test
+{ pool_t pool;
+  void SetUp()
+  { ASSERT_NE((void*)NULL,pool=pool_make());
+  }
+  void TearDown()
+  { pool_free(pool);
+  }
+
+  size_t allocated()
+  { size_t n;
+    pool_stats(pool,&n,0,0);
+    return n;
+  }
+
+  size_t inuse()
+  { size_t n;
+    pool_stats(pool,0,&n,0);
+    return n;
+  }
+
+  nd_t get(size_t nbytes)
+  { return pool_get(pool,RENDER_BACKEND_CPU,nd_u8,1,&nbytes);
+  }
+
+  /** \returns the bytes allocated for a new buffer holding \a nbytes, or 0 if it couldn't be had. */
+  size_t capacity_for(size_t nbytes)
+  { const size_t before=allocated();
+    nd_t a=get(nbytes); // never put back, so a new block is made each time
+    return a?allocated()-before:0;
+  }
+};
+
+TEST_F(Pool,SmallestClassIs4KiB)
+{ EXPECT_EQ(4096u,capacity_for(1));
+  EXPECT_EQ(4096u,capacity_for(4096));
+  EXPECT_EQ(5120u,capacity_for(4097));
+}
+
+TEST_F(Pool,ClassesAreExactAtTheirBounds)
+{ unsigned c;
+  for(c=0;c<40;++c) // 4,5,6,7 KiB, then 8,10,12,14 KiB, ... up to 3.5 MiB
+  { const size_t bytes=(size_t)(4+(c&3))<<((c>>2)+10),
+                 next  =(size_t)(4+((c+1)&3))<<(((c+1)>>2)+10);
+    EXPECT_EQ(bytes,capacity_for(bytes))<<"class "<<c;
+    EXPECT_EQ(next,capacity_for(bytes+1))<<"class "<<c<<" + 1 byte";
+  }
+}
+
+TEST_F(Pool,NeverMoreThanAQuarterLarger)
+{ size_t n;
+  for(n=4097;n<(16u<<20);n+=n/7+13) // odd steps land all over the classes
+  { const size_t cap=capacity_for(n);
+    ASSERT_GE(cap,n);
+    EXPECT_LE(cap,n+n/4+1024)<<n<<" bytes"; // +1024 because requests are first rounded up to KiB
+  }
+}
+
+TEST_F(Pool,HugeSizesAreRefused)
+{ const size_t huge[]={SIZE_MAX,SIZE_MAX-1023,SIZE_MAX/2,(size_t)1<<62};
+  const size_t overflows[]={(size_t)1<<40,(size_t)1<<40}; // 2^80 bytes
+  unsigned i;
+  for(i=0;i<countof(huge);++i)
+    EXPECT_EQ((void*)NULL,get(huge[i]))<<huge[i]<<" bytes";
+  EXPECT_EQ((void*)NULL,pool_get(pool,RENDER_BACKEND_CPU,nd_u8,2,overflows));
+  EXPECT_EQ((void*)NULL,pool_get(pool,RENDER_BACKEND_CPU,nd_u64,1,huge+3));
+  EXPECT_EQ(0u,pool_reserve(pool,RENDER_BACKEND_CPU,SIZE_MAX,1));
+  EXPECT_EQ(0u,allocated());
+}
+
+TEST_F(Pool,HostBuffersNeedNoDevice)
+{ const size_t shape[]={33,17,5};
+  nd_t a;
+  ASSERT_NE((void*)NULL,a=pool_get(pool,RENDER_BACKEND_CPU,nd_f32,countof(shape),shape));
+  EXPECT_EQ(nd_heap,ndkind(a));
+  EXPECT_EQ(nd_f32,ndtype(a));
+  EXPECT_EQ(3u,ndndim(a));
+  EXPECT_EQ(0,memcmp(shape,ndshape(a),sizeof(shape)));
+  EXPECT_EQ(0u,((uintptr_t)nddata(a))%POOL_ALIGNMENT);
+  memset(nddata(a),0xff,ndnbytes(a)); // the whole array is writable
+  EXPECT_EQ(1,pool_put(pool,a));
+}
+
+TEST_F(Pool,PutTwiceIsCaught)
+{ nd_t a,foreign;
+  const size_t shape[]={8};
+  ASSERT_NE((void*)NULL,a=get(100));
+  EXPECT_EQ(1,pool_put(pool,a));
+  EXPECT_EQ(-1,pool_put(pool,a));
+  EXPECT_EQ(0u,inuse());
+  ASSERT_NE((void*)NULL,foreign=ndheap_ip(ndreshape(ndcast(ndinit(),nd_u8),1,shape)));
+  EXPECT_EQ(0,pool_put(pool,foreign)); // not from the pool; left alone
+  EXPECT_EQ(0,pool_put(pool,0));
+  ndfree(foreign);
+}
+
+TEST_F(Pool,PutBuffersAreReused)
+{ nd_t a,b;
+  size_t before;
+  ASSERT_NE((void*)NULL,a=get(6000));
+  EXPECT_EQ(1,pool_put(pool,a));
+  before=allocated();
+  ASSERT_NE((void*)NULL,b=get(5500)); // same class
+  EXPECT_EQ(a,b);
+  EXPECT_EQ(before,allocated());
+  EXPECT_EQ(1,pool_put(pool,b));
+}
+
+TEST_F(Pool,BiggerFreeBuffersAreNotUsed)
+{ nd_t a,b;
+  size_t before;
+  ASSERT_NE((void*)NULL,a=get(8192));
+  EXPECT_EQ(1,pool_put(pool,a));
+  before=allocated();
+  ASSERT_NE((void*)NULL,b=get(5000)); // would be 60% larger
+  EXPECT_NE(a,b);
+  EXPECT_EQ(before+5120,allocated());
+  EXPECT_EQ(1,pool_put(pool,b));
+}
+
+TEST_F(Pool,PutBeyondTheLimitIsFreed)
+{ nd_t a[3],b;
+  unsigned i;
+  pool_set_limit(pool,8192);
+  for(i=0;i<countof(a);++i)
+    ASSERT_NE((void*)NULL,a[i]=get(4096));
+  EXPECT_EQ(12288u,allocated());
+  EXPECT_EQ(1,pool_put(pool,a[0]));
+  EXPECT_EQ(1,pool_put(pool,a[1]));
+  EXPECT_EQ(12288u,allocated());  // both kept
+  EXPECT_EQ(1,pool_put(pool,a[2]));
+  EXPECT_EQ(8192u,allocated());   // the third is freed
+  EXPECT_EQ(0u,inuse());
+  ASSERT_NE((void*)NULL,b=get(4096));
+  EXPECT_EQ(8192u,allocated());   // the kept ones are still found
+  EXPECT_EQ(1,pool_put(pool,b));
+}
+
+TEST_F(Pool,ReservedBuffersAreUsed)
+{ size_t before;
+  nd_t a;
+  ASSERT_EQ(1u,pool_reserve(pool,RENDER_BACKEND_CPU,1<<20,2));
+  EXPECT_EQ(2u<<20,before=allocated());
+  EXPECT_EQ(0u,inuse());
+  ASSERT_NE((void*)NULL,a=get(1<<20));
+  EXPECT_EQ(before,allocated());
+  EXPECT_EQ(1u<<20,inuse());
+  EXPECT_EQ(1,pool_put(pool,a));
+}
+
+TEST_F(Pool,FitReshapesInPlace)
+{ const size_t small[]={1000},fits[]={20,200};
+  nd_t a,b;
+  size_t before;
+  ASSERT_NE((void*)NULL,a=pool_get(pool,RENDER_BACKEND_CPU,nd_u16,1,small)); // 2000 bytes in 4 KiB
+  before=allocated();
+  ASSERT_NE((void*)NULL,b=pool_fit(pool,RENDER_BACKEND_CPU,a,nd_u8,2,fits)); // 4000 bytes
+  EXPECT_EQ(a,b);
+  EXPECT_EQ(nd_u8,ndtype(b));
+  EXPECT_EQ(2u,ndndim(b));
+  EXPECT_EQ(0,memcmp(fits,ndshape(b),sizeof(fits)));
+  EXPECT_EQ(before,allocated());
+  EXPECT_EQ(1,pool_put(pool,b));
+}
+
+TEST_F(Pool,FitGrowsIntoABiggerBuffer)
+{ const size_t small[]={1000},big[]={100,100};
+  nd_t a,b;
+  size_t before;
+  ASSERT_NE((void*)NULL,a=pool_get(pool,RENDER_BACKEND_CPU,nd_u8,1,small));
+  before=allocated();
+  ASSERT_NE((void*)NULL,b=pool_fit(pool,RENDER_BACKEND_CPU,a,nd_u8,2,big)); // 10000 bytes
+  EXPECT_NE(a,b);
+  EXPECT_EQ(10000u,ndnbytes(b));
+  EXPECT_EQ(before+10240,allocated());
+  EXPECT_EQ(10240u,inuse());                 // the small one was put back
+  EXPECT_EQ(-1,pool_put(pool,a));
+  EXPECT_EQ(1,pool_put(pool,b));
+}
+
+TEST_F(Pool,FitWithoutAnArrayGetsOne)
+{ const size_t shape[]={64};
+  nd_t a;
+  ASSERT_NE((void*)NULL,a=pool_fit(pool,RENDER_BACKEND_CPU,0,nd_f64,1,shape));
+  EXPECT_EQ(512u,ndnbytes(a));
+  EXPECT_EQ(1,pool_put(pool,a));
+}
+///@endcond
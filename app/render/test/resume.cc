@@ -0,0 +1,124 @@
+/**
+ * \file
+ * Tests: Resuming a render from nodes saved by an earlier one.
+ *
+ * A node finished by an earlier render is reloaded instead of rendered.  It
+ * still has to be composed into its parent, even when nothing has been
+ * rendered yet.
+ * @cond TESTS
+ */
+
+// solves a std::tuple problem in vs2012
+#define GTEST_HAS_TR1_TUPLE     0
+#define GTEST_USE_OWN_TR1_TUPLE 1
+
+#include <gtest/gtest.h>
+#include <map>
+#include <string.h>
+#include "tilebase.h"
+#include "src/synthetic.h"
+#include "config.h"
+#include "nd.h"
+#include "render.h"
+
+#define LATTICE_PATH TILEBASE_TEST_OUTPUT_PATH "/render-resume-lattice"
+
+typedef std::map<uint64_t,nd_t> nodes_t; ///< keyed by address_to_int(address,10)
+
+static uint64_t key(address_t a)
+{ return address_to_int(a,10);
+}
+
+static nd_t copy(nd_t a)
+{ nd_t out=ndheap(a);
+  return out?ndcopy(out,a,0,0):0;
+}
+
+static void clear(nodes_t *nodes)
+{ for(nodes_t::iterator it=nodes->begin();it!=nodes->end();++it)
+    ndfree(it->second);
+  nodes->clear();
+}
+
+static unsigned keep(nd_t vol, address_t address, aabb_t bbox, void *args)
+{ nodes_t *nodes=(nodes_t*)args;
+  nd_t c;
+  if(nodes->count(key(address))) // saved twice
+    return 0;
+  if(!(c=copy(vol)))
+    return 0;
+  (*nodes)[key(address)]=c;
+  return 1;
+}
+
+// done_t and loader_t don't take a context
+static nodes_t  g_saved;  ///< nodes from the first render
+static uint64_t g_done;   ///< the node the first render is pretended to have finished
+
+static unsigned is_done(address_t address)
+{ return key(address)==g_done;
+}
+
+static nd_t load(address_t address)
+{ nodes_t::iterator it=g_saved.find(key(address));
+  return (it==g_saved.end())?0:copy(it->second);
+}
+
+/** The parameter is the number of leaves rendered at once.  1 renders them in order. */
+struct RenderResume:public testing::TestWithParam<unsigned>
+{ synthetic_lattice_t lattice;
+  struct render opts;
+  tiles_t tiles;
+  nodes_t yielded;
+
+  void SetUp()
+  { ndioAddPluginPath(ND_ROOT_DIR"/bin/plugins");
+    memset(&lattice,0,sizeof(lattice));
+    lattice.count[0]=lattice.count[1]=2;  // one tile under each child of the root
+    lattice.count[2]=1;
+    lattice.tile.dims[0]=lattice.tile.dims[1]=32;
+    lattice.tile.dims[2]=4;
+    lattice.tile.voxel[0]=lattice.tile.voxel[1]=lattice.tile.voxel[2]=1000.0;
+    lattice.tile.type=nd_u16;
+    lattice.ext="tif";
+    ASSERT_EQ(4u,SyntheticLatticeMake(LATTICE_PATH,&lattice,NULL,NULL));
+    ASSERT_NE((void*)NULL,tiles=TileBaseOpen(LATTICE_PATH,"tilebase.synthetic"));
+
+    memset(&opts,0,sizeof(opts));
+    opts.voxel_um[0]=opts.voxel_um[1]=opts.voxel_um[2]=2.0;
+    opts.size[0]=opts.size[1]=opts.size[2]=1.0;
+    opts.countof_leaf=600; // the root is 32x32x2 voxels, its children are leaves
+    opts.nchildren=4;
+    opts.input_filter_scale_thresh=0.25f;
+    opts.output_filter_scale_thresh=0.25f;
+    opts.backend=RENDER_BACKEND_CPU;
+    opts.nthreads=GetParam();
+
+    g_done=0;
+    ASSERT_EQ(1,render(&opts,tiles,keep,&g_saved));
+    ASSERT_EQ(5u,g_saved.size()); // the root and its four children
+  }
+
+  void TearDown()
+  { clear(&g_saved);
+    clear(&yielded);
+    TileBaseClose(tiles);
+  }
+};
+
+TEST_P(RenderResume,FirstChildDone)
+{ nodes_t::iterator root;
+  g_done=1; // the first child of the root
+  opts.done=is_done;
+  opts.loader=load;
+  ASSERT_EQ(1,render(&opts,tiles,keep,&yielded));
+  EXPECT_EQ(0u,yielded.count(1));    // reloaded, not saved again
+  EXPECT_EQ(4u,yielded.size());
+  ASSERT_NE(yielded.end(),root=yielded.find(0));
+  ASSERT_EQ(ndnbytes(g_saved[0]),ndnbytes(root->second));
+  EXPECT_EQ(0,memcmp(nddata(g_saved[0]),nddata(root->second),ndnbytes(root->second))) // the reloaded child was composed
+    <<"Root differs from the one rendered from scratch.";
+}
+
+INSTANTIATE_TEST_CASE_P(Workers,RenderResume,testing::Values(1u,4u));
+///@endcond
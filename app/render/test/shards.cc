@@ -0,0 +1,191 @@
+/**
+ * \file
+ * Tests: Sharded containers for the nodes of a rendered tree.
+ *
+ * Records are only ever appended, so the latest record for a key has to win,
+ * also after the index is rebuilt from the file.  A record cut short by a
+ * crash has to be dropped without losing the ones before it.
+ * @cond TESTS
+ */
+
+// solves a std::tuple problem in vs2012
+#define GTEST_HAS_TR1_TUPLE     0
+#define GTEST_USE_OWN_TR1_TUPLE 1
+
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "config.h"
+#include "shards.h"
+#include "mkpath.h"
+
+#define countof(e) (sizeof(e)/sizeof(*(e)))
+#define ROOT TILEBASE_TEST_OUTPUT_PATH "/render-shards"
+
+static const char *g_names[]={"root","0","3","3-1","0-1"}; ///< every shard the tests make
+
+static std::string shard_path(const char *name)
+{ return std::string(ROOT)+"/"+name+"."+SHARDS_EXT;
+}
+
+static bool exists(const char *name)
+{ FILE *fp=fopen(shard_path(name).c_str(),"rb");
+  if(fp) fclose(fp);
+  return fp!=0;
+}
+
+static long file_size(const char *name)
+{ FILE *fp=fopen(shard_path(name).c_str(),"rb");
+  long n=-1;
+  if(fp && 0==fseek(fp,0,SEEK_END))
+    n=ftell(fp);
+  if(fp) fclose(fp);
+  return n;
+}
+
+static std::vector<char> read_file(const char *name)
+{ std::vector<char> out(file_size(name)>0?file_size(name):0);
+  FILE *fp=fopen(shard_path(name).c_str(),"rb");
+  if(fp && !out.empty() && 1!=fread(&out[0],out.size(),1,fp))
+    out.clear();
+  if(fp) fclose(fp);
+  return out;
+}
+
+static void write_file(const char *name, const std::vector<char> &data)
+{ FILE *fp=fopen(shard_path(name).c_str(),"wb");
+  ASSERT_NE((void*)NULL,fp);
+  if(!data.empty())
+  { EXPECT_EQ(1u,fwrite(&data[0],data.size(),1,fp));
+  }
+  fclose(fp);
+}
+
+struct Shards:public testing::Test
+{ shards_t shards;
+
+  void SetUp()
+  { char root[]=ROOT;
+    unsigned i;
+    ASSERT_TRUE(mkpath(root));
+    for(i=0;i<countof(g_names);++i)
+      remove(shard_path(g_names[i]).c_str());
+    shards=0;
+  }
+  void TearDown()
+  { shards_close(shards);
+  }
+
+  void reopen(unsigned depth, int truncate)
+  { shards_close(shards);
+    ASSERT_NE((void*)NULL,shards=shards_open(ROOT,depth,truncate));
+  }
+
+  void put(const char *key, const char *data)
+  { ASSERT_EQ(1u,shards_put(shards,key,data,strlen(data)));
+  }
+
+  /** \returns the data stored for \a key, or "(none)". */
+  std::string get(const char *key)
+  { size_t n;
+    char *buf=(char*)shards_get(shards,key,&n);
+    std::string out=buf?std::string(buf,n):"(none)";
+    free(buf);
+    return out;
+  }
+};
+
+TEST_F(Shards,LaterRecordWins)
+{ reopen(1,1);
+  put("0/1","first");
+  put("0/1","second, and longer");
+  put("0/2","other");
+  EXPECT_EQ("second, and longer",get("0/1"));
+  reopen(1,0); // the index is rebuilt from the file
+  EXPECT_EQ("second, and longer",get("0/1"));
+  EXPECT_EQ("other",get("0/2"));
+  put("0/1","third");
+  EXPECT_EQ("third",get("0/1"));
+}
+
+TEST_F(Shards,TornRecordIsDropped)
+{ long good;
+  std::vector<char> data;
+  reopen(1,1);
+  put("0","kept");
+  reopen(1,0);
+  good=file_size("0");
+  put("0/3","cut short");
+  reopen(1,0);
+  data=read_file("0");
+  ASSERT_GT(data.size(),(size_t)good+4);
+  data.resize(data.size()-4); // lose the end of the last record
+  write_file("0",data);
+
+  EXPECT_EQ("kept",get("0"));
+  EXPECT_EQ("(none)",get("0/3"));
+  EXPECT_EQ(good,file_size("0"));
+  put("0/3","again"); // goes where the torn record was
+  reopen(1,0);
+  EXPECT_EQ("kept",get("0"));
+  EXPECT_EQ("again",get("0/3"));
+}
+
+TEST_F(Shards,GarbageAfterLastRecordIsDropped)
+{ long good;
+  std::vector<char> data;
+  reopen(1,1);
+  put("0","kept");
+  reopen(1,0);
+  good=file_size("0");
+  data=read_file("0");
+  data.insert(data.end(),37,'x');
+  write_file("0",data);
+
+  EXPECT_EQ("kept",get("0"));
+  EXPECT_EQ(good,file_size("0"));
+}
+
+TEST_F(Shards,RemovedKeyIsGone)
+{ reopen(1,1);
+  put("3/1","data");
+  ASSERT_EQ(1u,shards_remove(shards,"3/1"));
+  EXPECT_EQ("(none)",get("3/1"));
+  reopen(1,0);
+  EXPECT_EQ("(none)",get("3/1"));
+  put("3/1","back");
+  EXPECT_EQ("back",get("3/1"));
+}
+
+TEST_F(Shards,NamesFollowDepth)
+{ const char *keys[]={".","3","3/1","3/1/2","3/1/2/0","0/1/2"};
+  const char *expect[]={"root","3","3-1","3-1","3-1","0-1"};
+  unsigned i;
+  reopen(2,1);
+  for(i=0;i<countof(keys);++i)
+    put(keys[i],keys[i]);
+  for(i=0;i<countof(keys);++i)
+  { EXPECT_TRUE(exists(expect[i]))<<keys[i];
+    EXPECT_EQ(keys[i],get(keys[i]));
+  }
+  EXPECT_FALSE(exists("0"));
+}
+
+TEST_F(Shards,DepthZeroUsesOneShard)
+{ const char *keys[]={".","3","3/1","0/1/2"};
+  unsigned i;
+  reopen(0,1);
+  for(i=0;i<countof(keys);++i)
+    put(keys[i],keys[i]);
+  EXPECT_TRUE(exists("root"));
+  EXPECT_FALSE(exists("3"));
+  EXPECT_FALSE(exists("3-1"));
+  EXPECT_FALSE(exists("0-1"));
+  reopen(0,0);
+  for(i=0;i<countof(keys);++i)
+    EXPECT_EQ(keys[i],get(keys[i]));
+}
+///@endcond
@@ -0,0 +1,118 @@
+/**
+ * \file
+ * Tests: Rendering tile by tile.
+ *
+ * Reading each tile once and resampling it into every leaf it overlaps has
+ * to give the same nodes as rendering the leaves one at a time.  When the
+ * memory budget is too small for that, the render falls back to rendering
+ * leaf by leaf, and still has to save each node exactly once.
+ * @cond TESTS
+ */
+
+// solves a std::tuple problem in vs2012
+#define GTEST_HAS_TR1_TUPLE     0
+#define GTEST_USE_OWN_TR1_TUPLE 1
+
+#include <gtest/gtest.h>
+#include <map>
+#include <string.h>
+#include "tilebase.h"
+#include "src/synthetic.h"
+#include "config.h"
+#include "nd.h"
+#include "render.h"
+
+#define LATTICE_PATH TILEBASE_TEST_OUTPUT_PATH "/render-tile-major-lattice"
+
+typedef std::map<uint64_t,nd_t> nodes_t; ///< keyed by address_to_int(address,10)
+
+static uint64_t key(address_t a)
+{ return address_to_int(a,10);
+}
+
+static nd_t copy(nd_t a)
+{ nd_t out=ndheap(a);
+  return out?ndcopy(out,a,0,0):0;
+}
+
+static void clear(nodes_t *nodes)
+{ for(nodes_t::iterator it=nodes->begin();it!=nodes->end();++it)
+    ndfree(it->second);
+  nodes->clear();
+}
+
+static unsigned keep(nd_t vol, address_t address, aabb_t bbox, void *args)
+{ nodes_t *nodes=(nodes_t*)args;
+  nd_t c;
+  if(nodes->count(key(address))) // saved twice
+    return 0;
+  if(!(c=copy(vol)))
+    return 0;
+  (*nodes)[key(address)]=c;
+  return 1;
+}
+
+static void expect_same(const nodes_t &expect, const nodes_t &actual)
+{ nodes_t::const_iterator e,a;
+  ASSERT_EQ(expect.size(),actual.size());
+  for(e=expect.begin();e!=expect.end();++e)
+  { ASSERT_NE(actual.end(),a=actual.find(e->first))<<"node "<<e->first;
+    ASSERT_EQ(ndnbytes(e->second),ndnbytes(a->second))<<"node "<<e->first;
+    EXPECT_EQ(0,memcmp(nddata(e->second),nddata(a->second),ndnbytes(e->second)))
+      <<"node "<<e->first<<" differs from the one rendered leaf by leaf.";
+  }
+}
+
+struct RenderTileMajor:public testing::Test
+{ synthetic_lattice_t lattice;
+  struct render opts;
+  tiles_t tiles;
+  nodes_t by_leaf,by_tile;
+
+  void SetUp()
+  { ndioAddPluginPath(ND_ROOT_DIR"/bin/plugins");
+    memset(&lattice,0,sizeof(lattice));
+    lattice.count[0]=lattice.count[1]=2; // on a 2x2 lattice Morton order is the order tiles are listed in
+    lattice.count[2]=1;
+    lattice.overlap=0.25;                 // so every leaf overlaps several tiles
+    lattice.tile.dims[0]=lattice.tile.dims[1]=32;
+    lattice.tile.dims[2]=4;
+    lattice.tile.voxel[0]=lattice.tile.voxel[1]=lattice.tile.voxel[2]=1000.0;
+    lattice.tile.type=nd_u16;
+    lattice.ext="tif";
+    ASSERT_EQ(4u,SyntheticLatticeMake(LATTICE_PATH,&lattice,NULL,NULL));
+    ASSERT_NE((void*)NULL,tiles=TileBaseOpen(LATTICE_PATH,"tilebase.synthetic"));
+
+    memset(&opts,0,sizeof(opts));
+    opts.voxel_um[0]=opts.voxel_um[1]=opts.voxel_um[2]=2.0;
+    opts.size[0]=opts.size[1]=opts.size[2]=1.0;
+    opts.countof_leaf=600; // the root is 28x28x2 voxels, its children are leaves
+    opts.nchildren=4;
+    opts.input_filter_scale_thresh=0.25f;
+    opts.output_filter_scale_thresh=0.25f;
+    opts.backend=RENDER_BACKEND_CPU;
+    opts.nthreads=1;
+    ASSERT_EQ(1,render(&opts,tiles,keep,&by_leaf));
+    ASSERT_EQ(5u,by_leaf.size()); // the root and its four children
+  }
+
+  void TearDown()
+  { clear(&by_leaf);
+    clear(&by_tile);
+    TileBaseClose(tiles);
+  }
+};
+
+TEST_F(RenderTileMajor,SameAsLeafByLeaf)
+{ opts.tile_major=1;
+  ASSERT_EQ(1,render(&opts,tiles,keep,&by_tile));
+  expect_same(by_leaf,by_tile);
+}
+
+TEST_F(RenderTileMajor,OverBudgetFallsBackOnce)
+{ opts.tile_major=1;
+  opts.memory_budget=1; // too small for any leaf to stay open
+  ASSERT_EQ(1,render(&opts,tiles,keep,&by_tile)); // keep() fails if a node is saved twice
+  expect_same(by_leaf,by_tile);
+}
+///@endcond
@@ -0,0 +1,124 @@
+/**
+ * \file
+ * Tests: Saving nodes on background threads.
+ *
+ * Nodes are put children first, but subtrees can be interleaved.  However
+ * many writer threads there are, a node must not be handed to the handler
+ * until every node below it has been saved.
+ * @cond TESTS
+ */
+
+// solves a std::tuple problem in vs2012
+#define GTEST_HAS_TR1_TUPLE     0
+#define GTEST_USE_OWN_TR1_TUPLE 1
+
+#include <gtest/gtest.h>
+#include <map>
+#include <string>
+#include "nd.h"
+#include "src/util/thread.h"
+#include "address.h"
+#include "writer.h"
+
+#ifdef _MSC_VER
+#include <windows.h>
+#define usleep(e) Sleep((e)/1000)
+#else
+#include <unistd.h>
+#endif
+
+#define countof(e) (sizeof(e)/sizeof(*(e)))
+
+typedef std::pair<unsigned,unsigned> span_t; ///< when the handler started and finished with a node
+
+struct events_t
+{ tbmutex_t lock;
+  unsigned  clock;
+  std::map<std::string,span_t> spans;    ///< keyed by node path
+  unsigned  repeats;                     ///< nodes handled more than once
+};
+
+static std::string path_of(address_t a)
+{ char buf[1024]={0};
+  return address_to_path(buf,sizeof(buf),a)?buf:"?";
+}
+
+/** Deeper nodes take longer, so an ancestor handled too early finishes first. */
+static unsigned slow(nd_t vol, address_t address, aabb_t bbox, void *args)
+{ events_t *e=(events_t*)args;
+  const std::string path=path_of(address);
+  unsigned start;
+  MutexLock(&e->lock);
+  start=e->clock++;
+  MutexUnlock(&e->lock);
+  usleep(10000*address_length(address));
+  MutexLock(&e->lock);
+  e->repeats+=e->spans.count(path);
+  e->spans[path]=span_t(start,e->clock++);
+  MutexUnlock(&e->lock);
+  return 1;
+}
+
+static address_t make(const int *ids, unsigned n)
+{ address_t a=make_address();
+  unsigned i;
+  for(i=0;a && i<n;++i)
+    address_push(a,ids[i]);
+  return a;
+}
+
+static bool is_below(const std::string &path, const std::string &parent)
+{ if(parent.empty()) return !path.empty();
+  return path.size()>parent.size() && 0==path.compare(0,parent.size(),parent)
+      && (path[parent.size()]=='/' || path[parent.size()]=='\\');
+}
+
+/** The parameter is the number of writer threads. */
+struct Writer:public testing::TestWithParam<unsigned>
+{ events_t events;
+  nd_t vol;
+
+  void SetUp()
+  { const size_t shape[]={16};
+    MutexInit(&events.lock);
+    events.clock=0;
+    events.repeats=0;
+    ASSERT_NE((void*)NULL,vol=ndheap_ip(ndreshape(ndcast(ndinit(),nd_u8),1,shape)));
+    ndfill(vol,0);
+  }
+  void TearDown()
+  { ndfree(vol);
+    MutexFree(&events.lock);
+  }
+};
+
+TEST_P(Writer,DescendantsBeforeAncestors)
+{ // children come before their parent, but two subtrees of depth 3 are interleaved
+  static const int nodes[][3]={
+    {0,0,0},{1,0,0},{0,0,1},{1,0,1},{0,0},{1,0},{0,1,0},{1,1,0},
+    {0,1},{1,1},{0},{1},{0,0,0}};
+  static const unsigned depth[]={3,3,3,3,2,2,3,3,2,2,1,1,0}; // the last node is the root
+  std::map<std::string,span_t>::const_iterator a,d;
+  writer_t writer;
+  unsigned i;
+  ASSERT_NE((void*)NULL,writer=writer_open(slow,&events,GetParam(),8));
+  for(i=0;i<countof(nodes);++i)
+  { address_t addr=make(nodes[i],depth[i]);
+    ASSERT_NE((void*)NULL,addr);
+    EXPECT_EQ(1u,writer_put(writer,vol,addr,0));
+    free_address(addr);
+  }
+  ASSERT_EQ(1u,writer_close(writer));
+
+  EXPECT_EQ(0u,events.repeats);
+  ASSERT_EQ(countof(nodes),events.spans.size());
+  for(a=events.spans.begin();a!=events.spans.end();++a)
+    for(d=events.spans.begin();d!=events.spans.end();++d)
+      if(is_below(d->first,a->first))
+      { EXPECT_LT(d->second.second,a->second.first)
+          <<"\""<<a->first<<"\" was handled before \""<<d->first<<"\" was done.";
+      }
+}
+
+INSTANTIATE_TEST_CASE_P(Threads,Writer,testing::Values(1u,3u,8u));
+///@endcond
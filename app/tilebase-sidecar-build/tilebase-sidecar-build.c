@@ -0,0 +1,94 @@
+/**
+ * \file
+ * Writes fast-to-read copies of the metadata for every tile under a root.
+ *
+ * For the protobuf formats these are binary encoded copies of the text
+ * descriptors.  Tiles are converted in parallel, one thread per core.
+ */
+#include "tilebase.h"
+#include "src/metadata/metadata.h"
+#include "src/util/thread.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _MSC_VER
+#define PATHSEP '\\'
+#else
+#define PATHSEP '/'
+#endif
+
+char *basename(char* r)
+{ char *o=strrchr(r,PATHSEP);
+  return o?(o+1):r;
+}
+
+/** Shared work queue.  Threads take the next tile index under \a lock. */
+typedef struct _work_t
+{ tile_t     *tiles;
+  size_t      ntiles,
+              next,
+              nok;
+  const char *fmt;
+  tbmutex_t   lock;
+} work_t;
+
+static void* worker(void *arg)
+{ work_t *w=(work_t*)arg;
+  while(1)
+  { metadata_t meta;
+    size_t i;
+    int ok;
+    MutexLock(&w->lock);
+    i=w->next++;
+    MutexUnlock(&w->lock);
+    if(i>=w->ntiles) break;
+    ok=(meta=MetadataOpen(TilePath(w->tiles[i]),w->fmt,"r")) && MetadataWriteSidecar(meta);
+    MetadataClose(meta);
+    MutexLock(&w->lock);
+    if(ok)
+    { ++w->nok;
+      printf(".");
+    } else
+      printf("\nFailed: %s\n",TilePath(w->tiles[i]));
+    fflush(stdout);
+    MutexUnlock(&w->lock);
+  }
+  return 0;
+}
+
+int main(int argc, char *argv[])
+{ tiles_t tiles;
+  work_t work={0};
+  tbthread_t *threads;
+  unsigned i,n=ThreadCount();
+
+  ndioAddPluginPath("plugins");
+  if(argc<2)
+  { printf("Usage: %s root-path [metadata-format]\n",basename(argv[0]));
+    return 0;
+  }
+  work.fmt=(argc==3)?argv[2]:0;
+  if(!(tiles=TileBaseOpen(argv[1],work.fmt)))
+  { printf("Could not open tiles at %s\n",argv[1]);
+    return 1;
+  }
+  work.tiles=TileBaseArray(tiles);
+  work.ntiles=TileBaseCount(tiles);
+  MutexInit(&work.lock);
+  if(!(threads=(tbthread_t*)malloc(sizeof(*threads)*n)))
+    return 1;
+  for(i=0;i<n;++i)
+    if(!ThreadCreate(threads+i,worker,&work))
+      break;
+  n=i;
+  if(n==0) // couldn't start any threads, so do the work here
+    worker(&work);
+  for(i=0;i<n;++i)
+    ThreadJoin(threads+i);
+  printf("\nConverted %llu of %llu tiles\n",(unsigned long long)work.nok,(unsigned long long)work.ntiles);
+  free(threads);
+  MutexFree(&work.lock);
+  TileBaseClose(tiles);
+  return work.nok==work.ntiles?0:1;
+}
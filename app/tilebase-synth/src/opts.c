@@ -0,0 +1,370 @@
+/**
+ * options for tilebase-synth
+ *
+ * TODO
+ * - scripting/config file (via lua)
+ * - threshold width on long option names
+ *   A long option name's lhs should be printed on it's own line and should 
+ *   not effect the lhs column width.
+ * - maybe change callback type so encountering an option can effect a state transition
+ * - Make SPEC and ARGS settable - hence making the option parsing an API
+ */
+#define _CRT_SECURE_NO_WARNINGS
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <sys/stat.h>
+#include "opts.h"
+
+#define MAXWIDTH (78)
+
+#define countof(e)        (sizeof(e)/sizeof(*(e)))
+#define PRINT(...)        printf(__VA_ARGS__)
+#define LOG(...)          reporter(__FILE__,__LINE__,__FUNCTION__,__VA_ARGS__)
+#define REPORT(msg1,msg2) LOG("\t%s\n\t%s\n",msg1,msg2)
+#define TRY(e)            do{if(!(e)){REPORT(#e,"Expression evaluated as false"); goto Error;}}while(0)
+
+#ifdef _MSC_VER
+  #include <malloc.h>
+  #define alloca      _alloca
+  #define snprintf    _snprintf
+  #define PATHSEP    '\\'
+  #define S_ISDIR(B) ((B)&_S_IFDIR)
+  #undef max
+#else
+  #define PATHSEP '/'
+#endif
+
+//-- TYPES --------------------------------------------------------------------- 
+typedef int  (*validator_t)(const char* s);
+typedef int  (*parse_t)    (opts_t* ctx,const char* s);
+typedef void (*callback_t) (opts_t* ctx);
+
+struct opt_state_t
+{ int is_found;
+  char buf[64];
+};
+
+typedef struct _opt_t
+{ validator_t validate;
+  parse_t     parse;
+  callback_t  callback;
+  int         is_flag;  
+  const char* shortname;
+  const char* longname;
+  const char* def; // default
+  const char* help;
+  struct opt_state_t state;
+} opt_t;
+
+typedef struct _arg_t
+{ validator_t validate;
+  parse_t     parse;
+  callback_t  callback;
+  const char *name;
+  const char *help;
+  struct opt_state_t state;
+} arg_t;
+
+//-- SPEC ----------------------------------------------------------------------
+static void help(opts_t *opts);
+static int  is_triple(const char* s);
+static int  is_fraction(const char* s);
+static int  is_double(const char* s);
+static int  path(opts_t *ctx,const char *s);
+static int  count(opts_t *ctx,const char *s);
+static int  dims(opts_t *ctx,const char *s);
+static int  voxel(opts_t *ctx,const char *s);
+static int  overlap(opts_t *ctx,const char *s);
+static int  type(opts_t *ctx,const char *s);
+static int  rotation(opts_t *ctx,const char *s);
+static int  shear(opts_t *ctx,const char *s);
+static int  ext(opts_t *ctx,const char *s);
+
+static int    ARGC;
+static char** ARGV;
+static opt_t SPEC[]=
+{ 
+  {NULL,NULL,help,1,"-h","--help",NULL, "Display this help message.",{0}},
+  {is_triple,count,NULL,0,"-n","--count","4,4,1","Number of tiles along x, y and z.",{0}},
+  {is_triple,dims,NULL,0,"-d","--dims","512,512,128","Voxels per tile along x, y and z.",{0}},
+  {is_triple,voxel,NULL,0,"-v","--voxel","250,250,1000","Voxel size in nanometers along x, y and z.",{0}},
+  {is_fraction,overlap,NULL,0,"-o","--overlap","0.1","Fraction of each tile that overlaps the next one along each axis.  Must be at least 0 and less than 1.",{0}},
+  {NULL,type,NULL,0,"-t","--type","u16","Voxel type.  One of u8, u16, u32, u64, i8, i16, i32, i64, f32 or f64.",{0}},
+  {is_double,rotation,NULL,0,"-r","--rotation","0","Rotation of each tile about z in radians.",{0}},
+  {is_double,shear,NULL,0,"-s","--shear","0","Shift along x, in voxels, per z plane.",{0}},
+  {NULL,ext,NULL,0,"-e","--ext",NULL,"Write a volume for each tile using this file extension (e.g. tif).  By default, only metadata is written.",{0}},
+};
+
+static arg_t ARGS[]= // position based arguments
+{ {NULL,path,NULL,"output-path","Folder to put the tiles in.  Made if it doesn't exist.",{0}},
+};
+
+//-- SPEC IMPLEMENTATION -------------------------------------------------------
+
+/** Parses "a,b,c" into three doubles. */
+static int triple(const char *s, double *v)
+{ int i;
+  char *end=0;
+  for(i=0;i<3;++i)
+  { v[i]=strtod(s,&end);
+    if(end==s) return 0;
+    if(i<2 && *end++!=',') return 0;
+    s=end;
+  }
+  return *end=='\0';
+}
+
+static int is_triple(const char* s)
+{ double v[3];
+  return s && triple(s,v) && v[0]>0 && v[1]>0 && v[2]>0;
+}
+
+static int is_double(const char* s)
+{ char *end=0;
+  if(!s) return 0;
+  strtod(s,&end);
+  return end!=s && *end=='\0';
+}
+
+static int is_fraction(const char* s)
+{ double d;
+  if(!is_double(s)) return 0;
+  d=strtod(s,NULL);
+  return 0.0<=d && d<1.0;
+}
+
+static int count(opts_t *ctx,const char *s)
+{ double v[3];
+  int i;
+  if(!triple(s,v)) return 0;
+  for(i=0;i<3;++i) ctx->count[i]=(unsigned)v[i];
+  return 1;
+}
+static int dims(opts_t *ctx,const char *s)
+{ double v[3];
+  int i;
+  if(!triple(s,v)) return 0;
+  for(i=0;i<3;++i) ctx->dims[i]=(size_t)v[i];
+  return 1;
+}
+static int voxel(opts_t *ctx,const char *s)   {return triple(s,ctx->voxel);}
+static int overlap(opts_t *ctx,const char *s) {ctx->overlap=strtod(s,0); return 1;}
+static int type(opts_t *ctx,const char *s)    {ctx->type=s; return 1;}
+static int rotation(opts_t *ctx,const char *s){ctx->rotation=strtod(s,0); return 1;}
+static int shear(opts_t *ctx,const char *s)   {ctx->shear=strtod(s,0); return 1;}
+static int ext(opts_t *ctx,const char *s)     {ctx->ext=s; return 1;}
+static int path(opts_t *ctx,const char *s)    {ctx->path=s; return 1;}
+
+//-- HANDLING ------------------------------------------------------------------
+// Given SPEC and ARGS, handling is pretty general.  Could split out to an API
+
+
+static char *basename(char* argv0)
+{ char *r = strrchr(argv0,PATHSEP);
+  return r?(r+1):argv0;
+}
+
+static void reporter(const char *file,int line,const char* function,const char*fmt,...)
+{ va_list ap;
+  fprintf(stdout,"At %s(%d) - %s()\n",file,line,function);
+  va_start(ap,fmt);
+  vfprintf(stdout,fmt,ap);
+  va_end(ap);
+}
+
+/** Prints a two column output where the help string is wrapped in the second
+    column. 
+*/
+static void writehelp(int maxwidth,const char* lhs,int width,const char* help)
+{ 
+  char helpbuf[1024]={0};
+  int n,r=(int)strlen(help); // remainder of help text to write
+  char t, // temp
+      *s, // the line split point: last space in the current range or a newline
+      *h=helpbuf; // current pos in help string
+  memcpy(h,help,r);
+  memset(h+r,0,countof(helpbuf)-r);
+
+  n=maxwidth-width+4;
+  t=h[n];
+  s=h+r;
+  if((h+n)<(helpbuf+r))    // test if the line needs to wrap
+  { h[n]='\0';             // null the wrap point
+    if((s=strchr(h,'\n'))||(s=strrchr(h,' '))) // split the help string at first newline or the last space
+    { *s='\0';
+      if(n<r) h[n]=t;
+      t=' ';
+    } else
+    { s=h+n;
+    }
+  }
+  PRINT("%-*s    %s\n",width,lhs,h);
+  h=s;
+  *s=t;
+  while(*h==' ' && (h-helpbuf)<r) ++h; // advance through white space
+
+  while((h-helpbuf)<r)
+  {
+    t=h[n];
+    s=h+r;
+    if((h+n)<(helpbuf+r))
+    { h[n]='\0';
+      if((s=strchr(h,'\n'))||(s=strrchr(h,' '))) // split the help string at first newline or the last space
+      { *s='\0';
+        if(n<r) h[n]=t;
+        t=' ';
+      } else
+      { s=h+n;
+      }
+    }
+    PRINT("%-*s    %s\n",width,"",h);
+    h=s;
+    *s=t;
+    while(*h==' ' && (h-helpbuf)<r) ++h; // advance through white space
+  }
+}
+
+static void usage()
+{ int i,width=0;
+  PRINT("Usage: %s [options]",basename(ARGV[0]));
+  for(i=0;i<countof(ARGS);++i)
+    PRINT(" <%s>",ARGS[i].name);
+  
+  for(i=0;i<countof(ARGS);++i)
+  { int c=0;
+#define WRITE(...) c+=snprintf(ARGS[i].state.buf+c,sizeof(ARGS[i].state.buf)-c,__VA_ARGS__)
+    WRITE("    %s",ARGS[i].name);
+#undef WRITE
+  }
+  
+
+  // left column of help text
+  for(i=0;i<countof(SPEC);++i)
+  { int c=0;
+#define WRITE(...) c+=snprintf(SPEC[i].state.buf+c,sizeof(SPEC[i].state.buf)-c,__VA_ARGS__)
+    WRITE("    %s",SPEC[i].shortname);
+    if(SPEC[i].longname)
+      WRITE(" [%s]",SPEC[i].longname);
+    if(!SPEC[i].is_flag)
+    { WRITE(" arg");
+      if(SPEC[i].def)
+        WRITE(" (=%s)",SPEC[i].def);
+    }
+#undef WRITE
+  }
+  // width of left column
+  for(i=0;i<countof(ARGS);++i)
+  { int n=(int)strlen(ARGS[i].state.buf);
+    width=(n>width)?n:width;
+  }
+  for(i=0;i<countof(SPEC);++i)
+  { int n=(int)strlen(SPEC[i].state.buf);
+    width=(n>width)?n:width;
+  }
+
+  PRINT("\nArguments:\n");
+  for(i=0;i<countof(ARGS);++i)
+    writehelp(MAXWIDTH,ARGS[i].state.buf,width,ARGS[i].help);
+
+  PRINT("\nOptions:\n");
+  for(i=0;i<countof(SPEC);++i)
+    writehelp(MAXWIDTH,SPEC[i].state.buf,width,SPEC[i].help);
+  
+  printf("\n");
+}
+
+static void help(opts_t *opts)
+{ usage(); exit(0); 
+}
+
+#define CALLBACK(iopt,opts)      if(SPEC[iopt].callback) SPEC[iopt].callback(&opts)
+#define VALIDATE(iopt,str)       (SPEC[iopt].validate==NULL || SPEC[iopt].validate(str))
+#define PARSE(iopt,opts,str)     (SPEC[iopt].parse==NULL || SPEC[iopt].parse(&opts,str))
+
+#define SAME(a,b) ((b!=0)&&strcmp(a,b)==0)
+
+opts_t parsargs(int *argc, char** argv[], int *isok)
+{ opts_t opts={0};
+  int iarg,iopt;
+  unsigned char *hit=0;  // flags to indicate an argv was used in option processing
+  TRY(argc && argv && isok);
+  *isok=0;
+  TRY(hit=(unsigned char*)alloca(*argc));
+  memset(hit,0,*argc);
+  ARGV=(char**)*argv;
+  ARGC=*argc;
+  for(iarg=1;iarg<*argc;++iarg)
+  { for(iopt=0;iopt<countof(SPEC);++iopt)
+    { if( SAME(argv[0][iarg],SPEC[iopt].shortname)
+        ||SAME(argv[0][iarg],SPEC[iopt].longname ))
+      { CALLBACK(iopt,opts);
+        hit[iarg]=1;
+        if(!SPEC[iopt].is_flag)
+        { if(iarg>=(*argc-1))
+          { LOG("\tAn argument was found but the value was not.\n\tOption \"%s\".\n",argv[0][iarg]);
+            goto Error;
+          }
+          if(!VALIDATE(iopt,argv[0][iarg+1]))
+          { LOG("\tArgument validation error.\n\tOption \"%s\" got \"%s\".\n",argv[0][iarg],argv[0][iarg+1]);
+            goto Error;
+          }
+          if(!PARSE(iopt,opts,argv[0][iarg+1]))
+          { LOG("\tArgument parse error.\n\tOption \"%s\" got \"%s\".\n",argv[0][iarg],argv[0][iarg+1]);
+            goto Error;
+          }
+          SPEC[iopt].state.is_found=1;
+          iarg++; // consumes an argument
+          hit[iarg]=1;
+        }
+      }
+    }
+  }
+  // apply default value for missing arguments
+  for(iopt=0;iopt<countof(SPEC);++iopt)
+  { if(!SPEC[iopt].is_flag && !SPEC[iopt].state.is_found)
+    { if(!VALIDATE(iopt,SPEC[iopt].def))
+      { LOG("\tDefault argument failed to validate.\n\tOption \"%s\" got \"%s\".\n",SPEC[iopt].shortname,SPEC[iopt].def);
+        goto Error;
+      }
+      if(!PARSE(iopt,opts,SPEC[iopt].def))
+      { LOG("\tDefault argument failed to parse.\n\tOption \"%s\" got \"%s\".\n",SPEC[iopt].shortname,SPEC[iopt].def);
+        goto Error;
+      }
+    }
+  }
+  // fixed place argument handling and sections
+#undef CALLBACK
+#undef VALIDATE
+#undef PARSE  
+#define CALLBACK(iopt,opts)      if(ARGS[iopt].callback) ARGS[iopt].callback(&opts)
+#define VALIDATE(iopt,str)       (ARGS[iopt].validate==NULL || ARGS[iopt].validate(str))
+#define PARSE(iopt,opts,str)     (ARGS[iopt].parse==NULL || ARGS[iopt].parse(&opts,str))
+  for(iarg=1,iopt=0;(iarg<*argc)&&(iopt<countof(ARGS));++iarg)
+  { if(hit[iarg]) continue;
+    if(!VALIDATE(iopt,argv[0][iarg]))
+    { LOG("\tPositional argument validation error.\n\tOption <%s> got \"%s\".\n",ARGS[iopt].name,argv[0][iarg]);
+      goto Error;
+    }
+    if(!PARSE(iopt,opts,argv[0][iarg]))
+    { LOG("\tPositional argument parse error.\n\tOption <%s> got \"%s\".\n",ARGS[iopt].name,argv[0][iarg]);
+      goto Error;
+    }
+    ARGS[iopt++].state.is_found=1;
+  }
+  // The specified fixed place args must be found
+  // Not too worried about extra args
+  for(iopt=0;iopt<countof(ARGS);++iopt)
+  { if(!ARGS[iopt].state.is_found)
+    { LOG("\tMissing required positional argument <%s>.\n",ARGS[iopt].name);
+      goto Error;
+    }
+  }
+  *isok=1;
+  return opts;
+Error:
+  if(isok) *isok=0;
+  usage();
+  return opts;
+}
\ No newline at end of file
@@ -0,0 +1,13 @@
+typedef struct _opts_t
+{ const char * path;
+  unsigned     count[3];
+  size_t       dims[3];
+  double       voxel[3];
+  double       overlap;
+  const char * type;
+  double       rotation;
+  double       shear;
+  const char * ext;     // if not null, write volumes with this extension
+} opts_t;
+
+opts_t parsargs(int *argc, char** argv[], int *isok);
@@ -0,0 +1,61 @@
+/**
+ * \file
+ * Makes a synthetic tile dataset.
+ *
+ * Tiles are arranged on a regular lattice and described by the
+ * "tilebase.synthetic" metadata format.  By default only metadata is
+ * written, which is enough to benchmark opening and caching large datasets.
+ * Use --ext to also write volumes, e.g. for rendering.
+ *
+ * Usage:
+ *   tilebase-synth [options] <output-path>
+ */
+#define _CRT_SECURE_NO_WARNINGS
+
+#include "tilebase.h"
+#include "src/synthetic.h"
+#include "src/opts.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LOG(...)          fprintf(stderr,__VA_ARGS__)
+
+static void progress(const char *path, void *data)
+{ size_t *n=(size_t*)data;
+  if((++*n)%1000==0)
+  { fprintf(stderr,".");
+    fflush(stderr);
+  }
+}
+
+int main(int argc,char*argv[])
+{ opts_t opts;
+  int isok,i;
+  synthetic_lattice_t lattice;
+  size_t n=0,nok,ntiles;
+
+  opts=parsargs(&argc,&argv,&isok);
+  if(!isok) return 1;
+  ndioAddPluginPath("plugins");
+
+  memset(&lattice,0,sizeof(lattice));
+  for(i=0;i<3;++i)
+  { lattice.count[i]=opts.count[i];
+    lattice.tile.dims[i]=opts.dims[i];
+    lattice.tile.voxel[i]=opts.voxel[i];
+  }
+  lattice.overlap=opts.overlap;
+  lattice.ext=opts.ext;
+  if(nd_id_unknown==(lattice.tile.type=SyntheticTypeFromName(opts.type)))
+  { LOG("Unrecognized voxel type \"%s\".\n",opts.type);
+    return 1;
+  }
+  lattice.tile.rotation=opts.rotation;
+  lattice.tile.shear=opts.shear;
+
+  ntiles=(size_t)lattice.count[0]*lattice.count[1]*lattice.count[2];
+  nok=SyntheticLatticeMake(opts.path,&lattice,progress,&n);
+  fprintf(stderr,"\nMade %llu of %llu tiles in %s\n",(unsigned long long)nok,(unsigned long long)ntiles,opts.path);
+  return (nok==ntiles)?0:1;
+}
@@ -0,0 +1,126 @@
+/**
+ * \file
+ * Writes new positions for many tiles at once.
+ *
+ * Reads a table with one line per tile:
+ * \verbatim
+ * <tile-path> <x> <y> <z> [<width> <height> <depth>]
+ * \endverbatim
+ * The origin and the optional bounding box size are in nanometers.  Tile
+ * paths may be relative to the root path.  Blank lines and lines starting
+ * with '#' are ignored.
+ *
+ * \see TileBaseUpdate()
+ */
+#include "tilebase.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _MSC_VER
+#define PATHSEP '\\'
+#else
+#define PATHSEP '/'
+#endif
+
+/// @cond DEFINES
+#define countof(e) (sizeof(e)/sizeof(*(e)))
+/// @endcond
+
+char *basename(char* r)
+{ char *o=strrchr(r,PATHSEP);
+  return o?(o+1):r;
+}
+
+/** One row of the update table. */
+typedef struct _row_t
+{ char    path[1024];
+  int64_t origin[3],
+          shape[3];
+  int     has_shape;
+} row_t;
+
+/**
+ * Reads the update table in \a filename.
+ * \returns the number of rows, or -1 on failure.  The caller must free \a *rows.
+ */
+static long read_table(const char *filename, row_t **rows)
+{ FILE *fp=0;
+  char line[4096];
+  long n=0,cap=0,lineno=0;
+  *rows=0;
+  if(!(fp=fopen(filename,"r")))
+  { printf("Could not open %s\n",filename);
+    return -1;
+  }
+  while(fgets(line,sizeof(line),fp))
+  { row_t r={{0}};
+    long long v[6];
+    int c,i;
+    ++lineno;
+    if(sscanf(line," %1023s",r.path)!=1 || r.path[0]=='#')
+      continue;
+    c=sscanf(line," %*s %lld %lld %lld %lld %lld %lld",v,v+1,v+2,v+3,v+4,v+5);
+    if(c!=3 && c!=6)
+    { printf("%s(%ld): Expected a path followed by 3 or 6 integers.\n",filename,lineno);
+      goto Error;
+    }
+    for(i=0;i<3;++i)
+    { r.origin[i]=v[i];
+      r.shape[i]=v[i+3];
+    }
+    r.has_shape=(c==6);
+    if(n>=cap)
+    { row_t *t;
+      cap=(long)(cap*1.2+50);
+      if(!(t=(row_t*)realloc(*rows,sizeof(row_t)*cap)))
+        goto Error;
+      *rows=t;
+    }
+    (*rows)[n++]=r;
+  }
+  fclose(fp);
+  return n;
+Error:
+  fclose(fp);
+  free(*rows);
+  *rows=0;
+  return -1;
+}
+
+int main(int argc, char *argv[])
+{ tiles_t tiles=0;
+  row_t *rows=0;
+  tile_update_t *updates=0;
+  long i,n;
+  size_t nok=0;
+  int ecode=1;
+
+  ndioAddPluginPath("plugins");
+  if(argc<3)
+  { printf("Usage: %s root-path table-file [metadata-format]\n",basename(argv[0]));
+    return 0;
+  }
+  if((n=read_table(argv[2],&rows))<0)
+    return 1;
+  if(!(tiles=TileBaseOpen(argv[1],(argc==4)?argv[3]:0)))
+  { printf("Could not open tiles at %s\n",argv[1]);
+    goto Finalize;
+  }
+  if(n>0 && !(updates=(tile_update_t*)malloc(sizeof(*updates)*n)))
+    goto Finalize;
+  for(i=0;i<n;++i)
+  { updates[i].path=rows[i].path;
+    updates[i].ndim=countof(rows[i].origin);
+    updates[i].origin=rows[i].origin;
+    updates[i].shape=rows[i].has_shape?rows[i].shape:0;
+  }
+  nok=TileBaseUpdate(tiles,updates,n);
+  printf("Updated %llu of %ld tiles\n",(unsigned long long)nok,n);
+  ecode=(nok==(size_t)n)?0:1;
+Finalize:
+  free(updates);
+  free(rows);
+  TileBaseClose(tiles);
+  return ecode;
+}
@@ -0,0 +1,190 @@
+/**
+ * \file
+ * Packs the tiles under a root directory into a container.
+ *
+ * The destination gets one container file holding every tile's record and a
+ * \c volumes directory with one HDF5 file per tile.  Tiles are named by their
+ * path relative to the source root.
+ *
+ * Tiles are converted in parallel.  Volumes are read concurrently, but HDF5
+ * isn't thread safe, so the writes are made one at a time under the same lock
+ * the tile table uses (see ContainerLockHDF5()).
+ */
+#define _CRT_SECURE_NO_WARNINGS
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include "tilebase.h"
+#include "src/util/thread.h"
+#include "src/metadata/metadata.h"
+#include "../src/table.h"
+#include "pack.h"
+
+#ifdef _MSC_VER
+#include <direct.h>
+#define PATHSEP    '\\'
+#define mkdir(p,m) _mkdir(p)
+#define realpath(a,b) _fullpath(b,a,PATH_MAX)
+#else
+#define PATHSEP    '/'
+#endif
+
+/// @cond DEFINES
+#define ENDL      "\n"
+#define LOG(...)  fprintf(stderr,__VA_ARGS__)
+#define TRY(e)    do{if(!(e)) { LOG("%s(%d): %s()"ENDL "\tExpression evaluated as false."ENDL "\t%s"ENDL,__FILE__,__LINE__,__FUNCTION__,#e); goto Error;}} while(0)
+#define VOLUMES   "volumes"
+/// @endcond
+
+/** Shared by the pack workers. */
+typedef struct _pack_t
+{ tile_t             *tiles;
+  container_record_t *records;
+  size_t              n,next,nok;
+  const char         *src,*dst,*format;
+  tbmutex_t           lock;
+} pack_t;
+
+/** Copies the volume of \a t to \a filename. */
+static unsigned copy_volume(tile_t t, const char *format, const char *filename)
+{ metadata_t meta=0;
+  ndio_t in=0,out=0;
+  nd_t vol=0;
+  unsigned ok=0,locked=0;
+  TRY(meta=MetadataOpen(TilePath(t),format,"r"));
+  TRY(in=MetadataOpenVolume(meta,"r"));
+  TRY(vol=ndheap(ndioShape(in)));
+  TRY(ndioRead(in,vol));
+  ContainerLockHDF5();
+  locked=1;
+  TRY(out=ndioOpen(filename,ndioFormat("hdf5"),"w"));
+  TRY(ndioWrite(out,vol));
+  ndioClose(out); // flushes, so it's done under the lock
+  out=0;
+  ok=1;
+Error:
+  if(out) ndioClose(out);
+  if(locked) ContainerUnlockHDF5();
+  if(in)  ndioClose(in);
+  if(vol) ndfree(vol);
+  MetadataClose(meta);
+  return ok;
+}
+
+/** Fills the record for tile \a i and copies its volume. */
+static unsigned pack_one(pack_t *p, size_t i)
+{ tile_t t=p->tiles[i];
+  container_record_t *r=p->records+i;
+  const char *path=TilePath(t);
+  const size_t nroot=strlen(p->src);
+  char filename[1024];
+  int64_t *ori,*shape;
+  size_t ndim,d;
+  nd_t vol;
+
+  memset(r,0,sizeof(*r));
+  if(0==strncmp(path,p->src,nroot) && path[nroot]==PATHSEP && path[nroot+1])
+  { TRY(strlen(path+nroot+1)<sizeof(r->name));
+    strcpy(r->name,path+nroot+1);
+  }
+  else
+    snprintf(r->name,sizeof(r->name),"%08llu",(unsigned long long)i);
+
+  TRY(AABBGet(TileAABB(t),&ndim,&ori,&shape));
+  TRY(ndim==3);
+  memcpy(r->origin,ori,sizeof(r->origin));
+  memcpy(r->shape,shape,sizeof(r->shape));
+  TRY(vol=TileShape(t));
+  TRY(ndndim(vol)<=CONTAINER_MAX_NDIM);
+  r->ndim=(int32_t)ndndim(vol);
+  r->type=(int32_t)ndtype(vol);
+  for(d=0;d<ndndim(vol);++d)
+    r->dims[d]=(int64_t)ndshape(vol)[d];
+  memcpy(r->transform,TileTransform(t),sizeof(float)*(r->ndim+1)*(r->ndim+1));
+
+  snprintf(r->volume,sizeof(r->volume),VOLUMES "%c%08llu.h5",PATHSEP,(unsigned long long)i);
+  TRY(snprintf(filename,sizeof(filename),"%s%c%s",p->dst,PATHSEP,r->volume)<(int)sizeof(filename));
+  TRY(copy_volume(t,p->format,filename));
+  return 1;
+Error:
+  LOG("\tCould not pack %s"ENDL,path);
+  return 0;
+}
+
+static void* pack_worker(void *arg)
+{ pack_t *p=(pack_t*)arg;
+  size_t i,nok=0;
+  for(;;)
+  { MutexLock(&p->lock);
+    i=p->next++;
+    MutexUnlock(&p->lock);
+    if(i>=p->n) break;
+    nok+=pack_one(p,i);
+  }
+  MutexLock(&p->lock);
+  p->nok+=nok;
+  MutexUnlock(&p->lock);
+  return 0;
+}
+
+/**
+ * Packs the tiles under \a src into a container at \a dst.
+ *
+ * \param[in] src     Root of the tiles to pack.
+ * \param[in] dst     Destination root.  Made if it doesn't exist.  Open it
+ *                    like any other tilebase afterwards.
+ * \param[in] format  Metadata format of the source tiles.  NULL or empty to
+ *                    detect it.
+ * \returns 1 if every tile was packed, otherwise 0.  Nothing is written to
+ *          the container file unless every tile was packed.
+ */
+unsigned ContainerPack(const char *src_, const char *dst_, const char *format)
+{ tiles_t tiles=0;
+  pack_t p={0};
+  tbthread_t *threads=0;
+  unsigned i,nthreads=0,nstarted=0,ok=0,has_lock=0;
+  char src[PATH_MAX+1]={0},dst[PATH_MAX+1]={0},name[PATH_MAX+64];
+
+  TRY(realpath(src_,src));
+  mkdir(dst_,0775);
+  TRY(realpath(dst_,dst));
+  snprintf(name,sizeof(name),"%s%c" VOLUMES,dst,PATHSEP);
+  mkdir(name,0775);
+  if(!(tiles=TileBaseOpen(src,format)))
+  { LOG("Could not open tiles at %s"ENDL,src);
+    goto Error;
+  }
+  p.tiles=TileBaseArray(tiles);
+  p.n=TileBaseCount(tiles);
+  p.src=src;
+  p.dst=dst;
+  p.format=format;
+  MutexInit(&p.lock);
+  has_lock=1;
+  TRY(p.records=(container_record_t*)malloc(sizeof(*p.records)*(p.n?p.n:1)));
+
+  nthreads=ThreadCount();
+  TRY(threads=(tbthread_t*)malloc(sizeof(*threads)*nthreads));
+  for(i=0;i<nthreads;++i)
+    nstarted+=ThreadCreate(threads+nstarted,pack_worker,&p);
+  if(!nstarted)
+    pack_worker(&p);
+  for(i=0;i<nstarted;++i)
+    ThreadJoin(threads+i);
+
+  TRY(p.nok==p.n);
+  snprintf(name,sizeof(name),"%s%c" CONTAINER_NAME,dst,PATHSEP);
+  TRY(ContainerTableWrite(name,p.records,p.n));
+  printf("Packed %llu tiles into %s\n",(unsigned long long)p.n,name);
+  ok=1;
+Error:
+  if(has_lock) MutexFree(&p.lock);
+  free(threads);
+  free(p.records);
+  TileBaseClose(tiles);
+  return ok;
+}
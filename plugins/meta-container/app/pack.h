@@ -0,0 +1,15 @@
+/** \file
+ *  Packing a tilebase into a container.
+ *
+ *  Requires "tilebase.h" to be included before this file.
+ */
+#pragma once
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+unsigned ContainerPack(const char *src, const char *dst, const char *format);
+
+#ifdef __cplusplus
+}//extern "C"{
+#endif
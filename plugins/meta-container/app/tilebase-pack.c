@@ -0,0 +1,41 @@
+/**
+ * \file
+ * Packs the tiles under a root directory into a container.
+ *
+ * \verbatim
+ * tilebase-pack <source-root> <destination-root> [metadata-format]
+ * \endverbatim
+ *
+ * The destination gets one container file holding every tile's record and a
+ * \c volumes directory with one HDF5 file per tile.  Tiles are named by their
+ * path relative to the source root.  Tiles are converted in parallel.
+ *
+ * Open the destination root like any other tilebase.
+ *
+ * \see ContainerPack()
+ */
+#define _CRT_SECURE_NO_WARNINGS
+#include <stdio.h>
+#include <string.h>
+#include "tilebase.h"
+#include "pack.h"
+
+#ifdef _MSC_VER
+#define PATHSEP    '\\'
+#else
+#define PATHSEP    '/'
+#endif
+
+char *basename(char* r)
+{ char *o=strrchr(r,PATHSEP);
+  return o?(o+1):r;
+}
+
+int main(int argc, char *argv[])
+{ ndioAddPluginPath("plugins");
+  if(argc<3)
+  { printf("Usage: %s source-root destination-root [metadata-format]\n",basename(argv[0]));
+    return 0;
+  }
+  return ContainerPack(argv[1],argv[2],(argc==4)?argv[3]:0)?0:1;
+}
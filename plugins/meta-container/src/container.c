@@ -0,0 +1,284 @@
+/**
+ * \file
+ * Metadata format for tiles held in a container file.
+ *
+ * A container replaces a directory (and a few small files) per tile with one
+ * table in one file.  See table.h for the layout.  Opening a tilebase whose
+ * root holds a container reads the table once; every tile then opens from its
+ * record without touching the file system.
+ *
+ * Tables are shared by every tile of a container.  They're keyed by the
+ * container's path, modification time and size, so a container that is
+ * replaced on disk is read again.
+ *
+ * This format is read-only.  Use tilebase-pack to make a container from
+ * tiles in any other format.
+ */
+#define _CRT_SECURE_NO_WARNINGS
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include "tilebase.h"
+#include "src/util/intern.h"
+#include "src/metadata/metadata.h"
+#include "src/metadata/interface.h"
+#include "table.h"
+
+/// @cond DEFINES
+#define CONTAINER_FORMAT_NAME "tilebase.container"
+
+#define ENDL               "\n"
+#define LOG(...)           fprintf(stderr,__VA_ARGS__)
+#define TRY(e)             do{if(!(e)) { LOG("%s(%d): %s()"ENDL "\tExpression evaluated as false."ENDL "\t%s"ENDL,__FILE__,__LINE__,__FUNCTION__,#e); goto Error;}} while(0)
+#define NEW(type,e,nelem)  TRY((e)=(type*)malloc(sizeof(type)*(nelem)))
+#define ZERO(type,e,nelem) memset((e),0,sizeof(type)*nelem)
+
+#ifdef _MSC_VER
+ #define snprintf _snprintf
+ #define stat     _stat
+ #define PATHSEP  "\\"
+#else
+ #define PATHSEP  "/"
+#endif
+/// @endcond
+
+typedef struct _container_ctx_t
+{ container_table_t  *table;     ///< shared, \see acquire_table()
+  container_record_t *record;    ///< this tile's record in \a table
+  char                dir[1024]; ///< directory holding the container
+} container_ctx_t;
+
+static void release_table(void *table)
+{ ContainerTableFree((container_table_t*)table);
+}
+
+static intern_t g_tables=INTERN_INIT(release_table);
+
+/**
+ * \returns the table in the container file \a filename, or NULL if it
+ *          couldn't be read.  Release with InternRelease(&g_tables,...).
+ */
+static container_table_t* acquire_table(const char *filename)
+{ char key[1100];
+  struct stat s;
+  container_table_t *table;
+  int n;
+  if(0!=stat(filename,&s))
+    return 0;
+  n=snprintf(key,sizeof(key),"%s|%lld|%lld",filename,(long long)s.st_mtime,(long long)s.st_size);
+  if(n<0 || n>=(int)sizeof(key))
+    return 0;
+  if((table=(container_table_t*)InternAcquire(&g_tables,key,n)))
+    return table;
+  if(!(table=ContainerTableRead(filename)))
+    return 0;
+  return (container_table_t*)InternInsert(&g_tables,key,n,table);
+}
+
+/** \returns 1 if \a mode only asks to read, otherwise 0. */
+static int is_read_only(const char *mode)
+{ return mode && 0==strcmp(mode,"r");
+}
+
+/**
+ * Opens the tile at \a path.
+ * \param[in] quiet  If 1, nothing is logged when \a path isn't a tile in a container.
+ */
+static container_ctx_t* open_tile(const char *path, const char *mode, int quiet)
+{ container_ctx_t *ctx=0;
+  char filename[1024];
+  const char *name;
+  if(!(name=ContainerSplitPath(path,filename,sizeof(filename))))
+    goto Quiet;
+  if(!is_read_only(mode))
+    goto Quiet;
+  NEW(container_ctx_t,ctx,1);
+  ZERO(container_ctx_t,ctx,1);
+  if(!(ctx->table=acquire_table(filename)))
+    goto Quiet;
+  if(!(ctx->record=ContainerTableFind(ctx->table,name)))
+    goto Quiet;
+  if(strlen(filename)>=sizeof(CONTAINER_NAME)) // strip PATHSEP CONTAINER_NAME
+    memcpy(ctx->dir,filename,strlen(filename)-sizeof(CONTAINER_NAME));
+  else
+    strcpy(ctx->dir,".");
+  return ctx;
+Quiet:
+  if(!quiet)
+    LOG("%s(%d): %s()"ENDL "\tCould not open %s for mode \"%s\" as a tile in a container."ENDL,
+        __FILE__,__LINE__,__FUNCTION__,path,mode?mode:"");
+Error:
+  if(ctx)
+  { if(ctx->table) InternRelease(&g_tables,ctx->table);
+    free(ctx);
+  }
+  return 0;
+}
+
+//
+// === INTERFACE ===
+//
+
+const char* container_name()
+{ return CONTAINER_FORMAT_NAME; }
+
+/** Just checks that \a path addresses a tile in a container file that exists. */
+unsigned container_is_fmt(const char* path, const char* mode)
+{ char filename[1024];
+  struct stat s;
+  return is_read_only(mode)
+      && ContainerSplitPath(path,filename,sizeof(filename))
+      && 0==stat(filename,&s);
+}
+
+/** Valid modes: "r" */
+void* container_open(const char* path, const char* mode)
+{ return open_tile(path,mode,0);
+}
+
+/** Detects the format and opens the tile in one step.  Containers aren't listed, so \a list is unused. */
+void* container_probe(const char* path, const char* mode, dirlist_t list)
+{ return open_tile(path,mode,1);
+}
+
+void container_close(metadata_t self)
+{ container_ctx_t *ctx=(container_ctx_t*)MetadataContext(self);
+  if(!ctx) return;
+  InternRelease(&g_tables,ctx->table);
+  free(ctx);
+}
+
+unsigned container_origin(metadata_t self, size_t *nelem, int64_t* origin)
+{ container_ctx_t *ctx=(container_ctx_t*)MetadataContext(self);
+  if(nelem) *nelem=3;
+  if(!origin)
+    return 0;
+  memcpy(origin,ctx->record->origin,sizeof(ctx->record->origin));
+  return 1;
+}
+
+unsigned container_shape(metadata_t self, size_t *nelem, int64_t* shape)
+{ container_ctx_t *ctx=(container_ctx_t*)MetadataContext(self);
+  if(nelem) *nelem=3;
+  if(!shape)
+    return 0;
+  memcpy(shape,ctx->record->shape,sizeof(ctx->record->shape));
+  return 1;
+}
+
+/** Containers are read-only.  Pack the tiles again instead. */
+unsigned container_set_origin(metadata_t self, size_t nelem, int64_t* origin)
+{ LOG("%s(%d): %s()"ENDL "\tTiles in a container are read-only."ENDL,__FILE__,__LINE__,__FUNCTION__);
+  return 0;
+}
+
+/** Containers are read-only.  Pack the tiles again instead. */
+unsigned container_set_shape(metadata_t self, size_t nelem, int64_t* shape)
+{ LOG("%s(%d): %s()"ENDL "\tTiles in a container are read-only."ENDL,__FILE__,__LINE__,__FUNCTION__);
+  return 0;
+}
+
+/** \returns 0 if the tile has no volume. */
+ndio_t container_get_vol(metadata_t self, const char* mode)
+{ container_ctx_t *ctx=(container_ctx_t*)MetadataContext(self);
+  char name[1024];
+  TRY(ctx->record->volume[0]);
+  TRY(snprintf(name,sizeof(name),"%s" PATHSEP "%s",ctx->dir,ctx->record->volume)<(int)sizeof(name));
+  return ndioOpen(name,0,mode);
+Error:
+  return 0;
+}
+
+unsigned container_get_transform(metadata_t self, float *transform)
+{ container_ctx_t *ctx=(container_ctx_t*)MetadataContext(self);
+  const size_t n=ctx->record->ndim+1;
+  memcpy(transform,ctx->record->transform,sizeof(float)*n*n);
+  return 1;
+}
+
+/**
+ * Everything comes from the tile's record, so the volume is never opened.
+ * \see metadata_description_t
+ */
+unsigned container_describe(metadata_t self, metadata_description_t *desc)
+{ container_ctx_t *ctx=(container_ctx_t*)MetadataContext(self);
+  const container_record_t *r=ctx->record;
+  size_t dims[CONTAINER_MAX_NDIM];
+  int i;
+  desc->ndim=3;
+  memcpy(desc->origin,r->origin,sizeof(r->origin));
+  memcpy(desc->shape,r->shape,sizeof(r->shape));
+  for(i=0;i<r->ndim;++i)
+    dims[i]=(size_t)r->dims[i];
+  TRY(desc->vol=ndinit());
+  TRY(ndcast(desc->vol,(nd_type_id_t)r->type));
+  TRY(ndreshape(desc->vol,r->ndim,dims));
+  if(r->volume[0])
+    TRY(snprintf(desc->vol_path,sizeof(desc->vol_path),"%s" PATHSEP "%s",ctx->dir,r->volume)<(int)sizeof(desc->vol_path));
+  container_get_transform(self,desc->transform);
+  return 1;
+Error:
+  if(desc->vol) { ndfree(desc->vol); desc->vol=0; }
+  return 0;
+}
+
+/** Lists every tile in the container file in the directory \a path, if there is one. */
+size_t container_list(const char* path, metadata_list_callback_t add, void *ctx)
+{ char filename[1024],tilepath[1024];
+  container_table_t *table;
+  struct stat s;
+  size_t i;
+  if(snprintf(filename,sizeof(filename),"%s" PATHSEP CONTAINER_NAME,path)>=(int)sizeof(filename))
+    return 0;
+  if(0!=stat(filename,&s))
+    return 0;
+  TRY(table=acquire_table(filename));
+  for(i=0;i<table->n;++i)
+  { if(snprintf(tilepath,sizeof(tilepath),"%s" PATHSEP "%s",filename,table->records[i].name)>=(int)sizeof(tilepath))
+      continue;
+    add(tilepath,CONTAINER_FORMAT_NAME,ctx);
+  }
+  i=table->n;
+  InternRelease(&g_tables,table);
+  return i;
+Error:
+  return 0;
+}
+
+//
+// === EXPORT ===
+//
+
+/// @cond DEFINES
+#ifdef _MSC_VER
+#define shared __declspec(dllexport)
+#else
+#define shared
+#endif
+/// @endcond
+
+shared
+const metadata_api_t* get_metadata_api()
+{ static const metadata_api_t api =
+  {   container_name,
+      container_is_fmt,
+      container_open,
+      container_close,
+      container_origin,
+      container_set_origin,
+      container_shape,
+      container_set_shape,
+      container_get_vol,
+      container_get_transform,
+      ndioAddPlugin,
+      NULL,
+      container_probe,
+      container_describe,
+      NULL,
+      container_list
+  };
+  return &api;
+}
@@ -0,0 +1,232 @@
+/**
+ * \file
+ * Reading and writing the tile table of a container file.
+ *
+ * HDF5 is not built thread-safe by default, so every call into it is made
+ * while holding one lock.
+ */
+#define _CRT_SECURE_NO_WARNINGS
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <hdf5.h>
+#include "src/util/thread.h"
+#include "table.h"
+
+/// @cond DEFINES
+#define ENDL               "\n"
+#define LOG(...)           fprintf(stderr,__VA_ARGS__)
+#define TRY(e)             do{if(!(e)) { LOG("%s(%d): %s()"ENDL "\tExpression evaluated as false."ENDL "\t%s"ENDL,__FILE__,__LINE__,__FUNCTION__,#e); goto Error;}} while(0)
+#define NEW(type,e,nelem)  TRY((e)=(type*)malloc(sizeof(type)*(nelem)))
+#define ZERO(type,e,nelem) memset((e),0,sizeof(type)*nelem)
+
+#ifdef _MSC_VER
+ #define snprintf _snprintf
+#endif
+
+#define CHUNK_RECORDS 1024 ///< Number of records per chunk of the table.
+/// @endcond
+
+static tbmutex_t g_h5=TBMUTEX_INIT;
+
+static int cmp_record(const void *a, const void *b)
+{ return strcmp(((const container_record_t*)a)->name,((const container_record_t*)b)->name);
+}
+
+static herr_t insert_array(hid_t t, const char *name, size_t offset, hid_t base, hsize_t n)
+{ hid_t a;
+  herr_t e;
+  if(0>(a=H5Tarray_create2(base,1,&n)))
+    return -1;
+  e=H5Tinsert(t,name,offset,a);
+  H5Tclose(a);
+  return e;
+}
+
+/** \returns the HDF5 type matching container_record_t, or a negative number on error. */
+static hid_t record_type(void)
+{ hid_t t=-1,s=-1;
+  TRY(0<=(t=H5Tcreate(H5T_COMPOUND,sizeof(container_record_t))));
+  TRY(0<=(s=H5Tcopy(H5T_C_S1)));
+  TRY(0<=H5Tset_size(s,sizeof(((container_record_t*)0)->name)));
+  TRY(0<=H5Tinsert(t,"name",HOFFSET(container_record_t,name),s));
+  TRY(0<=H5Tset_size(s,sizeof(((container_record_t*)0)->volume)));
+  TRY(0<=H5Tinsert(t,"volume",HOFFSET(container_record_t,volume),s));
+  TRY(0<=insert_array(t,"origin",HOFFSET(container_record_t,origin),H5T_NATIVE_INT64,3));
+  TRY(0<=insert_array(t,"shape" ,HOFFSET(container_record_t,shape) ,H5T_NATIVE_INT64,3));
+  TRY(0<=H5Tinsert(t,"type",HOFFSET(container_record_t,type),H5T_NATIVE_INT32));
+  TRY(0<=H5Tinsert(t,"ndim",HOFFSET(container_record_t,ndim),H5T_NATIVE_INT32));
+  TRY(0<=insert_array(t,"dims",HOFFSET(container_record_t,dims),H5T_NATIVE_INT64,CONTAINER_MAX_NDIM));
+  TRY(0<=insert_array(t,"transform",HOFFSET(container_record_t,transform),H5T_NATIVE_FLOAT,
+                      (CONTAINER_MAX_NDIM+1)*(CONTAINER_MAX_NDIM+1)));
+  H5Tclose(s);
+  return t;
+Error:
+  if(s>=0) H5Tclose(s);
+  if(t>=0) H5Tclose(t);
+  return -1;
+}
+
+/** \returns 1 if every name is distinct and the records are sorted by name, otherwise 0. */
+static int is_sorted(const container_record_t *r, size_t n)
+{ size_t i;
+  for(i=1;i<n;++i)
+    if(strcmp(r[i-1].name,r[i].name)>=0)
+      return 0;
+  return 1;
+}
+
+//
+// === INTERFACE ===
+//
+
+/**
+ * Reads the tile table from the container file \a filename.
+ * \returns NULL on error, otherwise the table.  Free with ContainerTableFree().
+ */
+container_table_t* ContainerTableRead(const char *filename)
+{ container_table_t *self=0;
+  hid_t f=-1,d=-1,s=-1,t=-1;
+  hssize_t n;
+  size_t i;
+  unsigned locked=1;
+  MutexLock(&g_h5);
+  TRY(0<=(f=H5Fopen(filename,H5F_ACC_RDONLY,H5P_DEFAULT)));
+  TRY(0<=(d=H5Dopen2(f,CONTAINER_TABLE,H5P_DEFAULT)));
+  TRY(0<=(s=H5Dget_space(d)));
+  TRY(0<=(n=H5Sget_simple_extent_npoints(s)));
+  TRY(0<=(t=record_type()));
+  NEW(container_table_t,self,1);
+  ZERO(container_table_t,self,1);
+  NEW(container_record_t,self->records,n?n:1);
+  self->n=(size_t)n;
+  if(n)
+    TRY(0<=H5Dread(d,t,H5S_ALL,H5S_ALL,H5P_DEFAULT,self->records));
+  H5Tclose(t);
+  H5Sclose(s);
+  H5Dclose(d);
+  H5Fclose(f);
+  t=s=d=f=-1;
+  MutexUnlock(&g_h5);
+  locked=0;
+  for(i=0;i<self->n;++i)
+  { self->records[i].name[sizeof(self->records[i].name)-1]=0;
+    self->records[i].volume[sizeof(self->records[i].volume)-1]=0;
+    TRY(0<self->records[i].ndim && self->records[i].ndim<=CONTAINER_MAX_NDIM);
+  }
+  if(!is_sorted(self->records,self->n))
+    qsort(self->records,self->n,sizeof(*self->records),cmp_record);
+  return self;
+Error:
+  if(t>=0) H5Tclose(t);
+  if(s>=0) H5Sclose(s);
+  if(d>=0) H5Dclose(d);
+  if(f>=0) H5Fclose(f);
+  if(locked) MutexUnlock(&g_h5);
+  LOG("\tCould not read tile table from %s"ENDL,filename);
+  ContainerTableFree(self);
+  return 0;
+}
+
+/**
+ * Writes a container file holding \a records.
+ *
+ * The records are sorted by name in place.  Names must be unique.  The file
+ * is written next to \a filename and then moved into place, so readers never
+ * see a partially written table.
+ *
+ * \returns 1 on success, 0 otherwise.
+ */
+unsigned ContainerTableWrite(const char *filename, container_record_t *records, size_t n)
+{ char tmp[1024]={0};
+  hid_t f=-1,d=-1,s=-1,t=-1,p=-1;
+  hsize_t dims,maxdims=H5S_UNLIMITED,chunk;
+  unsigned locked=0;
+  qsort(records,n,sizeof(*records),cmp_record);
+  TRY(is_sorted(records,n));
+  TRY(snprintf(tmp,sizeof(tmp),"%s.tmp",filename)<(int)sizeof(tmp));
+  dims=n;
+  chunk=n<CHUNK_RECORDS?(n?n:1):CHUNK_RECORDS;
+  MutexLock(&g_h5);
+  locked=1;
+  TRY(0<=(t=record_type()));
+  TRY(0<=(f=H5Fcreate(tmp,H5F_ACC_TRUNC,H5P_DEFAULT,H5P_DEFAULT)));
+  TRY(0<=(s=H5Screate_simple(1,&dims,&maxdims)));
+  TRY(0<=(p=H5Pcreate(H5P_DATASET_CREATE)));
+  TRY(0<=H5Pset_chunk(p,1,&chunk));
+  if(H5Zfilter_avail(H5Z_FILTER_DEFLATE)>0)
+  { TRY(0<=H5Pset_shuffle(p));
+    TRY(0<=H5Pset_deflate(p,4));
+  }
+  TRY(0<=(d=H5Dcreate2(f,CONTAINER_TABLE,t,s,H5P_DEFAULT,p,H5P_DEFAULT)));
+  if(n)
+    TRY(0<=H5Dwrite(d,t,H5S_ALL,H5S_ALL,H5P_DEFAULT,records));
+  H5Dclose(d); d=-1;
+  H5Pclose(p); p=-1;
+  H5Sclose(s); s=-1;
+  H5Tclose(t); t=-1;
+  TRY(0<=H5Fclose(f)); f=-1;
+  MutexUnlock(&g_h5);
+  locked=0;
+  TRY(0==rename(tmp,filename));
+  return 1;
+Error:
+  if(d>=0) H5Dclose(d);
+  if(p>=0) H5Pclose(p);
+  if(s>=0) H5Sclose(s);
+  if(t>=0) H5Tclose(t);
+  if(f>=0) H5Fclose(f);
+  if(locked) MutexUnlock(&g_h5);
+  if(tmp[0]) remove(tmp);
+  LOG("\tCould not write tile table to %s"ENDL,filename);
+  return 0;
+}
+
+void ContainerTableFree(container_table_t *self)
+{ if(!self) return;
+  free(self->records);
+  free(self);
+}
+
+/** \returns the record named \a name, or NULL if there isn't one. */
+container_record_t* ContainerTableFind(container_table_t *self, const char *name)
+{ container_record_t key;
+  if(!self || !name || strlen(name)>=sizeof(key.name))
+    return 0;
+  strcpy(key.name,name);
+  return (container_record_t*)bsearch(&key,self->records,self->n,sizeof(*self->records),cmp_record);
+}
+
+/**
+ * Splits a tile path into the path of its container file and the tile's name.
+ *
+ * \param[in]  tilepath  A path like <tt>root/tilebase.tiles.h5/name</tt>.
+ * \param[out] filename  Receives the path of the container file.
+ * \param[in]  nbytes    Capacity of \a filename.
+ * \returns a pointer to the tile's name within \a tilepath, or NULL if
+ *          \a tilepath doesn't address a tile in a container.
+ */
+const char* ContainerSplitPath(const char *tilepath, char *filename, size_t nbytes)
+{ const size_t len=sizeof(CONTAINER_NAME)-1;
+  const char *c,*hit=0;
+  for(c=strstr(tilepath,CONTAINER_NAME);c;c=strstr(c+1,CONTAINER_NAME))
+    if((c==tilepath || c[-1]=='/' || c[-1]=='\\') && (c[len]=='/' || c[len]=='\\') && c[len+1])
+      hit=c;
+  if(!hit || (size_t)(hit-tilepath)+len>=nbytes)
+    return 0;
+  memcpy(filename,tilepath,hit-tilepath+len);
+  filename[hit-tilepath+len]=0;
+  return hit+len+1;
+}
+
+/**
+ * Takes the lock held around every call into HDF5 made here.
+ *
+ * Hold it around other HDF5 calls made by the same program, for example
+ * writes through the nd hdf5 plugin, so they can't run at the same time.
+ */
+void ContainerLockHDF5(void)   { MutexLock(&g_h5); }
+/** Releases the lock taken by ContainerLockHDF5(). */
+void ContainerUnlockHDF5(void) { MutexUnlock(&g_h5); }
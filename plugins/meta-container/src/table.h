@@ -0,0 +1,54 @@
+/** \file
+ *  Tile table for container files.
+ *
+ *  A container is a single HDF5 file, CONTAINER_NAME, in a directory.  It
+ *  holds one record per tile in a chunked, compressed table sorted by tile
+ *  name.  The records carry everything needed to describe a tile, so opening
+ *  a tilebase is one file open and one table read.
+ *
+ *  Tiles in a container are addressed by a path made from the container's
+ *  path and the tile's name:
+ *  \verbatim
+ *  <root>/tilebase.tiles.h5/<name>
+ *  \endverbatim
+ *
+ *  Requires <stdint.h> and <stddef.h> to be included before this file.
+ */
+#pragma once
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+#define CONTAINER_NAME        "tilebase.tiles.h5"
+#define CONTAINER_TABLE       "tiles"   ///< Name of the table's dataset in the container.
+#define CONTAINER_MAX_NDIM    4         ///< Maximum number of dimensions of a tile's volume.
+
+typedef struct _container_record_t
+{ char     name[256];    ///< tile name, unique within a container
+  char     volume[256];  ///< volume file relative to the container's directory.  Empty if there's no volume.
+  int64_t  origin[3];    ///< nanometers
+  int64_t  shape[3];     ///< nanometers
+  int32_t  type;         ///< nd_type_id_t of the volume
+  int32_t  ndim;         ///< number of dimensions of the volume
+  int64_t  dims[CONTAINER_MAX_NDIM]; ///< volume shape in voxels
+  float    transform[(CONTAINER_MAX_NDIM+1)*(CONTAINER_MAX_NDIM+1)]; ///< pixel to space transform, <tt>(ndim+1)^2</tt> elements are used.
+} container_record_t;
+
+typedef struct _container_table_t
+{ container_record_t *records; ///< sorted by name
+  size_t              n;
+} container_table_t;
+
+container_table_t* ContainerTableRead (const char *filename);
+unsigned           ContainerTableWrite(const char *filename, container_record_t *records, size_t n);
+void               ContainerTableFree (container_table_t *self);
+container_record_t* ContainerTableFind(container_table_t *self, const char *name);
+
+const char*        ContainerSplitPath (const char *tilepath, char *filename, size_t nbytes);
+
+void               ContainerLockHDF5  (void);
+void               ContainerUnlockHDF5(void);
+
+#ifdef __cplusplus
+}//extern "C"{
+#endif
@@ -0,0 +1,136 @@
+/**
+ * \file
+ * Tests: Tiles held in a container file
+ * @cond TESTS
+ */
+
+// solves a std::tuple problem in vs2012
+#define GTEST_HAS_TR1_TUPLE     0
+#define GTEST_USE_OWN_TR1_TUPLE 1
+
+#include <gtest/gtest.h>
+#include "tilebase.h"
+#include "plugins/meta-container/src/table.h"
+#include "plugins/meta-container/app/pack.h"
+#include "src/synthetic.h"
+#include "config.h"
+#include <string.h>
+#include <sys/stat.h>
+#ifdef _MSC_VER
+#include <direct.h>
+#define mkdir(p,m) _mkdir(p)
+#endif
+
+#define ROOT_PATH CONTAINER_TEST_OUTPUT_PATH "/container"
+#define PACK_SRC  CONTAINER_TEST_OUTPUT_PATH "/pack-source"
+#define PACK_DST  CONTAINER_TEST_OUTPUT_PATH "/pack-destination"
+
+struct Container:public testing::Test
+{ container_record_t records[3];
+  void SetUp()
+  { ndioAddPluginPath(ND_ROOT_DIR"/bin/plugins");
+    mkdir(ROOT_PATH,0775);
+    remove(ROOT_PATH "/tilebase.cache.yml");
+    memset(records,0,sizeof(records));
+    for(int i=0;i<3;++i)
+    { container_record_t *r=records+i;
+      snprintf(r->name,sizeof(r->name),"%05d/%05d",2-i,i); // out of order on purpose
+      r->origin[0]=1000*i;
+      r->shape[0]=r->shape[1]=r->shape[2]=2000;
+      r->type=nd_u16;
+      r->ndim=3;
+      r->dims[0]=r->dims[1]=r->dims[2]=10;
+      for(int d=0;d<4;++d)
+        r->transform[d*5]=(d<3)?200.0f:1.0f;
+      r->transform[3]=(float)r->origin[0];
+    }
+  }
+};
+
+TEST_F(Container,SplitPath)
+{ char filename[1024];
+  EXPECT_STREQ("a/b",ContainerSplitPath("/x/" CONTAINER_NAME "/a/b",filename,sizeof(filename)));
+  EXPECT_STREQ("/x/" CONTAINER_NAME,filename);
+  EXPECT_EQ(NULL,ContainerSplitPath("/x/" CONTAINER_NAME,filename,sizeof(filename)));
+  EXPECT_EQ(NULL,ContainerSplitPath("/x/not" CONTAINER_NAME "/a",filename,sizeof(filename)));
+}
+
+TEST_F(Container,TableRoundTrip)
+{ container_table_t *t;
+  container_record_t *r;
+  ASSERT_EQ(1,ContainerTableWrite(ROOT_PATH "/" CONTAINER_NAME,records,3));
+  ASSERT_NE((void*)NULL,t=ContainerTableRead(ROOT_PATH "/" CONTAINER_NAME));
+  ASSERT_EQ(3,t->n);
+  EXPECT_STREQ("00000/00002",t->records[0].name);
+  ASSERT_NE((void*)NULL,r=ContainerTableFind(t,"00001/00001"));
+  EXPECT_EQ(1000,r->origin[0]);
+  EXPECT_EQ(200.0f,r->transform[0]);
+  EXPECT_EQ(NULL,ContainerTableFind(t,"00003/00003"));
+  ContainerTableFree(t);
+}
+
+TEST_F(Container,DuplicateNamesAreRejected)
+{ strcpy(records[1].name,records[0].name);
+  EXPECT_EQ(0,ContainerTableWrite(ROOT_PATH "/duplicates.h5",records,3));
+}
+
+TEST_F(Container,Open)
+{ tiles_t tiles;
+  int64_t *ori,*shape;
+  size_t ndim;
+  ASSERT_EQ(1,ContainerTableWrite(ROOT_PATH "/" CONTAINER_NAME,records,3));
+  ASSERT_NE((void*)NULL,tiles=TileBaseOpen(ROOT_PATH,NULL));
+  ASSERT_EQ(3,TileBaseCount(tiles));
+  for(size_t i=0;i<TileBaseCount(tiles);++i)
+  { tile_t t=TileBaseArray(tiles)[i];
+    EXPECT_NE((void*)NULL,strstr(TilePath(t),"/" CONTAINER_NAME "/"));
+    ASSERT_NE((void*)NULL,AABBGet(TileAABB(t),&ndim,&ori,&shape));
+    EXPECT_EQ(3,ndim);
+    EXPECT_EQ(2000,shape[0]);
+    EXPECT_EQ(3,ndndim(TileShape(t)));
+    EXPECT_EQ(nd_u16,ndtype(TileShape(t)));
+  }
+  TileBaseClose(tiles);
+}
+
+TEST_F(Container,OpenByName)
+{ tiles_t tiles;
+  ASSERT_EQ(1,ContainerTableWrite(ROOT_PATH "/" CONTAINER_NAME,records,3));
+  ASSERT_NE((void*)NULL,tiles=TileBaseOpen(ROOT_PATH,"tilebase.container"));
+  EXPECT_EQ(3,TileBaseCount(tiles));
+  TileBaseClose(tiles);
+}
+TEST_F(Container,PackThenReadVoxel)
+{ synthetic_lattice_t lattice;
+  tiles_t tiles;
+  tile_t t=0;
+  ndio_t file;
+  nd_t vol;
+  memset(&lattice,0,sizeof(lattice));
+  lattice.count[0]=3;
+  lattice.count[1]=2;
+  lattice.count[2]=1;
+  lattice.tile.dims[0]=lattice.tile.dims[1]=16;
+  lattice.tile.dims[2]=4;
+  lattice.tile.voxel[0]=lattice.tile.voxel[1]=lattice.tile.voxel[2]=1000.0;
+  lattice.tile.type=nd_u16;
+  lattice.ext="tif";
+  ASSERT_EQ(6,SyntheticLatticeMake(PACK_SRC,&lattice,NULL,NULL));
+  mkdir(PACK_DST,0775);
+  remove(PACK_DST "/tilebase.cache.yml");
+  ASSERT_EQ(1,ContainerPack(PACK_SRC,PACK_DST,"tilebase.synthetic"));
+
+  ASSERT_NE((void*)NULL,tiles=TileBaseOpen(PACK_DST,NULL));
+  ASSERT_EQ(6,TileBaseCount(tiles));
+  for(size_t i=0;i<TileBaseCount(tiles);++i)
+    if(strstr(TilePath(TileBaseArray(tiles)[i]),"/" CONTAINER_NAME "/00000-00001-00002"))
+      t=TileBaseArray(tiles)[i];
+  ASSERT_NE((void*)NULL,t);
+  ASSERT_NE((void*)NULL,file=TileFile(t));
+  ASSERT_NE((void*)NULL,vol=ndheap(ndioShape(file)));
+  ASSERT_EQ(file,ndioRead(file,vol));
+  EXPECT_EQ(1+5,((uint16_t*)nddata(vol))[0]); // the lattice fills tile i with 1+i
+  ndfree(vol);
+  TileBaseClose(tiles);
+}
+///@endcond
@@ -12,6 +12,7 @@
 #include <string>
 
 #include <fcntl.h>
+#include <sys/stat.h>
 #include <errno.h>
 
 #include <string.h>
@@ -27,6 +28,8 @@
 #include "tilebase.h"
 #include "src/metadata/metadata.h"
 #include "src/metadata/interface.h"
+#include "src/util/intern.h"
+#include "src/util/dirlist.h"
 
 #include <iostream>
 #include <Eigen/Dense>
@@ -58,6 +61,9 @@ using namespace std;
 #else
  #define PATHSEP '/'
 #endif
+#ifndef O_BINARY
+ #define O_BINARY 0
+#endif
 /// @endcond
 
 typedef fetch::cfg::device::MicroscopeV1 scope_desc_t;
@@ -67,11 +73,20 @@ typedef google::protobuf::Message       desc_t;
 //
 // GLOBALS
 //
-/// \todo protect globals with a mutex
-static int g_silent=0; ///< Use to turn logging to stderr on/off.
+#ifdef _MSC_VER
+#define THREAD_LOCAL __declspec(thread)
+#else
+#define THREAD_LOCAL __thread
+#endif
+/// Use to turn logging to stderr on/off.  Per-thread so concurrent calls can't silence each other.
+static THREAD_LOCAL int g_silent=0;
 
 #if 1
 static void toggle_silence() { g_silent=!g_silent; }
+
+static void release_scope(void *desc) { delete (scope_desc_t*)desc; }
+/// Parsed scope descriptors shared by tiles with byte-identical .microscope files.
+static intern_t g_scopes=INTERN_INIT(release_scope);
 #else
 static void toggle_silence() { }
 #endif
@@ -91,19 +106,48 @@ static size_t rfind_pathsep(const std::string& s)
 }
 
 struct pbufv1_t
-{ scope_desc_t  scope;
+{ scope_desc_t *scope;   ///< May be shared with other contexts (see readScopeFromPath()).  Use mutable_scope() to modify.
+  int           shared;  ///< 1 if \a scope is held through \a g_scopes.
   stack_desc_t  stack;
   unsigned      read_mode,
                 write_mode;
+  int           scope_dirty, ///< 1 if the scope descriptor changed since it was read or written.
+                stack_dirty; ///< 1 if the stack descriptor changed since it was read or written.
   std::string   path;
 
-  pbufv1_t(const char* _path):read_mode(0),write_mode(0),path(_path)
+  pbufv1_t(const char* _path):scope(new scope_desc_t),shared(0),read_mode(0),write_mode(0),scope_dirty(0),stack_dirty(0),path(_path)
   { // clean path of the trailing path seperator if it's there
     char e= *path.rbegin();
     if(e=='/') // assume unix-style path seperators
       path=path.substr(0,path.size()-1);
   }
 
+  ~pbufv1_t()
+  { if(shared) InternRelease(&g_scopes,scope);
+    else        delete scope;
+  }
+
+  /** Replaces the scope descriptor with the shared descriptor \a desc. \returns 0 if \a desc is NULL. */
+  int share(scope_desc_t *desc)
+  { if(!desc) return 0;
+    if(shared) InternRelease(&g_scopes,scope);
+    else        delete scope;
+    scope=desc;
+    shared=1;
+    return 1;
+  }
+
+  /** Copy on write.  \returns a scope descriptor owned by this context. */
+  scope_desc_t* mutable_scope()
+  { if(shared)
+    { scope_desc_t *s=new scope_desc_t(*scope);
+      InternRelease(&g_scopes,scope);
+      scope=s;
+      shared=0;
+    }
+    return scope;
+  }
+
   /**
    * Notes:
    * File's have the form:
@@ -122,8 +166,8 @@ struct pbufv1_t
   { //extract the series no. from the path
     std::string ss=path.substr(rfind_pathsep(path));
     const char *series=ss.c_str(),
-               *prefix=scope.file_prefix().c_str(),
-               *ext=normalize_extension(scope.stack_extension().c_str());
+               *prefix=scope->file_prefix().c_str(),
+               *ext=normalize_extension(scope->stack_extension().c_str());
     char buf[1024]={0};
     TRY(snprintf(buf,countof(buf),"%s%s-%s.%%.%s",path.c_str(),series,prefix,ext)>0);
     return string(buf);
@@ -182,42 +226,219 @@ static void cat(char *buf, size_t nbytes, int nstrings, const char** strings)
 }
 
 /** Finds file with extension \a ext at \a path.
+    \param[in] list  Listing of \a path made by the caller, or NULL to list it here.
+    \returns NULL if no file was found.
 */
 static
-char* find(char* out,size_t n, const char* path, const char *ext)
+char* find(char* out,size_t n, const char* path, const char *ext, dirlist_t list)
 { DIR *dir=0;
   struct dirent *ent=0;
   char *r;
+  int found=0;
+  if(list) // the caller already listed this directory
+  { const char *name;
+    if(!(name=DirListFindExtension(list,ext)))
+      return NULL;
+    { const char *s[]={path,"/",name};
+      cat(out,n,countof(s),s);
+    }
+    return out;
+  }
   TRYMSG(dir=opendir(path),strerror(errno));
   while((ent=readdir(dir)))
   { if((r=strrchr(ent->d_name,'.')) && strcmp(r,ext)==0)
     { const char *s[]={path,"/",ent->d_name};
       cat(out,n,countof(s),s);
+      found=1;
       break;
     }
   }
   TRYMSG(closedir(dir)>=0,strerror(errno));
-  return out;
+  return found?out:NULL;
 Error:
   if(dir)
     TRYMSG(closedir(dir)>=0,strerror(errno));
   return NULL;
 }
 
+/**
+ * Binary encoded copies of the text descriptors are stored next to them with
+ * this suffix appended, e.g. <tt>default.microscope.v1.pb</tt>.  The suffix
+ * carries the format version.  The binary parser accepts fields it doesn't
+ * know, so a sidecar written by another version would parse; it just never
+ * gets opened.
+ * \see pbufv1_write_sidecar()
+ */
+#define BINARY_SUFFIX ".v1.pb"
+
+/**
+ * Gets the name of the binary sidecar for the text descriptor \a textname.
+ * Sidecars older than the text file are ignored since the text may have been
+ * edited after it was converted.
+ * \returns 1 if a usable sidecar exists, otherwise 0.
+ */
+static
+int findBinary(char *out, size_t n, const char *textname)
+{ struct stat t,b;
+  if(strlen(textname)+sizeof(BINARY_SUFFIX)>n) return 0;
+  strcpy(out,textname);
+  strcat(out,BINARY_SUFFIX);
+  return 0==stat(out,&b)
+      && 0==stat(textname,&t)
+      && b.st_mtime>=t.st_mtime;
+}
+
+/** Parses the binary encoded message in \a filename into \a desc. */
+static
+int readBinaryDesc(const char* filename, desc_t *desc)
+{ int fd;
+  int isok=1;
+  google::protobuf::io::ZeroCopyInputStream *raw=0;
+  TRY(-1<(fd=open(filename,O_RDONLY|O_BINARY)));
+  raw=new google::protobuf::io::FileInputStream(fd);
+  TRY(desc->ParseFromZeroCopyStream(raw));
+Finalize:
+  if(raw) delete raw;
+  if(fd>=0) close(fd);
+  return isok;
+Error:
+  isok=0;
+  goto Finalize;
+}
+
+/**
+ * Replaces the contents of the file \a name with \a bytes.
+ * Writes to a temporary file first and renames it over \a name so readers
+ * never see a partially written file.
+ */
+static
+int replaceFile(const char *name, const std::string &bytes)
+{ char tmp[1024];
+  FILE *fp=0;
+  TRY(strlen(name)+sizeof(".tmp")<=sizeof(tmp));
+  snprintf(tmp,sizeof(tmp),"%s.tmp",name);
+  TRY(fp=fopen(tmp,"wb"));
+  TRY(fwrite(bytes.data(),1,bytes.size(),fp)==bytes.size());
+  TRY(0==fclose(fp));
+  fp=0;
+#ifdef _MSC_VER
+  remove(name); // rename won't replace an existing file on windows
+#endif
+  TRY(0==rename(tmp,name));
+  return 1;
+Error:
+  if(fp) fclose(fp);
+  remove(tmp);
+  return 0;
+}
+
+/**
+ * Writes \a msg binary encoded next to the text descriptor with extension
+ * \a ext in \a path.  Writes to a temporary file first so readers never see
+ * a partial sidecar.
+ */
+static
+int writeBinaryDesc(const desc_t &msg, const char* path, const char *ext)
+{ char name[1024],bin[1024];
+  std::string bytes;
+  TRY(find(name,sizeof(name),path,ext,0));
+  TRY(strlen(name)+sizeof(BINARY_SUFFIX)<=sizeof(name));
+  snprintf(bin,sizeof(bin),"%s" BINARY_SUFFIX,name);
+  TRY(msg.SerializeToString(&bytes));
+  TRY(replaceFile(bin,bytes));
+  return 1;
+Error:
+  return 0;
+}
+
 /**
  * Finds the first file in \a path with the extension \ext and
  * uses the protobuf text parser to read a protobuf message \a desc.
+ * \a list is the listing of \a path, or NULL.
  * \returns 1 on success, 0 otherwise.
  */
 static
-int readDescFromPath(const char* path, const char* ext, desc_t *desc)
-{ char name[1024];
-  TRY(find(name,sizeof(name),path,ext));
+int readDescFromPath(const char* path, const char* ext, desc_t *desc, dirlist_t list)
+{ char name[1024],bin[1024];
+  TRY(find(name,sizeof(name),path,ext,list));
+  if(findBinary(bin,sizeof(bin),name) && readBinaryDesc(bin,desc))
+    return 1;
   return readDesc(name,desc);
 Error:
   return 0;
 }
 
+/** Reads the whole file at \a filename into \a out. */
+static
+int readFile(const char* filename, std::string *out)
+{ FILE *fp=0;
+  char buf[4096];
+  size_t n;
+  TRY(fp=fopen(filename,"rb"));
+  out->clear();
+  while((n=fread(buf,1,sizeof(buf),fp))>0)
+    out->append(buf,n);
+  TRY(!ferror(fp));
+  fclose(fp);
+  return 1;
+Error:
+  if(fp) fclose(fp);
+  return 0;
+}
+
+/** Parses the text-format message in \a bytes into \a desc. */
+static
+int parseDesc(const std::string& bytes, desc_t *desc)
+{ google::protobuf::io::ArrayInputStream raw(bytes.data(),(int)bytes.size());
+  google::protobuf::TextFormat::Parser parser;
+  ErrorCollector e;
+  parser.RecordErrorsTo(&e);
+  TRY(parser.Parse(&raw,desc));
+  TRY(e.ok());
+  return 1;
+Error:
+  return 0;
+}
+
+/**
+ * Reads the scope descriptor from the .microscope file at \a path.
+ * \a list is the listing of \a path, or NULL.
+ *
+ * Every tile of an acquisition carries a byte-identical .microscope file, so
+ * descriptors are shared by content instead of being parsed for each tile.
+ * If \a binary is set, a binary sidecar is used instead of the text file
+ * when there is one.  Format detection passes 0: only the text parser
+ * rejects descriptors from other versions.
+ *
+ * \returns 0 on failure, otherwise a shared, read-only descriptor.  Release
+ *          with InternRelease(&g_scopes,...).
+ */
+static
+scope_desc_t* readScopeFromPath(const char* path, dirlist_t list, int binary)
+{ char name[1024],bin[1024];
+  std::string bytes;
+  scope_desc_t *desc=0;
+  TRY(find(name,sizeof(name),path,".microscope",list));
+  if(binary && findBinary(bin,sizeof(bin),name) && readFile(bin,&bytes))
+  { if((desc=(scope_desc_t*)InternAcquire(&g_scopes,bytes.data(),bytes.size())))
+      return desc;
+    desc=new scope_desc_t;
+    if(desc->ParseFromArray(bytes.data(),(int)bytes.size()))
+      return (scope_desc_t*)InternInsert(&g_scopes,bytes.data(),bytes.size(),desc);
+    delete desc; // fall back to the text file
+    desc=0;
+  }
+  TRY(readFile(name,&bytes));
+  if((desc=(scope_desc_t*)InternAcquire(&g_scopes,bytes.data(),bytes.size())))
+    return desc;
+  desc=new scope_desc_t;
+  TRY(parseDesc(bytes,desc));
+  return (scope_desc_t*)InternInsert(&g_scopes,bytes.data(),bytes.size(),desc);
+Error:
+  if(desc) delete desc;
+  return 0;
+}
+
 /**
  * Get write target.
  * Finds the first file with extension \a ext in \a path.  If
@@ -232,22 +453,27 @@ Error:
  */
 static
 void getWriteTarget(char* out, size_t n,const char* path, const char* ext, const char* default_prefix)
-{ if(!find(out,n,path,ext))
+{ if(!find(out,n,path,ext,0))
   { const char *p[]={path,"/",default_prefix,ext};
-    cat(out,sizeof(out),countof(p),p);
+    cat(out,n,countof(p),p);
   }
 }
 
+/**
+ * Writes \a msg as text to the descriptor with extension \a ext in \a path.
+ * The file is replaced atomically.  Any binary sidecar is removed since it
+ * no longer matches the text.
+ */
 static
 int write(const desc_t &msg,const char* path, const char *ext, const char *default_prefix)
-{ int fd;
-  char out[1024];
+{ char out[1024],bin[1024];
+  std::string text;
   getWriteTarget(out,sizeof(out),path,ext,default_prefix);
-  TRY((fd=open(out,O_WRONLY))>-1);
-  { google::protobuf::io::FileOutputStream os(fd);
-    google::protobuf::TextFormat::Print(msg,&os);
-  }
-  close(fd);
+  TRY(google::protobuf::TextFormat::PrintToString(msg,&text));
+  TRY(replaceFile(out,text));
+  TRY(strlen(out)+sizeof(BINARY_SUFFIX)<=sizeof(bin));
+  snprintf(bin,sizeof(bin),"%s" BINARY_SUFFIX,out);
+  remove(bin);
   return 1;
 Error:
   return 0;
@@ -275,16 +501,18 @@ const char* pbufv1_name()
 { return PBUFV1_FORMAT_NAME; }
 
 /**
- * Just checks for the existence of the expected files at \a path.
+ * Checks for the expected files at \a path and parses the text .microscope
+ * file.  Sidecars aren't consulted, so whether a tile is in this format only
+ * depends on the text.
  */
 unsigned pbufv1_is_fmt(const char* path, const char* mode)
 { char name[1024];
-  scope_desc_t desc;
+  scope_desc_t *desc=0;
   unsigned v;
   toggle_silence();
-  v=(find(name,sizeof(name),path,".acquisition") &&
-          find(name,sizeof(name),path,".microscope") &&
-          readDesc(name,&desc));
+  v=(find(name,sizeof(name),path,".acquisition",0) &&
+          (desc=readScopeFromPath(path,0,0)));
+  InternRelease(&g_scopes,desc);
   toggle_silence();
   return v;
 }
@@ -294,22 +522,71 @@ void* pbufv1_open(const char* path, const char* mode)
 { pbufv1_t *ctx=new pbufv1_t(path);
   TRY(parse_mode_string((char*)mode,&ctx->read_mode,&ctx->write_mode));
   if(ctx->read_mode)
-  { TRY(readDescFromPath(path,".microscope",&ctx->scope));
-    TRY(readDescFromPath(path,".acquisition",&ctx->stack));
-  }
+  { TRY(ctx->share(readScopeFromPath(path,0,1)));
+    TRY(readDescFromPath(path,".acquisition",&ctx->stack,0));
+  } else
+    ctx->scope_dirty=ctx->stack_dirty=1; // nothing was read, so both get written
   return (void*)ctx;
 Error:
   if(ctx) delete ctx;
   return 0;
 }
 
-/** Commit any changes if opened with write mode. */
-void pbufv1_close(metadata_t self)
+/**
+ * Detects the format and opens the tile in one step.
+ *
+ * The descriptors parsed while detecting the format are kept in the returned
+ * context, so they are only parsed once.  As in pbufv1_is_fmt(), the format is
+ * decided by the text .microscope file.  Identical files are only parsed once
+ * (see readScopeFromPath()), and the per-tile .acquisition still comes from
+ * its sidecar.
+ * \param[in] list  Listing of \a path made by the caller, or NULL.
+ * \returns 0 if the tile isn't in this format, otherwise the opened context.
+ */
+void* pbufv1_probe(const char* path, const char* mode, dirlist_t list)
+{ pbufv1_t *ctx=0;
+  if(!strchr(mode,'r'))
+    return pbufv1_is_fmt(path,mode)?pbufv1_open(path,mode):0;
+  toggle_silence();
+  ctx=new pbufv1_t(path);
+  TRY(parse_mode_string((char*)mode,&ctx->read_mode,&ctx->write_mode));
+  TRY(ctx->share(readScopeFromPath(path,list,0)));
+  TRY(readDescFromPath(path,".acquisition",&ctx->stack,list));
+  toggle_silence();
+  return (void*)ctx;
+Error:
+  toggle_silence();
+  if(ctx) delete ctx;
+  return 0;
+}
+
+/**
+ * Writes any changes if opened with write mode.
+ * When the descriptors were also read ("rw"), only the ones that changed are
+ * rewritten.
+ * \returns 1 on success, otherwise 0.
+ */
+unsigned pbufv1_commit(metadata_t self)
 { pbufv1_t *ctx=(pbufv1_t*)MetadataContext(self);
-  if(ctx->write_mode)
-  { WARN(write(ctx->scope,ctx->path.c_str(),".microscope" ,"default"));
-    WARN(write(ctx->stack,ctx->path.c_str(),".acquisition","default"));
+  if(!ctx->write_mode)
+    return 1;
+  if(ctx->scope_dirty)
+  { TRY(write(*ctx->scope,ctx->path.c_str(),".microscope" ,"default"));
+    ctx->scope_dirty=0;
+  }
+  if(ctx->stack_dirty)
+  { TRY(write(ctx->stack,ctx->path.c_str(),".acquisition","default"));
+    ctx->stack_dirty=0;
   }
+  return 1;
+Error:
+  return 0;
+}
+
+/** Commit any changes that weren't committed yet.  \see pbufv1_commit() */
+void pbufv1_close(metadata_t self)
+{ pbufv1_t *ctx=(pbufv1_t*)MetadataContext(self);
+  WARN(pbufv1_commit(self));
   delete ctx;
 }
 
@@ -334,7 +611,12 @@ unsigned pbufv1_origin(metadata_t self, size_t *nelem, int64_t* origin)
 unsigned pbufv1_set_origin(metadata_t self_, size_t nelem, int64_t* origin)
 { pbufv1_t *self=(pbufv1_t*)MetadataContext(self_);
   double nm2mm=1e-6;
+  int64_t cur[3];
   TRY(nelem==3);
+  pbufv1_origin(self_,0,cur);
+  if(0==memcmp(cur,origin,sizeof(cur)))
+    return 1; // unchanged
+  self->stack_dirty=1;
   self->stack.set_x_mm(origin[0]*nm2mm);
   self->stack.set_y_mm(origin[1]*nm2mm);
   self->stack.set_z_mm(origin[2]*nm2mm);
@@ -346,10 +628,17 @@ Error:
 unsigned pbufv1_set_shape (metadata_t self_, size_t nelem, int64_t* shape)
 { pbufv1_t *self=(pbufv1_t*)MetadataContext(self_);
   double nm2um=1e-3;
+  static const int64_t um2nm=1e3;
+  const int64_t cur[3]={(int64_t)(self->scope->fov().x_size_um()*um2nm),
+                        (int64_t)(self->scope->fov().y_size_um()*um2nm),
+                        (int64_t)(self->scope->fov().z_size_um()*um2nm)};
   TRY(nelem==3);
-  self->scope.mutable_fov()->set_x_size_um(shape[0]*nm2um);
-  self->scope.mutable_fov()->set_y_size_um(shape[1]*nm2um);
-  self->scope.mutable_fov()->set_z_size_um(shape[2]*nm2um);
+  if(0==memcmp(cur,shape,sizeof(cur)))
+    return 1; // unchanged
+  self->scope_dirty=1;
+  self->mutable_scope()->mutable_fov()->set_x_size_um(shape[0]*nm2um);
+  self->mutable_scope()->mutable_fov()->set_y_size_um(shape[1]*nm2um);
+  self->mutable_scope()->mutable_fov()->set_z_size_um(shape[2]*nm2um);
   return 1;
 Error:
   return 0;
@@ -361,9 +650,9 @@ unsigned pbufv1_shape(metadata_t self, size_t *nelem, int64_t* shape)
   if(nelem) *nelem=3;
   if(!shape) //just set nelem and return
     return 0;
-  shape[0]=ctx->scope.fov().x_size_um()*um2nm;
-  shape[1]=ctx->scope.fov().y_size_um()*um2nm;
-  shape[2]=ctx->scope.fov().z_size_um()*um2nm;
+  shape[0]=ctx->scope->fov().x_size_um()*um2nm;
+  shape[1]=ctx->scope->fov().y_size_um()*um2nm;
+  shape[2]=ctx->scope->fov().z_size_um()*um2nm;
   return 1;
 }
 
@@ -399,18 +688,16 @@ ndio_t pbufv1_get_vol(metadata_t self, const char* mode)
 // { matrix[idim*(ndim+1)+ndim]=s;
 // }
 
-unsigned pbufv1_get_transform(metadata_t self, float *transform)
+/**
+ * Computes the transform for a volume with shape \a vol.
+ * \see pbufv1_get_transform()
+ */
+static unsigned compute_transform(metadata_t self, nd_t vol, float *transform)
 { pbufv1_t *ctx=(pbufv1_t*)MetadataContext(self);
 #if 1
-  nd_t vol;
   unsigned n;
   int64_t shape[3],ori[3];
 
-  ndio_t file;
-  TRY(file=pbufv1_get_vol(self,"r"));
-  vol=ndioShape(file);
-  ndioClose(file);
-
   TRY((n=ndndim(vol))==3 || n==4); // 3d or 3d+1 color dimension
   TRY(pbufv1_shape(self,NULL,shape));
   TRY(pbufv1_origin(self,NULL,ori));
@@ -418,7 +705,7 @@ unsigned pbufv1_get_transform(metadata_t self, float *transform)
   { MatrixXf center(n+1,n+1),stage(n+1,n+1),S(n+1,n+1),R(n+1,n+1),F(n+1,n+1);
 
     F.setIdentity().block<3,3>(0,0).diagonal() << 1.0f,-1.0f,1.0f;
-    R.setIdentity().block<3,3>(0,0)=AngleAxisf(ctx->scope.fov().rotation_radians(),Vector3f(0,0,1)).matrix();
+    R.setIdentity().block<3,3>(0,0)=AngleAxisf(ctx->scope->fov().rotation_radians(),Vector3f(0,0,1)).matrix();
     center.setIdentity().block<3,1>(0,n)
         << (-(float)ndshape(vol)[0]/2.0f),
            (-(float)ndshape(vol)[1]/2.0f),
@@ -458,6 +745,57 @@ Error:
   return 0;
 }
 
+unsigned pbufv1_get_transform(metadata_t self, float *transform)
+{ nd_t vol;
+  ndio_t file;
+  unsigned ok;
+  TRY(file=pbufv1_get_vol(self,"r"));
+  vol=ndioShape(file);
+  ndioClose(file);
+  ok=compute_transform(self,vol,transform);
+  ndfree(vol);
+  return ok;
+Error:
+  return 0;
+}
+
+/**
+ * Reads the bounding box, volume shape, volume path and transform with one
+ * parse of the descriptors and one probe of the volume.
+ */
+unsigned pbufv1_describe(metadata_t self, metadata_description_t *desc)
+{ pbufv1_t *ctx=(pbufv1_t*)MetadataContext(self);
+  ndio_t file=0;
+  std::string path;
+  TRY(pbufv1_origin(self,&desc->ndim,desc->origin));
+  TRY(pbufv1_shape(self,&desc->ndim,desc->shape));
+  TRY((path=ctx->get_vol_path()).size()<sizeof(desc->vol_path));
+  strcpy(desc->vol_path,path.c_str());
+  TRY(file=ndioOpen(desc->vol_path,0,"r"));
+  TRY(desc->vol=ndioShape(file));
+  ndioClose(file);
+  file=0;
+  TRY(compute_transform(self,desc->vol,desc->transform));
+  return 1;
+Error:
+  if(file) ndioClose(file);
+  if(desc->vol) { ndfree(desc->vol); desc->vol=0; }
+  return 0;
+}
+
+/**
+ * Writes binary encoded copies of the descriptors next to the text files.
+ * Later opens read these instead of running the much slower text parser.
+ */
+unsigned pbufv1_write_sidecar(metadata_t self)
+{ pbufv1_t *ctx=(pbufv1_t*)MetadataContext(self);
+  TRY(writeBinaryDesc(*ctx->scope,ctx->path.c_str(),".microscope"));
+  TRY(writeBinaryDesc(ctx->stack,ctx->path.c_str(),".acquisition"));
+  return 1;
+Error:
+  return 0;
+}
+
 //
 // === EXPORT ===
 //
@@ -484,7 +822,12 @@ const metadata_api_t* get_metadata_api()
       pbufv1_get_vol,
       pbufv1_get_transform,
       ndioAddPlugin,
-      NULL
+      NULL,
+      pbufv1_probe,
+      pbufv1_describe,
+      pbufv1_write_sidecar,
+      NULL,
+      pbufv1_commit
   };
   return &api;
 }
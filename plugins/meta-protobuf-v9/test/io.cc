@@ -4,7 +4,45 @@
 
 #include <gtest/gtest.h>
 #include "tilebase.h"
-#include "plugins/meta-protobuf-v/config.h"
+#include "src/metadata/metadata.h"
+#include "config.h"
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#ifdef _MSC_VER
+#include <direct.h>
+#include "src/util/dirent.win.h"
+#define mkdir(p,m) _mkdir(p)
+#else
+#include <dirent.h>
+#endif
+
+#define MOVED_ROOT PBUFV9_TEST_OUTPUT_PATH "/pbufv9-moved"
+#define MOVED_TILE MOVED_ROOT "/06087"
+
+/** Copies the files in the directory \a src into \a dst.  \returns 0 on failure. */
+static int copy_files(const char *src, const char *dst)
+{ DIR *dir;
+  struct dirent *ent;
+  int ok=1;
+  if(!(dir=opendir(src))) return 0;
+  while(ok && (ent=readdir(dir)))
+  { char a[1024],b[1024],buf[4096];
+    FILE *in,*out;
+    size_t n;
+    if(ent->d_name[0]=='.') continue;
+    snprintf(a,sizeof(a),"%s/%s",src,ent->d_name);
+    snprintf(b,sizeof(b),"%s/%s",dst,ent->d_name);
+    if(!(in=fopen(a,"rb"))) continue; // e.g. a directory
+    if(!(out=fopen(b,"wb"))) ok=0;
+    while(ok && (n=fread(buf,1,sizeof(buf),in))>0)
+      ok=(fwrite(buf,1,n,out)==n);
+    fclose(in);
+    if(out) ok&=(0==fclose(out));
+  }
+  closedir(dir);
+  return ok;
+}
 
 
 struct FetchProtobufV9: public testing::Test
@@ -34,3 +72,90 @@ TEST_F(FetchProtobufV9,ByName)
   EXPECT_EQ(1,TileBaseCount(tiles));
   TileBaseClose(tiles);
 }
+
+TEST_F(FetchProtobufV9,DetectedFormatName)
+{ tiles_t tiles;
+  metadata_t meta;
+  ASSERT_NE((void*)NULL,tiles=TileBaseOpen(PBUFV9_TEST_DATA_PATH "/06087",""));
+  ASSERT_NE((void*)NULL,meta=MetadataOpen(TilePath(TileBaseArray(tiles)[0]),NULL,"r"));
+  EXPECT_STREQ("fetch.protobuf.v9",MetadataFormat(meta));
+  MetadataClose(meta);
+  TileBaseClose(tiles);
+}
+
+TEST_F(FetchProtobufV9,WrongHintFallsBackToDetection)
+{ tiles_t tiles;
+  metadata_t meta;
+  ASSERT_NE((void*)NULL,tiles=TileBaseOpen(PBUFV9_TEST_DATA_PATH "/06087",""));
+  ASSERT_NE((void*)NULL,meta=MetadataOpenWithHint(TilePath(TileBaseArray(tiles)[0]),"not.a.format",NULL,"r"));
+  EXPECT_STREQ("fetch.protobuf.v9",MetadataFormat(meta));
+  MetadataClose(meta);
+  TileBaseClose(tiles);
+}
+
+TEST_F(FetchProtobufV9,UpdateWithSameOriginKeepsBox)
+{ tiles_t tiles;
+  int64_t *ori,*shape,before[3],after[3];
+  tile_update_t u={0};
+  ASSERT_NE((void*)NULL,tiles=TileBaseOpen(PBUFV9_TEST_DATA_PATH "/06087",""));
+  ASSERT_NE((void*)NULL,AABBGet(TileAABB(TileBaseArray(tiles)[0]),NULL,&ori,&shape));
+  memcpy(before,ori,sizeof(before));
+  u.path=TilePath(TileBaseArray(tiles)[0]);
+  u.ndim=3;
+  u.origin=before;
+  EXPECT_EQ(1,TileBaseUpdate(tiles,&u,1));
+  ASSERT_NE((void*)NULL,AABBGet(TileAABB(TileBaseArray(tiles)[0]),NULL,&ori,&shape));
+  memcpy(after,ori,sizeof(after));
+  EXPECT_EQ(0,memcmp(before,after,sizeof(before)));
+  TileBaseClose(tiles);
+}
+
+TEST_F(FetchProtobufV9,MoveTile)
+{ tiles_t tiles;
+  metadata_t meta;
+  int64_t *ori,*shape,moved[3],got[3];
+  size_t ndim;
+  tile_update_t u={0};
+  mkdir(MOVED_ROOT,0775);
+  mkdir(MOVED_TILE,0775);
+  remove(MOVED_ROOT "/tilebase.cache.yml");
+  ASSERT_TRUE(copy_files(PBUFV9_TEST_DATA_PATH "/06087",MOVED_TILE));
+  ASSERT_NE((void*)NULL,tiles=TileBaseOpen(MOVED_ROOT,""));
+  ASSERT_EQ(1,TileBaseCount(tiles));
+  ASSERT_NE((void*)NULL,AABBGet(TileAABB(TileBaseArray(tiles)[0]),NULL,&ori,&shape));
+  for(int i=0;i<3;++i)
+    moved[i]=ori[i]+(i+1)*1000000; // whole millimeters, since the file stores mm
+  u.path="06087"; // relative to the root
+  u.ndim=3;
+  u.origin=moved;
+  EXPECT_EQ(1,TileBaseUpdate(tiles,&u,1));
+  ASSERT_NE((void*)NULL,AABBGet(TileAABB(TileBaseArray(tiles)[0]),&ndim,&ori,&shape));
+  for(int i=0;i<3;++i)
+    EXPECT_NEAR(moved[i],ori[i],1) << "tile, dimension " << i;
+  TileBaseClose(tiles);
+
+  // the metadata file
+  ASSERT_NE((void*)NULL,meta=MetadataOpen(MOVED_TILE,"fetch.protobuf.v9","r"));
+  ndim=3;
+  EXPECT_EQ(1,MetadataGetOrigin(meta,&ndim,got));
+  for(int i=0;i<3;++i)
+    EXPECT_NEAR(moved[i],got[i],1) << "file, dimension " << i;
+  MetadataClose(meta);
+
+  // the cache at the root
+  ASSERT_NE((void*)NULL,tiles=TileBaseOpen(MOVED_ROOT,""));
+  ASSERT_EQ(1,TileBaseCount(tiles));
+  ASSERT_NE((void*)NULL,AABBGet(TileAABB(TileBaseArray(tiles)[0]),NULL,&ori,&shape));
+  for(int i=0;i<3;++i)
+    EXPECT_NEAR(moved[i],ori[i],1) << "cache, dimension " << i;
+  TileBaseClose(tiles);
+}
+
+TEST_F(FetchProtobufV9,UpdateUnknownTile)
+{ tiles_t tiles;
+  int64_t ori[3]={0};
+  tile_update_t u={"totally.not.here",3,ori,NULL};
+  ASSERT_NE((void*)NULL,tiles=TileBaseOpen(PBUFV9_TEST_DATA_PATH "/06087",""));
+  EXPECT_EQ(0,TileBaseUpdate(tiles,&u,1));
+  TileBaseClose(tiles);
+}
@@ -0,0 +1,263 @@
+/**
+ * \file
+ * Metadata format for synthetic tiles.
+ *
+ * Reads the descriptors written by SyntheticLatticeMake() (see
+ * src/synthetic.h).  Tiles described this way don't need any voxels on disk,
+ * so large datasets can be made quickly for tests and benchmarks.
+ */
+#define _CRT_SECURE_NO_WARNINGS
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include "tilebase.h"
+#include "src/synthetic.h"
+#include "src/metadata/metadata.h"
+#include "src/metadata/interface.h"
+
+/// @cond DEFINES
+#define SYNTHETIC_FORMAT_NAME "tilebase.synthetic"
+
+#define ENDL               "\n"
+#define LOG(...)           fprintf(stderr,__VA_ARGS__)
+#define TRY(e)             do{if(!(e)) { LOG("%s(%d): %s()"ENDL "\tExpression evaluated as false."ENDL "\t%s"ENDL,__FILE__,__LINE__,__FUNCTION__,#e); goto Error;}} while(0)
+#define NEW(type,e,nelem)  TRY((e)=(type*)malloc(sizeof(type)*(nelem)))
+#define ZERO(type,e,nelem) memset((e),0,sizeof(type)*nelem)
+
+#ifdef _MSC_VER
+ #define snprintf _snprintf
+ #define stat     _stat
+ #define PATHSEP  "\\"
+#else
+ #define PATHSEP  "/"
+#endif
+/// @endcond
+
+typedef struct _synthetic_ctx_t
+{ synthetic_tile_t tile;
+  char             path[1024];
+  unsigned         read_mode,
+                   write_mode;
+  int              dirty;     ///< 1 if the descriptor changed since it was read or written.
+} synthetic_ctx_t;
+
+static int parse_mode_string(const char* mode, unsigned *r, unsigned *w)
+{ *r=*w=0;
+  for(;*mode;++mode)
+  { switch(*mode)
+    { case 'r': *r=1; break;
+      case 'w': *w=1; break;
+      default: return 0;
+    }
+  }
+  return 1;
+}
+
+/** Defaults used for descriptors opened for writing only. */
+static void defaults(synthetic_tile_t *tile)
+{ memset(tile,0,sizeof(*tile));
+  tile->voxel[0]=tile->voxel[1]=tile->voxel[2]=1000.0;
+  tile->dims[0]=tile->dims[1]=tile->dims[2]=1;
+  tile->type=nd_u16;
+}
+
+//
+// === INTERFACE ===
+//
+
+const char* synthetic_name()
+{ return SYNTHETIC_FORMAT_NAME; }
+
+/** Just checks for the descriptor at \a path. */
+unsigned synthetic_is_fmt(const char* path, const char* mode)
+{ char name[1024];
+  struct stat s;
+  if(snprintf(name,sizeof(name),"%s" PATHSEP SYNTHETIC_DESCRIPTOR,path)>=(int)sizeof(name))
+    return 0;
+  return 0==stat(name,&s);
+}
+
+/** Valid modes: "r", "w", "rw" */
+void* synthetic_open(const char* path, const char* mode)
+{ synthetic_ctx_t *ctx=0;
+  NEW(synthetic_ctx_t,ctx,1);
+  ZERO(synthetic_ctx_t,ctx,1);
+  defaults(&ctx->tile);
+  TRY(strlen(path)<sizeof(ctx->path));
+  strcpy(ctx->path,path);
+  TRY(parse_mode_string(mode,&ctx->read_mode,&ctx->write_mode));
+  if(ctx->read_mode)
+    TRY(SyntheticTileRead(&ctx->tile,path));
+  else
+    ctx->dirty=1; // nothing was read, so it gets written
+  return ctx;
+Error:
+  free(ctx);
+  return 0;
+}
+
+/**
+ * Detects the format and opens the tile in one step.
+ * The descriptor is small, so this just tries to read it.  \a list is unused.
+ */
+void* synthetic_probe(const char* path, const char* mode, dirlist_t list)
+{ return synthetic_is_fmt(path,mode)?synthetic_open(path,mode):0;
+}
+
+/**
+ * Writes any changes if opened with write mode.
+ * When the descriptor was also read ("rw"), it is only rewritten if it
+ * changed.
+ * \returns 1 on success, otherwise 0.
+ */
+unsigned synthetic_commit(metadata_t self)
+{ synthetic_ctx_t *ctx=(synthetic_ctx_t*)MetadataContext(self);
+  if(ctx->write_mode && ctx->dirty)
+  { if(!SyntheticTileWrite(&ctx->tile,ctx->path))
+    { LOG("%s(%d): %s()"ENDL "\tCould not write descriptor for %s"ENDL,__FILE__,__LINE__,__FUNCTION__,ctx->path);
+      return 0;
+    }
+    ctx->dirty=0;
+  }
+  return 1;
+}
+
+/** Commit any changes that weren't committed yet.  \see synthetic_commit() */
+void synthetic_close(metadata_t self)
+{ synthetic_ctx_t *ctx=(synthetic_ctx_t*)MetadataContext(self);
+  synthetic_commit(self);
+  free(ctx);
+}
+
+/** The origin is the lower corner of the bounding box.  \see SyntheticTileBounds() */
+unsigned synthetic_origin(metadata_t self, size_t *nelem, int64_t* origin)
+{ synthetic_ctx_t *ctx=(synthetic_ctx_t*)MetadataContext(self);
+  if(nelem) *nelem=3;
+  if(!origin)
+    return 0;
+  SyntheticTileBounds(&ctx->tile,origin,NULL);
+  return 1;
+}
+
+/** Moves the tile so the lower corner of its bounding box is at \a origin. */
+unsigned synthetic_set_origin(metadata_t self, size_t nelem, int64_t* origin)
+{ synthetic_ctx_t *ctx=(synthetic_ctx_t*)MetadataContext(self);
+  int64_t cur[3];
+  int i;
+  TRY(nelem==3);
+  SyntheticTileBounds(&ctx->tile,cur,NULL);
+  if(memcmp(cur,origin,sizeof(cur)))
+  { for(i=0;i<3;++i)
+      ctx->tile.origin[i]+=origin[i]-cur[i];
+    ctx->dirty=1;
+  }
+  return 1;
+Error:
+  return 0;
+}
+
+unsigned synthetic_shape(metadata_t self, size_t *nelem, int64_t* shape)
+{ synthetic_ctx_t *ctx=(synthetic_ctx_t*)MetadataContext(self);
+  if(nelem) *nelem=3;
+  if(!shape)
+    return 0;
+  SyntheticTileBounds(&ctx->tile,NULL,shape);
+  return 1;
+}
+
+/**
+ * Changes the voxel size so the tile spans \a shape.
+ * Each voxel size is scaled by how much its extent changes, which is exact
+ * unless the tile is rotated.
+ */
+unsigned synthetic_set_shape(metadata_t self, size_t nelem, int64_t* shape)
+{ synthetic_ctx_t *ctx=(synthetic_ctx_t*)MetadataContext(self);
+  int64_t cur[3];
+  int i;
+  TRY(nelem==3);
+  SyntheticTileBounds(&ctx->tile,NULL,cur);
+  if(0==memcmp(cur,shape,sizeof(cur)))
+    return 1; // unchanged
+  for(i=0;i<3;++i)
+  { TRY(cur[i]>0);
+    ctx->tile.voxel[i]*=shape[i]/(double)cur[i];
+  }
+  ctx->dirty=1;
+  return 1;
+Error:
+  return 0;
+}
+
+/** \returns 0 if the tile has no volume file. */
+ndio_t synthetic_get_vol(metadata_t self, const char* mode)
+{ synthetic_ctx_t *ctx=(synthetic_ctx_t*)MetadataContext(self);
+  char name[1024];
+  TRY(ctx->tile.volume[0]);
+  TRY(snprintf(name,sizeof(name),"%s" PATHSEP "%s",ctx->path,ctx->tile.volume)<(int)sizeof(name));
+  return ndioOpen(name,0,mode);
+Error:
+  return 0;
+}
+
+unsigned synthetic_get_transform(metadata_t self, float *transform)
+{ synthetic_ctx_t *ctx=(synthetic_ctx_t*)MetadataContext(self);
+  SyntheticTileTransform(&ctx->tile,transform);
+  return 1;
+}
+
+/**
+ * Everything comes from the descriptor, so the volume is never opened.
+ * \see metadata_description_t
+ */
+unsigned synthetic_describe(metadata_t self, metadata_description_t *desc)
+{ synthetic_ctx_t *ctx=(synthetic_ctx_t*)MetadataContext(self);
+  desc->ndim=3;
+  synthetic_origin(self,NULL,desc->origin);
+  synthetic_shape(self,NULL,desc->shape);
+  TRY(desc->vol=SyntheticTileVolume(&ctx->tile));
+  if(ctx->tile.volume[0])
+    TRY(snprintf(desc->vol_path,sizeof(desc->vol_path),"%s" PATHSEP "%s",ctx->path,ctx->tile.volume)<(int)sizeof(desc->vol_path));
+  SyntheticTileTransform(&ctx->tile,desc->transform);
+  return 1;
+Error:
+  if(desc->vol) { ndfree(desc->vol); desc->vol=0; }
+  return 0;
+}
+
+//
+// === EXPORT ===
+//
+
+/// @cond DEFINES
+#ifdef _MSC_VER
+#define shared __declspec(dllexport)
+#else
+#define shared
+#endif
+/// @endcond
+
+shared
+const metadata_api_t* get_metadata_api()
+{ static const metadata_api_t api =
+  {   synthetic_name,
+      synthetic_is_fmt,
+      synthetic_open,
+      synthetic_close,
+      synthetic_origin,
+      synthetic_set_origin,
+      synthetic_shape,
+      synthetic_set_shape,
+      synthetic_get_vol,
+      synthetic_get_transform,
+      ndioAddPlugin,
+      NULL,
+      synthetic_probe,
+      synthetic_describe,
+      NULL,
+      NULL,
+      synthetic_commit
+  };
+  return &api;
+}
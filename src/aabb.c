@@ -4,6 +4,8 @@
  *  \todo Possible optimizations:  There might be a lot of these objects.  They'll all have the same shape.
  *        It's probably worth trying to reuse objects.  One might have a bunch of objects with the same shape.
  *        Could allocate only unique shapes and then reference those.
+ *        For the common 3d case, aabb3_t avoids the allocations altogether
+ *        and supports batch operations over packed arrays.
  */
 #include <stdint.h>
 #include <stdlib.h>
@@ -28,6 +30,13 @@
 
 #define BIT(e,n) (((e)>>(n))&1)
 
+#ifdef __AVX2__
+#define HAVE_AVX2 1
+#include <immintrin.h>
+#else
+#define HAVE_AVX2 0
+#endif
+
  #ifndef restrict
  #define restrict __restrict
  #endif
@@ -276,3 +285,246 @@ double AABBVolume(aabb_t self)
     v*=(double)self->shape[i];
   return v;
 }
+
+//
+// Fixed 3d boxes
+//
+
+#if HAVE_AVX2
+#define LOAD(e)    _mm256_loadu_si256((const __m256i*)(e))
+#define STORE(e,v) _mm256_storeu_si256((__m256i*)(e),(v))
+
+static __m256i vmin(__m256i a, __m256i b) { return _mm256_blendv_epi8(a,b,_mm256_cmpgt_epi64(a,b)); }
+static __m256i vmax(__m256i a, __m256i b) { return _mm256_blendv_epi8(b,a,_mm256_cmpgt_epi64(a,b)); }
+/** \returns 1 if the box [lo,hi) is non-empty on every lane. */
+static int     vnonempty(__m256i lo, __m256i hi)
+{ return _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(hi,lo)))==0xf;
+}
+#endif
+
+/** Constructs a box from a 3d origin and shape. */
+aabb3_t AABB3Make(const int64_t*const ori, const int64_t*const shape)
+{ aabb3_t out;
+  int i;
+  for(i=0;i<3;++i)
+  { out.lo[i]=ori[i];
+    out.hi[i]=ori[i]+shape[i];
+  }
+  out.lo[3]=0;
+  out.hi[3]=1;
+  return out;
+}
+
+/**
+ * \returns a box that is the identity for AABB3Union() and that never hits
+ *          another box.
+ */
+aabb3_t AABB3Empty(void)
+{ aabb3_t out;
+  int i;
+  for(i=0;i<3;++i)
+  { out.lo[i]=INT64_MAX;
+    out.hi[i]=INT64_MIN;
+  }
+  out.lo[3]=0;
+  out.hi[3]=1;
+  return out;
+}
+
+/**
+ * Packs \a src into \a dst.
+ * Boxes with fewer than three dimensions are extended with unit intervals,
+ * <tt>[0,1)</tt>, so hit tests agree with AABBHit().
+ * \returns 1 on success, 0 if \a src is NULL or has more than 3 dimensions.
+ *          On failure, \a dst is set to the empty box.
+ */
+int AABB3FromAABB(aabb3_t *dst, aabb_t src)
+{ size_t i;
+  TRY(dst);
+  *dst=AABB3Empty();
+  TRY(src && src->ndim<=3);
+  for(i=0;i<3;++i)
+  { dst->lo[i]=(i<src->ndim)?src->ori[i]:0;
+    dst->hi[i]=(i<src->ndim)?(src->ori[i]+src->shape[i]):1;
+  }
+  return 1;
+Error:
+  return 0;
+}
+
+/**
+ * Copies \a src to the 3d box \a dst.
+ * If \a dst is NULL, a new aabb_t is allocated and returned.  The caller must
+ * free it with AABBFree().
+ */
+aabb_t AABB3ToAABB(aabb_t dst, const aabb3_t *src)
+{ int64_t shape[3];
+  int i;
+  TRY(src);
+  for(i=0;i<3;++i)
+    shape[i]=(src->hi[i]>src->lo[i])?(src->hi[i]-src->lo[i]):0;
+  return AABBSet(dst,3,src->lo,shape);
+Error:
+  return 0;
+}
+
+/** \returns 1 if \a a covers no volume. */
+int AABB3IsEmpty(const aabb3_t *a)
+{ int i;
+  for(i=0;i<3;++i)
+    if(a->hi[i]<=a->lo[i]) return 1;
+  return 0;
+}
+
+/**
+ * Same convention as AABBHit().  Boxes that only share a face don't hit.
+ * \returns 1 if there is a non-empty intersection between \a a and \a b.
+ */
+int AABB3Hit(const aabb3_t *a, const aabb3_t *b)
+{
+#if HAVE_AVX2
+  return vnonempty(vmax(LOAD(a->lo),LOAD(b->lo)),
+                   vmin(LOAD(a->hi),LOAD(b->hi)));
+#else
+  int i;
+  for(i=0;i<3;++i)
+  { int64_t lo=(a->lo[i]>b->lo[i])?a->lo[i]:b->lo[i],
+            hi=(a->hi[i]<b->hi[i])?a->hi[i]:b->hi[i];
+    if(hi<=lo) return 0;
+  }
+  return 1;
+#endif
+}
+
+/** \returns the smallest box containing both \a a and \a b. */
+aabb3_t AABB3Union(const aabb3_t *a, const aabb3_t *b)
+{ aabb3_t out;
+#if HAVE_AVX2
+  STORE(out.lo,vmin(LOAD(a->lo),LOAD(b->lo)));
+  STORE(out.hi,vmax(LOAD(a->hi),LOAD(b->hi)));
+#else
+  int i;
+  for(i=0;i<4;++i)
+  { out.lo[i]=(a->lo[i]<b->lo[i])?a->lo[i]:b->lo[i];
+    out.hi[i]=(a->hi[i]>b->hi[i])?a->hi[i]:b->hi[i];
+  }
+#endif
+  return out;
+}
+
+/**
+ * \returns the intersection of \a a and \a b.  When the boxes don't
+ *          intersect, the result has zero shape along the separating axes.
+ */
+aabb3_t AABB3Intersect(const aabb3_t *a, const aabb3_t *b)
+{ aabb3_t out;
+#if HAVE_AVX2
+  __m256i lo=vmax(LOAD(a->lo),LOAD(b->lo)),
+          hi=vmin(LOAD(a->hi),LOAD(b->hi));
+  STORE(out.lo,lo);
+  STORE(out.hi,vmax(hi,lo));
+#else
+  int i;
+  for(i=0;i<4;++i)
+  { out.lo[i]=(a->lo[i]>b->lo[i])?a->lo[i]:b->lo[i];
+    out.hi[i]=(a->hi[i]<b->hi[i])?a->hi[i]:b->hi[i];
+    if(out.hi[i]<out.lo[i]) out.hi[i]=out.lo[i];
+  }
+#endif
+  return out;
+}
+
+/** Returns the volume of the box in physical units (nanometers). */
+double AABB3Volume(const aabb3_t *a)
+{ double v=1;
+  int i;
+  if(AABB3IsEmpty(a)) return 0.0;
+  for(i=0;i<3;++i)
+    v*=(double)(a->hi[i]-a->lo[i]);
+  return v;
+}
+
+//
+// Batch operations
+//
+
+/**
+ * Tests each of the \a n packed \a boxes against the query box \a q.
+ *
+ * \param[out] hit   If not NULL, must have room for \a n elements.
+ *                   <tt>hit[i]</tt> is set to 1 if <tt>boxes[i]</tt> hits
+ *                   \a q, and 0 otherwise.
+ * \param[in]  boxes Array of \a n boxes.
+ * \param[in]  n     The number of boxes.
+ * \param[in]  q     The query box.
+ * \returns the number of boxes that hit \a q.
+ */
+size_t AABBHitMany(unsigned char *hit, const aabb3_t *boxes, size_t n, const aabb3_t *q)
+{ size_t i,c=0;
+#if HAVE_AVX2
+  const __m256i qlo=LOAD(q->lo),
+                qhi=LOAD(q->hi);
+  for(i=0;i<n;++i)
+  { const int h=vnonempty(vmax(qlo,LOAD(boxes[i].lo)),
+                          vmin(qhi,LOAD(boxes[i].hi)));
+    if(hit) hit[i]=(unsigned char)h;
+    c+=h;
+  }
+#else
+  for(i=0;i<n;++i)
+  { const int h=AABB3Hit(boxes+i,q);
+    if(hit) hit[i]=(unsigned char)h;
+    c+=h;
+  }
+#endif
+  return c;
+}
+
+/**
+ * Computes the union of \a n packed \a boxes.
+ * \param[out] out  The result.  If \a n is 0, this is the empty box.
+ * \returns \a out.
+ */
+aabb3_t* AABBUnionReduce(aabb3_t *out, const aabb3_t *boxes, size_t n)
+{ size_t i;
+#if HAVE_AVX2
+  aabb3_t e=AABB3Empty();
+  __m256i lo=LOAD(e.lo),
+          hi=LOAD(e.hi);
+  for(i=0;i<n;++i)
+  { lo=vmin(lo,LOAD(boxes[i].lo));
+    hi=vmax(hi,LOAD(boxes[i].hi));
+  }
+  STORE(out->lo,lo);
+  STORE(out->hi,hi);
+#else
+  *out=AABB3Empty();
+  for(i=0;i<n;++i)
+    *out=AABB3Union(out,boxes+i);
+#endif
+  return out;
+}
+
+/**
+ * Intersects each of the \a n packed \a boxes with \a q.
+ * \param[out] out  Must have room for \a n elements.  May be the same as
+ *                  \a boxes.
+ * \returns \a out.
+ */
+aabb3_t* AABBIntersectMany(aabb3_t *out, const aabb3_t *boxes, size_t n, const aabb3_t *q)
+{ size_t i;
+#if HAVE_AVX2
+  const __m256i qlo=LOAD(q->lo),
+                qhi=LOAD(q->hi);
+  for(i=0;i<n;++i)
+  { __m256i lo=vmax(qlo,LOAD(boxes[i].lo)),
+            hi=vmin(qhi,LOAD(boxes[i].hi));
+    STORE(out[i].lo,lo);
+    STORE(out[i].hi,vmax(hi,lo));
+  }
+#else
+  for(i=0;i<n;++i)
+    out[i]=AABB3Intersect(boxes+i,q);
+#endif
+  return out;
+}
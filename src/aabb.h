@@ -31,8 +31,35 @@ aabb_t AABBIntersectIP(aabb_t dst, aabb_t src);
 
 double AABBVolume(aabb_t self);
 
+/** Fixed 3d axis aligned bounding box stored by value.
+ *
+ *  Boxes are half-open, covering <tt>[lo,hi)</tt> on each axis.  Unlike
+ *  aabb_t, these don't need to be allocated, so they can be packed into
+ *  contiguous arrays and processed in batches (see AABBHitMany()).
+ *
+ *  The fourth lane is padding so that each corner fills a 256-bit register.
+ *  It is always <tt>[0,1)</tt> so it never changes the result of an
+ *  operation.
+ */
+typedef struct _aabb3_t
+{ int64_t lo[4];
+  int64_t hi[4];
+} aabb3_t;
+
+aabb3_t AABB3Make(const int64_t*const ori, const int64_t*const shape);
+aabb3_t AABB3Empty(void);
+int     AABB3FromAABB(aabb3_t *dst, aabb_t src);
+aabb_t  AABB3ToAABB(aabb_t dst, const aabb3_t *src);
 
+int     AABB3IsEmpty(const aabb3_t *a);
+int     AABB3Hit(const aabb3_t *a, const aabb3_t *b);
+aabb3_t AABB3Union(const aabb3_t *a, const aabb3_t *b);
+aabb3_t AABB3Intersect(const aabb3_t *a, const aabb3_t *b);
+double  AABB3Volume(const aabb3_t *a);
 
+size_t   AABBHitMany(unsigned char *hit, const aabb3_t *boxes, size_t n, const aabb3_t *q);
+aabb3_t* AABBUnionReduce(aabb3_t *out, const aabb3_t *boxes, size_t n);
+aabb3_t* AABBIntersectMany(aabb3_t *out, const aabb3_t *boxes, size_t n, const aabb3_t *q);
 
 #ifdef __cplusplus
 }//extern "C"{
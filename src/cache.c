@@ -260,6 +260,7 @@ static void* shape(tilebase_cache_t self);
 static void* aabb(tilebase_cache_t self);
 static void* sequence_of_ints(tilebase_cache_t self);
 static void* sequence_of_floats(tilebase_cache_t self);
+static void* channels(tilebase_cache_t self);
 // sequence handlers - forward declared
 static void  ori(tilebase_cache_t self);
 static void  box(tilebase_cache_t self);
@@ -362,6 +363,22 @@ void transform(tilebase_cache_t self)
   Error:; //pass
 }
 
+/** Reads the resolved channel files into the last tile.  \see TileBaseCacheWrite() */
+void* channels(tilebase_cache_t self)
+{ char path[1024]={0};
+  switch(E_TYPE)
+  { case YAML_SEQUENCE_START_EVENT: return channels;
+    case YAML_SEQUENCE_END_EVENT: return tile;
+    case YAML_SCALAR_EVENT:
+      join(path,self,E_VAL);
+      TRY(tile_add_channel(LASTTILE,path));
+      return channels;
+    default:;
+  }
+Error:
+  return 0;
+}
+
 void* aabb(tilebase_cache_t self)
 { switch(E_TYPE)
   { case YAML_MAPPING_START_EVENT:
@@ -420,6 +437,19 @@ void* tile(tilebase_cache_t self)
         join(LASTTILE->path,self,E_VAL);
         return tile;
       }
+      else if(KEY("volume"))
+      { yaml_event_delete(EVENT);
+        TRY(yaml_parser_parse(PARSER,EVENT));
+        join(LASTTILE->volume,self,E_VAL);
+        return tile;
+      }
+      else if(KEY("channels")) { return channels;}
+      else if(KEY("format"))
+      { yaml_event_delete(EVENT);
+        TRY(yaml_parser_parse(PARSER,EVENT));
+        strncpy(LASTTILE->format_hint,E_VAL,sizeof(LASTTILE->format_hint)-1);
+        return tile;
+      }
       else if(KEY("aabb")) { return aabb;}
       else if(KEY("shape")){ return shape;}
       else if(KEY("transform"))
@@ -670,6 +700,24 @@ tilebase_cache_t TileBaseCacheWrite(tilebase_cache_t self, const char* path_, ti
   MAP_START; EMIT;
     SCALAR("path"); EMIT;
     SCALAR(relative(self,path)); EMIT;
+    if(t->volume[0])
+    { SCALAR("volume"); EMIT;
+      SCALAR(relative(self,t->volume)); EMIT;
+    }
+    if(t->nchannels) // so opening from the cache needn't list the directory
+    { unsigned i;
+      SCALAR("channels"); EMIT;
+      SEQ_START; EMIT;
+      for(i=0;i<t->nchannels;++i)
+      { SCALAR(relative(self,t->channels[i])); EMIT;
+      }
+      SEQ_END; EMIT;
+    }
+    if(t->metadata_format[0] || t->format_hint[0])
+    { const char *format=t->metadata_format[0]?t->metadata_format:t->format_hint;
+      SCALAR("format"); EMIT;
+      SCALAR(format); EMIT;
+    }
     SCALAR("aabb"); EMIT;
     MAP_START; EMIT;
       SCALAR("ori"); EMIT;
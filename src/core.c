@@ -20,11 +20,15 @@
 #include <stdlib.h>
 #include "nd.h"
 #include "aabb.h"
+#include "sfc.h"
+#include "footprint.h"
 #include "core.h"
 #include "metadata/metadata.h"
 #include <stdio.h>
 #include <string.h>
 #include "cache.h"
+#include "util/dirlist.h"
+#include "util/thread.h"
 #include "core.priv.h" // defines tile_t and tiles_t structs
 
 #include <limits.h> // for PATH_MAX (for realpath)
@@ -95,11 +99,29 @@ void TileFree(tile_t self)
   AABBFree(self->aabb);
   ndioClose(self->file);
   ndfree(self->shape);
+  ndfree(self->crop);
   if(self->transform) free(self->transform);
+  if(self->footprint) free(self->footprint);
+  while(self->nchannels)
+    free(self->channels[--self->nchannels]);
+  if(self->channels) free(self->channels);
   MetadataClose(self->meta);
   free(self);
 }
 
+/** Appends \a path to the tile's resolved channel files.  \returns 1 on success, otherwise 0. */
+int tile_add_channel(tile_t self, const char *path)
+{ char **c,*p=0;
+  TRY(c=(char**)realloc(self->channels,sizeof(char*)*(self->nchannels+1)));
+  self->channels=c;
+  NEW(char,p,strlen(path)+1);
+  strcpy(p,path);
+  self->channels[self->nchannels++]=p;
+  return 1;
+Error:
+  return 0;
+}
+
 /**
  * Load tile data from the tile at \a path using the metadata format \a format.
  * Makes a new tile; the caller is responsible for cleaning up with TileFree() 
@@ -126,15 +148,69 @@ Error:
   return 0;
 }
 
-static metadata_t TileMetadata(tile_t self)
+/**
+ * Opens the tile's metadata if it isn't open yet.
+ * \param[in] list  Listing of the tile's directory, or NULL.  Only used when
+ *                  the format has to be detected.
+ */
+static metadata_t open_metadata(tile_t self, dirlist_t list)
 { if(!self->meta)
-    TRY(self->meta=MetadataOpen(self->path,self->metadata_format,"r"));
+  { if(self->metadata_format[0])
+      TRY(self->meta=MetadataOpen(self->path,self->metadata_format,"r"));
+    else
+      TRY(self->meta=MetadataOpenWithHint(self->path,self->format_hint,list,"r"));
+    if(!self->metadata_format[0]) // remember the detected format
+    { strncpy(self->metadata_format,MetadataFormat(self->meta),sizeof(self->metadata_format));
+      self->metadata_format[sizeof(self->metadata_format)-1]='\0';
+    }
+  }
   return self->meta;
 Error:
   return 0;
 }
+
+static metadata_t TileMetadata(tile_t self)
+{ return open_metadata(self,0);
+}
+
+/**
+ * Fills in whichever of the bounding box, shape and transform are missing
+ * using a single MetadataDescribe() call.  This avoids reopening the volume
+ * for each attribute when the metadata format supports it.
+ *
+ * Only tried once per tile.  The individual accessors fall back to reading
+ * each attribute separately when this fails.
+ */
+static void maybe_describe(tile_t self)
+{ metadata_description_t desc;
+  metadata_t meta;
+  unsigned n;
+  if(self->described) return;
+  self->described=-1;
+  if(!(meta=TileMetadata(self)) || !MetadataDescribe(meta,&desc))
+    return;
+  n=ndndim(desc.vol);
+  if(!self->aabb)
+    TRY(self->aabb=AABBSet(0,desc.ndim,desc.origin,desc.shape));
+  if(!self->transform)
+  { NEW(float,self->transform,(n+1)*(n+1));
+    memcpy(self->transform,desc.transform,sizeof(float)*(n+1)*(n+1));
+  }
+  if(!self->shape)
+  { self->shape=desc.vol;
+    desc.vol=0;
+  }
+  if(!self->volume[0])
+    memcpy(self->volume,desc.vol_path,sizeof(self->volume));
+  self->described=1;
+Error:
+  if(desc.vol) ndfree(desc.vol);
+}
+
 aabb_t TileAABB(tile_t self)
 { if(!self->aabb)
+    maybe_describe(self);
+  if(!self->aabb)
   { TRY(self->aabb=AABBMake(0));
     TRY(MetadataGetTileAABB(TileMetadata(self),self));
   }
@@ -144,15 +220,60 @@ Error:
   self->aabb=0;
   return 0;
 }
+/**
+ * Opens the one file a single channel tile's volume pattern resolved to.
+ * The file is only used if it has the shape recorded for the tile, since
+ * otherwise the series reader would have read it differently.
+ * \returns 0 if there isn't exactly one channel or the file doesn't match.
+ */
+static ndio_t open_channel(tile_t self)
+{ ndio_t file=0;
+  nd_t shape=0;
+  if(self->nchannels!=1 || !self->shape) return 0;
+  if(!(file=ndioOpen(self->channels[0],0,"r"))) return 0;
+  if(  (shape=ndioShape(file))
+    && ndtype(shape)==ndtype(self->shape)
+    && ndndim(shape)==ndndim(self->shape)
+    && 0==memcmp(ndshape(shape),ndshape(self->shape),sizeof(size_t)*ndndim(shape)))
+  { ndfree(shape);
+    return file;
+  }
+  ndfree(shape);
+  ndioClose(file);
+  return 0;
+}
+
 ndio_t TileFile(tile_t self) 
 { if(!self->file)
-    TRY(self->file=MetadataOpenVolume(TileMetadata(self),"r"));
+    TRY(self->file=TileOpenFile(self));
   return self->file; 
 Error:
   return 0;
 }
+
+/**
+ * Opens a new handle to the tile's volume.
+ * Unlike TileFile(), the handle isn't kept by the tile, so threads reading
+ * the same tile can each use their own.  Opening may still open the tile's
+ * metadata, so calls for the same tile shouldn't overlap.
+ * \returns 0 on failure.  Close the result with ndioClose().
+ */
+ndio_t TileOpenFile(tile_t self)
+{ ndio_t file=0;
+  if(!self->meta)                      // e.g. from the cache, so the metadata doesn't need to be opened
+    file=open_channel(self);           // and the directory doesn't need to be listed
+  if(!file && !self->meta && self->volume[0])
+    file=ndioOpen(self->volume,0,"r");
+  if(!file)
+    TRY(file=MetadataOpenVolume(TileMetadata(self),"r"));
+  return file;
+Error:
+  return 0;
+}
 nd_t TileShape(tile_t self)
 { if(!self->shape)
+    maybe_describe(self);
+  if(!self->shape)
     TRY(self->shape=ndioShape(TileFile(self)));
   return self->shape;
 Error:
@@ -167,7 +288,7 @@ Error:
 */
 nd_t TileCrop(tile_t self) {
   if(!self->crop)
-    TRY(self->crop==ndioShape(TileFile(self)));
+    TRY(self->crop=ndioShape(TileFile(self)));
   return self->crop;
 Error:
   return 0;
@@ -193,6 +314,14 @@ Error:
   return 0.0;
 }
 
+/**
+ * \returns the name of the tile's metadata format, or the format recorded in
+ *          the cache if the metadata hasn't been opened.  Empty if unknown.
+ */
+const char* TileFormat(tile_t self)
+{ return self->metadata_format[0]?self->metadata_format:self->format_hint;
+}
+
 /** Gets the tile path.
     \returns a const string with the tile's path.
  */
@@ -200,6 +329,14 @@ const char* TilePath(tile_t self)
 { return self->path;
 }
 
+/**
+ * \returns the space filling curve key assigned to the tile by the last call
+ *          to TileBaseSort() on a tile database containing the tile, or 0.
+ */
+uint64_t TileSpatialKey(tile_t self)
+{ return self?self->key:0;
+}
+
 /**
  * Get pixel to space transform.
  * For example, a point at index ir=(ix,iy,iz) will be mapped to r=T.ir,
@@ -211,6 +348,8 @@ const char* TilePath(tile_t self)
  */
 float* TileTransform(tile_t self)
 { if(!self->transform)
+    maybe_describe(self);
+  if(!self->transform)
   { unsigned n;
     TRY(n=ndndim(TileShape(self)));
     NEW(float,self->transform,(n+1)*(n+1));
@@ -221,6 +360,41 @@ Error:
   return 0;
 }
 
+/**
+ * Computes the region of space covered by the tile's voxels by mapping the
+ * corners of the voxel domain through TileTransform().  Unlike TileAABB(),
+ * this accounts for rotation, flips and shear in the transform.
+ *
+ * \returns 0 on failure, otherwise the footprint.  It is owned by the tile.
+ */
+const footprint_t* TileFootprint(tile_t self)
+{ if(!self->footprint)
+  { nd_t shape;
+    float *transform;
+    TRY(shape=TileShape(self));
+    TRY(transform=TileTransform(self));
+    NEW(footprint_t,self->footprint,1);
+    TRY(FootprintMake(self->footprint,transform,(unsigned)ndndim(shape),ndshape(shape)));
+  }
+  return self->footprint;
+Error:
+  SAFEFREE(self->footprint);
+  return 0;
+}
+
+/**
+ * Tests the tile's footprint against \a box.
+ * Falls back to TileAABB() if the footprint can't be computed.
+ * \returns 1 if the tile's voxels cover some of \a box, otherwise 0.
+ */
+int TileFootprintHit(tile_t self, const aabb3_t *box)
+{ const footprint_t *fp;
+  aabb3_t b;
+  if((fp=TileFootprint(self)))
+    return FootprintHit(fp,box);
+  return AABB3FromAABB(&b,TileAABB(self)) && AABB3Hit(&b,box);
+}
+
 //
 //  === TILE COLLECTION ===
 //
@@ -301,6 +475,104 @@ Error:
   return 0;  
 }
 
+/**
+ * Loads the attributes recorded in the cache file.
+ * \returns 1 if they could all be loaded, otherwise 0.
+ */
+static int isvalid(tile_t t)
+{ return TileAABB(t) && TileShape(t) && TileTransform(t);
+}
+
+/**
+ * Records the files in \a list that match the "%" channel pattern in the
+ * tile's volume path, so the cache can store them (see open_channel()).
+ * Nothing is recorded if the volume isn't a pattern in the listed directory.
+ */
+static void resolve_channels(tile_t t, dirlist_t list)
+{ const char *dir,*name,*pct,*suffix;
+  size_t ndir,nprefix,nsuffix,i,k;
+  char path[1024];
+  char **c;
+  if(t->channels || !list || !(pct=strchr(t->volume,'%'))) return;
+  dir=DirListPath(list);
+  ndir=strlen(dir);
+  if(strncmp(t->volume,dir,ndir) || !ispathsep(t->volume[ndir]))
+    return;
+  name=t->volume+ndir+1;
+  if(strchr(pct+1,'%') || strpbrk(name,"/\\"))
+    return;
+  nprefix=pct-name;
+  suffix=pct+1;
+  nsuffix=strlen(suffix);
+  for(i=0;i<DirListCount(list);++i)
+  { const char *e=DirListName(list,i);
+    size_t n=strlen(e);
+    if(n<=nprefix+nsuffix || strncmp(e,name,nprefix) || strcmp(e+n-nsuffix,suffix))
+      continue;
+    for(k=nprefix;k<n-nsuffix && '0'<=e[k] && e[k]<='9';++k);
+    if(k!=n-nsuffix)
+      continue;
+    if(!join(path,sizeof(path),dir,e) || !tile_add_channel(t,path))
+      return;
+  }
+  // order by channel number; lists are short
+  c=t->channels;
+  for(i=1;i<t->nchannels;++i)
+    for(k=i;k>0 && atol(c[k-1]+ndir+1+nprefix)>atol(c[k]+ndir+1+nprefix);--k)
+    { char *tmp=c[k]; c[k]=c[k-1]; c[k-1]=tmp;
+    }
+}
+
+/// Number of tiles that must be detected with the same format before that format is tried first.
+#define DETECT_SAMPLE_SIZE 8
+
+/**
+ * Tiles under a common root almost always share a metadata format.  Once
+ * enough consecutive tiles have been detected with the same format, new tiles
+ * are given that format as a hint so detection tries it first.
+ *
+ * The sample is detected without hints so the format that wins is the same one
+ * that unhinted detection would choose.  If a hinted tile turns out to have a
+ * different format, sampling starts over.
+ */
+static void hint_format(tiles_t tiles, tile_t t)
+{ if(!t->metadata_format[0] && tiles->ndetected>=DETECT_SAMPLE_SIZE)
+    memcpy(t->format_hint,tiles->detected_format,sizeof(t->format_hint));
+}
+
+/** Records the format detected for a valid tile \a t.  \see hint_format() */
+static void remember_format(tiles_t tiles, tile_t t)
+{ if(0==strcmp(tiles->detected_format,t->metadata_format))
+  { ++tiles->ndetected;
+  } else
+  { memcpy(tiles->detected_format,t->metadata_format,sizeof(tiles->detected_format));
+    tiles->ndetected=1;
+  }
+}
+
+/** State for add_listed(). */
+typedef struct _listing_t
+{ tiles_t             tiles;
+  tilebase_progress_t callback;
+  void               *cbdata;
+  int                 ok;
+} listing_t;
+
+/** Adds one tile listed by a container.  \see MetadataListTiles() */
+static void add_listed(const char *tilepath, const char *format, void *ctx)
+{ listing_t *l=(listing_t*)ctx;
+  tile_t t=0;
+  if(!l->ok) return;
+  if(!push(l->tiles,t=TileNew(tilepath,format)))
+  { TileFree(t);
+    l->ok=0;
+    return;
+  }
+  if(l->callback) l->callback(tilepath,l->cbdata);
+  if(t && !isvalid(t))
+    pop(l->tiles);
+}
+
 /**
  * Recursively descend path looking for tiles.
  *
@@ -312,6 +584,7 @@ static unsigned addtiles(tiles_t tiles,const char *path, const char* format, til
   char next[1024]={0};
   DIR *dir=0;
   struct dirent *ent;
+  dirlist_t list=0;
   TRY(path);
 
   // First, try to open a cache at path
@@ -320,19 +593,30 @@ static unsigned addtiles(tiles_t tiles,const char *path, const char* format, til
     if(local)
     { size_t i;
       for(i=0;i<local->sz;++i)
-      { if(callback) callback(local->tiles[i]->path,cbdata);
-        TileBaseCacheWrite(tiles->cache,local->tiles[i]->path,local->tiles[i]);
-      }
+        if(callback) callback(local->tiles[i]->path,cbdata);
       push_many(tiles,local);
       TileBaseClose(local);
       return 1;
     }
   }
 
+  // Next, look for a container holding many tiles in one file
+  { listing_t l={0};
+    l.tiles=tiles;
+    l.callback=callback;
+    l.cbdata=cbdata;
+    l.ok=1;
+    if(MetadataListTiles(path,format,add_listed,&l))
+      return l.ok;
+  }
+
   // No cache, process the directory
+  // The listing is kept so the metadata for a leaf can be read without listing it again.
+  TRY(list=DirListNew(path));
   TRY(dir=opendir(path));
   while((ent=readdir(dir)))
   { int isok=1;
+    TRY(DirListAdd(list,ent->d_name));
     if(ent->d_name[0]!='.') //ignore "dot" hidden files and directories (including '.' and '..')
     { if(isdir(path,ent,&isok)) 
       { any=1; // has a subdirectory ==> not a leaf
@@ -348,15 +632,23 @@ static unsigned addtiles(tiles_t tiles,const char *path, const char* format, til
   { tile_t t=0;
     TRY(push(tiles,t=TileNew(path,format)));
     if(callback) callback(path,cbdata);
-    if(t) // !!! insufficient?...Tile is lazy, so we don't know it's valid at constuction
-      TRYLBL(TileBaseCacheWrite(tiles->cache,path,t),CacheWriteError); // this should be able to handle bad tiles by silently failing.
+    if(t) // Tile is lazy, so we don't know it's valid at constuction
+    { int ok;
+      hint_format(tiles,t);
+      ok=open_metadata(t,list) && isvalid(t);
+      TRYLBL(ok,InvalidTile);
+      remember_format(tiles,t);
+      resolve_channels(t,list);
+    }
   }
 
+  DirListFree(list);
   return 1;
-CacheWriteError:
+InvalidTile:
   pop(tiles);
 Error:
   if(dir) closedir(dir);
+  DirListFree(list);
   return 0; 
 }
 
@@ -389,17 +681,23 @@ tiles_t TileBaseOpenWithProgressIndicator(const char *path_, const char* format,
   TRY(realpath(path_,path));// canonicalize input path
   if((cache=TileBaseCacheOpen(path,"r")) && TileBaseCacheRead(cache,&out) && out && out->sz>0)
   { TileBaseCacheClose(cache);
+    TRY(TileBaseSort(out,SFC_ORDER_MORTON)); // caches written by older versions may not be sorted
   } else
   { if(!cache || !out || out->sz==0) // no cache was found so try to make one from scratch
     { NEW( struct _tiles_t,out,1);
       ZERO(struct _tiles_t,out,1);
       out->cache=TileBaseCacheOpen(path,"w");
       TRY(addtiles(out,path,format,callback,cbdata));
+      TRY(TileBaseSort(out,SFC_ORDER_MORTON));
+      TileBaseCacheWriteMany(out->cache,out->tiles,out->sz);
       TileBaseCacheClose(out->cache);
+      out->cache=0;
     }
     else
       LOG("Error reading cache file at:\n\t%s\n\n\t%s\n",path,TileBaseCacheError(cache));
   }
+  if(out)
+    memcpy(out->root,path,min(sizeof(out->root)-1,strlen(path)));
   return out;
 Error:
   TileBaseClose(out);
@@ -424,6 +722,8 @@ void TileFreeArray(tile_t *tiles,size_t sz)
 void TileBaseClose(tiles_t self)
 { if(!self) return;
   TileFreeArray(self->tiles,self->sz);  
+  SAFEFREE(self->boxes);
+  SAFEFREE(self->fpboxes);
   free(self);
 }
 
@@ -434,6 +734,16 @@ size_t TileBaseCount(tiles_t self)
 { return self?self->sz:0;
 }
 
+/**
+ * The canonical path the tiles were opened from (see TileBaseOpen()).
+ * Tile paths found by crawling start with it, but tiles read from a cache
+ * that was written elsewhere may not.
+ * \returns the empty string if unknown.
+ */
+const char* TileBaseRoot(tiles_t self)
+{ return self?self->root:"";
+}
+
 /**
  * The tile array.
  */
@@ -449,11 +759,167 @@ tile_t* TileBaseArray(tiles_t self)
 aabb_t TileBaseAABB(tiles_t self)
 { aabb_t out=0;
   size_t i;
+  if(self->sz>0 && AABBNDim(TileAABB(self->tiles[0]))==3)
+  { const aabb3_t *boxes;
+    aabb3_t u;
+    if((boxes=TileBaseBoxes(self)) && !AABB3IsEmpty(AABBUnionReduce(&u,boxes,self->sz)))
+      return AABB3ToAABB(0,&u);
+  }
   for(i=0;i<self->sz;++i)
     out=AABBUnionIP(out,TileAABB(self->tiles[i]));
   return out;
 }
 
+/**
+ * Packs the bounding box of every tile into a contiguous array for use
+ * with the batch AABB operations (e.g. AABBHitMany()).
+ *
+ * The boxes are computed on the first call and reused afterwards.  Call
+ * TileBaseInvalidateBoxes() after modifying a tile's bounding box.
+ *
+ * Tiles that fail to load, or that aren't 3d, get the empty box so they
+ * never hit anything.
+ *
+ * \returns 0 on failure, otherwise an array of TileBaseCount() boxes
+ *          owned by \a self.
+ */
+const aabb3_t* TileBaseBoxes(tiles_t self)
+{ size_t i;
+  TRY(self);
+  if(!self->boxes)
+  { NEW(aabb3_t,self->boxes,self->sz?self->sz:1);
+    for(i=0;i<self->sz;++i)
+      AABB3FromAABB(self->boxes+i,TileAABB(self->tiles[i]));
+  }
+  return self->boxes;
+Error:
+  return 0;
+}
+
+/**
+ * Packs the bounds of every TileFootprint() into a contiguous array.
+ * These are a cheap prefilter for TileFootprintHit().
+ *
+ * Like TileBaseBoxes(), the boxes are computed on the first call.  Tiles
+ * without a footprint get their TileAABB().
+ *
+ * \returns 0 on failure, otherwise an array of TileBaseCount() boxes
+ *          owned by \a self.
+ */
+const aabb3_t* TileBaseFootprintBoxes(tiles_t self)
+{ size_t i;
+  TRY(self);
+  if(!self->fpboxes)
+  { NEW(aabb3_t,self->fpboxes,self->sz?self->sz:1);
+    for(i=0;i<self->sz;++i)
+    { const footprint_t *fp=TileFootprint(self->tiles[i]);
+      if(fp)
+        self->fpboxes[i]=fp->bounds;
+      else
+        AABB3FromAABB(self->fpboxes+i,TileAABB(self->tiles[i]));
+    }
+  }
+  return self->fpboxes;
+Error:
+  return 0;
+}
+
+/**
+ * Discards the packed boxes returned by TileBaseBoxes() and
+ * TileBaseFootprintBoxes(), and each tile's footprint, so they are
+ * recomputed on the next request.  Call this after modifying a tile's
+ * bounding box or transform.
+ */
+void TileBaseInvalidateBoxes(tiles_t self)
+{ size_t i;
+  if(!self) return;
+  SAFEFREE(self->boxes);
+  SAFEFREE(self->fpboxes);
+  for(i=0;i<self->sz;++i)
+    SAFEFREE(self->tiles[i]->footprint);
+}
+
+/**
+ * Finds the tiles whose footprints intersect \a box.
+ * Tests the footprint bounds first with AABBHitMany(), and then tests the
+ * footprints of the tiles that pass with TileFootprintHit().
+ *
+ * \param[in]  self  The tile database.
+ * \param[out] hit   If not NULL, must have room for TileBaseCount() elements.
+ *                   <tt>hit[i]</tt> is set to 1 if tile \c i hits \a box,
+ *                   and 0 otherwise.
+ * \param[in]  box   The query box.
+ * \returns the number of hit tiles.
+ */
+size_t TileBaseHitMany(tiles_t self, unsigned char *hit, const aabb3_t *box)
+{ const aabb3_t *boxes;
+  unsigned char *h=hit;
+  size_t i,c=0;
+  TRY(boxes=TileBaseFootprintBoxes(self));
+  if(!h)
+    NEW(unsigned char,h,self->sz?self->sz:1);
+  if(AABBHitMany(h,boxes,self->sz,box))
+  { for(i=0;i<self->sz;++i)
+      if(h[i])
+        c+=(h[i]=(unsigned char)TileFootprintHit(self->tiles[i],box));
+  }
+  if(h!=hit) free(h);
+  return c;
+Error:
+  return 0;
+}
+
+static int cmp_key(const void *a_, const void *b_)
+{ const tile_t a=*(const tile_t*)a_,
+               b=*(const tile_t*)b_;
+  if(a->key<b->key) return -1;
+  if(a->key>b->key) return  1;
+  return strcmp(a->path,b->path); // break ties so the order is deterministic
+}
+
+/**
+ * Sorts the tile array along a space filling curve through the tile
+ * centers so that tiles that are close in space are close in the array.
+ *
+ * Tiles are opened with SFC_ORDER_MORTON order, which matches the order in
+ * which the leaves of an octree are visited (see octree.h).  Tiles with no
+ * bounding box are moved to the end.
+ *
+ * Pointers returned by TileBaseArray() remain valid, but the order of the
+ * elements changes.
+ *
+ * \param[in] self   The tile database.
+ * \param[in] order  The curve to sort along.  If SFC_ORDER_NONE, the array
+ *                   is left as is.
+ * \returns 1 on success, otherwise 0.
+ */
+int TileBaseSort(tiles_t self, sfc_order_t order)
+{ const aabb3_t *boxes;
+  aabb3_t bounds;
+  size_t i;
+  TRY(self);
+  if(order==SFC_ORDER_NONE || self->order==order)
+  { self->order=order;
+    return 1;
+  }
+  TRY(boxes=TileBaseBoxes(self));
+  AABBUnionReduce(&bounds,boxes,self->sz);
+  for(i=0;i<self->sz;++i)
+    self->tiles[i]->key=SFCKey(order,&bounds,boxes+i);
+  qsort(self->tiles,self->sz,sizeof(*self->tiles),cmp_key);
+  SAFEFREE(self->boxes);   // packed boxes are in the old order
+  SAFEFREE(self->fpboxes);
+  self->order=order;
+  return 1;
+Error:
+  return 0;
+}
+
+/** \returns the order of the tile array.  \see TileBaseSort() */
+sfc_order_t TileBaseOrder(tiles_t self)
+{ return self?self->order:SFC_ORDER_NONE;
+}
+
 /**
  * Computes the voxel size from the tile database for dimension \a idim.
  * Use AABBNDim(TileAABB(TileBaseArray(self))) to get the number of dimensions.
@@ -468,6 +934,200 @@ Error:
   return 0.0;
 }
 
+//
+//  === UPDATE ===
+//
+
+/// @cond PRIVATE
+typedef struct _update_work_t
+{ const tile_update_t *updates;
+  tile_t              *targets; ///< The tile matched to each update.  NULL if there was no match.
+  size_t               n,       ///< The number of updates.
+                       next,    ///< The next update to apply.
+                       nok;     ///< The number of updates applied so far.
+  tbmutex_t            lock;
+} update_work_t;
+/// @endcond
+
+static int cmp_path(const void *a_, const void *b_)
+{ return strcmp((*(const tile_t*)a_)->path,(*(const tile_t*)b_)->path);
+}
+
+static int cmp_path_key(const void *key, const void *b_)
+{ return strcmp((const char*)key,(*(const tile_t*)b_)->path);
+}
+
+/**
+ * Writes the changes in \a u to the metadata for \a t, then reloads the
+ * tile's bounding box and transform from the new metadata.
+ * Only the metadata that changed is rewritten (see MetadataCommit()).
+ */
+static int update_tile(tile_t t, const tile_update_t *u)
+{ metadata_t meta=0;
+  TRY(meta=MetadataOpen(t->path,t->metadata_format,"rw"));
+  if(u->shape)  TRY(MetadataSetShape(meta,u->ndim,(int64_t*)u->shape));
+  if(u->origin) TRY(MetadataSetOrigin(meta,u->ndim,(int64_t*)u->origin));
+  TRY(MetadataCommit(meta));
+  MetadataClose(meta);
+  meta=0;
+
+  MetadataClose(t->meta);
+  t->meta=0;
+  AABBFree(t->aabb);
+  t->aabb=0;
+  SAFEFREE(t->transform);
+  SAFEFREE(t->footprint);
+  t->described=0;
+  TRY(isvalid(t));
+  return 1;
+Error:
+  MetadataClose(meta);
+  LOG("\tCould not update tile at %s"ENDL,t->path);
+  return 0;
+}
+
+static void* update_worker(void *arg)
+{ update_work_t *w=(update_work_t*)arg;
+  while(1)
+  { size_t i;
+    int ok;
+    MutexLock(&w->lock);
+    i=w->next++;
+    MutexUnlock(&w->lock);
+    if(i>=w->n) break;
+    if(!w->targets[i]) continue;
+    ok=update_tile(w->targets[i],w->updates+i);
+    MutexLock(&w->lock);
+    w->nok+=ok;
+    MutexUnlock(&w->lock);
+  }
+  return 0;
+}
+
+/**
+ * Finds the tile for each update.  Paths may be relative to the root the
+ * tiles were opened from.  Only the first update for a tile is used.
+ */
+static int match_updates(tiles_t self, const tile_update_t *updates, size_t n, tile_t *targets)
+{ tile_t *byname=0;
+  unsigned char *claimed=0;
+  size_t i;
+  NEW(tile_t,byname,self->sz?self->sz:1);
+  NEW(unsigned char,claimed,self->sz?self->sz:1);
+  ZERO(unsigned char,claimed,self->sz);
+  memcpy(byname,self->tiles,sizeof(tile_t)*self->sz);
+  qsort(byname,self->sz,sizeof(tile_t),cmp_path);
+  for(i=0;i<n;++i)
+  { char full[1024];
+    const char *path=updates[i].path;
+    tile_t *t=0;
+    targets[i]=0;
+    if(!path) continue;
+    if(!(t=(tile_t*)bsearch(path,byname,self->sz,sizeof(tile_t),cmp_path_key))
+       && self->root[0] && join(full,sizeof(full),self->root,path))
+      t=(tile_t*)bsearch(full,byname,self->sz,sizeof(tile_t),cmp_path_key);
+    if(!t)
+      LOG("%s(%d): %s()"ENDL "\tNo tile found for %s"ENDL,__FILE__,__LINE__,__FUNCTION__,path);
+    else if(claimed[t-byname])
+      LOG("%s(%d): %s()"ENDL "\tIgnoring repeated update for %s"ENDL,__FILE__,__LINE__,__FUNCTION__,path);
+    else
+    { claimed[t-byname]=1;
+      targets[i]=*t;
+    }
+  }
+  free(byname);
+  free(claimed);
+  return 1;
+Error:
+  SAFEFREE(byname);
+  return 0;
+}
+
+/**
+ * Rewrites the cache file at the root the tiles were opened from.
+ * The new cache is written next to the old one and then moved into place.
+ * \see TileBaseCacheOpen()
+ */
+static int write_cache(tiles_t self)
+{ char name[1024],tmp[1024];
+  tilebase_cache_t cache=0;
+  TRY(join(name,sizeof(name),self->root,"tilebase.cache.yml"));
+  TRY(strlen(name)+sizeof(".tmp")<=sizeof(tmp));
+  strcpy(tmp,name);
+  strcat(tmp,".tmp");
+  TRY(cache=TileBaseCacheOpenWithRoot(tmp,"w",self->root));
+  TileBaseCacheWriteMany(cache,self->tiles,self->sz);
+  TRY(!TileBaseCacheError(cache));
+  TileBaseCacheClose(cache);
+  cache=0;
+#ifdef _MSC_VER
+  remove(name); // rename won't replace an existing file on windows
+#endif
+  TRY(0==rename(tmp,name));
+  return 1;
+Error:
+  TileBaseCacheClose(cache);
+  remove(tmp);
+  return 0;
+}
+
+/**
+ * Writes new bounding boxes for many tiles at once.
+ *
+ * Each tile's metadata is rewritten in place, in parallel, by the metadata
+ * format the tile was opened with.  Only metadata that changed is written,
+ * and each file is replaced atomically so a reader never sees a partial
+ * update.  The tiles in \a self are refreshed from the new metadata, and,
+ * if \a self was opened with TileBaseOpen(), the cache file at the root is
+ * rewritten to match.
+ *
+ * Since tiles move, the tile array is re-sorted (see TileBaseSort()).
+ *
+ * \param[in] self     The tile database.
+ * \param[in] updates  An array of \a n updates.  Update paths are matched
+ *                     against TilePath(), or, if relative, against the root
+ *                     passed to TileBaseOpen().
+ * \param[in] n        The number of updates.
+ * \returns the number of tiles that were updated.
+ */
+size_t TileBaseUpdate(tiles_t self, const tile_update_t *updates, size_t n)
+{ update_work_t work={0};
+  tbthread_t *threads=0;
+  unsigned i,nthreads=ThreadCount();
+  sfc_order_t order;
+  TRY(self && (updates || n==0));
+  if(n==0) return 0;
+  work.updates=updates;
+  work.n=n;
+  NEW(tile_t,work.targets,n);
+  TRY(match_updates(self,updates,n,work.targets));
+  MutexInit(&work.lock);
+  if(nthreads>n) nthreads=(unsigned)n;
+  NEW(tbthread_t,threads,nthreads);
+  for(i=0;i<nthreads;++i)
+    if(!ThreadCreate(threads+i,update_worker,&work))
+      break;
+  nthreads=i;
+  if(nthreads==0) // couldn't start any threads, so do the work here
+    update_worker(&work);
+  for(i=0;i<nthreads;++i)
+    ThreadJoin(threads+i);
+  MutexFree(&work.lock);
+  free(threads);
+  free(work.targets);
+
+  TileBaseInvalidateBoxes(self);
+  order=self->order;
+  self->order=SFC_ORDER_NONE;
+  TRY(TileBaseSort(self,order));
+  if(self->root[0])
+    TRY(write_cache(self));
+  return work.nok;
+Error:
+  SAFEFREE(work.targets);
+  return work.nok;
+}
+
 /** \returns NULL on failure, otherwise 
              the prefix string common to all tiles in \a tiles.
              The caller must free the returned string.
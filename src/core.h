@@ -8,6 +8,8 @@
  *  #include "nd.h"
 nd
 0 *  #include "aabb.h"
+ *  #include "sfc.h"
+ *  #include "footprint.h"
  *  #include "core.h"
  *  \endcode
  *  \todo Use the standard pattern in the master header.
@@ -34,6 +36,14 @@ typedef struct _tiles_t *tiles_t;
 
 typedef void (*tilebase_progress_t)(const char* path, void* data);
 
+/** A change to a tile's metadata.  \see TileBaseUpdate() */
+typedef struct _tile_update_t
+{ const char    *path;   ///< Path to the tile.
+  size_t         ndim;   ///< Number of elements in \a origin and \a shape.
+  const int64_t *origin; ///< New origin in nanometers.  NULL to leave as is.
+  const int64_t *shape;  ///< New size of the bounding box in nanometers.  NULL to leave as is.
+} tile_update_t;
+
 tiles_t TileBaseOpen(const char *path, const char* format);
 tiles_t TileBaseOpenWithProgressIndicator(const char *path, const char* format,
                                           tilebase_progress_t callback, void* cbdata);
@@ -43,8 +53,16 @@ void    TileBaseClose(tiles_t self);
 
 //int         TileBaseToSVG(tiles_t self,const char *path);
 size_t  TileBaseCount(tiles_t self);
+const char* TileBaseRoot(tiles_t self); // returned string is owned by tiles.
 tile_t* TileBaseArray(tiles_t self);
 aabb_t  TileBaseAABB(tiles_t self);
+const aabb3_t* TileBaseBoxes(tiles_t self); // returned array owned by tiles.  One box per tile in TileBaseArray() order.
+const aabb3_t* TileBaseFootprintBoxes(tiles_t self); // returned array owned by tiles.  Bounds of each TileFootprint().
+void    TileBaseInvalidateBoxes(tiles_t self);
+size_t  TileBaseUpdate(tiles_t self, const tile_update_t *updates, size_t n);
+size_t  TileBaseHitMany(tiles_t self, unsigned char *hit, const aabb3_t *box);
+int     TileBaseSort(tiles_t self, sfc_order_t order);
+sfc_order_t TileBaseOrder(tiles_t self);
 float   TileBaseVoxelSize(tiles_t self, unsigned idim);
 
 tile_t  TileNew(const char* path,const char* metadata_format);
@@ -52,11 +70,16 @@ void    TileFree(tile_t tile);
 // void    TileFreeArray(tile_t *tiles,size_t sz); // -- as of now, don't want this public bc it closes referenced tiles.
 aabb_t  TileAABB(tile_t self); // returned AABB owned by tile.
 ndio_t  TileFile(tile_t self); // returned file handle already opened.  Owned by tile.
+ndio_t  TileOpenFile(tile_t self); // a new handle each call.  Owned by the caller; close with ndioClose().
 nd_t    TileShape(tile_t self);// returned array is still owned by the tile.
 nd_t    TileCrop(tile_t self); // returned array is still owned by the tile.
 float*  TileTransform(tile_t self);
+const footprint_t* TileFootprint(tile_t self); // returned footprint owned by tile.
+int     TileFootprintHit(tile_t self, const aabb3_t *box);
 float   TileVoxelSize(tile_t self, unsigned idim);
 const char* TilePath(tile_t self); // returned string is owned by the tile.
+const char* TileFormat(tile_t self); // returned string is owned by the tile.
+uint64_t TileSpatialKey(tile_t self); // key assigned by the last TileBaseSort()
 
 
 char*   TilesCommonRoot(const tile_t* tiles, size_t ntiles);
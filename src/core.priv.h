@@ -12,8 +12,15 @@ struct _tile_t
   nd_t   crop;
   metadata_t meta; ///< handle to tile metadata.  Used to resolve filenames  
   float* transform;
+  footprint_t *footprint; ///< transformed voxel domain.  NULL until requested.
   char   path[1024];
-  char   metadata_format[64];
+  char   volume[1024]; ///< path used to open the volume (see TileFile()).  Empty if unknown.
+  char **channels;     ///< files matched by a "%" channel pattern in \a volume, in channel order.  NULL if not resolved.
+  unsigned nchannels;  ///< number of \a channels
+  char   metadata_format[64]; ///< format used to open the metadata.  Empty until known, in which case the format is detected.
+  char   format_hint[64];     ///< format to try first when detecting.  May be empty.
+  uint64_t key;    ///< space filling curve key assigned by TileBaseSort()
+  int    described; ///< 0 until MetadataDescribe() has been tried, then 1 on success or -1 on failure.
 };
 
 struct _tiles_t
@@ -21,9 +28,16 @@ struct _tiles_t
   size_t  sz,     ///< tiles array length
           cap;    ///< tiles array capacity
   tilebase_cache_t cache; ///< used to cache tilebase information
+  aabb3_t *boxes; ///< packed copy of the tile bounding boxes (see TileBaseBoxes()). NULL until requested.
+  aabb3_t *fpboxes; ///< packed copy of the tile footprint bounds (see TileBaseFootprintBoxes()). NULL until requested.
+  sfc_order_t order; ///< order of the tiles array
+  char     detected_format[64]; ///< format detected for recently added tiles (see addtiles())
+  unsigned ndetected;           ///< number of consecutive tiles detected as \a detected_format
+  char     root[1024];          ///< path the tiles were opened from (see TileBaseOpen()).  Empty if unknown.
 //  char   *log;    ///< error log (NULL if no errors)
 };
 
+int tile_add_channel(tile_t self, const char *path);
 
 #ifdef __cplusplus
 } //extern "C"
@@ -0,0 +1,157 @@
+/** \file
+ *  Tile footprints.
+ *
+ *  Hit tests use the separating axis theorem.  Two parallelepipeds are
+ *  disjoint if and only if their projections are disjoint on one of: the
+ *  three face normals of either one, or the cross product of an edge from
+ *  each (15 axes in all).
+ */
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <math.h>
+#include "aabb.h"
+#include "footprint.h"
+
+/// @cond DEFINES
+#define ENDL     "\n"
+#define LOG(...) fprintf(stderr,__VA_ARGS__)
+#define TRY(e)   do{if(!(e)) { LOG("%s(%d): %s"ENDL "\tExpression evaluated as false."ENDL "\t%s"ENDL,__FILE__,__LINE__,__FUNCTION__,#e); goto Error;}} while(0)
+
+/** Overlaps smaller than this fraction of the projected extents are treated
+ *  as touching.  This absorbs the rounding in single precision transforms so
+ *  tiles that abut exactly don't count as hits, matching AABBHit().
+ */
+#define TOLERANCE (1e-6)
+
+#ifndef restrict
+#define restrict __restrict
+#endif
+/// @endcond
+
+static void cross(double *restrict out, const double *a, const double *b)
+{ out[0]=a[1]*b[2]-a[2]*b[1];
+  out[1]=a[2]*b[0]-a[0]*b[2];
+  out[2]=a[0]*b[1]-a[1]*b[0];
+}
+
+static double dot(const double *a, const double *b)
+{ return a[0]*b[0]+a[1]*b[1]+a[2]*b[2];
+}
+
+/** Fills in the corners and bounds from the origin and edges. */
+static void finish(footprint_t *out)
+{ double lo[3],hi[3];
+  int i,d;
+  for(i=0;i<8;++i)
+  { for(d=0;d<3;++d)
+      out->corners[i][d]=out->origin[d]
+                        +((i&1)?out->edges[0][d]:0.0)
+                        +((i&2)?out->edges[1][d]:0.0)
+                        +((i&4)?out->edges[2][d]:0.0);
+  }
+  for(d=0;d<3;++d)
+  { lo[d]=hi[d]=out->corners[0][d];
+    for(i=1;i<8;++i)
+    { if(out->corners[i][d]<lo[d]) lo[d]=out->corners[i][d];
+      if(out->corners[i][d]>hi[d]) hi[d]=out->corners[i][d];
+    }
+  }
+  for(d=0;d<3;++d)
+  { out->bounds.lo[d]=(int64_t)floor(lo[d]);
+    out->bounds.hi[d]=(int64_t)ceil(hi[d]);
+  }
+  out->bounds.lo[3]=0;
+  out->bounds.hi[3]=1;
+}
+
+/**
+ * Computes the footprint of a volume from its pixel to space transform.
+ *
+ * \param[out] out        The footprint.
+ * \param[in]  transform  A row-major <tt>(ndim+1)x(ndim+1)</tt> homogeneous
+ *                        transform (see TileTransform()).
+ * \param[in]  ndim       Number of volume dimensions.  Must be at least 3.
+ *                        Only the first three dimensions are spatial.
+ * \param[in]  shape      The volume shape in voxels.
+ * \returns 1 on success, otherwise 0.
+ */
+int FootprintMake(footprint_t *out, const float *transform, unsigned ndim, const size_t *shape)
+{ const unsigned stride=ndim+1;
+  int d,e;
+  TRY(out && transform && shape);
+  TRY(ndim>=3);
+  for(d=0;d<3;++d)
+  { out->origin[d]=transform[d*stride+ndim];
+    for(e=0;e<3;++e)
+      out->edges[e][d]=transform[d*stride+e]*(double)shape[e];
+  }
+  finish(out);
+  return 1;
+Error:
+  return 0;
+}
+
+/** Makes the footprint of an axis aligned box. */
+int FootprintFromAABB(footprint_t *out, const aabb3_t *box)
+{ int d;
+  TRY(out && box);
+  memset(out->edges,0,sizeof(out->edges));
+  for(d=0;d<3;++d)
+  { out->origin[d]=(double)box->lo[d];
+    out->edges[d][d]=(double)(box->hi[d]-box->lo[d]);
+  }
+  finish(out);
+  return 1;
+Error:
+  return 0;
+}
+
+/** \returns 1 if the projections of \a a and \a b on \a axis are disjoint. */
+static int separated(const footprint_t *a, const footprint_t *b, const double *axis)
+{ double ca,cb,ra=0.0,rb=0.0,d[3];
+  int i;
+  if(dot(axis,axis)==0.0) return 0; // parallel edges: not a candidate axis
+  for(i=0;i<3;++i)
+  { ra+=fabs(dot(a->edges[i],axis));
+    rb+=fabs(dot(b->edges[i],axis));
+    d[i]=(a->corners[7][i]+a->origin[i])-(b->corners[7][i]+b->origin[i]); // twice the center offset
+  }
+  ca=fabs(dot(d,axis));
+  cb=ra+rb;
+  return ca>=cb*(1.0-TOLERANCE);
+}
+
+/**
+ * Two footprints hit if they share some volume.  Footprints that only
+ * share a face don't hit.
+ * \returns 1 if \a a and \a b intersect, otherwise 0.
+ */
+int FootprintsHit(const footprint_t *a, const footprint_t *b)
+{ double axis[3];
+  int i,j;
+  if(!AABB3Hit(&a->bounds,&b->bounds)) return 0;
+  for(i=0;i<3;++i) // face normals
+  { cross(axis,a->edges[(i+1)%3],a->edges[(i+2)%3]);
+    if(separated(a,b,axis)) return 0;
+    cross(axis,b->edges[(i+1)%3],b->edges[(i+2)%3]);
+    if(separated(a,b,axis)) return 0;
+  }
+  for(i=0;i<3;++i) // edge pairs
+    for(j=0;j<3;++j)
+    { cross(axis,a->edges[i],b->edges[j]);
+      if(separated(a,b,axis)) return 0;
+    }
+  return 1;
+}
+
+/** \returns 1 if the footprint \a a intersects \a box, otherwise 0. */
+int FootprintHit(const footprint_t *a, const aabb3_t *box)
+{ footprint_t b;
+  if(!AABB3Hit(&a->bounds,box)) return 0;
+  TRY(FootprintFromAABB(&b,box));
+  return FootprintsHit(a,&b);
+Error:
+  return 0;
+}
@@ -0,0 +1,32 @@
+/** \file
+ *  Tile footprints.
+ *
+ *  A footprint is the region of space covered by a tile's voxels once they're
+ *  mapped through the tile's pixel to space transform.  Since the transform
+ *  is affine, the footprint is a parallelepiped.  Rotation and shear make
+ *  it smaller than its axis aligned bounds, so testing against the
+ *  footprint rejects boxes that only hit the corners of the bounds.
+ *
+ *  Requires <stdint.h>, <stdlib.h> and aabb.h to be included before this file.
+ */
+#pragma once
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+typedef struct _footprint_t
+{ double  origin[3];     ///< position of the corner at voxel index 0
+  double  edges[3][3];   ///< edges[d] spans the volume along dimension d
+  double  corners[8][3]; ///< corner i is origin+sum of edges[d] for each bit d set in i
+  aabb3_t bounds;        ///< smallest integer box containing the corners
+} footprint_t;
+
+int FootprintMake(footprint_t *out, const float *transform, unsigned ndim, const size_t *shape);
+int FootprintFromAABB(footprint_t *out, const aabb3_t *box);
+
+int FootprintsHit(const footprint_t *a, const footprint_t *b);
+int FootprintHit(const footprint_t *a, const aabb3_t *box);
+
+#ifdef __cplusplus
+}//extern "C"{
+#endif
@@ -22,6 +22,22 @@ typedef unsigned    (*_metadata_is_fmt_t)    (const char* path, const char* mode
 typedef void*       (*_metadata_open_t)      (const char* path, const char* mode);
 /// Closes an open metadata context.
 typedef void        (*_metadata_close_t)     (metadata_t self);
+/**
+ * Detects the format and opens the tile metadata at \a path in one step.
+ *
+ * Optional.  Formats that must parse the tile's metadata to decide if
+ * they can read it should implement this so the parsed data is kept in the
+ * returned context instead of being parsed again by \c open().
+ *
+ * Should not log anything when the tile is not in this format.
+ *
+ * \param[in] list  Listing of the directory at \a path, or NULL.  Formats
+ *                  can look up files in it instead of listing the directory
+ *                  again.  Owned by the caller and only valid during the call.
+ * \returns NULL if the tile is not in this format or could not be opened,
+ *          otherwise the same kind of context returned by \c open().
+ */
+typedef void*       (*_metadata_probe_t)     (const char* path, const char* mode, dirlist_t list);
 /**
  * Get the origin of the tile in nanometers (nm).
  *
@@ -70,6 +86,54 @@ typedef ndio_t      (*_metadata_get_vol_t)   (metadata_t self,const char *mode);
  */
 typedef unsigned    (*_metadata_get_transform_t)(metadata_t self, float *transform);
 
+/**
+ * Reads everything needed to build a tile's record in one call.
+ *
+ * Optional.  Implementations should parse the metadata at most once and probe
+ * the volume at most once.
+ *
+ * \param[in]   self  The metadata context.
+ * \param[out]  desc  Zero-initialized by the caller.  On failure, \c desc->vol
+ *                    should be left NULL.
+ * \returns 1 on success, 0 otherwise.
+ */
+typedef unsigned    (*_metadata_describe_t)(metadata_t self, metadata_description_t *desc);
+
+/**
+ * Writes a copy of the tile's metadata next to it in a form that is faster to
+ * read, for example binary encoded protobuf messages instead of text.
+ *
+ * Optional.  Later opens should prefer the copy when it is up to date.
+ *
+ * \returns 1 on success, 0 otherwise.
+ */
+typedef unsigned    (*_metadata_write_sidecar_t)(metadata_t self);
+
+/**
+ * Lists the tiles held in a container file in the directory \a path.
+ *
+ * Optional.  Formats that keep many tiles in one file implement this so a
+ * tilebase can be opened without walking a directory per tile.  \a add should
+ * be called once per tile with a path that this format's \c open() accepts
+ * and the format's name.
+ *
+ * Should not log anything when there is no container at \a path.
+ *
+ * \returns the number of tiles listed, or 0 if there is no container at \a path.
+ */
+typedef size_t      (*_metadata_list_t)(const char* path, metadata_list_callback_t add, void *ctx);
+
+/**
+ * Writes any changes made through the context.
+ *
+ * Optional.  Formats without it write changes in \c close(), which can't
+ * report a failure.  \c close() should still write anything changed after
+ * the last commit.
+ *
+ * \returns 1 on success, 0 otherwise.
+ */
+typedef unsigned    (*_metadata_commit_t)(metadata_t self);
+
 /**
  * Since shared libraries don't share global memory, we need to pass loaded ndio
  * plugins to any shared libraries that want to use them (and don't have the 
@@ -94,6 +158,11 @@ struct _metadata_api_t
   _metadata_get_transform_t   get_transform;
   _metadata_add_ndio_plugin_t add_ndio_plugin;
   void *lib;                        ///< Handle to the library context (if not null)
+  _metadata_probe_t           probe;     ///< (optional) Detect and open in one step.  May be NULL.
+  _metadata_describe_t        describe;  ///< (optional) Read everything needed for a tile's record in one call.  May be NULL.
+  _metadata_write_sidecar_t   write_sidecar; ///< (optional) Write a faster to read copy of the metadata next to it.  May be NULL.
+  _metadata_list_t            list;      ///< (optional) List the tiles held in a container at a directory.  May be NULL.
+  _metadata_commit_t          commit;    ///< (optional) Write changes and report whether that worked.  May be NULL.
 };
 typedef const metadata_api_t* (*get_metadata_api_t)(void); ///< \returns the interface used to read/write tile metadata.  The caller will not free the returned pointer.  It should be statically allocated by the implementation.
 #ifdef __cplusplus
@@ -6,6 +6,9 @@
     1. The number of color channels.
     2. Properties that deterimine the bounding box of the tile.
 
+    The functions here may be called from many threads at once.  The format
+    registry is initialized exactly once, and each metadata_t handle is
+    independent.  A single handle should only be used by one thread at a time.
 */
 #include <stdlib.h>
 #include "tilebase.h"
@@ -16,10 +19,17 @@
 #include "interface.h"
 #include "plugin.h"
 #include "config.h"
+#include "util/thread.h"
+#include "util/dirlist.h"
 #include <stdio.h>
 #include <string.h>
+#include <sys/stat.h>
 
 /// @cond DEFINES
+#ifdef _MSC_VER
+#define snprintf _snprintf
+#define stat     _stat
+#endif
 #define ENDL              "\n"
 #define LOG(...)          fprintf(stderr,__VA_ARGS__)
 #define TRY(e)            do{if(!(e)) { LOG("%s(%d): %s()"ENDL "\tExpression evaluated as false."ENDL "\t%s"ENDL,__FILE__,__LINE__,__FUNCTION__,#e); goto Error;}} while(0)
@@ -40,32 +50,188 @@ struct _metadata_t
 // FORMAT REGISTRY
 //
 
-static metadata_api_t** g_formats=NULL;      ///< metadata format registry
-static size_t           g_countof_formats=0; ///< number of loaded metadata formats
-
 /**
- * Find metadata formats and initialize \a g_formats. 
- * \todo make thread safe
+ * A metadata format.
+ *
+ * Formats listed in the plugin manifest aren't loaded until they're needed.
+ * When there's no manifest, every plugin is loaded up front and \a entry is
+ * left zeroed.
  */
+typedef struct _format_t
+{ metadata_manifest_entry_t entry; ///< The format's manifest entry.
+  metadata_api_t           *api;   ///< NULL until the plugin is loaded.
+  int                       tried; ///< 1 once loading the plugin was attempted.
+} format_t;
+
+static format_t*        g_formats=NULL;      ///< metadata format registry
+static size_t           g_countof_formats=0; ///< number of known metadata formats
+static char*            g_plugin_dir=NULL;   ///< where plugins named in the manifest are loaded from
+
+static tbonce_t         g_formats_once=TBONCE_INIT;
+static tbmutex_t        g_formats_lock=TBMUTEX_INIT; ///< guards loading plugins named in the manifest
+
+/** Find metadata formats and initialize \a g_formats.  Called exactly once. */
 #define PLUGIN_PATH (TILEBASE_INSTALL_PATH "/bin/" METADATA_PLUGIN_PATH) // Warning: using this breaks relocatable package
-static int maybe_load_plugins()
-{ if(g_formats) return 1;
-  TRY(g_formats=MetadataLoadPlugins(METADATA_PLUGIN_PATH /*PLUGIN_PATH*/,&g_countof_formats));
-  return 1;
+static void load_plugins()
+{ metadata_manifest_entry_t *entries;
+  metadata_apis_t apis;
+  size_t i,n=0;
+  if((entries=MetadataReadManifest(METADATA_PLUGIN_PATH /*PLUGIN_PATH*/,&g_plugin_dir,&n)))
+  { TRY(g_formats=(format_t*)calloc(n?n:1,sizeof(*g_formats)));
+    for(i=0;i<n;++i)
+      g_formats[i].entry=entries[i];
+    g_countof_formats=n;
+    free(entries);
+    return;
+  }
+  // No manifest, so load every plugin in the plugin directory
+  TRY(apis=MetadataLoadPlugins(METADATA_PLUGIN_PATH /*PLUGIN_PATH*/,&n));
+  TRY(g_formats=(format_t*)calloc(n?n:1,sizeof(*g_formats)));
+  for(i=0;i<n;++i)
+  { g_formats[i].api=apis[i];
+    g_formats[i].tried=1;
+  }
+  g_countof_formats=n;
+  free(apis);
 Error:
+  free(entries);
+}
+
+/**
+ * Initialize \a g_formats if it hasn't been already.
+ * Safe to call from many threads at once.  The registry is never resized
+ * after initialization.  Plugins are loaded under \a g_formats_lock.
+ */
+static int maybe_load_plugins()
+{ Once(&g_formats_once,load_plugins);
+  return g_formats!=NULL;
+}
+
+/**
+ * \returns the interface for format \a i, loading its plugin the first time
+ *          it's needed, or NULL if the plugin couldn't be loaded.
+ */
+static metadata_api_t* api(size_t i)
+{ metadata_api_t *out;
+  MutexLock(&g_formats_lock);
+  if(!g_formats[i].tried)
+  { g_formats[i].tried=1;
+    g_formats[i].api=MetadataLoadPlugin(g_plugin_dir,g_formats[i].entry.lib);
+  }
+  out=g_formats[i].api;
+  MutexUnlock(&g_formats_lock);
+  return out;
+}
+
+/** \returns the name of format \a i without loading its plugin. */
+static const char* format_name(size_t i)
+{ if(g_formats[i].entry.name[0])
+    return g_formats[i].entry.name;
+  return g_formats[i].api?g_formats[i].api->name():"";
+}
+
+/** \returns 1 if the file \a name exists in the directory \a path, otherwise 0. */
+static int has_file(const char *path, const char *name)
+{ char buf[1024];
+  struct stat s;
+  if(snprintf(buf,sizeof(buf),"%s/%s",path,name)>=(int)sizeof(buf))
+    return 0;
+  return 0==stat(buf,&s);
+}
+
+/**
+ * Checks the manifest hints of format \a i against the tile at \a path.
+ *
+ * Formats without tile hints (including every format when there's no
+ * manifest) might read any tile.
+ *
+ * \param[in,out] list  Listing of \a path.  Read the first time an \c ext
+ *                      hint needs it, unless the caller passed one in.
+ * \returns 1 if format \a i might read the tile, otherwise 0.
+ */
+static int might_read(size_t i, const char *path, dirlist_t *list)
+{ const metadata_manifest_entry_t *e=&g_formats[i].entry;
+  size_t k;
+  int any=0;
+  for(k=0;k<e->nhints;++k)
+  { const metadata_hint_t *h=e->hints+k;
+    switch(h->kind)
+    { case METADATA_HINT_EXT:
+        any=1;
+        if(!*list)
+          *list=DirListRead(path);
+        if(DirListFindExtension(*list,h->arg)) return 1;
+        break;
+      case METADATA_HINT_FILE:
+        any=1;
+        if(has_file(path,h->arg)) return 1;
+        break;
+      case METADATA_HINT_PATH:
+        any=1;
+        if(strstr(path,h->arg)) return 1;
+        break;
+      default:; // other hints don't describe tiles
+    }
+  }
+  return !any;
+}
+
+/**
+ * Tries to open \a filename with format \a i.
+ *
+ * Formats that implement \c probe() detect and open in one step, so the
+ * descriptors parsed during detection are reused by the opened context.
+ * Other formats fall back to \c is_fmt() followed by \c open().
+ *
+ * \param[in] list  Listing of \a filename passed on to \c probe().  May be NULL.
+ * \returns the format specific context on success, otherwise 0.
+ */
+static void* try_format(size_t i, const char *filename, const char *mode, dirlist_t list)
+{ metadata_api_t *fmt;
+  if(!(fmt=api(i)))
+    return 0;
+  if(fmt->probe)
+    return fmt->probe(filename,mode,list);
+  if(fmt->is_fmt(filename,mode))
+    return fmt->open(filename,mode);
   return 0;
 }
 
-/** \returns the index of the detected format on sucess, otherwise -1 */
-static int detect_file_type(const char *filename, const char *mode)
+/** \returns 1 if format \a i recognizes \a filename, otherwise 0.  Doesn't open it. */
+static int is_format(size_t i, const char *filename, const char *mode)
+{ metadata_api_t *fmt;
+  return (fmt=api(i)) && fmt->is_fmt(filename,mode);
+}
+
+/**
+ * Detects the format and opens the file.
+ *
+ * Only formats whose manifest hints match the tile are tried, so only their
+ * plugins get loaded.
+ *
+ * \param[out] ctx  Receives the format specific context opened by the
+ *                  detected format.  If \a ctx is NULL, the file is only
+ *                  checked with \c is_fmt(), not opened.
+ * \param[in]  given  Listing of \a filename made by the caller, or NULL.
+ *                    If it's NULL and a manifest hint needs a listing, the
+ *                    directory is listed here and shared with the formats.
+ * \returns the index of the detected format on sucess, otherwise -1
+ */
+static int detect_file_type(const char *filename, const char *mode, void **ctx, dirlist_t given)
 { size_t i;
+  int out=-1;
+  dirlist_t list=given;
   TRY(filename);
   TRY(mode);
-  for(i=0;i<g_countof_formats;++i)
-    if(g_formats[i]->is_fmt(filename,mode))
-      return (int)i;
+  for(i=0;i<g_countof_formats && out<0;++i)
+    if(might_read(i,filename,&list))
+    { if(ctx?(*ctx=try_format(i,filename,mode,list))!=0:is_format(i,filename,mode))
+        out=(int)i;
+    }
 Error:
-  return -1;
+  if(list!=given)
+    DirListFree(list);
+  return out;
 }
 
 /** \returns the index of the detected format on sucess, otherwise -1 */
@@ -73,7 +239,7 @@ static int get_format_by_name(const char *format)
 { size_t i;
   if(!format) return -1;
   for(i=0;i<g_countof_formats;++i)
-    if(0==strcmp(format,g_formats[i]->name()))
+    if(0==strcmp(format,format_name(i)))
       return (int)i;
   return -1;
 }
@@ -88,7 +254,7 @@ unsigned MetadataFormatCount()
 }
 const char* MetadataFormatName(unsigned i)
 { if(i>=MetadataFormatCount()) return NULL;
-  return g_formats[i]->name();
+  return format_name(i);
 }
 
 /** Get abstract context. \returns the format specific context on success, otherwise 0.*/
@@ -96,16 +262,22 @@ void* MetadataContext(metadata_t self) {return self?self->ctx:0;}
 /** Get error string. \returns an error string if there was an error, otherwise 0.*/
 char* MetadataError(metadata_t self)   {return self?self->log:0;}
 
-/** Detect the presence of readible metadata as \a path. */
+/**
+ * Detect the presence of readible metadata as \a path.
+ *
+ * This only asks each format's \c is_fmt(), so it's cheaper than opening
+ * the tile.  Every registered format counts, including the first one.
+ */
 unsigned MetadataIsFound(const char *tilepath)
 { maybe_load_plugins();
-  return detect_file_type(tilepath,"r")>0;
+  return detect_file_type(tilepath,"r",NULL,NULL)>=0;
 }
 
 /**
- * Open metadata according to the mode.
+ * Opens metadata with \a format, or detects it if \a format is NULL or empty.
+ * \param[in] list  Listing of \a path used during detection.  May be NULL.
  */
-metadata_t MetadataOpen(const char *path, const char *format, const char *mode)
+static metadata_t open_metadata(const char *path, const char *format, dirlist_t list, const char *mode)
 { metadata_t file=NULL;
   void *ctx=NULL;
   int ifmt;
@@ -113,12 +285,14 @@ metadata_t MetadataOpen(const char *path, const char *format, const char *mode)
   if(format && *format)
   { if(0>(ifmt=get_format_by_name(format))) goto ErrorSpecificFormat;
   } else
-  { if(0>(ifmt=detect_file_type(path,mode))) goto ErrorDetectFormat;
+  { if(0>(ifmt=detect_file_type(path,mode,&ctx,list))) goto ErrorDetectFormat;
   }  
-  TRY(ctx=g_formats[ifmt]->open(path,mode));
+  if(!api(ifmt)) goto ErrorSpecificFormat;
+  if(!ctx)
+    TRY(ctx=api(ifmt)->open(path,mode));
   NEW(struct _metadata_t,file,1);
   file->ctx=ctx;
-  file->fmt=g_formats[ifmt];
+  file->fmt=api(ifmt);
   file->log=NULL;
   return file;
 ErrorSpecificFormat:
@@ -133,6 +307,54 @@ Error:
   return NULL; 
 }
 
+/**
+ * Open metadata according to the mode.
+ */
+metadata_t MetadataOpen(const char *path, const char *format, const char *mode)
+{ return open_metadata(path,format,0,mode);
+}
+
+/**
+ * Open metadata, trying the format named by \a hint first.
+ *
+ * Use this when the format is probably known, for example because other tiles
+ * under the same root were detected with it.  Unlike passing \a hint as the
+ * format to MetadataOpen(), a wrong guess is not an error: the format is
+ * auto-detected instead.
+ *
+ * \param[in] hint  Name of the format to try first.  May be NULL or empty.
+ * \param[in] list  Listing of the directory at \a path, for example one made
+ *                  while crawling.  Formats use it instead of listing the
+ *                  directory again.  May be NULL.
+ */
+metadata_t MetadataOpenWithHint(const char *path, const char *hint, dirlist_t list, const char *mode)
+{ metadata_t file=NULL;
+  void *ctx=NULL;
+  int ifmt;
+  maybe_load_plugins();
+  if(path && mode && hint && *hint && (ifmt=get_format_by_name(hint))>=0 && (ctx=try_format(ifmt,path,mode,list)))
+  { NEW(struct _metadata_t,file,1);
+    file->ctx=ctx;
+    file->fmt=api(ifmt);
+    file->log=NULL;
+    return file;
+  }
+  return open_metadata(path,NULL,list,mode);
+Error:
+  if(ctx)
+  { struct _metadata_t tmp={0};
+    tmp.fmt=api(ifmt);
+    tmp.ctx=ctx;
+    tmp.fmt->close(&tmp);
+  }
+  return NULL;
+}
+
+/** \returns the name of the format used to open \a self, or NULL. */
+const char* MetadataFormat(metadata_t self)
+{ return self?self->fmt->name():NULL;
+}
+
 /** Closes the file and releases resources.  Always succeeds. */
 void MetadataClose(metadata_t self)
 { if(!self) return;
@@ -229,4 +451,105 @@ unsigned MetadataGetTransform(metadata_t self, float *transform)
   return self->fmt->get_transform(self,transform);
 Error:
   return 0;
-}
\ No newline at end of file
+}
+
+/**
+ * Reads the bounding box, volume shape, volume path and transform in one call.
+ *
+ * Only some formats support this.  When it fails, callers should fall back to
+ * MetadataGetOrigin(), MetadataGetShape(), MetadataOpenVolume() and
+ * MetadataGetTransform().
+ *
+ * \param[out] desc  On success, the caller is responsible for calling
+ *                   ndfree() on \c desc->vol.
+ * \returns 1 on success, 0 if the format doesn't support this or on error.
+ */
+unsigned MetadataDescribe(metadata_t self, metadata_description_t *desc)
+{ if(!self || !desc || !self->fmt->describe) return 0;
+  memset(desc,0,sizeof(*desc));
+  if(!self->fmt->describe(self,desc)) goto Error;
+  TRY(desc->vol);
+  TRY(desc->ndim<=METADATA_MAX_NDIM);
+  TRY(ndndim(desc->vol)<=METADATA_MAX_NDIM);
+  return 1;
+Error:
+  if(desc->vol) ndfree(desc->vol);
+  desc->vol=0;
+  return 0;
+}
+
+/**
+ * Writes a copy of the metadata next to the tile in a form the format can
+ * read faster than the original.
+ * \returns 1 on success, 0 if the format doesn't support this or on error.
+ */
+unsigned MetadataWriteSidecar(metadata_t self)
+{ TRY(self&&self->fmt->write_sidecar);
+  return self->fmt->write_sidecar(self);
+Error:
+  return 0;
+}
+
+/**
+ * Writes the changes made through \a self without closing it.
+ *
+ * Formats that don't implement \c commit() write their changes when
+ * \a self is closed, so there's nothing to do here and this succeeds.
+ * \returns 1 on success, otherwise 0.
+ */
+unsigned MetadataCommit(metadata_t self)
+{ TRY(self);
+  if(!self->fmt->commit)
+    return 1;
+  return self->fmt->commit(self);
+Error:
+  return 0;
+}
+
+/**
+ * \returns 1 if format \a i might list a container in the directory \a path.
+ *
+ * Formats from the manifest can only list a container when one of their
+ * \c list hints names a file in \a path.  Formats loaded without a manifest
+ * are asked if they implement \c list().
+ */
+static int might_list(size_t i, const char *path)
+{ const metadata_manifest_entry_t *e=&g_formats[i].entry;
+  size_t k;
+  if(!e->name[0])
+    return 1;
+  for(k=0;k<e->nhints;++k)
+    if(e->hints[k].kind==METADATA_HINT_LIST && has_file(path,e->hints[k].arg))
+      return 1;
+  return 0;
+}
+
+/**
+ * Lists the tiles held in a container file in the directory \a path.
+ *
+ * Only formats that implement \c list() are asked.  The first one that
+ * finds a container wins.
+ *
+ * \param[in] path    A directory.
+ * \param[in] format  Only ask this format.  May be NULL or the empty string,
+ *                    in which case every format is asked.
+ * \param[in] add     Called once per tile with its path and format name.
+ * \param[in] ctx     Passed to \a add.
+ * \returns the number of tiles listed, or 0 if there's no container at \a path.
+ */
+size_t MetadataListTiles(const char *path, const char *format, metadata_list_callback_t add, void *ctx)
+{ size_t i,n;
+  int ifmt;
+  metadata_api_t *fmt;
+  if(!path || !add || !maybe_load_plugins())
+    return 0;
+  if(format && format[0])
+  { if(0>(ifmt=get_format_by_name(format)) || !(fmt=api(ifmt)) || !fmt->list)
+      return 0;
+    return fmt->list(path,add,ctx);
+  }
+  for(i=0;i<g_countof_formats;++i)
+    if(might_list(i,path) && (fmt=api(i)) && fmt->list && (n=fmt->list(path,add,ctx)))
+      return n;
+  return 0;
+}
@@ -2,10 +2,15 @@
  * \file
  * Interface for reading and writing tile metadata.
  *
+ * All functions are safe to call from many threads at once, as long as a
+ * single metadata_t handle is only used by one thread at a time.
+ *
  * \todo add MetadataAddPluginPath() and corresponding functionality for
  *       search paths to metadata/plugin.c. see ndioAddPluginPath() for reference.
  *       This would enable plugin specific tests to run in the build tree.
  */
+#include "../util/dirlist.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -13,9 +18,32 @@ extern "C" {
 typedef struct _metadata_t*     metadata_t;
 typedef struct _metadata_api_t  metadata_api_t;
 
+#define METADATA_MAX_NDIM 8 ///< Maximum dimensionality of a described tile.
+
+/**
+ * Everything needed to build a tile's record.
+ * \see MetadataDescribe()
+ */
+typedef struct _metadata_description_t
+{ size_t  ndim;                         ///< Number of elements in \a origin and \a shape.
+  int64_t origin[METADATA_MAX_NDIM];    ///< Tile origin in nanometers (nm).
+  int64_t shape[METADATA_MAX_NDIM];     ///< Size of the tile's bounding box in nanometers (nm).
+  nd_t    vol;                          ///< Shape and type of the volume (no data).  The caller frees it with ndfree().
+  char    vol_path[1024];               ///< Path used to open the volume.
+  float   transform[(METADATA_MAX_NDIM+1)*(METADATA_MAX_NDIM+1)]; ///< Pixel to space transform with <tt>(ndndim(vol)+1)^2</tt> elements.
+} metadata_description_t;
+
+/**
+ * Called once for each tile found in a container.
+ * \see MetadataListTiles()
+ */
+typedef void (*metadata_list_callback_t)(const char *tilepath, const char *format, void *ctx);
+
 unsigned    MetadataIsFound(const char* tilepath);
 metadata_t  MetadataOpen(const char *tilepath, const char *format, const char *mode);
+metadata_t  MetadataOpenWithHint(const char *tilepath, const char *hint, dirlist_t list, const char *mode);
 void        MetadataClose(metadata_t self);
+const char* MetadataFormat(metadata_t self);
 
 unsigned    MetadataFormatCount();
 const char* MetadataFormatName(unsigned i);
@@ -29,7 +57,15 @@ ndio_t      MetadataOpenVolume(metadata_t self, const char* mode);
 unsigned    MetadataGetTileAABB(metadata_t self, tile_t tile);
 unsigned    MetadataSetTileAABB(metadata_t self, tile_t tile);
 
+unsigned    MetadataGetOrigin(metadata_t self, size_t *nelem, int64_t *origin);
+unsigned    MetadataGetShape(metadata_t self, size_t *nelem, int64_t *shape);
+unsigned    MetadataSetOrigin(metadata_t self, size_t  nelem, int64_t *origin);
+unsigned    MetadataSetShape(metadata_t self, size_t  nelem, int64_t *shape);
 unsigned    MetadataGetTransform(metadata_t self, float *transform);
+unsigned    MetadataDescribe(metadata_t self, metadata_description_t *desc);
+unsigned    MetadataWriteSidecar(metadata_t self);
+unsigned    MetadataCommit(metadata_t self);
+size_t      MetadataListTiles(const char *path, const char *format, metadata_list_callback_t add, void *ctx);
 
 /// \todo MetadataSetFormat - set the tile format string 
 /// \todo MetadataCopy
@@ -11,6 +11,7 @@
 #include "metadata.h"
 #include "plugin.h"
 #include "interface.h"
+#include "util/thread.h"
 #include <errno.h>
 #include <stdlib.h>
 #include <string.h>
@@ -296,6 +297,50 @@ static unsigned is_path_relative(const char *path)
 #endif
 }
 
+/**
+ * \returns the directory \a path, resolved relative to the directory holding
+ *          the executable if \a path is relative, or NULL on failure.  The
+ *          caller must free the returned string.
+ */
+static char* plugin_dir(const char *path)
+{ char *out=0,
+       *exepath=0;
+  if(!is_path_relative(path))
+  { NEW(char,out,strlen(path)+1);
+    strcpy(out,path);
+  } else
+  { size_t n;
+    TRY(exepath=rpath(),"Could not find the executable's path.");
+    n=strlen(exepath)+strlen(path)+2; // +1 for the directory seperator and +1 for the terminating null
+    { const char *p[]={exepath,"/",path};
+      NEW(char,out,n);
+      cat(out,n,3,p);
+    }
+  }
+Finalize:
+  if(exepath) free(exepath);
+  return out;
+Error:
+  goto Finalize;
+}
+
+static void preload_ndio_plugins(void) { ndioPreloadPlugins(); }
+
+/**
+ * Register loaded ndio plugins with a loaded metadata plugin to share them
+ * across shared library boundaries.
+ */
+static void share_ndio_plugins(metadata_api_t *api)
+{ static tbonce_t once=TBONCE_INIT;
+  size_t i,n;
+  ndio_fmt_t **ndio_plugins;
+  if(!api->add_ndio_plugin) return;
+  Once(&once,preload_ndio_plugins);
+  ndio_plugins=ndioPlugins(&n);
+  for(i=0;i<n;++i)
+    api->add_ndio_plugin(ndio_plugins[i]);
+}
+
 /**
  * Recursively descends a directory tree starting at \a path searching for 
  * plugins to load.
@@ -317,38 +362,20 @@ static unsigned is_path_relative(const char *path)
  */
 metadata_apis_t MetadataLoadPlugins(const char *path, size_t *n)
 { apis_t apis = {0};
-  DIR*           dir;
-  char *buf=0,
-       *exepath=rpath();
-  if(!is_path_relative(path))
-  { buf=(char*)path;
-  } else
-  { size_t n=strlen(exepath)+strlen(path)+2; // +1 for the directory seperator and +1 for the terminating null
-    const char *p[]={exepath,"/",path};
-    TRY(buf=(char*)alloca(n),"Out of stack space.");
-    cat(buf,n,3,p);
-  }
+  DIR*           dir=0;
+  char *buf=0;
+  size_t i;
+  TRY(buf=plugin_dir(path),path);
   DBG("LOAD PLUGINS FROM %s"ENDL,buf);
   TRY(dir=opendir(buf),strerror(errno));
   TRY(recursive_load(&apis,dir,buf),"Search for plugins failed.");
   *n=apis.n;
-  
-  // Register loaded ndio plugins with loaded metadata plugins
-  // to share across shared library boundaries.
-  ndioPreloadPlugins();
-  { size_t i,n;
-    ndio_fmt_t **ndio_plugins=ndioPlugins(&n);
-    for(i=0;i<apis.n;++i)
-    { size_t j;
-      if(apis.v[i]->add_ndio_plugin)
-        for(j=0;j<n;++j)
-          apis.v[i]->add_ndio_plugin(ndio_plugins[j]);
-    }
-  }
+  for(i=0;i<apis.n;++i)
+    share_ndio_plugins(apis.v[i]);
 
 Finalize:
   if(dir) closedir(dir);
-  if(exepath) free(exepath);
+  if(buf) free(buf);
   return apis.v;
 Error:
   if(n) *n=0;
@@ -356,6 +383,130 @@ Error:
   goto Finalize;
 }
 
+/**
+ * Loads the plugin in the file \a lib from the directory \a dir.
+ *
+ * Use with the entries read by MetadataReadManifest().  Loaded ndio plugins
+ * are shared with the plugin.
+ *
+ * \returns NULL on failure, otherwise the plugin's interface.
+ * \ingroup metadataplugins
+ */
+metadata_api_t* MetadataLoadPlugin(const char *dir, const char *lib)
+{ metadata_api_t *api;
+  if(!dir || !lib || !(api=load(dir,lib)))
+    return NULL;
+  share_ndio_plugins(api);
+  return api;
+}
+
+/** \returns the hint kind named by \a s, or METADATA_HINT_NONE. */
+static metadata_hint_kind_t hint_kind(const char *s)
+{ if(0==strcmp(s,"ext"))  return METADATA_HINT_EXT;
+  if(0==strcmp(s,"file")) return METADATA_HINT_FILE;
+  if(0==strcmp(s,"path")) return METADATA_HINT_PATH;
+  if(0==strcmp(s,"list")) return METADATA_HINT_LIST;
+  return METADATA_HINT_NONE;
+}
+
+/**
+ * Parses one manifest line: <tt>name library [kind argument]...</tt>
+ * Hints of a kind this version doesn't know are skipped with a warning.
+ * \returns 1 on success, otherwise 0.
+ */
+static int parse_manifest_line(metadata_manifest_entry_t *e, char *line)
+{ char *tok,*arg;
+  const char *sep=" \t\r\n";
+  memset(e,0,sizeof(*e));
+  TRY(tok=strtok(line,sep),"Missing format name.");
+  TRY(strlen(tok)<sizeof(e->name),tok);
+  strcpy(e->name,tok);
+  TRY(tok=strtok(NULL,sep),"Missing library.");
+  TRY(strlen(tok)<sizeof(e->lib),tok);
+  strcpy(e->lib,tok);
+  while((tok=strtok(NULL,sep)))
+  { metadata_hint_t *h=e->hints+e->nhints;
+    TRY(e->nhints<METADATA_MAX_HINTS,"Too many hints.");
+    TRY(arg=strtok(NULL,sep),"Missing hint argument.");
+    if((h->kind=hint_kind(tok))==METADATA_HINT_NONE)
+    { LOG("Warning: Plugin manifest entry for %s has an unknown hint, \"%s\".  Ignoring the hint."ENDL,e->name,tok);
+      continue;
+    }
+    TRY(strlen(arg)<sizeof(h->arg),arg);
+    strcpy(h->arg,arg);
+    ++e->nhints;
+  }
+  return 1;
+Error:
+  return 0;
+}
+
+/**
+ * Reads the plugin manifest, METADATA_MANIFEST, from the plugin directory
+ * \a path.
+ *
+ * The manifest is written when the plugins are built.  Each line names a
+ * format, the library implementing it, and hints that say cheaply which
+ * tiles the format might read:
+ * \verbatim
+ * # <format-name> <library> [<hint-kind> <argument>]...
+ * fetch.protobuf.v9  libmeta-protobuf-v9.so  ext .acquisition
+ * tilebase.container libmeta-container.so    path tilebase.tiles.h5 list tilebase.tiles.h5
+ * \endverbatim
+ * Blank lines and lines starting with '#' are ignored.  Hints of a kind
+ * this version doesn't know, for example ones written by a newer build, are
+ * dropped with a warning, but their entry is kept.  An entry left without
+ * tile hints is probed for every tile.  No libraries are loaded; use
+ * MetadataLoadPlugin() to load the ones that are needed.
+ *
+ * \param[in]  path The path to the plugins folder.
+ * \param[out] dir  Receives the resolved plugin directory.  The caller must
+ *                  free it.
+ * \param[out] n    The number of entries in the returned array.
+ * \returns NULL if there's no manifest or it couldn't be read, otherwise an
+ *          array of entries in manifest order.  The caller must free it.
+ * \ingroup metadataplugins
+ */
+metadata_manifest_entry_t* MetadataReadManifest(const char *path, char **dir, size_t *n)
+{ metadata_manifest_entry_t *out=0;
+  size_t cap=0;
+  FILE *fp=0;
+  char line[1024],*name=0,*d=0;
+  *n=0;
+  *dir=0;
+  SILENTTRY(d=plugin_dir(path),path);
+  TRY(name=(char*)malloc(strlen(d)+sizeof("/" METADATA_MANIFEST)),"Memory allocation failed.");
+  sprintf(name,"%s/" METADATA_MANIFEST,d);
+  SILENTTRY(fp=fopen(name,"r"),name);
+  while(fgets(line,sizeof(line),fp))
+  { char *c=line+strspn(line," \t\r\n");
+    if(!*c || *c=='#')
+      continue;
+    if(*n>=cap)
+    { metadata_manifest_entry_t *t;
+      cap=(size_t)(1.2*cap+10);
+      TRY(t=(metadata_manifest_entry_t*)realloc(out,sizeof(*out)*cap),"Expanding manifest.");
+      out=t;
+    }
+    TRY(parse_manifest_line(out+*n,c),name);
+    ++*n;
+  }
+  if(!out)
+    TRY(out=(metadata_manifest_entry_t*)malloc(sizeof(*out)),"Memory allocation failed.");
+  fclose(fp);
+  free(name);
+  *dir=d;
+  return out;
+Error:
+SilentError:
+  if(fp) fclose(fp);
+  free(name);
+  free(d);
+  free(out);
+  *n=0;
+  return 0;
+}
+
 /**
  * Releases resources acquired to load plugins and frees the array.
  * \ingroup ndioplugins
@@ -11,9 +11,37 @@ extern "C" {
 
   typedef struct _metadata_api_t** metadata_apis_t;                    ///< Type that describes a buffer containing loaded plugin's. \ingroup metadataplugins
 
+#define METADATA_MANIFEST  "plugins.manifest" ///< Name of the plugin manifest in the plugin directory.  \see MetadataReadManifest()
+#define METADATA_MAX_HINTS 8                  ///< Maximum number of hints for one format in the plugin manifest.
+
+  /** Kinds of hints in the plugin manifest. \ingroup metadataplugins */
+  typedef enum _metadata_hint_kind_t
+  { METADATA_HINT_NONE=0,
+    METADATA_HINT_EXT,   ///< The tile directory holds a file with this extension.
+    METADATA_HINT_FILE,  ///< The tile directory holds a file with this name.
+    METADATA_HINT_PATH,  ///< The tile path contains this string.
+    METADATA_HINT_LIST,  ///< A directory holding a file with this name is a container the format can list.
+  } metadata_hint_kind_t;
+
+  typedef struct _metadata_hint_t
+  { metadata_hint_kind_t kind;
+    char                 arg[64];
+  } metadata_hint_t;
+
+  /** One line of the plugin manifest.  \ingroup metadataplugins */
+  typedef struct _metadata_manifest_entry_t
+  { char            name[64];   ///< Format name.
+    char            lib[256];   ///< Library file, relative to the plugin directory.
+    metadata_hint_t hints[METADATA_MAX_HINTS];
+    size_t          nhints;
+  } metadata_manifest_entry_t;
+
   metadata_apis_t MetadataLoadPlugins(const char *path, size_t *n);    // Loads the plugins contained in \a path.  \returns 0 on failure, otherwise an array with the loaded plugins. \param[out] n The number of loaded plugins.
   void            MetadataFreePlugins(metadata_apis_t fmts, size_t n); // Releases resources.  Always succeeds.
 
+  metadata_manifest_entry_t* MetadataReadManifest(const char *path, char **dir, size_t *n); // Reads the plugin manifest without loading any plugins.  \returns NULL if there's no manifest.
+  struct _metadata_api_t*    MetadataLoadPlugin(const char *dir, const char *lib);         // Loads one plugin.  \returns NULL on failure.
+
 #ifdef __cplusplus
 }//extern "C" {
 #endif
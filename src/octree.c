@@ -0,0 +1,120 @@
+/** \file
+ *  Octree geometry.
+ *
+ *  Child boxes are computed arithmetically from their parent in constant
+ *  time.  Because each split rounds the lower half down, a node's box can't
+ *  be computed with a closed form from the root; OctreeNode() walks the
+ *  index one level at a time instead.  That's O(level), but levels are few.
+ */
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include "aabb.h"
+#include "octree.h"
+
+/// @cond DEFINES
+#define ENDL     "\n"
+#define LOG(...) fprintf(stderr,__VA_ARGS__)
+#define TRY(e)   do{if(!(e)) { LOG("%s(%d): %s"ENDL "\tExpression evaluated as false."ENDL "\t%s"ENDL,__FILE__,__LINE__,__FUNCTION__,#e); goto Error;}} while(0)
+
+#define BIT(e,n) (((e)>>(n))&1)
+/// @endcond
+
+static unsigned ulog2(unsigned x)
+{ unsigned r=0;
+  while (x>>=1) r++;
+  return r;
+}
+
+/**
+ * \param[out] self       The tree to initialize.
+ * \param[in]  root       The bounding box of the root node.
+ * \param[in]  nchildren  Must be 2, 4 or 8.
+ * \returns 1 on success, otherwise 0.
+ */
+int OctreeInit(octree_t *self, const aabb3_t *root, unsigned nchildren)
+{ TRY(self && root);
+  TRY(nchildren==2 || nchildren==4 || nchildren==8);
+  self->root=*root;
+  self->nchildren=nchildren;
+  return 1;
+Error:
+  return 0;
+}
+
+/**
+ * \returns the box for child \a ichild of \a parent.
+ *          Same as the corresponding box from AABBBinarySubdivision().
+ */
+aabb3_t OctreeChild(const octree_t *self, const aabb3_t *parent, unsigned ichild)
+{ aabb3_t out=*parent;
+  unsigned d;
+  for(d=0;d<3;++d)
+  { if(BIT(self->nchildren-1,d))  // should subdivide this dim?
+    { const int64_t h=(parent->hi[d]-parent->lo[d])/2;
+      if(BIT(ichild,d))            // upper half gets the remainder
+        out.lo[d]=parent->lo[d]+h;
+      else
+        out.hi[d]=parent->lo[d]+h;
+    }
+  }
+  return out;
+}
+
+/**
+ * \returns the box of the node at \a level with Morton index \a index.
+ *          \a index must be less than OctreeLevelCount(self,level).
+ */
+aabb3_t OctreeNode(const octree_t *self, unsigned level, uint64_t index)
+{ const unsigned b=ulog2(self->nchildren),
+                 m=self->nchildren-1;
+  aabb3_t out=self->root;
+  while(level--)
+    out=OctreeChild(self,&out,(unsigned)((index>>(b*level))&m));
+  return out;
+}
+
+/** \returns the index of child \a ichild of the node at \a index. */
+uint64_t OctreeChildIndex(const octree_t *self, uint64_t index, unsigned ichild)
+{ return index*self->nchildren+ichild;
+}
+
+/** \returns the number of nodes at \a level. */
+uint64_t OctreeLevelCount(const octree_t *self, unsigned level)
+{ return ((uint64_t)1)<<(ulog2(self->nchildren)*level);
+}
+
+/**
+ * Enumerates the boxes of every node at \a level in Morton order.
+ * <tt>out[i]</tt> is the box of the node with index \c i.
+ *
+ * The level is built in place, expanding each level into the next from the
+ * back of the array so parents are consumed before they're overwritten.
+ *
+ * \param[out] out  Must have room for \a n boxes.
+ * \param[in]  n    Must be at least OctreeLevelCount(self,level).
+ * \returns the number of boxes written, or 0 on failure.
+ */
+size_t OctreeLevel(const octree_t *self, unsigned level, aabb3_t *out, size_t n)
+{ const unsigned nc=self->nchildren;
+  uint64_t count;
+  size_t c=1;
+  unsigned l;
+  TRY(out);
+  TRY(ulog2(nc)*level<8*sizeof(size_t)-1);
+  TRY((count=OctreeLevelCount(self,level))<=n);
+  out[0]=self->root;
+  for(l=0;l<level;++l)
+  { size_t j=c;
+    while(j--)
+    { const aabb3_t parent=out[j];
+      unsigned i=nc;
+      while(i--)
+        out[j*nc+i]=OctreeChild(self,&parent,i);
+    }
+    c*=nc;
+  }
+  return c;
+Error:
+  return 0;
+}
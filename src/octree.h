@@ -0,0 +1,40 @@
+/** \file
+ *  Octree geometry.
+ *
+ *  Computes the boxes of nodes in a binary subdivision tree without
+ *  allocating.  Subdivision matches AABBBinarySubdivision(), so boxes computed
+ *  here agree exactly with ones computed by recursively subdividing aabb_t's.
+ *
+ *  Nodes are addressed by (level,index).  The root is at level 0.  The index
+ *  of a node at level \c L is formed by concatenating the child ids along the
+ *  path from the root, most significant first:
+ *  \code{c}
+ *  index = ((id[0]*nchildren + id[1])*nchildren + ... ) + id[L-1]
+ *  \endcode
+ *  Bit \c d of a child id selects the upper half along dimension \c d, so
+ *  the indexes at a level are in Morton (Z-curve) order.
+ *
+ *  Requires <stdint.h>, <stdlib.h> and aabb.h to be included before this file.
+ */
+#pragma once
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+typedef struct _octree_t
+{ aabb3_t  root;      ///< the box at level 0
+  unsigned nchildren; ///< subdivision factor: 2, 4, or 8.  Dimensions 0 through log2(nchildren)-1 are divided.
+} octree_t;
+
+int      OctreeInit(octree_t *self, const aabb3_t *root, unsigned nchildren);
+
+aabb3_t  OctreeChild(const octree_t *self, const aabb3_t *parent, unsigned ichild);
+aabb3_t  OctreeNode(const octree_t *self, unsigned level, uint64_t index);
+uint64_t OctreeChildIndex(const octree_t *self, uint64_t index, unsigned ichild);
+
+uint64_t OctreeLevelCount(const octree_t *self, unsigned level);
+size_t   OctreeLevel(const octree_t *self, unsigned level, aabb3_t *out, size_t n);
+
+#ifdef __cplusplus
+}//extern "C"{
+#endif
@@ -0,0 +1,115 @@
+/** \file
+ *  Space filling curves.
+ *
+ *  The Hilbert encoding uses Skilling's transpose algorithm:
+ *  J. Skilling, "Programming the Hilbert curve", AIP Conf. Proc. 707 (2004).
+ */
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "aabb.h"
+#include "sfc.h"
+
+#ifdef _MSC_VER
+#define strcasecmp _stricmp
+#else
+#include <strings.h>
+#endif
+
+/// @cond DEFINES
+#define MASK ((1u<<SFC_BITS)-1)
+/// @endcond
+
+/** Spreads the low 21 bits of \a v so there are two zero bits between each. */
+static uint64_t spread3(uint32_t v)
+{ uint64_t x=v&MASK;
+  x=(x|(x<<32))&0x001f00000000ffffULL;
+  x=(x|(x<<16))&0x001f0000ff0000ffULL;
+  x=(x|(x<< 8))&0x100f00f00f00f00fULL;
+  x=(x|(x<< 4))&0x10c30c30c30c30c3ULL;
+  x=(x|(x<< 2))&0x1249249249249249ULL;
+  return x;
+}
+
+/** Interleaves the low 21 bits of each coordinate; \a x is least significant. */
+uint64_t SFCMorton3(uint32_t x, uint32_t y, uint32_t z)
+{ return spread3(x)|(spread3(y)<<1)|(spread3(z)<<2);
+}
+
+/** Position along the Hilbert curve through a 2^21 cube. */
+uint64_t SFCHilbert3(uint32_t x, uint32_t y, uint32_t z)
+{ uint32_t X[3],M=1u<<(SFC_BITS-1),P,Q,t;
+  int i;
+  X[0]=x&MASK; X[1]=y&MASK; X[2]=z&MASK;
+  // inverse undo
+  for(Q=M;Q>1;Q>>=1)
+  { P=Q-1;
+    for(i=0;i<3;++i)
+    { if(X[i]&Q)
+        X[0]^=P;         // invert
+      else
+      { t=(X[0]^X[i])&P; // exchange
+        X[0]^=t;
+        X[i]^=t;
+      }
+    }
+  }
+  // gray encode
+  for(i=1;i<3;++i) X[i]^=X[i-1];
+  t=0;
+  for(Q=M;Q>1;Q>>=1)
+    if(X[2]&Q) t^=Q-1;
+  for(i=0;i<3;++i) X[i]^=t;
+  // the transposed form stores the key's bits round-robin with X[0] first
+  return SFCMorton3(X[2],X[1],X[0]);
+}
+
+static uint32_t quantize(int64_t c2, int64_t lo, int64_t hi)
+{ double f;
+  if(hi<=lo) return 0;
+  f=(0.5*(double)c2-(double)lo)/((double)hi-(double)lo);
+  if(f<=0.0) return 0;
+  if(f>=1.0) return MASK;
+  return (uint32_t)(f*MASK);
+}
+
+/**
+ * Computes the curve key for the center of \a box.
+ *
+ * \param[in] order   The curve to use.  SFC_ORDER_NONE always yields 0.
+ * \param[in] bounds  The domain.  The center of \a box is quantized to 21 bits
+ *                    per axis relative to this box.
+ * \param[in] box     The box to key.
+ * \returns the key.  Empty boxes get the largest key so they sort last.
+ */
+uint64_t SFCKey(sfc_order_t order, const aabb3_t *bounds, const aabb3_t *box)
+{ uint32_t q[3];
+  int i;
+  if(AABB3IsEmpty(box)) return UINT64_MAX;
+  for(i=0;i<3;++i)
+    q[i]=quantize(box->lo[i]+box->hi[i],bounds->lo[i],bounds->hi[i]);
+  switch(order)
+  { case SFC_ORDER_MORTON:  return SFCMorton3(q[0],q[1],q[2]);
+    case SFC_ORDER_HILBERT: return SFCHilbert3(q[0],q[1],q[2]);
+    default: return 0;
+  }
+}
+
+static const char *g_order_names[]={"none","morton","hilbert"};
+
+/** \returns a name for \a order suitable for command line options. */
+const char* SFCOrderName(sfc_order_t order)
+{ if((unsigned)order<sizeof(g_order_names)/sizeof(*g_order_names))
+    return g_order_names[order];
+  return "none";
+}
+
+/** \returns the order named \a name, or SFC_ORDER_NONE if not recognized. */
+sfc_order_t SFCOrderFromName(const char *name)
+{ unsigned i;
+  if(name)
+    for(i=0;i<sizeof(g_order_names)/sizeof(*g_order_names);++i)
+      if(0==strcasecmp(name,g_order_names[i]))
+        return (sfc_order_t)i;
+  return SFC_ORDER_NONE;
+}
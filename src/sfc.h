@@ -0,0 +1,37 @@
+/** \file
+ *  Space filling curves.
+ *
+ *  Maps 3d positions to 63-bit keys so that sorting by key groups things
+ *  that are close in space.  Each axis is quantized to 21 bits.
+ *
+ *  The Morton (Z-order) key interleaves the bits of each axis with x in the
+ *  least significant position.  That matches the child numbering used by
+ *  AABBBinarySubdivision() and the octree module, so the leaves of a render
+ *  traversal are visited in Morton order.  The Hilbert key has better
+ *  locality: consecutive keys are always face neighbors.
+ *
+ *  Requires <stdint.h>, <stdlib.h> and aabb.h to be included before this file.
+ */
+#pragma once
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+#define SFC_BITS (21) ///< bits per axis
+
+typedef enum _sfc_order_t
+{ SFC_ORDER_NONE=0, ///< no particular order
+  SFC_ORDER_MORTON,
+  SFC_ORDER_HILBERT
+} sfc_order_t;
+
+uint64_t    SFCMorton3(uint32_t x, uint32_t y, uint32_t z);
+uint64_t    SFCHilbert3(uint32_t x, uint32_t y, uint32_t z);
+uint64_t    SFCKey(sfc_order_t order, const aabb3_t *bounds, const aabb3_t *box);
+
+const char* SFCOrderName(sfc_order_t order);
+sfc_order_t SFCOrderFromName(const char *name);
+
+#ifdef __cplusplus
+}//extern "C"{
+#endif
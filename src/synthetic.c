@@ -0,0 +1,347 @@
+/** \file
+ *  Synthetic tiles.
+ *
+ *  Descriptors are replaced atomically when written, so the metadata format
+ *  can rewrite them in place (see TileBaseUpdate()).
+ */
+#define _CRT_SECURE_NO_WARNINGS
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include "nd.h"
+#include "aabb.h"
+#include "sfc.h"
+#include "footprint.h"
+#include "core.h"
+#include "synthetic.h"
+#include "util/thread.h"
+
+#ifdef _MSC_VER
+#include <direct.h>
+#define mkdir(name,mode) _mkdir(name)
+#define snprintf         _snprintf
+#define PATHSEP          "\\"
+#else
+#define PATHSEP          "/"
+#endif
+
+/// @cond DEFINES
+#define ENDL               "\n"
+#define LOG(...)           fprintf(stderr,__VA_ARGS__)
+#define TRY(e)             do{if(!(e)) { LOG("%s(%d): %s()"ENDL "\tExpression evaluated as false."ENDL "\t%s"ENDL,__FILE__,__LINE__,__FUNCTION__,#e); goto Error;}} while(0)
+#define NEW(type,e,nelem)  TRY((e)=(type*)malloc(sizeof(type)*(nelem)))
+#define countof(e)         (sizeof(e)/sizeof(*(e)))
+/// @endcond
+
+static const char *g_type_names[]={
+  "u8",  "u16",  "u32",  "u64",
+  "i8",  "i16",  "i32",  "i64",
+                 "f32",  "f64"};
+
+/** \returns the voxel type named \a str (e.g. "u16"), or nd_id_unknown. */
+nd_type_id_t SyntheticTypeFromName(const char *str)
+{ int i;
+  for(i=0;i<(int)countof(g_type_names);++i)
+    if(0==strcmp(g_type_names[i],str))
+      return (nd_type_id_t)i;
+  return nd_id_unknown;
+}
+
+/** Forms <tt>path/name</tt> in \a out.  \returns 0 if it doesn't fit. */
+static int join(char *out, size_t n, const char *path, const char *name)
+{ return snprintf(out,n,"%s" PATHSEP "%s",path,name)<(int)n;
+}
+
+/**
+ * Reads the descriptor for the tile in the directory \a path.
+ * Keys that are missing keep the values already in \a tile.
+ * \returns 1 on success, otherwise 0.  Silent if there's no descriptor.
+ */
+unsigned SyntheticTileRead(synthetic_tile_t *tile, const char *path)
+{ char name[1024],line[1024],key[32],val[256];
+  FILE *fp=0;
+  TRY(join(name,sizeof(name),path,SYNTHETIC_DESCRIPTOR));
+  if(!(fp=fopen(name,"r")))
+    return 0;
+  while(fgets(line,sizeof(line),fp))
+  { long long o[3];
+    unsigned long long d[3];
+    if(sscanf(line," %31s",key)!=1 || key[0]=='#')
+      continue;
+    if(0==strcmp(key,"origin"))
+    { TRY(3==sscanf(line," %*s %lld %lld %lld",o,o+1,o+2));
+      tile->origin[0]=o[0]; tile->origin[1]=o[1]; tile->origin[2]=o[2];
+    } else if(0==strcmp(key,"voxel"))
+    { TRY(3==sscanf(line," %*s %lf %lf %lf",tile->voxel,tile->voxel+1,tile->voxel+2));
+    } else if(0==strcmp(key,"dims"))
+    { TRY(3==sscanf(line," %*s %llu %llu %llu",d,d+1,d+2));
+      tile->dims[0]=(size_t)d[0]; tile->dims[1]=(size_t)d[1]; tile->dims[2]=(size_t)d[2];
+    } else if(0==strcmp(key,"type"))
+    { TRY(1==sscanf(line," %*s %255s",val));
+      TRY(nd_id_unknown!=(tile->type=SyntheticTypeFromName(val)));
+    } else if(0==strcmp(key,"rotation"))
+    { TRY(1==sscanf(line," %*s %lf",&tile->rotation));
+    } else if(0==strcmp(key,"shear"))
+    { TRY(1==sscanf(line," %*s %lf",&tile->shear));
+    } else if(0==strcmp(key,"volume"))
+    { TRY(1==sscanf(line," %*s %255s",tile->volume));
+    }
+  }
+  fclose(fp);
+  return 1;
+Error:
+  if(fp) fclose(fp);
+  LOG("\tWhile reading %s"ENDL,path);
+  return 0;
+}
+
+/**
+ * Writes the descriptor for \a tile into the directory \a path.
+ * The descriptor is written to a temporary file first and then renamed so
+ * readers never see a partial descriptor.
+ */
+unsigned SyntheticTileWrite(const synthetic_tile_t *tile, const char *path)
+{ char name[1024],tmp[1024];
+  FILE *fp=0;
+  TRY(0<=tile->type && tile->type<(int)countof(g_type_names));
+  TRY(join(name,sizeof(name),path,SYNTHETIC_DESCRIPTOR));
+  TRY(join(tmp,sizeof(tmp),path,SYNTHETIC_DESCRIPTOR ".tmp"));
+  TRY(fp=fopen(tmp,"w"));
+  fprintf(fp,"origin   %lld %lld %lld\n",(long long)tile->origin[0],(long long)tile->origin[1],(long long)tile->origin[2]);
+  fprintf(fp,"voxel    %.17g %.17g %.17g\n",tile->voxel[0],tile->voxel[1],tile->voxel[2]);
+  fprintf(fp,"dims     %llu %llu %llu\n",(unsigned long long)tile->dims[0],(unsigned long long)tile->dims[1],(unsigned long long)tile->dims[2]);
+  fprintf(fp,"type     %s\n",g_type_names[tile->type]);
+  fprintf(fp,"rotation %.17g\n",tile->rotation);
+  fprintf(fp,"shear    %.17g\n",tile->shear);
+  if(tile->volume[0])
+    fprintf(fp,"volume   %s\n",tile->volume);
+  TRY(0==fclose(fp));
+  fp=0;
+#ifdef _MSC_VER
+  remove(name); // rename won't replace an existing file on windows
+#endif
+  TRY(0==rename(tmp,name));
+  return 1;
+Error:
+  if(fp) fclose(fp);
+  remove(tmp);
+  return 0;
+}
+
+/** Computes the pixel to space transform in double precision.  \see SyntheticTileTransform() */
+static void transform_of(const synthetic_tile_t *tile, double *m)
+{ const double c=cos(tile->rotation),
+               s=sin(tile->rotation),
+              *v=tile->voxel,
+              cx=tile->dims[0]*v[0]/2.0,
+              cy=tile->dims[1]*v[1]/2.0;
+  const double t[16]={
+    c*v[0], -s*v[1], c*v[0]*tile->shear, tile->origin[0]+cx-(c*cx-s*cy),
+    s*v[0],  c*v[1], s*v[0]*tile->shear, tile->origin[1]+cy-(s*cx+c*cy),
+    0.0,     0.0,    v[2],               (double)tile->origin[2],
+    0.0,     0.0,    0.0,                1.0};
+  memcpy(m,t,sizeof(t));
+}
+
+/**
+ * Computes the tile's bounding box in nanometers.
+ *
+ * The box holds the corners of the voxel grid after they've been through
+ * SyntheticTileTransform(), so it grows with rotation and shear.  Without
+ * either, the box starts at the tile's origin.
+ * \param[out] origin  The lower corner.  May be NULL.
+ * \param[out] shape   The extent.  May be NULL.
+ */
+void SyntheticTileBounds(const synthetic_tile_t *tile, int64_t *origin, int64_t *shape)
+{ double m[16],lo[3],hi[3];
+  unsigned corner,i,j;
+  transform_of(tile,m);
+  for(corner=0;corner<8;++corner)
+  { double r[3];
+    for(j=0;j<3;++j)
+      r[j]=(corner&(1u<<j))?(double)tile->dims[j]:0.0;
+    for(i=0;i<3;++i)
+    { const double x=m[4*i]*r[0]+m[4*i+1]*r[1]+m[4*i+2]*r[2]+m[4*i+3];
+      if(corner==0 || x<lo[i]) lo[i]=x;
+      if(corner==0 || x>hi[i]) hi[i]=x;
+    }
+  }
+  for(i=0;i<3;++i)
+  { // round outward, but don't let round-off grow an exact box
+    const double a=floor(lo[i]+1e-6),b=ceil(hi[i]-1e-6);
+    if(origin) origin[i]=(int64_t)a;
+    if(shape)  shape[i]=(int64_t)(b-a);
+  }
+}
+
+/**
+ * Computes the 4x4 pixel to space transform.
+ *
+ * Voxels are sheared along x by z, scaled to nanometers, rotated about the
+ * center of the xy field and then moved to the tile origin.
+ * \param[out] transform  Must have room for 16 elements.  Row-major.
+ */
+void SyntheticTileTransform(const synthetic_tile_t *tile, float *transform)
+{ double m[16];
+  int i;
+  transform_of(tile,m);
+  for(i=0;i<16;++i)
+    transform[i]=(float)m[i];
+}
+
+/**
+ * \returns an empty (no data) array with the shape and type of the tile's
+ *          volume, or 0 on failure.  The caller must free it with ndfree().
+ */
+nd_t SyntheticTileVolume(const synthetic_tile_t *tile)
+{ nd_t out=0;
+  TRY(out=ndinit());
+  TRY(ndcast(out,tile->type));
+  TRY(ndreshapev(out,3,tile->dims[0],tile->dims[1],tile->dims[2]));
+  return out;
+Error:
+  if(out) ndfree(out);
+  return 0;
+}
+
+//
+// === LATTICE ===
+//
+
+/// @cond PRIVATE
+typedef struct _lattice_work_t
+{ const char                *root;
+  const synthetic_lattice_t *lattice;
+  size_t                     n,    ///< total number of tiles
+                             next, ///< next tile to make
+                             nok;  ///< number of tiles made so far
+  tilebase_progress_t        callback;
+  void                      *cbdata;
+  tbmutex_t                  lock;
+} lattice_work_t;
+/// @endcond
+
+/** Writes the volume for \a tile at \a path, reusing \a *vol between calls. */
+static int write_volume(const synthetic_tile_t *tile, const char *path, size_t index, nd_t *vol)
+{ char name[1024];
+  ndio_t file=0;
+  if(!*vol)
+  { nd_t shape;
+    TRY(shape=SyntheticTileVolume(tile));
+    *vol=ndheap(shape);
+    ndfree(shape);
+    TRY(*vol);
+  }
+  TRY(ndfill(*vol,1+index%200)); // distinct values so tile boundaries are visible
+  TRY(join(name,sizeof(name),path,tile->volume));
+  TRY(file=ndioOpen(name,NULL,"w"));
+  TRY(ndioWrite(file,*vol));
+  ndioClose(file);
+  return 1;
+Error:
+  if(file) ndioClose(file);
+  return 0;
+}
+
+/** Makes tile \a index of the lattice. */
+static int make_tile(lattice_work_t *w, size_t index, char *path, size_t npath, nd_t *vol)
+{ const synthetic_lattice_t *L=w->lattice;
+  synthetic_tile_t t=L->tile;
+  size_t r[3];
+  int i;
+  r[0]=index%L->count[0];
+  r[1]=(index/L->count[0])%L->count[1];
+  r[2]=index/((size_t)L->count[0]*L->count[1]);
+  for(i=0;i<3;++i)
+    t.origin[i]+=(int64_t)(r[i]*t.dims[i]*t.voxel[i]*(1.0-L->overlap));
+  TRY(snprintf(path,npath,"%s" PATHSEP "%05u-%05u-%05u",w->root,(unsigned)r[2],(unsigned)r[1],(unsigned)r[0])<(int)npath);
+  TRY(0==mkdir(path,0777) || errno==EEXIST);
+  if(L->ext)
+  { TRY(snprintf(t.volume,sizeof(t.volume),"volume.%s",L->ext)<(int)sizeof(t.volume));
+    TRY(write_volume(&t,path,index,vol));
+  } else
+    t.volume[0]='\0';
+  TRY(SyntheticTileWrite(&t,path));
+  return 1;
+Error:
+  return 0;
+}
+
+static void* lattice_worker(void *arg)
+{ lattice_work_t *w=(lattice_work_t*)arg;
+  char path[1024];
+  nd_t vol=0;
+  while(1)
+  { size_t i;
+    int ok;
+    MutexLock(&w->lock);
+    i=w->next++;
+    MutexUnlock(&w->lock);
+    if(i>=w->n) break;
+    ok=make_tile(w,i,path,sizeof(path),&vol);
+    MutexLock(&w->lock);
+    w->nok+=ok;
+    if(ok && w->callback) w->callback(path,w->cbdata);
+    MutexUnlock(&w->lock);
+  }
+  if(vol) ndfree(vol);
+  return 0;
+}
+
+/**
+ * Makes a dataset of synthetic tiles arranged on a regular lattice.
+ *
+ * Each tile gets its own directory under \a root named after its lattice
+ * position.  Neighboring tiles along each dimension overlap by
+ * <tt>lattice->overlap</tt> of the tile size.  Tiles are written in parallel.
+ *
+ * Any cache file at \a root is removed since it would describe the old
+ * tiles.  Tiles from earlier calls with a larger lattice are not removed.
+ *
+ * \param[in] root      The directory to put the tiles in.  Made if it
+ *                      doesn't exist, but its parent must exist.
+ * \param[in] lattice   The lattice description.
+ * \param[in] callback  If not NULL, called with the path of each tile as it
+ *                      is made.  Calls are serialized.
+ * \param[in] cbdata    Passed to \a callback.
+ * \returns the number of tiles that were made.
+ */
+size_t SyntheticLatticeMake(const char *root, const synthetic_lattice_t *lattice,
+                            tilebase_progress_t callback, void *cbdata)
+{ lattice_work_t work={0};
+  tbthread_t *threads=0;
+  char cache[1024];
+  unsigned i,nthreads=ThreadCount();
+  TRY(root && lattice);
+  TRY(0<=lattice->overlap && lattice->overlap<1.0);
+  TRY(0==mkdir(root,0777) || errno==EEXIST);
+  TRY(join(cache,sizeof(cache),root,"tilebase.cache.yml"));
+  remove(cache);
+
+  work.root=root;
+  work.lattice=lattice;
+  work.n=(size_t)lattice->count[0]*lattice->count[1]*lattice->count[2];
+  work.callback=callback;
+  work.cbdata=cbdata;
+  MutexInit(&work.lock);
+  if(nthreads>work.n) nthreads=(unsigned)work.n;
+  NEW(tbthread_t,threads,nthreads?nthreads:1);
+  for(i=0;i<nthreads;++i)
+    if(!ThreadCreate(threads+i,lattice_worker,&work))
+      break;
+  nthreads=i;
+  if(nthreads==0) // couldn't start any threads, so do the work here
+    lattice_worker(&work);
+  for(i=0;i<nthreads;++i)
+    ThreadJoin(threads+i);
+  MutexFree(&work.lock);
+  free(threads);
+  return work.nok;
+Error:
+  return 0;
+}
@@ -0,0 +1,60 @@
+/** \file
+ *  Synthetic tiles.
+ *
+ *  A synthetic tile is a directory holding a small text descriptor,
+ *  SYNTHETIC_DESCRIPTOR, and, optionally, a volume file.  The descriptor
+ *  fully determines the tile's bounding box, voxel shape and transform, so
+ *  datasets with many tiles can be made without writing any voxels.  They
+ *  are read by the "tilebase.synthetic" metadata format.
+ *
+ *  The descriptor has one key per line:
+ *  \verbatim
+ *  origin   <x> <y> <z>     # nanometers
+ *  voxel    <x> <y> <z>     # nanometers per voxel
+ *  dims     <w> <h> <d>     # voxels
+ *  type     u16             # one of u8,u16,u32,u64,i8,i16,i32,i64,f32,f64
+ *  rotation <radians>       # about z, around the center of the xy field
+ *  shear    <s>             # x shifts by s voxels per z plane
+ *  volume   <file>          # optional, relative to the tile directory
+ *  \endverbatim
+ *
+ *  Requires <stdint.h>, <stdlib.h>, nd.h and core.h to be included before
+ *  this file.
+ */
+#pragma once
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+#define SYNTHETIC_DESCRIPTOR "tile.synthetic"
+
+typedef struct _synthetic_tile_t
+{ int64_t      origin[3];    ///< position of voxel 0 in nanometers, before rotation and shear
+  double       voxel[3];     ///< voxel size in nanometers
+  size_t       dims[3];      ///< voxels along each dimension
+  nd_type_id_t type;         ///< voxel type
+  double       rotation;     ///< rotation about z in radians
+  double       shear;        ///< x shift, in voxels, per z plane
+  char         volume[256];  ///< volume file name relative to the tile directory.  Empty if there's no volume.
+} synthetic_tile_t;
+
+typedef struct _synthetic_lattice_t
+{ unsigned          count[3]; ///< number of tiles along each dimension
+  double            overlap;  ///< fraction of a tile shared with the next one along each dimension.  In [0,1).
+  synthetic_tile_t  tile;     ///< template for every tile.  The origin is the origin of the first tile.
+  const char       *ext;      ///< if not NULL, volumes are written with this extension (e.g. "tif").
+} synthetic_lattice_t;
+
+unsigned SyntheticTileRead     (synthetic_tile_t *tile, const char *path);
+unsigned SyntheticTileWrite    (const synthetic_tile_t *tile, const char *path);
+void     SyntheticTileBounds   (const synthetic_tile_t *tile, int64_t *origin, int64_t *shape);
+void     SyntheticTileTransform(const synthetic_tile_t *tile, float *transform);
+nd_t     SyntheticTileVolume   (const synthetic_tile_t *tile);
+nd_type_id_t SyntheticTypeFromName(const char *name);
+
+size_t   SyntheticLatticeMake  (const char *root, const synthetic_lattice_t *lattice,
+                                tilebase_progress_t callback, void *cbdata);
+
+#ifdef __cplusplus
+}//extern "C"{
+#endif
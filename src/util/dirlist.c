@@ -0,0 +1,110 @@
+/**
+ * \file
+ * Short-lived directory listings.
+ */
+#include "dirlist.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+#ifdef _MSC_VER
+#include "dirent.win.h"
+#else
+#include <dirent.h>
+#endif
+
+/// @cond DEFINES
+#define ENDL              "\n"
+#define LOG(...)          fprintf(stderr,__VA_ARGS__)
+#define TRY(e)            do{if(!(e)) { LOG("%s(%d): %s()"ENDL "\tExpression evaluated as false."ENDL "\t%s"ENDL,__FILE__,__LINE__,__FUNCTION__,#e); goto Error;}} while(0)
+#define NEW(type,e,nelem) TRY((e)=(type*)malloc(sizeof(type)*(nelem)))
+/// @endcond
+
+struct _dirlist_t
+{ char   *path;
+  char  **names;
+  size_t  n,cap;
+};
+
+static char* copy(const char *s)
+{ char *out=0;
+  NEW(char,out,strlen(s)+1);
+  strcpy(out,s);
+Error:
+  return out;
+}
+
+/** \returns an empty listing for the directory at \a path. */
+dirlist_t DirListNew(const char *path)
+{ dirlist_t self=0;
+  NEW(struct _dirlist_t,self,1);
+  memset(self,0,sizeof(*self));
+  TRY(self->path=copy(path));
+  return self;
+Error:
+  DirListFree(self);
+  return 0;
+}
+
+/** Lists the directory at \a path. \returns 0 on failure. */
+dirlist_t DirListRead(const char *path)
+{ dirlist_t self=0;
+  DIR *dir=0;
+  struct dirent *ent;
+  TRY(self=DirListNew(path));
+  TRY(dir=opendir(path));
+  while((ent=readdir(dir)))
+    TRY(DirListAdd(self,ent->d_name));
+  closedir(dir);
+  return self;
+Error:
+  if(dir) closedir(dir);
+  DirListFree(self);
+  return 0;
+}
+
+void DirListFree(dirlist_t self)
+{ size_t i;
+  if(!self) return;
+  for(i=0;i<self->n;++i)
+    free(self->names[i]);
+  if(self->names) free(self->names);
+  if(self->path)  free(self->path);
+  free(self);
+}
+
+/** Adds the entry \a name to the listing. */
+unsigned DirListAdd(dirlist_t self, const char *name)
+{ TRY(self);
+  if(self->n>=self->cap)
+  { size_t cap=(size_t)(1.2*self->cap+16);
+    char **names;
+    TRY(names=(char**)realloc(self->names,sizeof(*names)*cap));
+    self->names=names;
+    self->cap=cap;
+  }
+  TRY(self->names[self->n]=copy(name));
+  ++self->n;
+  return 1;
+Error:
+  return 0;
+}
+
+const char* DirListPath (dirlist_t self)           {return self?self->path:0;}
+size_t      DirListCount(dirlist_t self)           {return self?self->n:0;}
+const char* DirListName (dirlist_t self, size_t i) {return (self&&i<self->n)?self->names[i]:0;}
+
+/**
+ * Finds the first entry whose last extension is \a ext.  \a ext should
+ * include the leading dot, e.g. ".microscope".
+ * \returns 0 if there is no such entry, otherwise the entry's name.
+ */
+const char* DirListFindExtension(dirlist_t self, const char *ext)
+{ size_t i;
+  const char *r;
+  if(!self) return 0;
+  for(i=0;i<self->n;++i)
+    if((r=strrchr(self->names[i],'.')) && strcmp(r,ext)==0)
+      return self->names[i];
+  return 0;
+}
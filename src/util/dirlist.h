@@ -0,0 +1,30 @@
+/**
+ * \file
+ * Short-lived directory listings.
+ *
+ * The core lists each tile directory while crawling.  It passes that listing
+ * along when the tile's metadata is opened, so metadata formats can look up
+ * files without listing the directory again.
+ */
+#pragma once
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct _dirlist_t* dirlist_t;
+
+dirlist_t   DirListNew          (const char *path);
+dirlist_t   DirListRead         (const char *path);
+void        DirListFree         (dirlist_t self);
+unsigned    DirListAdd          (dirlist_t self, const char *name);
+
+const char* DirListPath         (dirlist_t self);
+size_t      DirListCount        (dirlist_t self);
+const char* DirListName         (dirlist_t self, size_t i);
+const char* DirListFindExtension(dirlist_t self, const char *ext);
+
+#ifdef __cplusplus
+} //extern "C"
+#endif
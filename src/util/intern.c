@@ -0,0 +1,148 @@
+/**
+ * \file
+ * Content-keyed cache of shared, reference counted objects.
+ *
+ * Entries are kept in a short linked list.  The expected number of distinct
+ * keys is small (one per acquisition), so lookups are dominated by the hash
+ * of the key rather than the search.
+ */
+#include "intern.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+/// @cond DEFINES
+#define ENDL              "\n"
+#define LOG(...)          fprintf(stderr,__VA_ARGS__)
+#define TRY(e)            do{if(!(e)) { LOG("%s(%d): %s()"ENDL "\tExpression evaluated as false."ENDL "\t%s"ENDL,__FILE__,__LINE__,__FUNCTION__,#e); goto Error;}} while(0)
+#define NEW(type,e,nelem) TRY((e)=(type*)malloc(sizeof(type)*(nelem)))
+/// @endcond
+
+struct _intern_entry_t
+{ uint64_t        hash;
+  size_t          nbytes;
+  void           *bytes;  ///< copy of the key
+  void           *obj;
+  unsigned        refs;
+  intern_entry_t *next;
+};
+
+/** 64-bit FNV-1a hash of \a bytes. */
+uint64_t HashFNV1a(const void *bytes, size_t nbytes)
+{ const uint8_t *b=(const uint8_t*)bytes;
+  uint64_t h=14695981039346656037ULL;
+  size_t i;
+  for(i=0;i<nbytes;++i)
+  { h^=b[i];
+    h*=1099511628211ULL;
+  }
+  return h;
+}
+
+static intern_entry_t* find_by_key(intern_t *self, uint64_t hash, const void *bytes, size_t nbytes)
+{ intern_entry_t *e;
+  for(e=self->head;e;e=e->next)
+    if(e->hash==hash && e->nbytes==nbytes && 0==memcmp(e->bytes,bytes,nbytes))
+      return e;
+  return 0;
+}
+
+/**
+ * Looks up the object made from \a bytes.
+ * \returns 0 if there is none, otherwise the object.  The caller holds a
+ *          reference and must call InternRelease() when done with it.
+ */
+void* InternAcquire(intern_t *self, const void *bytes, size_t nbytes)
+{ intern_entry_t *e;
+  uint64_t h=HashFNV1a(bytes,nbytes);
+  void *obj=0;
+  MutexLock(&self->lock);
+  if((e=find_by_key(self,h,bytes,nbytes)))
+  { ++e->refs;
+    obj=e->obj;
+  }
+  MutexUnlock(&self->lock);
+  return obj;
+}
+
+/**
+ * Adds \a obj, made from \a bytes, to the table.
+ *
+ * If another thread added an object for the same bytes first, \a obj is
+ * released and the existing object is returned instead.
+ *
+ * \returns the shared object.  The caller holds a reference and must call
+ *          InternRelease() when done with it.  If the entry couldn't be
+ *          allocated, \a obj is returned unshared; InternRelease() still
+ *          frees it correctly.
+ */
+void* InternInsert(intern_t *self, const void *bytes, size_t nbytes, void *obj)
+{ intern_entry_t *e=0,*existing;
+  uint64_t h=HashFNV1a(bytes,nbytes);
+  NEW(intern_entry_t,e,1);
+  e->bytes=0;
+  NEW(uint8_t,e->bytes,nbytes?nbytes:1);
+  memcpy(e->bytes,bytes,nbytes);
+  e->hash=h;
+  e->nbytes=nbytes;
+  e->obj=obj;
+  e->refs=1;
+  MutexLock(&self->lock);
+  if((existing=find_by_key(self,h,bytes,nbytes)))
+  { ++existing->refs;
+    MutexUnlock(&self->lock);
+    self->release(obj);
+    free(e->bytes);
+    free(e);
+    return existing->obj;
+  }
+  e->next=self->head;
+  self->head=e;
+  MutexUnlock(&self->lock);
+  return obj;
+Error:
+  if(e)
+  { if(e->bytes) free(e->bytes);
+    free(e);
+  }
+  return obj;
+}
+
+/**
+ * Drops a reference to \a obj.  The object is released once no references
+ * remain.  Objects that aren't in the table are released immediately.
+ */
+void InternRelease(intern_t *self, void *obj)
+{ intern_entry_t **p,*e,*dead=0;
+  int shared=0;
+  if(!obj) return;
+  MutexLock(&self->lock);
+  for(p=&self->head;(e=*p);p=&e->next)
+    if(e->obj==obj)
+    { shared=1;
+      if(--e->refs==0)
+      { *p=e->next;
+        dead=e;
+      }
+      break;
+    }
+  MutexUnlock(&self->lock);
+  if(!shared)
+    self->release(obj);
+  else if(dead)
+  { self->release(dead->obj);
+    free(dead->bytes);
+    free(dead);
+  }
+}
+
+/** \returns the number of distinct objects in the table. */
+size_t InternCount(intern_t *self)
+{ intern_entry_t *e;
+  size_t n=0;
+  MutexLock(&self->lock);
+  for(e=self->head;e;e=e->next)
+    ++n;
+  MutexUnlock(&self->lock);
+  return n;
+}
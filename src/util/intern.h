@@ -0,0 +1,41 @@
+/**
+ * \file
+ * Content-keyed cache of shared, reference counted objects.
+ *
+ * Used to share objects parsed from byte-identical files, for example the
+ * microscope descriptors carried by every tile of an acquisition.
+ */
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include "thread.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct _intern_entry_t intern_entry_t;
+
+/**
+ * A table of objects keyed by the bytes they were made from.
+ * May be statically initialized with INTERN_INIT().  Safe to use from many
+ * threads at once.
+ */
+typedef struct _intern_t
+{ tbmutex_t       lock;
+  intern_entry_t *head;
+  void          (*release)(void *obj); ///< Called to free an object once it is no longer referenced.
+} intern_t;
+
+#define INTERN_INIT(release) {TBMUTEX_INIT,0,(release)}
+
+uint64_t HashFNV1a     (const void *bytes, size_t nbytes);
+
+void*    InternAcquire (intern_t *self, const void *bytes, size_t nbytes);
+void*    InternInsert  (intern_t *self, const void *bytes, size_t nbytes, void *obj);
+void     InternRelease (intern_t *self, void *obj);
+size_t   InternCount   (intern_t *self);
+
+#ifdef __cplusplus
+} //extern "C"
+#endif
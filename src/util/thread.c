@@ -0,0 +1,116 @@
+/**
+ * \file
+ * Minimal portable threading primitives.
+ */
+#include "thread.h"
+#include <stdlib.h>
+#include <stdio.h>
+
+/// @cond DEFINES
+#define ENDL              "\n"
+#define LOG(...)          fprintf(stderr,__VA_ARGS__)
+#define TRY(e)            do{if(!(e)) { LOG("%s(%d): %s()"ENDL "\tExpression evaluated as false."ENDL "\t%s"ENDL,__FILE__,__LINE__,__FUNCTION__,#e); goto Error;}} while(0)
+#define NEW(type,e,nelem) TRY((e)=(type*)malloc(sizeof(type)*(nelem)))
+/// @endcond
+
+#ifdef _MSC_VER
+
+void MutexInit  (tbmutex_t *self) {InitializeSRWLock(self);}
+void MutexFree  (tbmutex_t *self) {}
+void MutexLock  (tbmutex_t *self) {AcquireSRWLockExclusive(self);}
+void MutexUnlock(tbmutex_t *self) {ReleaseSRWLockExclusive(self);}
+
+void CondInit     (tbcond_t *self)                 {InitializeConditionVariable(self);}
+void CondFree     (tbcond_t *self)                 {}
+void CondWait     (tbcond_t *self, tbmutex_t *lock){SleepConditionVariableSRW(self,lock,INFINITE,0);}
+void CondSignal   (tbcond_t *self)                 {WakeConditionVariable(self);}
+void CondBroadcast(tbcond_t *self)                 {WakeAllConditionVariable(self);}
+
+/// Windows threads return a DWORD, so the entry point and result are carried here.
+struct _tbthread_t
+{ HANDLE h;
+  tbthread_func_t f;
+  void *arg,*result;
+};
+static DWORD WINAPI trampoline(LPVOID p)
+{ tbthread_t t=(tbthread_t)p;
+  t->result=t->f(t->arg);
+  return 0;
+}
+
+unsigned ThreadCreate(tbthread_t *self, tbthread_func_t f, void *arg)
+{ tbthread_t t=0;
+  NEW(struct _tbthread_t,t,1);
+  t->f=f;
+  t->arg=arg;
+  t->result=0;
+  TRY(t->h=CreateThread(NULL,0,trampoline,t,0,NULL));
+  *self=t;
+  return 1;
+Error:
+  if(t) free(t);
+  return 0;
+}
+
+void* ThreadJoin(tbthread_t *self)
+{ void *result;
+  WaitForSingleObject((*self)->h,INFINITE);
+  CloseHandle((*self)->h);
+  result=(*self)->result;
+  free(*self);
+  *self=0;
+  return result;
+}
+
+unsigned ThreadCount(void)
+{ SYSTEM_INFO info;
+  GetSystemInfo(&info);
+  return info.dwNumberOfProcessors>0?(unsigned)info.dwNumberOfProcessors:1;
+}
+
+static BOOL CALLBACK once_trampoline(PINIT_ONCE once, PVOID f, PVOID *ctx)
+{ ((void(*)(void))f)();
+  return TRUE;
+}
+void Once(tbonce_t *self, void (*f)(void))
+{ InitOnceExecuteOnce(self,once_trampoline,(PVOID)f,NULL);
+}
+
+#else // POSIX
+
+#include <unistd.h>
+
+void MutexInit  (tbmutex_t *self) {pthread_mutex_init(self,NULL);}
+void MutexFree  (tbmutex_t *self) {pthread_mutex_destroy(self);}
+void MutexLock  (tbmutex_t *self) {pthread_mutex_lock(self);}
+void MutexUnlock(tbmutex_t *self) {pthread_mutex_unlock(self);}
+
+void CondInit     (tbcond_t *self)                 {pthread_cond_init(self,NULL);}
+void CondFree     (tbcond_t *self)                 {pthread_cond_destroy(self);}
+void CondWait     (tbcond_t *self, tbmutex_t *lock){pthread_cond_wait(self,lock);}
+void CondSignal   (tbcond_t *self)                 {pthread_cond_signal(self);}
+void CondBroadcast(tbcond_t *self)                 {pthread_cond_broadcast(self);}
+
+unsigned ThreadCreate(tbthread_t *self, tbthread_func_t f, void *arg)
+{ TRY(0==pthread_create(self,NULL,f,arg));
+  return 1;
+Error:
+  return 0;
+}
+
+void* ThreadJoin(tbthread_t *self)
+{ void *result=0;
+  pthread_join(*self,&result);
+  return result;
+}
+
+unsigned ThreadCount(void)
+{ long n=sysconf(_SC_NPROCESSORS_ONLN);
+  return n>0?(unsigned)n:1;
+}
+
+void Once(tbonce_t *self, void (*f)(void))
+{ pthread_once(self,f);
+}
+
+#endif
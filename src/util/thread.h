@@ -0,0 +1,54 @@
+/**
+ * \file
+ * Minimal portable threading primitives.
+ *
+ * Wraps pthreads on posix systems and the native (Vista and later) primitives
+ * on Windows.
+ */
+#pragma once
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifdef _MSC_VER
+#include <windows.h>
+typedef SRWLOCK            tbmutex_t;
+typedef CONDITION_VARIABLE tbcond_t;
+typedef INIT_ONCE          tbonce_t;
+typedef struct _tbthread_t* tbthread_t; ///< Carries the handle and the entry point's result.
+#define TBMUTEX_INIT       SRWLOCK_INIT
+#define TBONCE_INIT        INIT_ONCE_STATIC_INIT
+#define TB_THREAD_LOCAL    __declspec(thread)
+#else
+#include <pthread.h>
+typedef pthread_mutex_t    tbmutex_t;
+typedef pthread_cond_t     tbcond_t;
+typedef pthread_once_t     tbonce_t;
+typedef pthread_t          tbthread_t;
+#define TBMUTEX_INIT       PTHREAD_MUTEX_INITIALIZER
+#define TBONCE_INIT        PTHREAD_ONCE_INIT
+#define TB_THREAD_LOCAL    __thread
+#endif
+
+typedef void* (*tbthread_func_t)(void *arg); ///< Thread entry point.
+
+void     MutexInit    (tbmutex_t *self);
+void     MutexFree    (tbmutex_t *self);
+void     MutexLock    (tbmutex_t *self);
+void     MutexUnlock  (tbmutex_t *self);
+
+void     CondInit     (tbcond_t *self);
+void     CondFree     (tbcond_t *self);
+void     CondWait     (tbcond_t *self, tbmutex_t *lock);
+void     CondSignal   (tbcond_t *self);
+void     CondBroadcast(tbcond_t *self);
+
+unsigned ThreadCreate (tbthread_t *self, tbthread_func_t f, void *arg);
+void*    ThreadJoin   (tbthread_t *self);
+unsigned ThreadCount  (void);
+
+void     Once         (tbonce_t *self, void (*f)(void));
+
+#ifdef __cplusplus
+} //extern "C"
+#endif
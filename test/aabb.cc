@@ -87,4 +87,75 @@ TEST_F(AABB,Hit)
     EXPECT_FALSE(AABBHit(a,c));
   }
 }
-///@endcond
\ No newline at end of file
+TEST_F(AABB,Pack)
+{ aabb3_t p;
+  aabb_t e=0;
+  EXPECT_TRUE(AABB3FromAABB(&p,a));
+  EXPECT_TRUE(e=AABB3ToAABB(0,&p));
+  EXPECT_TRUE(AABBSame(a,e));
+  EXPECT_FALSE(AABB3FromAABB(&p,0));
+  EXPECT_TRUE(AABB3IsEmpty(&p));
+  AABBFree(e);
+}
+
+TEST_F(AABB,Hit3)
+{ aabb3_t pa,pc;
+  EXPECT_TRUE(AABB3FromAABB(&pa,a));
+  EXPECT_TRUE(AABB3FromAABB(&pc,c));
+  EXPECT_TRUE(AABB3Hit(&pa,&pc));
+  EXPECT_TRUE(AABB3Hit(&pc,&pa));
+  { int64_t o[]={38,81,56};
+    EXPECT_EQ(a,AABBSet(a,countof(o),o,0));
+    EXPECT_TRUE(AABB3FromAABB(&pa,a));
+    EXPECT_FALSE(AABB3Hit(&pa,&pc));
+  }
+  { aabb3_t e=AABB3Empty();
+    EXPECT_FALSE(AABB3Hit(&e,&pc));
+  }
+}
+
+TEST_F(AABB,HitMany)
+{ aabb3_t boxes[3],q;
+  unsigned char hit[3];
+  int64_t o[]={38,81,56};
+  EXPECT_TRUE(AABB3FromAABB(boxes+0,a));
+  EXPECT_TRUE(AABB3FromAABB(boxes+1,c));
+  EXPECT_EQ(a,AABBSet(a,countof(o),o,0));
+  EXPECT_TRUE(AABB3FromAABB(boxes+2,a));
+  EXPECT_TRUE(AABB3FromAABB(&q,c));
+  EXPECT_EQ(2,AABBHitMany(hit,boxes,countof(boxes),&q));
+  EXPECT_EQ(1,hit[0]);
+  EXPECT_EQ(1,hit[1]);
+  EXPECT_EQ(0,hit[2]);
+  EXPECT_EQ(2,AABBHitMany(0,boxes,countof(boxes),&q));
+}
+
+TEST_F(AABB,UnionReduce)
+{ aabb3_t boxes[2],u;
+  aabb_t e;
+  EXPECT_TRUE(AABB3FromAABB(boxes+0,a));
+  EXPECT_TRUE(AABB3FromAABB(boxes+1,c));
+  EXPECT_EQ(&u,AABBUnionReduce(&u,boxes,countof(boxes)));
+  EXPECT_EQ(a,AABBUnionIP(a,c));
+  EXPECT_TRUE(e=AABB3ToAABB(0,&u));
+  EXPECT_TRUE(AABBSame(a,e));
+  AABBFree(e);
+  EXPECT_EQ(&u,AABBUnionReduce(&u,boxes,0));
+  EXPECT_TRUE(AABB3IsEmpty(&u));
+}
+
+TEST_F(AABB,IntersectMany)
+{ aabb3_t boxes[2],q,out[2];
+  aabb_t e;
+  EXPECT_TRUE(AABB3FromAABB(boxes+0,a));
+  EXPECT_TRUE(AABB3FromAABB(boxes+1,c));
+  EXPECT_TRUE(AABB3FromAABB(&q,c));
+  EXPECT_EQ(out,AABBIntersectMany(out,boxes,countof(boxes),&q));
+  EXPECT_EQ(a,AABBIntersectIP(a,c));
+  EXPECT_TRUE(e=AABB3ToAABB(0,out+0));
+  EXPECT_TRUE(AABBSame(a,e));
+  EXPECT_TRUE(AABB3ToAABB(e,out+1));
+  EXPECT_TRUE(AABBSame(c,e));
+  AABBFree(e);
+}
+///@endcond
@@ -0,0 +1,77 @@
+/**
+ * \file
+ * Benchmarks: Opening a generated tilebase
+ *
+ * Times crawling a synthetic lattice, opening it again from the cache, and
+ * packing the bounding boxes.  Registered with ctest under the \c bench
+ * label; run it with <tt>ctest -L bench</tt>.
+ * @cond TESTS
+ */
+
+// solves a std::tuple problem in vs2012
+#define GTEST_HAS_TR1_TUPLE     0
+#define GTEST_USE_OWN_TR1_TUPLE 1
+
+#include <gtest/gtest.h>
+#include "tilebase.h"
+#include "src/synthetic.h"
+#include "config.h"
+#include "nd.h"
+#include <chrono>
+#include <stdio.h>
+#include <string.h>
+
+#define BENCH_PATH TILEBASE_TEST_OUTPUT_PATH "/bench-lattice"
+
+typedef std::chrono::steady_clock bench_clock;
+
+static double seconds_since(bench_clock::time_point t0)
+{ return std::chrono::duration<double>(bench_clock::now()-t0).count();
+}
+
+struct SyntheticBench:public testing::Test
+{ synthetic_lattice_t lattice;
+  size_t ntiles;
+  void SetUp()
+  { ndioAddPluginPath(ND_ROOT_DIR"/bin/plugins");
+    memset(&lattice,0,sizeof(lattice));
+    lattice.count[0]=16;
+    lattice.count[1]=16;
+    lattice.count[2]=8;
+    lattice.overlap=0.1;
+    lattice.tile.dims[0]=lattice.tile.dims[1]=1024;
+    lattice.tile.dims[2]=100;
+    lattice.tile.voxel[0]=lattice.tile.voxel[1]=200.0;
+    lattice.tile.voxel[2]=1000.0;
+    lattice.tile.type=nd_u16;
+    ntiles=lattice.count[0]*lattice.count[1]*lattice.count[2];
+    ASSERT_EQ(ntiles,SyntheticLatticeMake(BENCH_PATH,&lattice,NULL,NULL)); // also removes the cache
+  }
+
+  void report(const char *what, double s)
+  { printf("%-24s %8.3f s  %8.1f us/tile\n",what,s,1e6*s/ntiles);
+    RecordProperty(what,(int)(1e6*s));
+  }
+};
+
+TEST_F(SyntheticBench,OpenCrawlThenCache)
+{ tiles_t tiles;
+  bench_clock::time_point t0;
+
+  t0=bench_clock::now();
+  ASSERT_NE((void*)NULL,tiles=TileBaseOpen(BENCH_PATH,NULL)); // detects the format
+  report("crawl",seconds_since(t0));
+  EXPECT_EQ(ntiles,TileBaseCount(tiles));
+  TileBaseClose(tiles);
+
+  t0=bench_clock::now();
+  ASSERT_NE((void*)NULL,tiles=TileBaseOpen(BENCH_PATH,NULL)); // reads the cache
+  report("cache",seconds_since(t0));
+  EXPECT_EQ(ntiles,TileBaseCount(tiles));
+
+  t0=bench_clock::now();
+  EXPECT_NE((void*)NULL,TileBaseBoxes(tiles));
+  report("boxes",seconds_since(t0));
+  TileBaseClose(tiles);
+}
+///@endcond
@@ -45,4 +45,32 @@ TEST_F(TileBase,Bounds)
   EXPECT_TRUE(out=TileBaseAABB(tiles));
   AABBFree(out);
 }
+
+TEST_F(TileBase,Footprint)
+{ for(size_t i=0;i<TileBaseCount(tiles);++i)
+  { tile_t t=TileBaseArray(tiles)[i];
+    aabb3_t box;
+    EXPECT_TRUE(TileFootprint(t));
+    EXPECT_TRUE(AABB3FromAABB(&box,TileAABB(t)));
+    EXPECT_TRUE(TileFootprintHit(t,&box));
+  }
+  { aabb3_t box;
+    aabb_t bounds;
+    EXPECT_TRUE(bounds=TileBaseAABB(tiles));
+    EXPECT_TRUE(AABB3FromAABB(&box,bounds));
+    EXPECT_EQ(TileBaseCount(tiles),TileBaseHitMany(tiles,0,&box));
+    AABBFree(bounds);
+  }
+}
+
+TEST_F(TileBase,Sorted)
+{ tile_t *ts=TileBaseArray(tiles);
+  EXPECT_EQ(SFC_ORDER_MORTON,TileBaseOrder(tiles));
+  for(size_t i=1;i<TileBaseCount(tiles);++i)
+    EXPECT_LE(TileSpatialKey(ts[i-1]),TileSpatialKey(ts[i]));
+  EXPECT_TRUE(TileBaseSort(tiles,SFC_ORDER_HILBERT));
+  EXPECT_EQ(SFC_ORDER_HILBERT,TileBaseOrder(tiles));
+  for(size_t i=1;i<TileBaseCount(tiles);++i)
+    EXPECT_LE(TileSpatialKey(ts[i-1]),TileSpatialKey(ts[i]));
+}
 ///@endcond
\ No newline at end of file
@@ -0,0 +1,27 @@
+/**
+ * \file
+ * Tests: Shared directory listings
+ * @cond TESTS
+ */
+
+// solves a std::tuple problem in vs2012
+#define GTEST_HAS_TR1_TUPLE     0
+#define GTEST_USE_OWN_TR1_TUPLE 1
+
+#include <gtest/gtest.h>
+#include "src/util/dirlist.h"
+
+TEST(DirList,FindExtension)
+{ dirlist_t list;
+  ASSERT_TRUE(list=DirListNew("/data/00001"));
+  EXPECT_TRUE(DirListAdd(list,"."));
+  EXPECT_TRUE(DirListAdd(list,"default.microscope.pb"));
+  EXPECT_TRUE(DirListAdd(list,"default.microscope"));
+  EXPECT_TRUE(DirListAdd(list,"00001-ngc.0.tif"));
+  EXPECT_EQ(4,DirListCount(list));
+  EXPECT_STREQ("default.microscope",DirListFindExtension(list,".microscope"));
+  EXPECT_STREQ("default.microscope.pb",DirListFindExtension(list,".pb"));
+  EXPECT_EQ((void*)NULL,(void*)DirListFindExtension(list,".acquisition"));
+  DirListFree(list);
+}
+///@endcond
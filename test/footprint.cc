@@ -0,0 +1,65 @@
+/**
+ * \file
+ * Tests for tile footprints.
+ * @cond TESTS
+ */
+
+// solves a std::tuple problem in vs2012
+#define GTEST_HAS_TR1_TUPLE     0
+#define GTEST_USE_OWN_TR1_TUPLE 1
+
+#include <gtest/gtest.h>
+#include <math.h>
+#include "tilebase.h"
+
+class Footprint:public ::testing::Test
+{ public:
+  footprint_t rotated; // 100x100x10 voxels of size 1, rotated 45 degrees about z around (0,0,0)
+  void SetUp()
+  { const float c=(float)cos(atan(1.0)),
+                s=(float)sin(atan(1.0));
+    const float T[]={ c,-s, 0, 0,
+                      s, c, 0, 0,
+                      0, 0, 1, 0,
+                      0, 0, 0, 1};
+    const size_t shape[]={100,100,10};
+    EXPECT_TRUE(FootprintMake(&rotated,T,3,shape));
+  }
+};
+
+TEST_F(Footprint,Bounds)
+{ // x spans [-100/sqrt(2),100/sqrt(2)], y spans [0,200/sqrt(2)]
+  EXPECT_EQ(-71,rotated.bounds.lo[0]);
+  EXPECT_EQ( 71,rotated.bounds.hi[0]);
+  EXPECT_EQ(  0,rotated.bounds.lo[1]);
+  EXPECT_EQ(142,rotated.bounds.hi[1]);
+  EXPECT_EQ(  0,rotated.bounds.lo[2]);
+  EXPECT_EQ( 10,rotated.bounds.hi[2]);
+}
+
+TEST_F(Footprint,RejectsCornersOfBounds)
+{ int64_t o[]={50,0,0},s[]={20,20,10};
+  aabb3_t box=AABB3Make(o,s);
+  EXPECT_TRUE(AABB3Hit(&rotated.bounds,&box));
+  EXPECT_FALSE(FootprintHit(&rotated,&box));
+}
+
+TEST_F(Footprint,HitsInterior)
+{ int64_t o[]={-5,60,2},s[]={10,10,2};
+  aabb3_t box=AABB3Make(o,s);
+  EXPECT_TRUE(FootprintHit(&rotated,&box));
+}
+
+TEST(FootprintAABB,MatchesAABBHit)
+{ int64_t oa[]={10,20,30},sa[]={100,200,300},
+          ob[]={110,20,30},sb[]={10,10,10},  // shares a face with a
+          oc[]={109,219,329},sc[]={10,10,10};// overlaps a corner of a
+  aabb3_t a=AABB3Make(oa,sa),b=AABB3Make(ob,sb),c=AABB3Make(oc,sc);
+  footprint_t fa;
+  EXPECT_TRUE(FootprintFromAABB(&fa,&a));
+  EXPECT_EQ(AABB3Hit(&a,&b),FootprintHit(&fa,&b));
+  EXPECT_EQ(AABB3Hit(&a,&c),FootprintHit(&fa,&c));
+  EXPECT_TRUE(FootprintHit(&fa,&a));
+}
+
+///@endcond
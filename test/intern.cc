@@ -0,0 +1,59 @@
+/**
+ * \file
+ * Tests: Content-keyed sharing of parsed objects
+ * @cond TESTS
+ */
+
+// solves a std::tuple problem in vs2012
+#define GTEST_HAS_TR1_TUPLE     0
+#define GTEST_USE_OWN_TR1_TUPLE 1
+
+#include <gtest/gtest.h>
+#include "src/util/intern.h"
+#include <string.h>
+
+static int g_released=0;
+static void release(void *obj) { ++g_released; delete (int*)obj; }
+
+TEST(Intern,FNV1a)
+{ EXPECT_EQ(14695981039346656037ULL,HashFNV1a("",0));
+  EXPECT_EQ(0xaf63dc4c8601ec8cULL,HashFNV1a("a",1));
+  EXPECT_NE(HashFNV1a("ab",2),HashFNV1a("ba",2));
+}
+
+TEST(Intern,SharesByContent)
+{ intern_t table=INTERN_INIT(release);
+  const char a[]="scope a",b[]="scope b";
+  int *x,*y,*z;
+  g_released=0;
+  EXPECT_EQ((void*)NULL,InternAcquire(&table,a,sizeof(a)));
+  x=(int*)InternInsert(&table,a,sizeof(a),new int(1));
+  EXPECT_EQ(x,InternAcquire(&table,a,sizeof(a)));
+  y=(int*)InternInsert(&table,b,sizeof(b),new int(2));
+  EXPECT_NE(x,y);
+  EXPECT_EQ(2,InternCount(&table));
+  // a second insert for the same content keeps the first object
+  z=(int*)InternInsert(&table,a,sizeof(a),new int(3));
+  EXPECT_EQ(x,z);
+  EXPECT_EQ(1,g_released);
+  // three references to x are outstanding
+  InternRelease(&table,x);
+  InternRelease(&table,x);
+  EXPECT_EQ(2,InternCount(&table));
+  InternRelease(&table,x);
+  EXPECT_EQ(1,InternCount(&table));
+  EXPECT_EQ(2,g_released);
+  InternRelease(&table,y);
+  EXPECT_EQ(0,InternCount(&table));
+  EXPECT_EQ(3,g_released);
+}
+
+TEST(Intern,ReleaseUnshared)
+{ intern_t table=INTERN_INIT(release);
+  g_released=0;
+  InternRelease(&table,new int(0));
+  EXPECT_EQ(1,g_released);
+  InternRelease(&table,NULL);
+  EXPECT_EQ(1,g_released);
+}
+///@endcond
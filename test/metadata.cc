@@ -0,0 +1,240 @@
+/**
+ * \file
+ * Tests: Metadata interface
+ * @cond TESTS
+ */
+
+// solves a std::tuple problem in vs2012
+#define GTEST_HAS_TR1_TUPLE     0
+#define GTEST_USE_OWN_TR1_TUPLE 1
+
+#include <gtest/gtest.h>
+#include "tilebase.h"
+#include "src/metadata/metadata.h"
+#include "src/metadata/plugin.h"
+#include "src/util/thread.h"
+#include "config.h"
+#include "nd.h"
+#include <string.h>
+#include <sys/stat.h>
+#ifdef _MSC_VER
+#include <direct.h>
+#define mkdir(p,m) _mkdir(p)
+#define rmdir      _rmdir
+#else
+#include <unistd.h>
+#endif
+
+#define NTHREADS 16
+#define NREPEATS 8
+
+struct Metadata:public testing::Test
+{ tiles_t tiles;
+  Metadata() : tiles(0) {}
+  void SetUp()
+  { ndioAddPluginPath(ND_ROOT_DIR"/bin/plugins");
+    ndioPreloadPlugins();
+    EXPECT_TRUE(tiles=TileBaseOpen(TILEBASE_TEST_DATA_PATH,NULL));
+  }
+  void TearDown(void)
+  { TileBaseClose(tiles);
+  }
+};
+
+struct job_t
+{ const char *path;
+  float      *expected;
+  size_t      n;
+  int         ok;
+};
+
+static void* open_many(void *arg)
+{ job_t *job=(job_t*)arg;
+  float *transform=(float*)malloc(sizeof(float)*job->n);
+  job->ok=transform!=0;
+  for(int i=0;job->ok && i<NREPEATS;++i)
+  { metadata_t meta=MetadataOpen(job->path,NULL,"r");
+    job->ok=meta
+         && MetadataGetTransform(meta,transform)
+         && 0==memcmp(transform,job->expected,sizeof(float)*job->n);
+    MetadataClose(meta);
+  }
+  free(transform);
+  return 0;
+}
+
+TEST_F(Metadata,ConcurrentOpen)
+{ tile_t t;
+  size_t n;
+  float *expected;
+  tbthread_t threads[NTHREADS];
+  job_t jobs[NTHREADS];
+  ASSERT_TRUE(TileBaseCount(tiles)>0);
+  t=TileBaseArray(tiles)[0];
+  ASSERT_TRUE(TileShape(t));
+  n=(ndndim(TileShape(t))+1)*(ndndim(TileShape(t))+1);
+  ASSERT_TRUE(expected=TileTransform(t));
+  for(int i=0;i<NTHREADS;++i)
+  { jobs[i].path=TilePath(t);
+    jobs[i].expected=expected;
+    jobs[i].n=n;
+    jobs[i].ok=0;
+    ASSERT_TRUE(ThreadCreate(threads+i,open_many,jobs+i));
+  }
+  for(int i=0;i<NTHREADS;++i)
+  { ThreadJoin(threads+i);
+    EXPECT_TRUE(jobs[i].ok)<<"Thread "<<i;
+  }
+}
+
+TEST_F(Metadata,DescribeMatchesIndividualCalls)
+{ metadata_t meta;
+  metadata_description_t desc;
+  size_t ndim;
+  int64_t ori[METADATA_MAX_NDIM],shape[METADATA_MAX_NDIM];
+  ASSERT_TRUE(TileBaseCount(tiles)>0);
+  ASSERT_TRUE(meta=MetadataOpen(TilePath(TileBaseArray(tiles)[0]),NULL,"r"));
+  if(MetadataDescribe(meta,&desc)) // optional, so only check formats that support it
+  { unsigned n=ndndim(desc.vol);
+    float *transform=(float*)malloc(sizeof(float)*(n+1)*(n+1));
+    ndio_t file;
+    nd_t vol;
+    EXPECT_TRUE(MetadataGetTransform(meta,transform));
+    for(unsigned i=0;i<(n+1)*(n+1);++i)
+      EXPECT_FLOAT_EQ(transform[i],desc.transform[i])<<"Element "<<i;
+    EXPECT_TRUE(file=MetadataOpenVolume(meta,"r"));
+    EXPECT_TRUE(vol=ndioShape(file));
+    EXPECT_EQ(ndndim(vol),n);
+    for(unsigned i=0;i<n;++i)
+      EXPECT_EQ(ndshape(vol)[i],ndshape(desc.vol)[i]);
+    EXPECT_EQ(ndtype(vol),ndtype(desc.vol));
+    ASSERT_TRUE(MetadataGetOrigin(meta,&ndim,ori));
+    ASSERT_TRUE(MetadataGetShape(meta,&ndim,shape));
+    EXPECT_EQ(ndim,desc.ndim);
+    for(size_t i=0;i<ndim;++i)
+    { EXPECT_EQ(ori[i],desc.origin[i]);
+      EXPECT_EQ(shape[i],desc.shape[i]);
+    }
+    ndfree(vol);
+    ndioClose(file);
+    free(transform);
+    ndfree(desc.vol);
+  }
+  MetadataClose(meta);
+}
+
+static int g_count=0;
+static void count() {++g_count;}
+static tbonce_t g_once=TBONCE_INIT;
+
+static void* call_once(void*)
+{ Once(&g_once,count);
+  return 0;
+}
+
+TEST(Thread,Once)
+{ tbthread_t threads[NTHREADS];
+  for(int i=0;i<NTHREADS;++i)
+    ASSERT_TRUE(ThreadCreate(threads+i,call_once,0));
+  for(int i=0;i<NTHREADS;++i)
+    ThreadJoin(threads+i);
+  EXPECT_EQ(1,g_count);
+}
+
+struct counter_t
+{ tbmutex_t lock;
+  int       n;
+};
+
+static void* increment(void *arg)
+{ counter_t *c=(counter_t*)arg;
+  for(int i=0;i<10000;++i)
+  { MutexLock(&c->lock);
+    ++c->n;
+    MutexUnlock(&c->lock);
+  }
+  return 0;
+}
+
+TEST(Thread,Mutex)
+{ tbthread_t threads[NTHREADS];
+  counter_t c;
+  MutexInit(&c.lock);
+  c.n=0;
+  for(int i=0;i<NTHREADS;++i)
+    ASSERT_TRUE(ThreadCreate(threads+i,increment,&c));
+  for(int i=0;i<NTHREADS;++i)
+    ThreadJoin(threads+i);
+  EXPECT_EQ(NTHREADS*10000,c.n);
+  MutexFree(&c.lock);
+}
+
+#define MANIFEST_DIR TILEBASE_TEST_OUTPUT_PATH "/manifest-test" // not the build's own plugin directory
+
+struct PluginManifest:public testing::Test
+{ void SetUp()
+  { mkdir(MANIFEST_DIR,0775);
+  }
+  void TearDown()
+  { remove(MANIFEST_DIR "/" METADATA_MANIFEST);
+    rmdir(MANIFEST_DIR);
+  }
+};
+
+TEST_F(PluginManifest,Read)
+{ metadata_manifest_entry_t *e;
+  char *dir=0;
+  size_t n;
+  FILE *fp;
+  ASSERT_NE((void*)NULL,fp=fopen(MANIFEST_DIR "/" METADATA_MANIFEST,"w"));
+  fputs("# comment\n"
+        "fetch.protobuf.v9  libmeta-protobuf-v9.so ext .acquisition\n"
+        "\n"
+        "tilebase.container libmeta-container.so   path tilebase.tiles.h5 list tilebase.tiles.h5\n"
+        "plain              libplain.so\n",fp);
+  fclose(fp);
+  ASSERT_NE((void*)NULL,e=MetadataReadManifest(MANIFEST_DIR,&dir,&n));
+  EXPECT_STREQ(MANIFEST_DIR,dir);
+  ASSERT_EQ(3,n);
+  EXPECT_STREQ("fetch.protobuf.v9",e[0].name);
+  EXPECT_STREQ("libmeta-protobuf-v9.so",e[0].lib);
+  ASSERT_EQ(1,e[0].nhints);
+  EXPECT_EQ(METADATA_HINT_EXT,e[0].hints[0].kind);
+  EXPECT_STREQ(".acquisition",e[0].hints[0].arg);
+  ASSERT_EQ(2,e[1].nhints);
+  EXPECT_EQ(METADATA_HINT_PATH,e[1].hints[0].kind);
+  EXPECT_EQ(METADATA_HINT_LIST,e[1].hints[1].kind);
+  EXPECT_EQ(0,e[2].nhints);
+  free(e);
+  free(dir);
+}
+
+TEST_F(PluginManifest,SkipsUnknownHints)
+{ metadata_manifest_entry_t *e;
+  char *dir=0;
+  size_t n;
+  FILE *fp;
+  ASSERT_NE((void*)NULL,fp=fopen(MANIFEST_DIR "/" METADATA_MANIFEST,"w"));
+  fputs("fetch.protobuf.v9 libmeta-protobuf-v9.so color blue ext .acquisition\n"
+        "plain             libplain.so           color red\n",fp);
+  fclose(fp);
+  ASSERT_NE((void*)NULL,e=MetadataReadManifest(MANIFEST_DIR,&dir,&n));
+  ASSERT_EQ(2,n); // the entries are kept, so their formats can still be used
+  EXPECT_STREQ("fetch.protobuf.v9",e[0].name);
+  ASSERT_EQ(1,e[0].nhints);
+  EXPECT_EQ(METADATA_HINT_EXT,e[0].hints[0].kind);
+  EXPECT_STREQ(".acquisition",e[0].hints[0].arg);
+  EXPECT_STREQ("plain",e[1].name);
+  EXPECT_EQ(0,e[1].nhints);
+  free(e);
+  free(dir);
+}
+
+TEST_F(PluginManifest,Missing)
+{ char *dir=0;
+  size_t n=1;
+  EXPECT_EQ((void*)NULL,MetadataReadManifest(MANIFEST_DIR "/not-a-plugin-dir",&dir,&n));
+  EXPECT_EQ(0,n);
+}
+
+///@endcond
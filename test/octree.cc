@@ -0,0 +1,83 @@
+/**
+ * \file
+ * Tests for octree geometry.
+ * @cond TESTS
+ */
+
+// solves a std::tuple problem in vs2012
+#define GTEST_HAS_TR1_TUPLE     0
+#define GTEST_USE_OWN_TR1_TUPLE 1
+
+#include <gtest/gtest.h>
+#include <string.h>
+#include "tilebase.h"
+
+#define countof(e) (sizeof(e)/sizeof(*e))
+
+class Octree:public ::testing::Test
+{ public:
+  aabb_t   box;
+  octree_t tree;
+
+  Octree() : box(0) {}
+  void SetUp()
+  { int64_t o[] = {-11,20,30},
+            s[] = {1001,207,33};
+    aabb3_t root;
+    EXPECT_TRUE(box=AABBSet(NULL,countof(s),o,s));
+    EXPECT_TRUE(AABB3FromAABB(&root,box));
+    EXPECT_TRUE(OctreeInit(&tree,&root,8));
+  }
+  void TearDown()
+  { AABBFree(box);
+  }
+};
+
+// Walks the tree by recursively subdividing aabb_t's and checks each node
+// against OctreeNode().
+static void check(const octree_t *tree, aabb_t box, unsigned level, uint64_t index, unsigned depth)
+{ aabb3_t expect,actual=OctreeNode(tree,level,index);
+  EXPECT_TRUE(AABB3FromAABB(&expect,box));
+  EXPECT_EQ(0,memcmp(&expect,&actual,sizeof(expect)));
+  if(level<depth)
+  { aabb_t cboxes[8]={0};
+    EXPECT_EQ(box,AABBBinarySubdivision(cboxes,tree->nchildren,box));
+    for(unsigned i=0;i<tree->nchildren;++i)
+    { aabb3_t c=OctreeChild(tree,&actual,i);
+      EXPECT_TRUE(AABB3FromAABB(&expect,cboxes[i]));
+      EXPECT_EQ(0,memcmp(&expect,&c,sizeof(expect)));
+      check(tree,cboxes[i],level+1,OctreeChildIndex(tree,index,i),depth);
+      AABBFree(cboxes[i]);
+    }
+  }
+}
+
+TEST_F(Octree,MatchesBinarySubdivision)
+{ check(&tree,box,0,0,3);
+}
+
+TEST_F(Octree,MatchesQuadSubdivision)
+{ tree.nchildren=4;
+  check(&tree,box,0,0,4);
+}
+
+TEST_F(Octree,Level)
+{ aabb3_t boxes[512],u;
+  EXPECT_EQ(512,OctreeLevelCount(&tree,3));
+  EXPECT_EQ(0,OctreeLevel(&tree,3,boxes,511));
+  EXPECT_EQ(512,OctreeLevel(&tree,3,boxes,countof(boxes)));
+  for(uint64_t i=0;i<countof(boxes);++i)
+  { aabb3_t e=OctreeNode(&tree,3,i);
+    EXPECT_EQ(0,memcmp(&e,boxes+i,sizeof(e)));
+  }
+  // the nodes on a level tile the root
+  AABBUnionReduce(&u,boxes,countof(boxes));
+  EXPECT_EQ(0,memcmp(&u,&tree.root,sizeof(u)));
+  { double v=0;
+    for(size_t i=0;i<countof(boxes);++i)
+      v+=AABB3Volume(boxes+i);
+    EXPECT_EQ(AABB3Volume(&tree.root),v);
+  }
+}
+
+///@endcond
@@ -0,0 +1,66 @@
+/**
+ * \file
+ * Tests for space filling curve keys.
+ * @cond TESTS
+ */
+
+// solves a std::tuple problem in vs2012
+#define GTEST_HAS_TR1_TUPLE     0
+#define GTEST_USE_OWN_TR1_TUPLE 1
+
+#include <gtest/gtest.h>
+#include "tilebase.h"
+
+#define countof(e) (sizeof(e)/sizeof(*e))
+
+TEST(SFC,Morton)
+{ EXPECT_EQ(1,SFCMorton3(1,0,0));
+  EXPECT_EQ(2,SFCMorton3(0,1,0));
+  EXPECT_EQ(4,SFCMorton3(0,0,1));
+  EXPECT_EQ(7*8+7,SFCMorton3(3,3,3));
+  EXPECT_EQ(0x7fffffffffffffffULL,SFCMorton3(0x1fffff,0x1fffff,0x1fffff));
+}
+
+// The first 8^3 positions along the curve fill the corner cube, and
+// consecutive positions are face neighbors.
+TEST(SFC,HilbertIsContinuous)
+{ int pos[512][3];
+  for(int x=0;x<8;++x)
+    for(int y=0;y<8;++y)
+      for(int z=0;z<8;++z)
+      { uint64_t h=SFCHilbert3(x,y,z);
+        ASSERT_LT(h,512);
+        pos[h][0]=x; pos[h][1]=y; pos[h][2]=z;
+      }
+  for(int i=1;i<512;++i)
+    EXPECT_EQ(1,abs(pos[i][0]-pos[i-1][0])
+               +abs(pos[i][1]-pos[i-1][1])
+               +abs(pos[i][2]-pos[i-1][2]));
+}
+
+// Sorting boxes on a lattice by Morton key should match the octree's
+// level order.
+TEST(SFC,MortonMatchesOctree)
+{ int64_t o[]={0,0,0},s[]={800,800,800};
+  aabb3_t root=AABB3Make(o,s),boxes[64];
+  octree_t tree;
+  EXPECT_TRUE(OctreeInit(&tree,&root,8));
+  EXPECT_EQ(countof(boxes),OctreeLevel(&tree,2,boxes,countof(boxes)));
+  for(size_t i=1;i<countof(boxes);++i)
+    EXPECT_LT(SFCKey(SFC_ORDER_MORTON,&root,boxes+i-1),
+              SFCKey(SFC_ORDER_MORTON,&root,boxes+i));
+}
+
+TEST(SFC,EmptySortsLast)
+{ int64_t o[]={0,0,0},s[]={8,8,8};
+  aabb3_t root=AABB3Make(o,s),e=AABB3Empty();
+  EXPECT_LT(SFCKey(SFC_ORDER_HILBERT,&root,&root),SFCKey(SFC_ORDER_HILBERT,&root,&e));
+}
+
+TEST(SFC,Names)
+{ EXPECT_EQ(SFC_ORDER_HILBERT,SFCOrderFromName("hilbert"));
+  EXPECT_EQ(SFC_ORDER_MORTON,SFCOrderFromName(SFCOrderName(SFC_ORDER_MORTON)));
+  EXPECT_EQ(SFC_ORDER_NONE,SFCOrderFromName("bogus"));
+}
+
+///@endcond
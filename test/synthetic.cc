@@ -0,0 +1,160 @@
+/**
+ * \file
+ * Tests: Synthetic tile datasets
+ * @cond TESTS
+ */
+
+// solves a std::tuple problem in vs2012
+#define GTEST_HAS_TR1_TUPLE     0
+#define GTEST_USE_OWN_TR1_TUPLE 1
+
+#include <gtest/gtest.h>
+#include "tilebase.h"
+#include "src/synthetic.h"
+#include "config.h"
+#include "nd.h"
+#include <math.h>
+#include <string.h>
+
+#define LATTICE_PATH TILEBASE_TEST_OUTPUT_PATH "/synthetic-lattice"
+
+struct Synthetic:public testing::Test
+{ synthetic_lattice_t lattice;
+  void SetUp()
+  { ndioAddPluginPath(ND_ROOT_DIR"/bin/plugins");
+    memset(&lattice,0,sizeof(lattice));
+    lattice.count[0]=4;
+    lattice.count[1]=3;
+    lattice.count[2]=2;
+    lattice.overlap=0.1;
+    lattice.tile.dims[0]=lattice.tile.dims[1]=100;
+    lattice.tile.dims[2]=10;
+    lattice.tile.voxel[0]=lattice.tile.voxel[1]=200.0;
+    lattice.tile.voxel[2]=1000.0;
+    lattice.tile.type=nd_u16;
+  }
+};
+
+TEST_F(Synthetic,TypeNames)
+{ EXPECT_EQ(nd_u16,SyntheticTypeFromName("u16"));
+  EXPECT_EQ(nd_f64,SyntheticTypeFromName("f64"));
+  EXPECT_EQ(nd_id_unknown,SyntheticTypeFromName("u12"));
+}
+
+TEST_F(Synthetic,DescriptorRoundTrip)
+{ synthetic_tile_t in=lattice.tile,out;
+  in.origin[0]=-5; in.origin[1]=7; in.origin[2]=1000000000000LL;
+  in.rotation=0.25;
+  in.shear=-0.5;
+  strcpy(in.volume,"volume.tif");
+  ASSERT_EQ(24,SyntheticLatticeMake(LATTICE_PATH,&lattice,NULL,NULL));
+  ASSERT_EQ(1,SyntheticTileWrite(&in,LATTICE_PATH));
+  memset(&out,0,sizeof(out));
+  ASSERT_EQ(1,SyntheticTileRead(&out,LATTICE_PATH));
+  EXPECT_EQ(0,memcmp(in.origin,out.origin,sizeof(in.origin)));
+  EXPECT_EQ(0,memcmp(in.voxel,out.voxel,sizeof(in.voxel)));
+  EXPECT_EQ(0,memcmp(in.dims,out.dims,sizeof(in.dims)));
+  EXPECT_EQ(in.type,out.type);
+  EXPECT_EQ(in.rotation,out.rotation);
+  EXPECT_EQ(in.shear,out.shear);
+  EXPECT_STREQ(in.volume,out.volume);
+  remove(LATTICE_PATH "/" SYNTHETIC_DESCRIPTOR); // so the root isn't a tile
+}
+
+TEST_F(Synthetic,TransformWithoutRotationIsScaleAndOffset)
+{ float T[16];
+  lattice.tile.origin[0]=10;
+  lattice.tile.origin[2]=30;
+  SyntheticTileTransform(&lattice.tile,T);
+  EXPECT_FLOAT_EQ(200.0f,T[0]);
+  EXPECT_FLOAT_EQ(200.0f,T[5]);
+  EXPECT_FLOAT_EQ(1000.0f,T[10]);
+  EXPECT_FLOAT_EQ(10.0f,T[3]);
+  EXPECT_FLOAT_EQ(0.0f,T[7]);
+  EXPECT_FLOAT_EQ(30.0f,T[11]);
+}
+
+TEST_F(Synthetic,RotationKeepsFieldCenter)
+{ float T[16];
+  float cx=50.0f,cy=50.0f; // center of the field in voxels
+  lattice.tile.rotation=0.3;
+  SyntheticTileTransform(&lattice.tile,T);
+  EXPECT_NEAR(10000.0,T[0]*cx+T[1]*cy+T[3],1e-2);
+  EXPECT_NEAR(10000.0,T[4]*cx+T[5]*cy+T[7],1e-2);
+}
+
+TEST_F(Synthetic,BoundsWithoutRotationStartAtOrigin)
+{ int64_t ori[3],shape[3];
+  lattice.tile.origin[0]=-10;
+  lattice.tile.origin[1]=20;
+  lattice.tile.origin[2]=30;
+  SyntheticTileBounds(&lattice.tile,ori,shape);
+  EXPECT_EQ(-10,ori[0]);    EXPECT_EQ(20,ori[1]);    EXPECT_EQ(30,ori[2]);
+  EXPECT_EQ(20000,shape[0]); EXPECT_EQ(20000,shape[1]); EXPECT_EQ(10000,shape[2]);
+}
+
+TEST_F(Synthetic,BoundsHoldTransformedCorners)
+{ float T[16];
+  int64_t ori[3],shape[3];
+  unsigned corner,i;
+  lattice.tile.rotation=0.3;
+  lattice.tile.shear=-2.5;
+  SyntheticTileTransform(&lattice.tile,T);
+  SyntheticTileBounds(&lattice.tile,ori,shape);
+  EXPECT_GT(shape[0],20000); // rotation and shear both widen the box
+  EXPECT_GT(shape[1],20000);
+  for(corner=0;corner<8;++corner)
+  { float r[3];
+    for(i=0;i<3;++i)
+      r[i]=(corner&(1u<<i))?(float)lattice.tile.dims[i]:0.0f;
+    for(i=0;i<3;++i)
+    { const float x=T[4*i]*r[0]+T[4*i+1]*r[1]+T[4*i+2]*r[2]+T[4*i+3];
+      EXPECT_LE(ori[i]-1,x)<<"corner "<<corner<<" dim "<<i;          // -1, +1 for float round-off
+      EXPECT_GE(ori[i]+shape[i]+1,x)<<"corner "<<corner<<" dim "<<i;
+    }
+  }
+}
+
+TEST_F(Synthetic,OpenLattice)
+{ tiles_t tiles;
+  const aabb3_t *boxes;
+  size_t i,n;
+  ASSERT_EQ(24,SyntheticLatticeMake(LATTICE_PATH,&lattice,NULL,NULL));
+  ASSERT_NE((void*)NULL,tiles=TileBaseOpen(LATTICE_PATH,"tilebase.synthetic"));
+  ASSERT_EQ(24,n=TileBaseCount(tiles));
+  ASSERT_NE((void*)NULL,boxes=TileBaseBoxes(tiles));
+  for(i=0;i<n;++i)
+  { EXPECT_EQ(0,boxes[i].lo[0]%18000); // 100 voxels of 200 nm with 10% overlap
+    EXPECT_EQ(0,boxes[i].lo[1]%18000);
+    EXPECT_EQ(0,boxes[i].lo[2]%9000);
+    EXPECT_EQ(20000,boxes[i].hi[0]-boxes[i].lo[0]);
+    EXPECT_EQ(10000,boxes[i].hi[2]-boxes[i].lo[2]);
+  }
+  TileBaseClose(tiles);
+
+  // The second open reads the cache
+  ASSERT_NE((void*)NULL,tiles=TileBaseOpen(LATTICE_PATH,NULL));
+  EXPECT_EQ(24,TileBaseCount(tiles));
+  TileBaseClose(tiles);
+}
+
+TEST_F(Synthetic,UpdateMovesTile)
+{ tiles_t tiles;
+  int64_t ori[3]={1000,2000,3000},*o;
+  tile_update_t u={"00000-00000-00000",3,ori,NULL};
+  ASSERT_EQ(24,SyntheticLatticeMake(LATTICE_PATH,&lattice,NULL,NULL));
+  ASSERT_NE((void*)NULL,tiles=TileBaseOpen(LATTICE_PATH,"tilebase.synthetic"));
+  EXPECT_EQ(1,TileBaseUpdate(tiles,&u,1));
+  TileBaseClose(tiles);
+
+  ASSERT_NE((void*)NULL,tiles=TileBaseOpen(LATTICE_PATH,NULL));
+  for(size_t i=0;i<TileBaseCount(tiles);++i)
+  { tile_t t=TileBaseArray(tiles)[i];
+    if(strstr(TilePath(t),u.path))
+    { ASSERT_NE((void*)NULL,AABBGet(TileAABB(t),NULL,&o,NULL));
+      EXPECT_EQ(0,memcmp(ori,o,sizeof(ori)));
+    }
+  }
+  TileBaseClose(tiles);
+}
+///@endcond
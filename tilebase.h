@@ -4,4 +4,7 @@
 #include <stdlib.h>
 #include "nd.h"
 #include "src/aabb.h"
+#include "src/octree.h"
+#include "src/sfc.h"
+#include "src/footprint.h"
 #include "src/core.h"
\ No newline at end of file